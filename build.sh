@@ -4,6 +4,17 @@ CC=cc
 FLAGS="-I /opt/homebrew/include -L/opt/homebrew/lib/ -lglfw -lvulkan.1"
 DYLD_LIBRARY_PATH="/opt/homebrew/lib/:/opt/homebrew/opt/vulkan-validationlayers/lib/"
 
+# the .spv files are loaded at runtime, a missing shaders/downsample.spv
+# silently leaves textures on the blit mipmaps
+compile_shaders() {
+  if command -v glslangValidator >/dev/null 2>&1; then
+    echo "Compiling shaders ..."
+    ./compile-shaders.sh || return 1
+  else
+    echo "Warning: glslangValidator not found, shaders/*.spv not rebuilt"
+  fi
+}
+
 build() {
   local filename=$1
   local source_file="src/${filename}.c"
@@ -17,7 +28,7 @@ build() {
 
   # compile source
   echo "Compiling $source_file ..."
-  $CC $FLAGS "$source_file" -o "$output_file"
+  $CC $CFLAGS $FLAGS "$source_file" -o "$output_file"
 
   # check result
   if [ $? -eq 0 ]; then
@@ -30,9 +41,13 @@ build() {
 
 if [ $# -eq 0 ]; then
   echo "Build all..."
+  compile_shaders || exit 1
   build "setup"
   build "tutorial"
 else
+  if [ "${1}" = "tutorial" ]; then
+    compile_shaders || exit 1
+  fi
   build $1
 
   if [ $? -ne 0 ]; then
@@ -42,6 +57,6 @@ else
   if [ "${2}" = "--run" ]; then
     OUT="build/${1}"
     echo "Run $OUT"
-    bash -c "DYLD_LIBRARY_PATH=$DYLD_LIBRARY_PATH $OUT"
+    bash -c "DYLD_LIBRARY_PATH=$DYLD_LIBRARY_PATH $OUT ${*:3}"
   fi
 fi
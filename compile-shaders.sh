@@ -1,4 +1,7 @@
 #! /bin/sh
 
+set -e
+
 glslangValidator -V shaders/shader.vert -o shaders/vert.spv
 glslangValidator -V shaders/shader.frag -o shaders/frag.spv
+glslangValidator -V shaders/downsample.comp -o shaders/downsample.spv
@@ -84,6 +84,9 @@ typedef struct {
 } tinyobj_attrib_t;
 
 #define TINYOBJ_FLAG_TRIANGULATE (1 << 0)
+/* Parse lines on a pool of worker threads. Output is identical to the serial
+ * parser. */
+#define TINYOBJ_FLAG_PARALLEL (1 << 1)
 
 #define TINYOBJ_INVALID_INDEX (0x80000000)
 
@@ -130,6 +133,69 @@ extern int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
                              file_reader_callback file_reader, void *ctx,
                              unsigned int flags);
 
+/* Same as tinyobj_parse_obj, but with an explicit number of worker threads
+ * for TINYOBJ_FLAG_PARALLEL.
+ * @param[in] num_threads Number of threads. 0 = number of online CPUs.
+ */
+extern int tinyobj_parse_obj_mt(tinyobj_attrib_t *attrib,
+                                tinyobj_shape_t **shapes, size_t *num_shapes,
+                                tinyobj_material_t **materials,
+                                size_t *num_materials, const char *file_name,
+                                file_reader_callback file_reader, void *ctx,
+                                unsigned int flags, unsigned int num_threads);
+
+/* Provide a callback that reads the .obj piece by piece for
+ * tinyobj_parse_obj_stream.
+ *
+ * @param[in] ctx User provided context.
+ * @param[out] buf Buffer to fill with the bytes following the ones returned by
+ * the previous call.
+ * @param[in] len Size of `buf`.
+ *
+ * Returns the number of bytes written to `buf`, 0 at the end of the file.
+ */
+typedef size_t (*tinyobj_stream_reader_callback)(void *ctx, char *buf,
+                                                 size_t len);
+
+/* Receives the faces of a streamed .obj as soon as their line is parsed.
+ *
+ * @param[in] ctx User provided context.
+ * @param[in] attrib Vertices, normals and texcoords parsed so far. The arrays
+ * may move between calls.
+ * @param[in] face Zero based indices into `attrib` of the face's vertices.
+ * @param[in] num_verts Number of vertices in `face`.
+ * @param[in] material_id Index into the materials, -1 if there is none.
+ */
+typedef void (*tinyobj_face_callback)(void *ctx, const tinyobj_attrib_t *attrib,
+                                      const tinyobj_vertex_index_t *face,
+                                      int num_verts, int material_id);
+
+/* Parse wavefront .obj through a fixed size window instead of one buffer
+ * holding the whole file. Faces are handed to `face_callback` rather than
+ * stored, so memory use is bounded by the vertex attributes.
+ * @param[out] attrib Vertices, normals and texcoords. `faces`,
+ * `face_num_verts` and `material_ids` stay NULL, `num_faces` and
+ * `num_face_num_verts` count what was passed to `face_callback`.
+ * @param[out] materials Array of parsed materials
+ * @param[out] num_materials Array length of `materials`
+ * @param[in] file_name File name of .obj
+ * @param[in] stream_reader Callback reading the .obj.
+ * @param[in] face_callback Callback receiving the faces.
+ * @param[in] file_reader File reader callback function(to read .mtl).
+ * @param[in] ctx Context pointer passed to all callbacks.
+ * @param[in] flags combination of TINYOBJ_FLAG_***. TINYOBJ_FLAG_PARALLEL is
+ * ignored. Groups and objects are not reported.
+ *
+ * Returns TINYOBJ_SUCCESS if things goes well.
+ * Returns TINYOBJ_ERROR_*** when there is an error.
+ */
+extern int tinyobj_parse_obj_stream(
+    tinyobj_attrib_t *attrib, tinyobj_material_t **materials,
+    size_t *num_materials, const char *file_name,
+    tinyobj_stream_reader_callback stream_reader,
+    tinyobj_face_callback face_callback, file_reader_callback file_reader,
+    void *ctx, unsigned int flags);
+
 /* Parse wavefront .mtl
  *
  * @param[out] materials_out
@@ -163,7 +229,9 @@ extern void tinyobj_materials_free(tinyobj_material_t *materials,
 #ifdef TINYOBJ_LOADER_C_IMPLEMENTATION
 #include <assert.h>
 #include <errno.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #if defined(TINYOBJ_MALLOC) && defined(TINYOBJ_CALLOC) &&                      \
@@ -193,15 +261,129 @@ extern void tinyobj_materials_free(tinyobj_material_t *materials,
 
 #define TINYOBJ_MAX_FACES_PER_F_LINE (16)
 #define TINYOBJ_MAX_FILEPATH (8192)
+#define TINYOBJ_MAX_THREADS (64)
+/* Don't bother spawning threads for chunks smaller than this. */
+#define TINYOBJ_MIN_LINES_PER_THREAD (4096)
+/* parseLine() copies lines into a buffer of this size. */
+#define TINYOBJ_MAX_LINE_LENGTH (4095)
+
+#ifndef TINYOBJ_STREAM_WINDOW_SIZE
+#define TINYOBJ_STREAM_WINDOW_SIZE (1 << 20)
+#endif
+#if TINYOBJ_STREAM_WINDOW_SIZE <= TINYOBJ_MAX_LINE_LENGTH
+#error "TINYOBJ_STREAM_WINDOW_SIZE must hold at least one full line."
+#endif
+
+#if !defined(_WIN32)
+#include <pthread.h>
+#include <unistd.h>
+#define TINYOBJ_HAS_THREADS 1
+#endif
 
 #define IS_SPACE(x) (((x) == ' ') || ((x) == '\t'))
 #define IS_DIGIT(x) ((unsigned int)((x) - '0') < (unsigned int)(10))
 #define IS_NEW_LINE(x) (((x) == '\r') || ((x) == '\n') || ((x) == '\0'))
 
+/* Line endings and token boundaries are searched for 16 (SSE2) or 32 (AVX2)
+ * bytes at a time on x86. AVX2 is picked at runtime from CPUID, everything
+ * else falls back to the byte loops. Define TINYOBJ_NO_SIMD to always use the
+ * byte loops. */
+#if !defined(TINYOBJ_NO_SIMD) &&                                               \
+    (defined(__SSE2__) || defined(_M_X64) ||                                   \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define TINYOBJ_HAS_SSE2 1
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define TINYOBJ_HAS_AVX2 1
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+#endif
+
+/* skip_space() and until_space() read text in aligned 16 byte blocks, so it
+ * must be readable up to the end of the block holding its terminating '\0'.
+ * TINYOBJ_SCAN_PADDING bytes after the '\0' are always enough. */
+#define TINYOBJ_SCAN_PADDING (16)
+
+/* Lines are copied here by copy_line() before they are parsed. */
+typedef union {
+  char c[TINYOBJ_MAX_LINE_LENGTH + 1 + TINYOBJ_SCAN_PADDING];
+#ifdef TINYOBJ_HAS_SSE2
+  __m128i align;
+#endif
+} LineBuffer;
+
+#ifdef TINYOBJ_HAS_SSE2
+static unsigned int first_set_bit(unsigned int mask) {
+#if defined(_MSC_VER) && !defined(__clang__)
+  unsigned long index;
+  _BitScanForward(&index, mask);
+  return (unsigned int)index;
+#else
+  return (unsigned int)__builtin_ctz(mask);
+#endif
+}
+
+/* Bit i is set when byte i of `c` is one of `a` or `b`. */
+static unsigned int match_mask2(__m128i c, char a, char b) {
+  return (unsigned int)_mm_movemask_epi8(
+      _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8(a)),
+                   _mm_cmpeq_epi8(c, _mm_set1_epi8(b))));
+}
+
+static const char *align_down_16(const char *p) {
+  return p - ((size_t)p & 15);
+}
+#endif
+
+/* Copies `len` bytes of line `p` into `linebuf` and terminates them with at
+ * least TINYOBJ_SCAN_PADDING + 1 '\0's. The copy is made of aligned 16 byte
+ * stores, the same blocks the token scans load back, so those loads are
+ * forwarded from the stores instead of waiting for them to retire. */
+static void copy_line(LineBuffer *linebuf, const char *p, size_t len) {
+#ifdef TINYOBJ_HAS_SSE2
+  __m128i *dst = &linebuf->align;
+  char tail[16];
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    _mm_store_si128(dst++, _mm_loadu_si128((const __m128i *)(p + i)));
+  }
+  memset(tail, 0, sizeof(tail));
+  memcpy(tail, p + i, len - i);
+  _mm_store_si128(dst++, _mm_loadu_si128((const __m128i *)tail));
+  _mm_store_si128(dst, _mm_setzero_si128());
+#else
+  memcpy(linebuf->c, p, len);
+  memset(linebuf->c + len, 0, TINYOBJ_SCAN_PADDING + 1);
+#endif
+}
+
 static void skip_space(const char **token) {
+#ifdef TINYOBJ_HAS_SSE2
+  const char *block = align_down_16(*token);
+  __m128i c = _mm_load_si128((const __m128i *)block);
+  unsigned int mask = (match_mask2(c, ' ', '\t') ^ 0xFFFFU) >>
+                      (unsigned int)((*token) - block);
+  if (mask != 0) {
+    (*token) += first_set_bit(mask);
+    return;
+  }
+  for (;;) {
+    block += 16;
+    c = _mm_load_si128((const __m128i *)block);
+    mask = match_mask2(c, ' ', '\t') ^ 0xFFFFU;
+    if (mask != 0) {
+      (*token) = block + first_set_bit(mask);
+      return;
+    }
+  }
+#else
   while ((*token)[0] == ' ' || (*token)[0] == '\t') {
     (*token)++;
   }
+#endif
 }
 
 static void skip_space_and_cr(const char **token) {
@@ -211,12 +393,93 @@ static void skip_space_and_cr(const char **token) {
 }
 
 static int until_space(const char *token) {
+#ifdef TINYOBJ_HAS_SSE2
+  const char *block = align_down_16(token);
+  __m128i c = _mm_load_si128((const __m128i *)block);
+  unsigned int mask =
+      (match_mask2(c, '\0', ' ') | match_mask2(c, '\t', '\r')) >>
+      (unsigned int)(token - block);
+  if (mask != 0) {
+    return (int)first_set_bit(mask);
+  }
+  for (;;) {
+    block += 16;
+    c = _mm_load_si128((const __m128i *)block);
+    mask = match_mask2(c, '\0', ' ') | match_mask2(c, '\t', '\r');
+    if (mask != 0) {
+      return (int)(block - token) + (int)first_set_bit(mask);
+    }
+  }
+#else
   const char *p = token;
   while (p[0] != '\0' && p[0] != ' ' && p[0] != '\t' && p[0] != '\r') {
     p++;
   }
 
   return (int)(p - token);
+#endif
+}
+
+/* Returns the index of the first '\n', '\r' or '\0' in buf[i, end), or `end`
+ * when there is none. */
+typedef size_t (*tinyobj_line_scanner)(const char *buf, size_t i, size_t end);
+
+static size_t find_line_break_scalar(const char *buf, size_t i, size_t end) {
+  while (i < end && !IS_NEW_LINE(buf[i])) {
+    i++;
+  }
+  return i;
+}
+
+#ifdef TINYOBJ_HAS_SSE2
+static size_t find_line_break_sse2(const char *buf, size_t i, size_t end) {
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 16 <= end; i += 16) {
+    __m128i c = _mm_loadu_si128((const __m128i *)(buf + i));
+    unsigned int mask =
+        match_mask2(c, '\n', '\r') |
+        (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(c, zero));
+    if (mask != 0) {
+      return i + first_set_bit(mask);
+    }
+  }
+  return find_line_break_scalar(buf, i, end);
+}
+#endif
+
+#ifdef TINYOBJ_HAS_AVX2
+__attribute__((target("avx2"))) static size_t
+find_line_break_avx2(const char *buf, size_t i, size_t end) {
+  const __m256i lf = _mm256_set1_epi8('\n');
+  const __m256i cr = _mm256_set1_epi8('\r');
+  const __m256i zero = _mm256_setzero_si256();
+  for (; i + 32 <= end; i += 32) {
+    __m256i c = _mm256_loadu_si256((const __m256i *)(buf + i));
+    __m256i hit = _mm256_or_si256(
+        _mm256_or_si256(_mm256_cmpeq_epi8(c, lf), _mm256_cmpeq_epi8(c, cr)),
+        _mm256_cmpeq_epi8(c, zero));
+    unsigned int mask = (unsigned int)_mm256_movemask_epi8(hit);
+    if (mask != 0) {
+      return i + first_set_bit(mask);
+    }
+  }
+  return find_line_break_sse2(buf, i, end);
+}
+#endif
+
+/* Picks the widest line scanner the running CPU supports. */
+static tinyobj_line_scanner select_line_scanner(void) {
+#ifdef TINYOBJ_HAS_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    return find_line_break_avx2;
+  }
+#endif
+#ifdef TINYOBJ_HAS_SSE2
+  return find_line_break_sse2;
+#else
+  return find_line_break_scalar;
+#endif
 }
 
 static size_t length_until_newline(const char *token, size_t n) {
@@ -332,6 +595,274 @@ static int parseInt(const char **token) {
   return i;
 }
 
+/*
+ * Float parsing after Daniel Lemire's "Number Parsing at a Gigabyte per
+ * Second" (fast_float): the decimal digits are gathered into a 64 bit
+ * integer w and a power of ten q, and w * 10^q is rounded to the nearest
+ * float with one 64x128 bit multiply by a truncated power of five
+ * (Eisel-Lemire). Long runs of digits are converted eight or four at a time
+ * with SWAR arithmetic on a plain 64 bit load.
+ */
+
+/* 5^q for q in [TINYOBJ_FLOAT_MIN_POW10, TINYOBJ_FLOAT_MAX_POW10], normalized
+ * so the top bit is set and truncated to 128 bits, high word first. Outside
+ * this range every w rounds to zero or infinity. */
+#define TINYOBJ_FLOAT_MIN_POW10 (-64)
+#define TINYOBJ_FLOAT_MAX_POW10 (38)
+static const uint64_t tinyobj_power_of_five_128[] = {
+    0xa87fea27a539e9a5ULL, 0x3f2398d747b36224ULL, /* 5^-64 */
+    0xd29fe4b18e88640eULL, 0x8eec7f0d19a03aadULL, /* 5^-63 */
+    0x83a3eeeef9153e89ULL, 0x1953cf68300424acULL, /* 5^-62 */
+    0xa48ceaaab75a8e2bULL, 0x5fa8c3423c052dd7ULL, /* 5^-61 */
+    0xcdb02555653131b6ULL, 0x3792f412cb06794dULL, /* 5^-60 */
+    0x808e17555f3ebf11ULL, 0xe2bbd88bbee40bd0ULL, /* 5^-59 */
+    0xa0b19d2ab70e6ed6ULL, 0x5b6aceaeae9d0ec4ULL, /* 5^-58 */
+    0xc8de047564d20a8bULL, 0xf245825a5a445275ULL, /* 5^-57 */
+    0xfb158592be068d2eULL, 0xeed6e2f0f0d56712ULL, /* 5^-56 */
+    0x9ced737bb6c4183dULL, 0x55464dd69685606bULL, /* 5^-55 */
+    0xc428d05aa4751e4cULL, 0xaa97e14c3c26b886ULL, /* 5^-54 */
+    0xf53304714d9265dfULL, 0xd53dd99f4b3066a8ULL, /* 5^-53 */
+    0x993fe2c6d07b7fabULL, 0xe546a8038efe4029ULL, /* 5^-52 */
+    0xbf8fdb78849a5f96ULL, 0xde98520472bdd033ULL, /* 5^-51 */
+    0xef73d256a5c0f77cULL, 0x963e66858f6d4440ULL, /* 5^-50 */
+    0x95a8637627989aadULL, 0xdde7001379a44aa8ULL, /* 5^-49 */
+    0xbb127c53b17ec159ULL, 0x5560c018580d5d52ULL, /* 5^-48 */
+    0xe9d71b689dde71afULL, 0xaab8f01e6e10b4a6ULL, /* 5^-47 */
+    0x9226712162ab070dULL, 0xcab3961304ca70e8ULL, /* 5^-46 */
+    0xb6b00d69bb55c8d1ULL, 0x3d607b97c5fd0d22ULL, /* 5^-45 */
+    0xe45c10c42a2b3b05ULL, 0x8cb89a7db77c506aULL, /* 5^-44 */
+    0x8eb98a7a9a5b04e3ULL, 0x77f3608e92adb242ULL, /* 5^-43 */
+    0xb267ed1940f1c61cULL, 0x55f038b237591ed3ULL, /* 5^-42 */
+    0xdf01e85f912e37a3ULL, 0x6b6c46dec52f6688ULL, /* 5^-41 */
+    0x8b61313bbabce2c6ULL, 0x2323ac4b3b3da015ULL, /* 5^-40 */
+    0xae397d8aa96c1b77ULL, 0xabec975e0a0d081aULL, /* 5^-39 */
+    0xd9c7dced53c72255ULL, 0x96e7bd358c904a21ULL, /* 5^-38 */
+    0x881cea14545c7575ULL, 0x7e50d64177da2e54ULL, /* 5^-37 */
+    0xaa242499697392d2ULL, 0xdde50bd1d5d0b9e9ULL, /* 5^-36 */
+    0xd4ad2dbfc3d07787ULL, 0x955e4ec64b44e864ULL, /* 5^-35 */
+    0x84ec3c97da624ab4ULL, 0xbd5af13bef0b113eULL, /* 5^-34 */
+    0xa6274bbdd0fadd61ULL, 0xecb1ad8aeacdd58eULL, /* 5^-33 */
+    0xcfb11ead453994baULL, 0x67de18eda5814af2ULL, /* 5^-32 */
+    0x81ceb32c4b43fcf4ULL, 0x80eacf948770ced7ULL, /* 5^-31 */
+    0xa2425ff75e14fc31ULL, 0xa1258379a94d028dULL, /* 5^-30 */
+    0xcad2f7f5359a3b3eULL, 0x096ee45813a04330ULL, /* 5^-29 */
+    0xfd87b5f28300ca0dULL, 0x8bca9d6e188853fcULL, /* 5^-28 */
+    0x9e74d1b791e07e48ULL, 0x775ea264cf55347eULL, /* 5^-27 */
+    0xc612062576589ddaULL, 0x95364afe032a819eULL, /* 5^-26 */
+    0xf79687aed3eec551ULL, 0x3a83ddbd83f52205ULL, /* 5^-25 */
+    0x9abe14cd44753b52ULL, 0xc4926a9672793543ULL, /* 5^-24 */
+    0xc16d9a0095928a27ULL, 0x75b7053c0f178294ULL, /* 5^-23 */
+    0xf1c90080baf72cb1ULL, 0x5324c68b12dd6339ULL, /* 5^-22 */
+    0x971da05074da7beeULL, 0xd3f6fc16ebca5e04ULL, /* 5^-21 */
+    0xbce5086492111aeaULL, 0x88f4bb1ca6bcf585ULL, /* 5^-20 */
+    0xec1e4a7db69561a5ULL, 0x2b31e9e3d06c32e6ULL, /* 5^-19 */
+    0x9392ee8e921d5d07ULL, 0x3aff322e62439fd0ULL, /* 5^-18 */
+    0xb877aa3236a4b449ULL, 0x09befeb9fad487c3ULL, /* 5^-17 */
+    0xe69594bec44de15bULL, 0x4c2ebe687989a9b4ULL, /* 5^-16 */
+    0x901d7cf73ab0acd9ULL, 0x0f9d37014bf60a11ULL, /* 5^-15 */
+    0xb424dc35095cd80fULL, 0x538484c19ef38c95ULL, /* 5^-14 */
+    0xe12e13424bb40e13ULL, 0x2865a5f206b06fbaULL, /* 5^-13 */
+    0x8cbccc096f5088cbULL, 0xf93f87b7442e45d4ULL, /* 5^-12 */
+    0xafebff0bcb24aafeULL, 0xf78f69a51539d749ULL, /* 5^-11 */
+    0xdbe6fecebdedd5beULL, 0xb573440e5a884d1cULL, /* 5^-10 */
+    0x89705f4136b4a597ULL, 0x31680a88f8953031ULL, /* 5^-9 */
+    0xabcc77118461cefcULL, 0xfdc20d2b36ba7c3eULL, /* 5^-8 */
+    0xd6bf94d5e57a42bcULL, 0x3d32907604691b4dULL, /* 5^-7 */
+    0x8637bd05af6c69b5ULL, 0xa63f9a49c2c1b110ULL, /* 5^-6 */
+    0xa7c5ac471b478423ULL, 0x0fcf80dc33721d54ULL, /* 5^-5 */
+    0xd1b71758e219652bULL, 0xd3c36113404ea4a9ULL, /* 5^-4 */
+    0x83126e978d4fdf3bULL, 0x645a1cac083126eaULL, /* 5^-3 */
+    0xa3d70a3d70a3d70aULL, 0x3d70a3d70a3d70a4ULL, /* 5^-2 */
+    0xccccccccccccccccULL, 0xcccccccccccccccdULL, /* 5^-1 */
+    0x8000000000000000ULL, 0x0000000000000000ULL, /* 5^0 */
+    0xa000000000000000ULL, 0x0000000000000000ULL, /* 5^1 */
+    0xc800000000000000ULL, 0x0000000000000000ULL, /* 5^2 */
+    0xfa00000000000000ULL, 0x0000000000000000ULL, /* 5^3 */
+    0x9c40000000000000ULL, 0x0000000000000000ULL, /* 5^4 */
+    0xc350000000000000ULL, 0x0000000000000000ULL, /* 5^5 */
+    0xf424000000000000ULL, 0x0000000000000000ULL, /* 5^6 */
+    0x9896800000000000ULL, 0x0000000000000000ULL, /* 5^7 */
+    0xbebc200000000000ULL, 0x0000000000000000ULL, /* 5^8 */
+    0xee6b280000000000ULL, 0x0000000000000000ULL, /* 5^9 */
+    0x9502f90000000000ULL, 0x0000000000000000ULL, /* 5^10 */
+    0xba43b74000000000ULL, 0x0000000000000000ULL, /* 5^11 */
+    0xe8d4a51000000000ULL, 0x0000000000000000ULL, /* 5^12 */
+    0x9184e72a00000000ULL, 0x0000000000000000ULL, /* 5^13 */
+    0xb5e620f480000000ULL, 0x0000000000000000ULL, /* 5^14 */
+    0xe35fa931a0000000ULL, 0x0000000000000000ULL, /* 5^15 */
+    0x8e1bc9bf04000000ULL, 0x0000000000000000ULL, /* 5^16 */
+    0xb1a2bc2ec5000000ULL, 0x0000000000000000ULL, /* 5^17 */
+    0xde0b6b3a76400000ULL, 0x0000000000000000ULL, /* 5^18 */
+    0x8ac7230489e80000ULL, 0x0000000000000000ULL, /* 5^19 */
+    0xad78ebc5ac620000ULL, 0x0000000000000000ULL, /* 5^20 */
+    0xd8d726b7177a8000ULL, 0x0000000000000000ULL, /* 5^21 */
+    0x878678326eac9000ULL, 0x0000000000000000ULL, /* 5^22 */
+    0xa968163f0a57b400ULL, 0x0000000000000000ULL, /* 5^23 */
+    0xd3c21bcecceda100ULL, 0x0000000000000000ULL, /* 5^24 */
+    0x84595161401484a0ULL, 0x0000000000000000ULL, /* 5^25 */
+    0xa56fa5b99019a5c8ULL, 0x0000000000000000ULL, /* 5^26 */
+    0xcecb8f27f4200f3aULL, 0x0000000000000000ULL, /* 5^27 */
+    0x813f3978f8940984ULL, 0x4000000000000000ULL, /* 5^28 */
+    0xa18f07d736b90be5ULL, 0x5000000000000000ULL, /* 5^29 */
+    0xc9f2c9cd04674edeULL, 0xa400000000000000ULL, /* 5^30 */
+    0xfc6f7c4045812296ULL, 0x4d00000000000000ULL, /* 5^31 */
+    0x9dc5ada82b70b59dULL, 0xf020000000000000ULL, /* 5^32 */
+    0xc5371912364ce305ULL, 0x6c28000000000000ULL, /* 5^33 */
+    0xf684df56c3e01bc6ULL, 0xc732000000000000ULL, /* 5^34 */
+    0x9a130b963a6c115cULL, 0x3c7f400000000000ULL, /* 5^35 */
+    0xc097ce7bc90715b3ULL, 0x4b9f100000000000ULL, /* 5^36 */
+    0xf0bdc21abb48db20ULL, 0x1e86d40000000000ULL, /* 5^37 */
+    0x96769950b50d88f4ULL, 0x1314448000000000ULL, /* 5^38 */
+};
+
+/* 10^q for q in [0, 10], all exact in a float. */
+static const float tinyobj_float_pow10[] = {1e0f, 1e1f, 1e2f, 1e3f,
+                                            1e4f, 1e5f, 1e6f, 1e7f,
+                                            1e8f, 1e9f, 1e10f};
+
+static uint64_t load_u64_le(const char *p) {
+  uint64_t v;
+  memcpy(&v, p, sizeof(uint64_t));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap64(v);
+#endif
+  return v;
+}
+
+static uint32_t load_u32_le(const char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(uint32_t));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  v = __builtin_bswap32(v);
+#endif
+  return v;
+}
+
+static int is_eight_digits(uint64_t v) {
+  return !(((v + 0x4646464646464646ULL) | (v - 0x3030303030303030ULL)) &
+           0x8080808080808080ULL);
+}
+
+static int is_four_digits(uint32_t v) {
+  return !(((v + 0x46464646U) | (v - 0x30303030U)) & 0x80808080U);
+}
+
+/* "12345678" -> 12345678: pairs of digits, then pairs of pairs, then the
+ * two halves are combined by multiplying with constants. */
+static uint32_t parse_eight_digits(uint64_t v) {
+  const uint64_t mask = 0x000000FF000000FFULL;
+  const uint64_t mul1 = 0x000F424000000064ULL; /* 100 + (1000000 << 32) */
+  const uint64_t mul2 = 0x0000271000000001ULL; /* 1 + (10000 << 32) */
+  v -= 0x3030303030303030ULL;
+  v = (v * 10) + (v >> 8);
+  v = (((v & mask) * mul1) + (((v >> 16) & mask) * mul2)) >> 32;
+  return (uint32_t)v;
+}
+
+static uint32_t parse_four_digits(uint32_t v) {
+  v -= 0x30303030U;
+  v = (v * 10) + (v >> 8);
+  return ((v & 0xFF) * 100) + ((v >> 16) & 0xFF);
+}
+
+/* High and low 64 bits of a * b. */
+static void multiply_u64(uint64_t a, uint64_t b, uint64_t *hi, uint64_t *lo) {
+#if defined(__SIZEOF_INT128__)
+  unsigned __int128 r = (unsigned __int128)a * b;
+  *hi = (uint64_t)(r >> 64);
+  *lo = (uint64_t)r;
+#else
+  uint64_t a_lo = a & 0xFFFFFFFFU, a_hi = a >> 32;
+  uint64_t b_lo = b & 0xFFFFFFFFU, b_hi = b >> 32;
+  uint64_t p0 = a_lo * b_lo, p1 = a_lo * b_hi;
+  uint64_t p2 = a_hi * b_lo, p3 = a_hi * b_hi;
+  uint64_t mid = (p0 >> 32) + (p1 & 0xFFFFFFFFU) + (p2 & 0xFFFFFFFFU);
+  *lo = (mid << 32) | (p0 & 0xFFFFFFFFU);
+  *hi = p3 + (p1 >> 32) + (p2 >> 32) + (mid >> 32);
+#endif
+}
+
+static int leading_zeros_u64(uint64_t v) {
+#if defined(__GNUC__)
+  return __builtin_clzll(v);
+#else
+  int n = 0;
+  while (!(v & 0x8000000000000000ULL)) {
+    v <<= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+/* Bits of the float nearest to w * 10^q, w > 0, without the sign. */
+static uint32_t eisel_lemire_float(int q, uint64_t w) {
+  const int mantissa_bits = 23;
+  const int shift_base = 64 - mantissa_bits - 3;
+  uint64_t hi, lo, second_hi, second_lo, mantissa;
+  int index, lz, upper_bit, shift, power2;
+
+  if (q < TINYOBJ_FLOAT_MIN_POW10) {
+    return 0;
+  }
+  if (q > TINYOBJ_FLOAT_MAX_POW10) {
+    return 0x7F800000U;
+  }
+
+  lz = leading_zeros_u64(w);
+  w <<= lz;
+
+  /* Only the high word of the power when it already settles the rounding. */
+  index = 2 * (q - TINYOBJ_FLOAT_MIN_POW10);
+  multiply_u64(w, tinyobj_power_of_five_128[index], &hi, &lo);
+  if ((hi & (0xFFFFFFFFFFFFFFFFULL >> (mantissa_bits + 3))) ==
+      (0xFFFFFFFFFFFFFFFFULL >> (mantissa_bits + 3))) {
+    multiply_u64(w, tinyobj_power_of_five_128[index + 1], &second_hi,
+                 &second_lo);
+    lo += second_hi;
+    if (second_hi > lo) {
+      hi++;
+    }
+  }
+
+  upper_bit = (int)(hi >> 63);
+  shift = upper_bit + shift_base;
+  mantissa = hi >> shift;
+  /* floor(q * log2(10)) + 63, plus the float exponent bias */
+  power2 = (((152170 + 65536) * q) >> 16) + 63 + upper_bit - lz + 127;
+
+  if (power2 <= 0) {
+    /* subnormal */
+    if (-power2 + 1 >= 64) {
+      return 0;
+    }
+    mantissa >>= -power2 + 1;
+    mantissa += (mantissa & 1);
+    mantissa >>= 1;
+    power2 = mantissa < (1ULL << mantissa_bits) ? 0 : 1;
+    return (uint32_t)(power2 << mantissa_bits) |
+           (uint32_t)(mantissa & ((1ULL << mantissa_bits) - 1));
+  }
+
+  /* Exactly halfway between two floats: round to even. Only possible for
+   * small q, where w * 10^q is computed exactly. */
+  if (lo <= 1 && q >= -17 && q <= 10 && (mantissa & 3) == 1 &&
+      (mantissa << shift) == hi) {
+    mantissa &= ~1ULL;
+  }
+  mantissa += (mantissa & 1);
+  mantissa >>= 1;
+  if (mantissa >= (2ULL << mantissa_bits)) {
+    mantissa = 1ULL << mantissa_bits;
+    power2++;
+  }
+  if (power2 >= 0xFF) {
+    return 0x7F800000U;
+  }
+  return (uint32_t)(power2 << mantissa_bits) |
+         (uint32_t)(mantissa & ((1ULL << mantissa_bits) - 1));
+}
+
 /*
  * Tries to parse a floating point number located at s.
  *
@@ -349,8 +880,8 @@ static int parseInt(const char **token) {
  *  Valid strings are for example:
  *   -0  +3.1417e+2  -0.0E-3  1.0324  -1.41   11e2
  *
- * If the parsing is a success, result is set to the parsed value and true
- * is returned.
+ * If the parsing is a success, result is set to the parsed value rounded to
+ * the nearest float and true is returned.
  *
  * The function is greedy and will parse until any of the following happens:
  *  - a non-conforming character is encountered.
@@ -360,155 +891,135 @@ static int parseInt(const char **token) {
  *  - s >= s_end.
  *  - parse failure.
  */
-static int tryParseDouble(const char *s, const char *s_end, double *result) {
-  double mantissa = 0.0;
-  /* This exponent is base 2 rather than 10.
-   * However the exponent we parse is supposed to be one of ten,
-   * thus we must take care to convert the exponent/and or the
-   * mantissa to a * 2^E, where a is the mantissa and E is the
-   * exponent.
-   * To get the final double we will use ldexp, it requires the
-   * exponent to be in base 2.
-   */
+static int tryParseFloat(const char *s, const char *s_end, float *result) {
+  const char *curr = s;
+  int negative = 0;
+  uint64_t w = 0;
+  int num_digits = 0; /* significant digits in w */
+  int truncated = 0;  /* nonzero digits beyond the 19 that fit in w */
   int exponent = 0;
-
-  /* NOTE: THESE MUST BE DECLARED HERE SINCE WE ARE NOT ALLOWED
-   * TO JUMP OVER DEFINITIONS.
-   */
-  char sign = '+';
-  char exp_sign = '+';
-  char const *curr = s;
-
-  /* How many characters were read in a loop. */
   int read = 0;
-  /* Tells whether a loop terminated due to reaching s_end. */
-  int end_not_reached = 0;
-
-  /*
-     BEGIN PARSING.
-     */
+  uint32_t bits;
 
   if (s >= s_end) {
-    return 0; /* fail */
+    return 0;
   }
 
-  /* Find out what sign we've got. */
   if (*curr == '+' || *curr == '-') {
-    sign = *curr;
+    negative = *curr == '-';
     curr++;
-  } else if (IS_DIGIT(*curr)) { /* Pass through. */
-  } else {
-    goto fail;
   }
 
   /* Read the integer part. */
-  end_not_reached = (curr != s_end);
-  while (end_not_reached && IS_DIGIT(*curr)) {
-    mantissa *= 10;
-    mantissa += (int)(*curr - 0x30);
+  while (curr != s_end && IS_DIGIT(*curr)) {
+    if (num_digits < 19) {
+      w = w * 10 + (uint64_t)(*curr - '0');
+      num_digits += w != 0;
+    } else {
+      truncated |= *curr != '0';
+      exponent++;
+    }
     curr++;
     read++;
-    end_not_reached = (curr != s_end);
   }
 
-  /* We must make sure we actually got something. */
-  if (read == 0)
-    goto fail;
-  /* We allow numbers of form "#", "###" etc. */
-  if (!end_not_reached)
-    goto assemble;
-
-  /* Read the decimal part. */
-  if (*curr == '.') {
+  /* Read the decimal part, eight and then four digits at a time while they
+   * fit into w. Leading zeros in a block count as digits, which only makes
+   * the 19 digit limit kick in early. */
+  if (curr != s_end && *curr == '.') {
     curr++;
-    read = 1;
-    end_not_reached = (curr != s_end);
-    while (end_not_reached && IS_DIGIT(*curr)) {
-      /* pow(10.0, -read) */
-      double frac_value = 1.0;
-      int f;
-      for (f = 0; f < read; f++) {
-        frac_value *= 0.1;
+    while (num_digits <= 19 - 8 && s_end - curr >= 8 &&
+           is_eight_digits(load_u64_le(curr))) {
+      w = w * 100000000 + parse_eight_digits(load_u64_le(curr));
+      num_digits = w != 0 ? num_digits + 8 : 0;
+      exponent -= 8;
+      curr += 8;
+      read += 8;
+    }
+    if (num_digits <= 19 - 4 && s_end - curr >= 4 &&
+        is_four_digits(load_u32_le(curr))) {
+      w = w * 10000 + parse_four_digits(load_u32_le(curr));
+      num_digits = w != 0 ? num_digits + 4 : 0;
+      exponent -= 4;
+      curr += 4;
+      read += 4;
+    }
+    while (curr != s_end && IS_DIGIT(*curr)) {
+      if (num_digits < 19) {
+        w = w * 10 + (uint64_t)(*curr - '0');
+        num_digits += w != 0;
+        exponent--;
+      } else {
+        truncated |= *curr != '0';
       }
-      mantissa += (int)(*curr - 0x30) * frac_value;
-      read++;
       curr++;
-      end_not_reached = (curr != s_end);
+      read++;
     }
-  } else if (*curr == 'e' || *curr == 'E') {
-  } else {
-    goto assemble;
   }
 
-  if (!end_not_reached)
-    goto assemble;
+  /* We must make sure we actually got something. */
+  if (read == 0) {
+    return 0;
+  }
 
   /* Read the exponent part. */
-  if (*curr == 'e' || *curr == 'E') {
+  if (curr != s_end && (*curr == 'e' || *curr == 'E')) {
+    int exp_negative = 0;
+    int exp_value = 0;
     curr++;
-    /* Figure out if a sign is present and if it is. */
-    end_not_reached = (curr != s_end);
-    if (end_not_reached && (*curr == '+' || *curr == '-')) {
-      exp_sign = *curr;
+    if (curr != s_end && (*curr == '+' || *curr == '-')) {
+      exp_negative = *curr == '-';
       curr++;
-    } else if (IS_DIGIT(*curr)) { /* Pass through. */
-    } else {
+    }
+    if (curr == s_end || !IS_DIGIT(*curr)) {
       /* Empty E is not allowed. */
-      goto fail;
+      return 0;
     }
-
-    read = 0;
-    end_not_reached = (curr != s_end);
-    while (end_not_reached && IS_DIGIT(*curr)) {
-      exponent *= 10;
-      exponent += (int)(*curr - 0x30);
+    while (curr != s_end && IS_DIGIT(*curr)) {
+      if (exp_value < 0x10000) {
+        exp_value = exp_value * 10 + (*curr - '0');
+      }
       curr++;
-      read++;
-      end_not_reached = (curr != s_end);
     }
-    if (read == 0)
-      goto fail;
-  }
-
-assemble:
-
-{
-  double a = 1.0; /* = pow(5.0, exponent); */
-  double b = 1.0; /* = 2.0^exponent */
-  int i;
-  for (i = 0; i < exponent; i++) {
-    a = a * 5.0;
-  }
-
-  for (i = 0; i < exponent; i++) {
-    b = b * 2.0;
-  }
-
-  if (exp_sign == '-') {
-    a = 1.0 / a;
-    b = 1.0 / b;
+    exponent += exp_negative ? -exp_value : exp_value;
+  }
+
+  if (w == 0) {
+    bits = 0;
+  } else if (!truncated && w <= (1ULL << 24) && exponent >= -10 &&
+             exponent <= 10) {
+    /* w and 10^|q| are exact floats, so one correctly rounded operation
+     * gives the answer. */
+    float value = exponent < 0 ? (float)w / tinyobj_float_pow10[-exponent]
+                               : (float)w * tinyobj_float_pow10[exponent];
+    memcpy(&bits, &value, sizeof(float));
+  } else {
+    bits = eisel_lemire_float(exponent, w);
+    /* The digits cut off put the value somewhere between w and w + 1; when
+     * those round differently let the C library decide. */
+    if (truncated && bits != eisel_lemire_float(exponent, w + 1)) {
+      char buf[TINYOBJ_MAX_LINE_LENGTH + 1];
+      size_t len = (size_t)(curr - s);
+      float value;
+      memcpy(buf, s, len);
+      buf[len] = '\0';
+      value = strtof(buf, NULL);
+      memcpy(&bits, &value, sizeof(float));
+      bits &= 0x7FFFFFFFU;
+    }
   }
 
-  *result =
-      /* (sign == '+' ? 1 : -1) * ldexp(mantissa * pow(5.0, exponent),
-         exponent); */
-      (sign == '+' ? 1 : -1) * (mantissa * a * b);
-}
-
+  bits |= negative ? 0x80000000U : 0;
+  memcpy(result, &bits, sizeof(float));
   return 1;
-fail:
-  return 0;
 }
 
 static float parseFloat(const char **token) {
   const char *end;
-  double val = 0.0;
   float f = 0.0f;
   skip_space(token);
   end = (*token) + until_space((*token));
-  val = 0.0;
-  tryParseDouble((*token), end, &val);
-  f = (float)(val);
+  tryParseFloat((*token), end, &f);
   (*token) = end;
   return f;
 }
@@ -810,49 +1321,59 @@ typedef struct {
   size_t len;
 } LineInfo;
 
-/* Find '\n' and create line data. */
+/* Find line endings and create line data in a single pass. */
 static int get_line_infos(const char *buf, size_t buf_len,
                           LineInfo **line_infos, size_t *num_lines) {
+  tinyobj_line_scanner find_line_break = select_line_scanner();
   size_t i = 0;
   size_t end_idx = buf_len;
   size_t prev_pos = 0;
   size_t line_no = 0;
-  size_t last_line_ending = 0;
+  /* Grown as needed, one more than the lines found so far is always free for
+   * a last line without line ending. */
+  size_t capacity = buf_len / 32 + 16;
+  LineInfo *infos = (LineInfo *)TINYOBJ_MALLOC(sizeof(LineInfo) * capacity);
 
-  /* Count # of lines. */
-  for (i = 0; i < end_idx; i++) {
-    if (is_line_ending(buf, i, end_idx)) {
-      (*num_lines)++;
-      last_line_ending = i;
+  if (infos == NULL)
+    return TINYOBJ_ERROR_EMPTY;
+
+  for (i = find_line_break(buf, 0, end_idx); i < end_idx;
+       i = find_line_break(buf, i + 1, end_idx)) {
+    if (!is_line_ending(buf, i, end_idx)) {
+      continue; /* '\r' of "\r\n", or the very last byte */
     }
+    if (line_no + 1 == capacity) {
+      LineInfo *grown = (LineInfo *)TINYOBJ_REALLOC_SIZED(
+          infos, sizeof(LineInfo) * capacity, sizeof(LineInfo) * capacity * 2);
+      if (grown == NULL) {
+        TINYOBJ_FREE(infos);
+        return TINYOBJ_ERROR_EMPTY;
+      }
+      infos = grown;
+      capacity *= 2;
+    }
+    infos[line_no].pos = prev_pos;
+    infos[line_no].len = i - prev_pos;
+    prev_pos = i + 1;
+    line_no++;
   }
   /* The last char from the input may not be a line
    * ending character so add an extra line if there
    * are more characters after the last line ending
    * that was found. */
-  if (end_idx - last_line_ending > 1) {
-    (*num_lines)++;
+  if (prev_pos < end_idx) {
+    infos[line_no].pos = prev_pos;
+    infos[line_no].len = end_idx - prev_pos;
+    line_no++;
   }
 
-  if (*num_lines == 0)
+  if (line_no == 0) {
+    TINYOBJ_FREE(infos);
     return TINYOBJ_ERROR_EMPTY;
-
-  *line_infos = (LineInfo *)TINYOBJ_MALLOC(sizeof(LineInfo) * (*num_lines));
-
-  /* Fill line infos. */
-  for (i = 0; i < end_idx; i++) {
-    if (is_line_ending(buf, i, end_idx)) {
-      (*line_infos)[line_no].pos = prev_pos;
-      (*line_infos)[line_no].len = i - prev_pos;
-      prev_pos = i + 1;
-      line_no++;
-    }
-  }
-  if (end_idx - last_line_ending > 1) {
-    (*line_infos)[line_no].pos = prev_pos;
-    (*line_infos)[line_no].len = end_idx - 1 - last_line_ending;
   }
 
+  *line_infos = infos;
+  *num_lines = line_no;
   return 0;
 }
 
@@ -883,10 +1404,11 @@ static int tinyobj_parse_and_index_mtl_file(
   (*num_materials_out) = 0;
 
   file_reader(ctx, mtl_filename, 1, obj_filename, &buf, &len);
-  if (len < 1)
-    return TINYOBJ_ERROR_INVALID_PARAMETER;
   if (buf == NULL)
     return TINYOBJ_ERROR_INVALID_PARAMETER;
+  /* An empty file holds no materials. */
+  if (len < 1)
+    return TINYOBJ_SUCCESS;
 
   if (get_line_infos(buf, len, &line_infos, &num_lines) != 0) {
     TINYOBJ_FREE(line_infos);
@@ -900,14 +1422,13 @@ static int tinyobj_parse_and_index_mtl_file(
     const char *p = &buf[line_infos[i].pos];
     size_t p_len = line_infos[i].len;
 
-    char linebuf[4096];
+    LineBuffer linebuf;
     const char *token;
     assert(p_len < 4095);
 
-    memcpy(linebuf, p, p_len);
-    linebuf[p_len] = '\0';
+    copy_line(&linebuf, p, p_len);
 
-    token = linebuf;
+    token = linebuf.c;
     line_end = token + p_len;
 
     /* Skip leading space. */
@@ -1169,14 +1690,13 @@ typedef struct {
 
 static int parseLine(Command *command, const char *p, size_t p_len,
                      int triangulate) {
-  char linebuf[4096];
+  LineBuffer linebuf;
   const char *token;
-  assert(p_len < 4095);
+  assert(p_len < TINYOBJ_MAX_LINE_LENGTH);
 
-  memcpy(linebuf, p, p_len);
-  linebuf[p_len] = '\0';
+  copy_line(&linebuf, p, p_len);
 
-  token = linebuf;
+  token = linebuf.c;
 
   command->type = COMMAND_EMPTY;
 
@@ -1288,9 +1808,9 @@ static int parseLine(Command *command, const char *p, size_t p_len,
     token += 7;
 
     skip_space(&token);
-    command->material_name = p + (token - linebuf);
+    command->material_name = p + (token - linebuf.c);
     command->material_name_len = (unsigned int)length_until_newline(
-        token, (p_len - (size_t)(token - linebuf)) + 1);
+        token, (p_len - (size_t)(token - linebuf.c)) + 1);
     command->type = COMMAND_USEMTL;
 
     return 1;
@@ -1302,9 +1822,9 @@ static int parseLine(Command *command, const char *p, size_t p_len,
     token += 7;
 
     skip_space(&token);
-    command->mtllib_name = p + (token - linebuf);
+    command->mtllib_name = p + (token - linebuf.c);
     command->mtllib_name_len = (unsigned int)length_until_newline(
-                                   token, p_len - (size_t)(token - linebuf)) +
+                                   token, p_len - (size_t)(token - linebuf.c)) +
                                1;
     command->type = COMMAND_MTLLIB;
 
@@ -1316,9 +1836,9 @@ static int parseLine(Command *command, const char *p, size_t p_len,
     /* @todo { multiple group name. } */
     token += 2;
 
-    command->group_name = p + (token - linebuf);
+    command->group_name = p + (token - linebuf.c);
     command->group_name_len = (unsigned int)length_until_newline(
-                                  token, p_len - (size_t)(token - linebuf)) +
+                                  token, p_len - (size_t)(token - linebuf.c)) +
                               1;
     command->type = COMMAND_G;
 
@@ -1330,9 +1850,9 @@ static int parseLine(Command *command, const char *p, size_t p_len,
     /* @todo { multiple object name? } */
     token += 2;
 
-    command->object_name = p + (token - linebuf);
+    command->object_name = p + (token - linebuf.c);
     command->object_name_len = (unsigned int)length_until_newline(
-                                   token, p_len - (size_t)(token - linebuf)) +
+                                   token, p_len - (size_t)(token - linebuf.c)) +
                                1;
     command->type = COMMAND_O;
 
@@ -1402,11 +1922,238 @@ static char *generate_mtl_filename(const char *obj_filename,
   return mtl_filename;
 }
 
+typedef struct {
+  /* shared input */
+  Command *commands;
+  const LineInfo *line_infos;
+  const char *buf;
+  int triangulate;
+  tinyobj_attrib_t *attrib;
+  hash_table_t *material_table;
+
+  /* line range [begin, end) */
+  size_t begin;
+  size_t end;
+
+  /* counts within the chunk */
+  size_t num_v;
+  size_t num_vn;
+  size_t num_vt;
+  size_t num_f;
+  size_t num_faces;
+  int mtllib_line_index;
+  int usemtl_line_index;
+
+  /* global offsets of the chunk */
+  size_t v_offset;
+  size_t vn_offset;
+  size_t vt_offset;
+  size_t f_offset;
+  size_t face_offset;
+  int material_id;
+} ParseChunk;
+
+static void *parse_chunk_lines(void *arg) {
+  ParseChunk *chunk = (ParseChunk *)arg;
+  Command *commands = chunk->commands;
+  size_t i = 0;
+
+  for (i = chunk->begin; i < chunk->end; i++) {
+    int ret = parseLine(&commands[i], &chunk->buf[chunk->line_infos[i].pos],
+                        chunk->line_infos[i].len, chunk->triangulate);
+    if (ret) {
+      if (commands[i].type == COMMAND_V) {
+        chunk->num_v++;
+      } else if (commands[i].type == COMMAND_VN) {
+        chunk->num_vn++;
+      } else if (commands[i].type == COMMAND_VT) {
+        chunk->num_vt++;
+      } else if (commands[i].type == COMMAND_F) {
+        chunk->num_f += commands[i].num_f;
+        chunk->num_faces += commands[i].num_f_num_verts;
+      }
+
+      if (commands[i].type == COMMAND_MTLLIB) {
+        chunk->mtllib_line_index = (int)i;
+      }
+      if (commands[i].type == COMMAND_USEMTL && commands[i].material_name &&
+          commands[i].material_name_len > 0) {
+        chunk->usemtl_line_index = (int)i;
+      }
+    }
+  }
+
+  return NULL;
+}
+
+/* Parse the .mtl named by an `mtllib` command, relative to the .obj. */
+static void load_mtllib(const Command *command, const char *obj_filename,
+                        file_reader_callback file_reader, void *ctx,
+                        tinyobj_material_t **materials, size_t *num_materials,
+                        hash_table_t *material_table) {
+  /* Maximum length allowed by Linux - higher than Windows and macOS */
+  size_t obj_filename_len = my_strnlen(obj_filename, 4096 + 255) + 1;
+  char *mtl_filename;
+  char *mtllib_name;
+  size_t mtllib_name_len = 0;
+  int ret;
+
+  if (!command->mtllib_name || command->mtllib_name_len == 0) {
+    return;
+  }
+
+  mtllib_name_len =
+      length_until_line_feed(command->mtllib_name, command->mtllib_name_len);
+
+  mtllib_name = my_strndup(command->mtllib_name, mtllib_name_len);
+
+  /* allow for NUL terminator */
+  mtllib_name_len++;
+  mtl_filename = generate_mtl_filename(obj_filename, obj_filename_len,
+                                       mtllib_name, mtllib_name_len);
+
+  ret = tinyobj_parse_and_index_mtl_file(materials, num_materials,
+                                         mtl_filename, obj_filename,
+                                         file_reader, ctx, material_table);
+
+  if (ret != TINYOBJ_SUCCESS) {
+    /* warning. */
+    fprintf(stderr, "TINYOBJ: Failed to parse material file '%s': %d\n",
+            mtl_filename, ret);
+  }
+  TINYOBJ_FREE(mtl_filename);
+  TINYOBJ_FREE(mtllib_name);
+}
+
+static int lookup_material_id(const Command *command,
+                              hash_table_t *material_table) {
+  int material_id;
+  /* Create a null terminated string */
+  char *material_name_null_term =
+      (char *)TINYOBJ_MALLOC(command->material_name_len + 1);
+  memcpy((void *)material_name_null_term, (const void *)command->material_name,
+         command->material_name_len);
+  material_name_null_term[command->material_name_len] = 0;
+
+  if (hash_table_exists(material_name_null_term, material_table))
+    material_id = (int)hash_table_get(material_name_null_term, material_table);
+  else
+    material_id = -1;
+
+  TINYOBJ_FREE(material_name_null_term);
+  return material_id;
+}
+
+static void *construct_chunk_attrib(void *arg) {
+  ParseChunk *chunk = (ParseChunk *)arg;
+  const Command *commands = chunk->commands;
+  tinyobj_attrib_t *attrib = chunk->attrib;
+  size_t v_count = chunk->v_offset;
+  size_t n_count = chunk->vn_offset;
+  size_t t_count = chunk->vt_offset;
+  size_t f_count = chunk->f_offset;
+  size_t face_count = chunk->face_offset;
+  int material_id = chunk->material_id;
+  size_t i = 0;
+
+  for (i = chunk->begin; i < chunk->end; i++) {
+    if (commands[i].type == COMMAND_EMPTY) {
+      continue;
+    } else if (commands[i].type == COMMAND_USEMTL) {
+      if (commands[i].material_name && commands[i].material_name_len > 0) {
+        /* The material table is read-only once the .mtl has been loaded. */
+        material_id = lookup_material_id(&commands[i], chunk->material_table);
+      }
+    } else if (commands[i].type == COMMAND_V) {
+      attrib->vertices[3 * v_count + 0] = commands[i].vx;
+      attrib->vertices[3 * v_count + 1] = commands[i].vy;
+      attrib->vertices[3 * v_count + 2] = commands[i].vz;
+      v_count++;
+    } else if (commands[i].type == COMMAND_VN) {
+      attrib->normals[3 * n_count + 0] = commands[i].nx;
+      attrib->normals[3 * n_count + 1] = commands[i].ny;
+      attrib->normals[3 * n_count + 2] = commands[i].nz;
+      n_count++;
+    } else if (commands[i].type == COMMAND_VT) {
+      attrib->texcoords[2 * t_count + 0] = commands[i].tx;
+      attrib->texcoords[2 * t_count + 1] = commands[i].ty;
+      t_count++;
+    } else if (commands[i].type == COMMAND_F) {
+      size_t k = 0;
+      for (k = 0; k < commands[i].num_f; k++) {
+        tinyobj_vertex_index_t vi = commands[i].f[k];
+        int v_idx = fixIndex(vi.v_idx, v_count);
+        int vn_idx = fixIndex(vi.vn_idx, n_count);
+        int vt_idx = fixIndex(vi.vt_idx, t_count);
+        attrib->faces[f_count + k].v_idx = v_idx;
+        attrib->faces[f_count + k].vn_idx = vn_idx;
+        attrib->faces[f_count + k].vt_idx = vt_idx;
+      }
+
+      for (k = 0; k < commands[i].num_f_num_verts; k++) {
+        attrib->material_ids[face_count + k] = material_id;
+        attrib->face_num_verts[face_count + k] = commands[i].f_num_verts[k];
+      }
+
+      f_count += commands[i].num_f;
+      face_count += commands[i].num_f_num_verts;
+    }
+  }
+
+  return NULL;
+}
+
+/* Run `fn` over every chunk. Chunk 0 runs on the calling thread. */
+static void run_parse_chunks(void *(*fn)(void *), ParseChunk *chunks,
+                             size_t num_chunks) {
+  size_t c = 0;
+#ifdef TINYOBJ_HAS_THREADS
+  pthread_t threads[TINYOBJ_MAX_THREADS];
+  int started[TINYOBJ_MAX_THREADS];
+
+  for (c = 1; c < num_chunks; c++) {
+    started[c] = pthread_create(&threads[c], NULL, fn, &chunks[c]) == 0;
+    if (!started[c]) {
+      fn(&chunks[c]);
+    }
+  }
+  fn(&chunks[0]);
+  for (c = 1; c < num_chunks; c++) {
+    if (started[c]) {
+      pthread_join(threads[c], NULL);
+    }
+  }
+#else
+  for (c = 0; c < num_chunks; c++) {
+    fn(&chunks[c]);
+  }
+#endif
+}
+
+static unsigned int default_num_threads(void) {
+#ifdef TINYOBJ_HAS_THREADS
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  return n > 0 ? (unsigned int)n : 1;
+#else
+  return 1;
+#endif
+}
+
 int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
                       size_t *num_shapes, tinyobj_material_t **materials_out,
                       size_t *num_materials_out, const char *obj_filename,
                       file_reader_callback file_reader, void *ctx,
                       unsigned int flags) {
+  return tinyobj_parse_obj_mt(attrib, shapes, num_shapes, materials_out,
+                              num_materials_out, obj_filename, file_reader, ctx,
+                              flags, 0);
+}
+
+int tinyobj_parse_obj_mt(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
+                         size_t *num_shapes, tinyobj_material_t **materials_out,
+                         size_t *num_materials_out, const char *obj_filename,
+                         file_reader_callback file_reader, void *ctx,
+                         unsigned int flags, unsigned int num_threads) {
   LineInfo *line_infos = NULL;
   Command *commands = NULL;
   size_t num_lines = 0;
@@ -1424,6 +2171,8 @@ int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
 
   hash_table_t material_table;
 
+  ParseChunk chunks[TINYOBJ_MAX_THREADS];
+
   char *buf = NULL;
   size_t len = 0;
   file_reader(ctx, obj_filename, /* is_mtl */ 0, obj_filename, &buf, &len);
@@ -1445,6 +2194,15 @@ int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
 
   tinyobj_attrib_init(attrib);
 
+  if (!(flags & TINYOBJ_FLAG_PARALLEL)) {
+    num_threads = 1;
+  } else if (num_threads == 0) {
+    num_threads = default_num_threads();
+  }
+  if (num_threads > TINYOBJ_MAX_THREADS) {
+    num_threads = TINYOBJ_MAX_THREADS;
+  }
+
   /* 1. create line data */
   if (get_line_infos(buf, len, &line_infos, &num_lines) != 0) {
     return TINYOBJ_ERROR_EMPTY;
@@ -1455,26 +2213,54 @@ int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
   create_hash_table(HASH_TABLE_DEFAULT_SIZE, &material_table);
 
   /* 2. parse each line */
+  if (num_threads > num_lines / TINYOBJ_MIN_LINES_PER_THREAD) {
+    num_threads = (unsigned int)(num_lines / TINYOBJ_MIN_LINES_PER_THREAD);
+  }
+  if (num_threads < 1) {
+    num_threads = 1;
+  }
   {
-    size_t i = 0;
-    for (i = 0; i < num_lines; i++) {
-      int ret = parseLine(&commands[i], &buf[line_infos[i].pos],
-                          line_infos[i].len, flags & TINYOBJ_FLAG_TRIANGULATE);
-      if (ret) {
-        if (commands[i].type == COMMAND_V) {
-          num_v++;
-        } else if (commands[i].type == COMMAND_VN) {
-          num_vn++;
-        } else if (commands[i].type == COMMAND_VT) {
-          num_vt++;
-        } else if (commands[i].type == COMMAND_F) {
-          num_f += commands[i].num_f;
-          num_faces += commands[i].num_f_num_verts;
-        }
+    size_t c = 0;
+    size_t lines_per_chunk = (num_lines + num_threads - 1) / num_threads;
+
+    for (c = 0; c < num_threads; c++) {
+      ParseChunk *chunk = &chunks[c];
+      memset(chunk, 0, sizeof(ParseChunk));
+      chunk->commands = commands;
+      chunk->line_infos = line_infos;
+      chunk->buf = buf;
+      chunk->triangulate = flags & TINYOBJ_FLAG_TRIANGULATE;
+      chunk->attrib = attrib;
+      chunk->material_table = &material_table;
+      chunk->begin = c * lines_per_chunk;
+      chunk->end = chunk->begin + lines_per_chunk;
+      if (chunk->begin > num_lines)
+        chunk->begin = num_lines;
+      if (chunk->end > num_lines)
+        chunk->end = num_lines;
+      chunk->mtllib_line_index = -1;
+      chunk->usemtl_line_index = -1;
+    }
 
-        if (commands[i].type == COMMAND_MTLLIB) {
-          mtllib_line_index = (int)i;
-        }
+    run_parse_chunks(parse_chunk_lines, chunks, num_threads);
+
+    for (c = 0; c < num_threads; c++) {
+      /* Global index offsets of each chunk are the totals of its
+       * predecessors. */
+      chunks[c].v_offset = num_v;
+      chunks[c].vn_offset = num_vn;
+      chunks[c].vt_offset = num_vt;
+      chunks[c].f_offset = num_f;
+      chunks[c].face_offset = num_faces;
+
+      num_v += chunks[c].num_v;
+      num_vn += chunks[c].num_vn;
+      num_vt += chunks[c].num_vt;
+      num_f += chunks[c].num_f;
+      num_faces += chunks[c].num_faces;
+
+      if (chunks[c].mtllib_line_index >= 0) {
+        mtllib_line_index = chunks[c].mtllib_line_index;
       }
     }
   }
@@ -1485,50 +2271,16 @@ int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
   }
 
   /* Load material (if it exists) */
-  if (mtllib_line_index >= 0 && commands[mtllib_line_index].mtllib_name &&
-      commands[mtllib_line_index].mtllib_name_len > 0) {
-    /* Maximum length allowed by Linux - higher than Windows and macOS */
-    size_t obj_filename_len = my_strnlen(obj_filename, 4096 + 255) + 1;
-    char *mtl_filename;
-    char *mtllib_name;
-    size_t mtllib_name_len = 0;
-    int ret;
-
-    mtllib_name_len =
-        length_until_line_feed(commands[mtllib_line_index].mtllib_name,
-                               commands[mtllib_line_index].mtllib_name_len);
-
-    mtllib_name =
-        my_strndup(commands[mtllib_line_index].mtllib_name, mtllib_name_len);
-
-    /* allow for NUL terminator */
-    mtllib_name_len++;
-    mtl_filename = generate_mtl_filename(obj_filename, obj_filename_len,
-                                         mtllib_name, mtllib_name_len);
-
-    ret = tinyobj_parse_and_index_mtl_file(&materials, &num_materials,
-                                           mtl_filename, obj_filename,
-                                           file_reader, ctx, &material_table);
-
-    if (ret != TINYOBJ_SUCCESS) {
-      /* warning. */
-      fprintf(stderr, "TINYOBJ: Failed to parse material file '%s': %d\n",
-              mtl_filename, ret);
-    }
-    TINYOBJ_FREE(mtl_filename);
-    TINYOBJ_FREE(mtllib_name);
+  if (mtllib_line_index >= 0) {
+    load_mtllib(&commands[mtllib_line_index], obj_filename, file_reader, ctx,
+                &materials, &num_materials, &material_table);
   }
 
   /* Construct attributes */
 
   {
-    size_t v_count = 0;
-    size_t n_count = 0;
-    size_t t_count = 0;
-    size_t f_count = 0;
-    size_t face_count = 0;
     int material_id = -1; /* -1 = default unknown material. */
-    size_t i = 0;
+    size_t c = 0;
 
     attrib->vertices = (float *)TINYOBJ_MALLOC(sizeof(float) * num_v * 3);
     attrib->num_vertices = (unsigned int)num_v;
@@ -1543,76 +2295,16 @@ int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
     attrib->material_ids = (int *)TINYOBJ_MALLOC(sizeof(int) * num_faces);
     attrib->num_face_num_verts = (unsigned int)num_faces;
 
-    for (i = 0; i < num_lines; i++) {
-      if (commands[i].type == COMMAND_EMPTY) {
-        continue;
-      } else if (commands[i].type == COMMAND_USEMTL) {
-        /* @todo
-           if (commands[t][i].material_name &&
-           commands[t][i].material_name_len > 0) {
-           std::string material_name(commands[t][i].material_name,
-           commands[t][i].material_name_len);
-
-           if (material_map.find(material_name) != material_map.end()) {
-           material_id = material_map[material_name];
-           } else {
-        // Assign invalid material ID
-        material_id = -1;
-        }
-        }
-        */
-        if (commands[i].material_name && commands[i].material_name_len > 0) {
-          /* Create a null terminated string */
-          char *material_name_null_term =
-              (char *)TINYOBJ_MALLOC(commands[i].material_name_len + 1);
-          memcpy((void *)material_name_null_term,
-                 (const void *)commands[i].material_name,
-                 commands[i].material_name_len);
-          material_name_null_term[commands[i].material_name_len] = 0;
-
-          if (hash_table_exists(material_name_null_term, &material_table))
-            material_id =
-                (int)hash_table_get(material_name_null_term, &material_table);
-          else
-            material_id = -1;
-
-          TINYOBJ_FREE(material_name_null_term);
-        }
-      } else if (commands[i].type == COMMAND_V) {
-        attrib->vertices[3 * v_count + 0] = commands[i].vx;
-        attrib->vertices[3 * v_count + 1] = commands[i].vy;
-        attrib->vertices[3 * v_count + 2] = commands[i].vz;
-        v_count++;
-      } else if (commands[i].type == COMMAND_VN) {
-        attrib->normals[3 * n_count + 0] = commands[i].nx;
-        attrib->normals[3 * n_count + 1] = commands[i].ny;
-        attrib->normals[3 * n_count + 2] = commands[i].nz;
-        n_count++;
-      } else if (commands[i].type == COMMAND_VT) {
-        attrib->texcoords[2 * t_count + 0] = commands[i].tx;
-        attrib->texcoords[2 * t_count + 1] = commands[i].ty;
-        t_count++;
-      } else if (commands[i].type == COMMAND_F) {
-        size_t k = 0;
-        for (k = 0; k < commands[i].num_f; k++) {
-          tinyobj_vertex_index_t vi = commands[i].f[k];
-          int v_idx = fixIndex(vi.v_idx, v_count);
-          int vn_idx = fixIndex(vi.vn_idx, n_count);
-          int vt_idx = fixIndex(vi.vt_idx, t_count);
-          attrib->faces[f_count + k].v_idx = v_idx;
-          attrib->faces[f_count + k].vn_idx = vn_idx;
-          attrib->faces[f_count + k].vt_idx = vt_idx;
-        }
-
-        for (k = 0; k < commands[i].num_f_num_verts; k++) {
-          attrib->material_ids[face_count + k] = material_id;
-          attrib->face_num_verts[face_count + k] = commands[i].f_num_verts[k];
-        }
-
-        f_count += commands[i].num_f;
-        face_count += commands[i].num_f_num_verts;
+    /* A chunk starts with the material of the last `usemtl` before it. */
+    for (c = 0; c < num_threads; c++) {
+      chunks[c].material_id = material_id;
+      if (chunks[c].usemtl_line_index >= 0) {
+        material_id = lookup_material_id(
+            &commands[chunks[c].usemtl_line_index], &material_table);
       }
     }
+
+    run_parse_chunks(construct_chunk_attrib, chunks, num_threads);
   }
 
   /* 5. Construct shape information. */
@@ -1721,6 +2413,211 @@ int tinyobj_parse_obj(tinyobj_attrib_t *attrib, tinyobj_shape_t **shapes,
   return TINYOBJ_SUCCESS;
 }
 
+/* Grow `*data` to hold at least `needed` elements of `elem_size` bytes. */
+static int stream_reserve(void **data, size_t *cap, size_t needed,
+                          size_t elem_size) {
+  size_t new_cap = *cap > 0 ? *cap : 1024;
+  void *new_data;
+  if (needed <= *cap) {
+    return 1;
+  }
+  while (new_cap < needed) {
+    new_cap *= 2;
+  }
+  new_data =
+      TINYOBJ_REALLOC_SIZED(*data, *cap * elem_size, new_cap * elem_size);
+  if (new_data == NULL) {
+    return 0;
+  }
+  *data = new_data;
+  *cap = new_cap;
+  return 1;
+}
+
+typedef struct {
+  tinyobj_attrib_t *attrib;
+  size_t vertices_cap;
+  size_t normals_cap;
+  size_t texcoords_cap;
+
+  int material_id;
+  int mtllib_loaded;
+  tinyobj_material_t *materials;
+  size_t num_materials;
+  hash_table_t material_table;
+
+  const char *obj_filename;
+  tinyobj_face_callback face_callback;
+  file_reader_callback file_reader;
+  void *ctx;
+  int triangulate;
+} StreamState;
+
+/* Parse one line and apply it right away. */
+static int stream_line(StreamState *state, const char *p, size_t p_len) {
+  tinyobj_attrib_t *attrib = state->attrib;
+  Command command;
+  size_t k = 0;
+
+  if (p_len >= TINYOBJ_MAX_LINE_LENGTH) {
+    return TINYOBJ_ERROR_INVALID_PARAMETER;
+  }
+  if (!parseLine(&command, p, p_len, state->triangulate)) {
+    return TINYOBJ_SUCCESS;
+  }
+
+  if (command.type == COMMAND_V) {
+    if (!stream_reserve((void **)&attrib->vertices, &state->vertices_cap,
+                        3 * (attrib->num_vertices + 1), sizeof(float))) {
+      return TINYOBJ_ERROR_EMPTY;
+    }
+    attrib->vertices[3 * attrib->num_vertices + 0] = command.vx;
+    attrib->vertices[3 * attrib->num_vertices + 1] = command.vy;
+    attrib->vertices[3 * attrib->num_vertices + 2] = command.vz;
+    attrib->num_vertices++;
+  } else if (command.type == COMMAND_VN) {
+    if (!stream_reserve((void **)&attrib->normals, &state->normals_cap,
+                        3 * (attrib->num_normals + 1), sizeof(float))) {
+      return TINYOBJ_ERROR_EMPTY;
+    }
+    attrib->normals[3 * attrib->num_normals + 0] = command.nx;
+    attrib->normals[3 * attrib->num_normals + 1] = command.ny;
+    attrib->normals[3 * attrib->num_normals + 2] = command.nz;
+    attrib->num_normals++;
+  } else if (command.type == COMMAND_VT) {
+    if (!stream_reserve((void **)&attrib->texcoords, &state->texcoords_cap,
+                        2 * (attrib->num_texcoords + 1), sizeof(float))) {
+      return TINYOBJ_ERROR_EMPTY;
+    }
+    attrib->texcoords[2 * attrib->num_texcoords + 0] = command.tx;
+    attrib->texcoords[2 * attrib->num_texcoords + 1] = command.ty;
+    attrib->num_texcoords++;
+  } else if (command.type == COMMAND_F) {
+    size_t f_count = 0;
+    for (k = 0; k < command.num_f; k++) {
+      tinyobj_vertex_index_t *vi = &command.f[k];
+      vi->v_idx = fixIndex(vi->v_idx, attrib->num_vertices);
+      vi->vn_idx = fixIndex(vi->vn_idx, attrib->num_normals);
+      vi->vt_idx = fixIndex(vi->vt_idx, attrib->num_texcoords);
+    }
+    for (k = 0; k < command.num_f_num_verts; k++) {
+      state->face_callback(state->ctx, attrib, &command.f[f_count],
+                           command.f_num_verts[k], state->material_id);
+      f_count += (size_t)command.f_num_verts[k];
+    }
+    attrib->num_faces += (unsigned int)command.num_f;
+    attrib->num_face_num_verts += (unsigned int)command.num_f_num_verts;
+  } else if (command.type == COMMAND_USEMTL) {
+    if (command.material_name && command.material_name_len > 0) {
+      state->material_id =
+          lookup_material_id(&command, &state->material_table);
+    }
+  } else if (command.type == COMMAND_MTLLIB && !state->mtllib_loaded) {
+    /* By specification `mtllib` appears once, before any `usemtl`. */
+    load_mtllib(&command, state->obj_filename, state->file_reader,
+                state->ctx, &state->materials, &state->num_materials,
+                &state->material_table);
+    state->mtllib_loaded = 1;
+  }
+
+  return TINYOBJ_SUCCESS;
+}
+
+int tinyobj_parse_obj_stream(tinyobj_attrib_t *attrib,
+                             tinyobj_material_t **materials_out,
+                             size_t *num_materials_out,
+                             const char *obj_filename,
+                             tinyobj_stream_reader_callback stream_reader,
+                             tinyobj_face_callback face_callback,
+                             file_reader_callback file_reader, void *ctx,
+                             unsigned int flags) {
+  StreamState state;
+  tinyobj_line_scanner find_line_break = select_line_scanner();
+  char *window = NULL;
+  size_t filled = 0;
+  size_t num_lines = 0;
+  int at_end = 0;
+  int ret = TINYOBJ_SUCCESS;
+
+  if (attrib == NULL)
+    return TINYOBJ_ERROR_INVALID_PARAMETER;
+  if (stream_reader == NULL || face_callback == NULL)
+    return TINYOBJ_ERROR_INVALID_PARAMETER;
+  if (materials_out == NULL)
+    return TINYOBJ_ERROR_INVALID_PARAMETER;
+  if (num_materials_out == NULL)
+    return TINYOBJ_ERROR_INVALID_PARAMETER;
+
+  window = (char *)TINYOBJ_MALLOC(TINYOBJ_STREAM_WINDOW_SIZE);
+  if (window == NULL)
+    return TINYOBJ_ERROR_EMPTY;
+
+  tinyobj_attrib_init(attrib);
+  memset(&state, 0, sizeof(StreamState));
+  state.attrib = attrib;
+  state.material_id = -1;
+  state.obj_filename = obj_filename;
+  state.face_callback = face_callback;
+  state.file_reader = file_reader;
+  state.ctx = ctx;
+  state.triangulate = flags & TINYOBJ_FLAG_TRIANGULATE;
+  create_hash_table(HASH_TABLE_DEFAULT_SIZE, &state.material_table);
+
+  while (!at_end && ret == TINYOBJ_SUCCESS) {
+    size_t line_start = 0;
+    size_t i = 0;
+
+    /* Top up the window behind the partial line carried over. */
+    while (filled < TINYOBJ_STREAM_WINDOW_SIZE) {
+      size_t n = stream_reader(ctx, window + filled,
+                               TINYOBJ_STREAM_WINDOW_SIZE - filled);
+      if (n == 0) {
+        at_end = 1;
+        break;
+      }
+      filled += n;
+    }
+
+    for (i = find_line_break(window, 0, filled);
+         i < filled && ret == TINYOBJ_SUCCESS;
+         i = find_line_break(window, i + 1, filled)) {
+      ret = stream_line(&state, &window[line_start], i - line_start);
+      line_start = i + 1;
+      num_lines++;
+    }
+
+    if (ret == TINYOBJ_SUCCESS && at_end && line_start < filled) {
+      /* The last line may lack a line ending. */
+      ret = stream_line(&state, &window[line_start], filled - line_start);
+      line_start = filled;
+      num_lines++;
+    } else if (line_start == 0 && filled == TINYOBJ_STREAM_WINDOW_SIZE) {
+      /* No line ending in a full window. */
+      ret = TINYOBJ_ERROR_INVALID_PARAMETER;
+    }
+
+    memmove(window, &window[line_start], filled - line_start);
+    filled -= line_start;
+  }
+
+  TINYOBJ_FREE(window);
+  destroy_hash_table(&state.material_table);
+
+  if (ret == TINYOBJ_SUCCESS && num_lines == 0) {
+    ret = TINYOBJ_ERROR_EMPTY;
+  }
+  if (ret != TINYOBJ_SUCCESS) {
+    tinyobj_attrib_free(attrib);
+    tinyobj_materials_free(state.materials, state.num_materials);
+    return ret;
+  }
+
+  (*materials_out) = state.materials;
+  (*num_materials_out) = state.num_materials;
+
+  return TINYOBJ_SUCCESS;
+}
+
 void tinyobj_attrib_init(tinyobj_attrib_t *attrib) {
   attrib->vertices = NULL;
   attrib->num_vertices = 0;
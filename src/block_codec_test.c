@@ -0,0 +1,229 @@
+// Encodes 4x4 blocks with a known layout to BC7, BC1 and BC3, decodes them
+// again and checks the error stays within what each format can reach: a
+// block the format represents exactly comes back within the rounding of
+// its endpoints, others within a mean error bound. Exits non-zero on a
+// failure.
+//
+//   ./build.sh block_codec_test --run
+
+#define main tutorial_main
+#include "tutorial.c"
+#undef main
+
+#include "check.h"
+
+// reads `bits` bits of a block, least significant bit first
+static uint32_t read_block_bits(const uint8_t *block, uint32_t *pos,
+                                uint32_t bits) {
+  uint32_t value = 0;
+  for (uint32_t i = 0; i < bits; i++, (*pos)++) {
+    value |= (uint32_t)((block[*pos / 8] >> (*pos % 8)) & 1) << i;
+  }
+  return value;
+}
+
+// BC7 in mode 6, the only one the encoder writes. Returns 0 for any other.
+static int decode_bc7(const uint8_t *block, uint8_t texels[16][4]) {
+  uint32_t pos = 0;
+  if (read_block_bits(block, &pos, 7) != 1 << 6) {
+    return 0;
+  }
+  uint32_t endpoints[2][4];
+  for (int c = 0; c < 4; c++) {
+    for (int e = 0; e < 2; e++) {
+      endpoints[e][c] = read_block_bits(block, &pos, 7) << 1;
+    }
+  }
+  for (int e = 0; e < 2; e++) {
+    uint32_t p_bit = read_block_bits(block, &pos, 1);
+    for (int c = 0; c < 4; c++) {
+      endpoints[e][c] |= p_bit;
+    }
+  }
+  // the anchor index has its top bit implied
+  for (int i = 0; i < 16; i++) {
+    uint32_t w = bc7_weights[read_block_bits(block, &pos, i == 0 ? 3 : 4)];
+    for (int c = 0; c < 4; c++) {
+      texels[i][c] =
+          (uint8_t)(((64 - w) * endpoints[0][c] + w * endpoints[1][c] + 32) >>
+                    6);
+    }
+  }
+  return 1;
+}
+
+static void unpack_565(uint16_t packed, int *rgb) {
+  int r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+  rgb[0] = r << 3 | r >> 2;
+  rgb[1] = g << 2 | g >> 4;
+  rgb[2] = b << 3 | b >> 2;
+}
+
+// the color half of BC1 and BC3. BC1 has 3 colors and black when the first
+// endpoint isn't the larger, BC3 always has 4.
+static void decode_color_block(const uint8_t *block, int four_colors,
+                               uint8_t texels[16][4]) {
+  uint16_t c0 = block[0] | block[1] << 8;
+  uint16_t c1 = block[2] | block[3] << 8;
+  int palette[4][3];
+  unpack_565(c0, palette[0]);
+  unpack_565(c1, palette[1]);
+  for (int c = 0; c < 3; c++) {
+    if (c0 > c1 || four_colors) {
+      palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+      palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    } else {
+      palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+      palette[3][c] = 0;
+    }
+  }
+  uint32_t pos = 32;
+  for (int i = 0; i < 16; i++) {
+    uint32_t index = read_block_bits(block, &pos, 2);
+    for (int c = 0; c < 3; c++) {
+      texels[i][c] = (uint8_t)palette[index][c];
+    }
+    texels[i][3] = 255;
+  }
+}
+
+// the alpha half of BC3, 8 levels, or 6 and both ends when the first
+// endpoint isn't the larger
+static void decode_alpha_block(const uint8_t *block, uint8_t texels[16][4]) {
+  int a0 = block[0], a1 = block[1];
+  int palette[8] = {a0, a1};
+  if (a0 > a1) {
+    for (int k = 2; k < 8; k++) {
+      palette[k] = ((8 - k) * a0 + (k - 1) * a1) / 7;
+    }
+  } else {
+    for (int k = 2; k < 6; k++) {
+      palette[k] = ((6 - k) * a0 + (k - 1) * a1) / 5;
+    }
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+  uint32_t pos = 16;
+  for (int i = 0; i < 16; i++) {
+    texels[i][3] = (uint8_t)palette[read_block_bits(block, &pos, 3)];
+  }
+}
+
+static int decode_block(VkFormat format, const uint8_t *block,
+                        uint8_t texels[16][4]) {
+  switch (format) {
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+    return decode_bc7(block, texels);
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+    decode_color_block(block + 8, 1, texels);
+    decode_alpha_block(block, texels);
+    return 1;
+  default:
+    decode_color_block(block, 0, texels);
+    return 1;
+  }
+}
+
+// how far a format may be off on a block: the largest difference of a
+// channel, and the mean difference over every channel it stores
+typedef struct {
+  int max;
+  float mean;
+} ErrorBound;
+
+typedef struct {
+  const char *name;
+  uint8_t texels[16][4];
+  // BC7, BC1, BC3
+  ErrorBound bounds[3];
+} KnownBlock;
+
+static const VkFormat formats[3] = {VK_FORMAT_BC7_SRGB_BLOCK,
+                                    VK_FORMAT_BC1_RGB_SRGB_BLOCK,
+                                    VK_FORMAT_BC3_SRGB_BLOCK};
+
+static void check_block(const KnownBlock *known, int f) {
+  VkFormat format = formats[f];
+  uint8_t block[16];
+  encode_texture_blocks(&known->texels[0][0], 4, 4, 1, format, block);
+  uint8_t texels[16][4];
+  if (!decode_block(format, block, texels)) {
+    CHECK(0, "%s in %s: not a mode 6 block\n", known->name,
+          block_format_name(format));
+    return;
+  }
+
+  // BC1 stores no alpha
+  int channels = format == VK_FORMAT_BC1_RGB_SRGB_BLOCK ? 3 : 4;
+  int max = 0;
+  int total = 0;
+  for (int i = 0; i < 16; i++) {
+    for (int c = 0; c < channels; c++) {
+      int difference = abs((int)texels[i][c] - (int)known->texels[i][c]);
+      max = difference > max ? difference : max;
+      total += difference;
+    }
+  }
+  float mean = (float)total / (16 * channels);
+  printf("%-12s %-5s max %3d mean %6.2f\n", known->name,
+         block_format_name(format), max, mean);
+  const ErrorBound *bound = &known->bounds[f];
+  CHECK(max <= bound->max && mean <= bound->mean,
+        "%s in %s: off by %d, %.2f on average, over %d and %.2f\n",
+        known->name, block_format_name(format), max, mean, bound->max,
+        bound->mean);
+}
+
+static uint32_t random_state = 1;
+
+static uint8_t next_random_byte() {
+  random_state = random_state * 1664525 + 1013904223;
+  return (uint8_t)(random_state >> 24);
+}
+
+int main() {
+  static KnownBlock known[] = {
+      // one color, off only by rounding to 565 in BC1 and BC3
+      {.name = "solid",
+       .bounds = {{1, 1.0f}, {4, 4.0f}, {4, 4.0f}}},
+      // two colors in a checkerboard, the endpoints themselves
+      {.name = "two colors",
+       .bounds = {{1, 1.0f}, {4, 4.0f}, {4, 4.0f}}},
+      // four steps between two colors, BC1's palette and within the
+      // weights BC7 has near thirds
+      {.name = "four steps",
+       .bounds = {{3, 2.0f}, {5, 4.0f}, {5, 4.0f}}},
+      // 16 grays from black to white, BC7 has a weight for each, BC1 only
+      // 4 levels, which leave a sixth of the range between neighbours
+      {.name = "gray ramp",
+       .bounds = {{3, 2.0f}, {43, 22.0f}, {43, 22.0f}}},
+      // one color fading out, 8 alpha levels in BC3, 16 in BC7
+      {.name = "alpha ramp",
+       .bounds = {{3, 2.0f}, {4, 4.0f}, {19, 10.0f}}},
+      // unrelated texels, no line fits them, only the mean is bounded
+      {.name = "noise",
+       .bounds = {{255, 60.0f}, {255, 70.0f}, {255, 70.0f}}},
+  };
+  static const uint8_t color_a[4] = {200, 100, 40, 255};
+  static const uint8_t color_b[4] = {16, 180, 240, 255};
+  for (int i = 0; i < 16; i++) {
+    int step = i % 4;
+    for (int c = 0; c < 4; c++) {
+      known[0].texels[i][c] = color_a[c];
+      known[1].texels[i][c] = ((i + i / 4) % 2 ? color_b : color_a)[c];
+      known[2].texels[i][c] =
+          (uint8_t)((color_a[c] * (3 - step) + color_b[c] * step + 1) / 3);
+      known[3].texels[i][c] = c < 3 ? (uint8_t)(i * 17) : 255;
+      known[4].texels[i][c] = c < 3 ? color_a[c] : (uint8_t)(i * 17);
+      known[5].texels[i][c] = next_random_byte();
+    }
+  }
+
+  for (size_t k = 0; k < sizeof(known) / sizeof(known[0]); k++) {
+    for (int f = 0; f < 3; f++) {
+      check_block(&known[k], f);
+    }
+  }
+
+  return report_checks();
+}
@@ -0,0 +1,22 @@
+// What the test programs share: CHECK() prints the message of a condition
+// that doesn't hold and counts it, report_checks() sums up and gives the
+// exit code for main(). Included after tutorial.c.
+
+static int failures = 0;
+
+#define CHECK(condition, ...)                                                  \
+  do {                                                                         \
+    if (!(condition)) {                                                        \
+      printf("FAILED: " __VA_ARGS__);                                          \
+      failures += 1;                                                           \
+    }                                                                          \
+  } while (0)
+
+static int report_checks() {
+  if (failures > 0) {
+    printf("%d checks failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}
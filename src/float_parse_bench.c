@@ -0,0 +1,227 @@
+// Measures how fast tinyobj turns the numbers of an OBJ file into floats,
+// against the digit by digit parser it used before and against strtof.
+//
+//   ./build.sh float_parse_bench --run
+
+#define TINYOBJ_LOADER_C_IMPLEMENTATION
+#include "tinyobj_loader_c.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MODEL_PATH "models/viking_room.obj"
+#define TARGET_BYTES (64 << 20)
+#define RUNS 5
+
+// the parser tinyobj shipped with, kept to compare against
+static int legacy_parse_double(const char *s, const char *s_end,
+                               double *result) {
+  double mantissa = 0.0;
+  int exponent = 0;
+  char sign = '+';
+  char exp_sign = '+';
+  const char *curr = s;
+  int read = 0;
+
+  if (s >= s_end) {
+    return 0;
+  }
+  if (*curr == '+' || *curr == '-') {
+    sign = *curr;
+    curr++;
+  }
+
+  while (curr != s_end && IS_DIGIT(*curr)) {
+    mantissa = mantissa * 10 + (*curr - '0');
+    curr++;
+    read++;
+  }
+  if (read == 0) {
+    return 0;
+  }
+
+  if (curr != s_end && *curr == '.') {
+    curr++;
+    read = 1;
+    while (curr != s_end && IS_DIGIT(*curr)) {
+      double frac_value = 1.0;
+      for (int f = 0; f < read; f++) {
+        frac_value *= 0.1;
+      }
+      mantissa += (*curr - '0') * frac_value;
+      read++;
+      curr++;
+    }
+  }
+
+  if (curr != s_end && (*curr == 'e' || *curr == 'E')) {
+    curr++;
+    if (curr != s_end && (*curr == '+' || *curr == '-')) {
+      exp_sign = *curr;
+      curr++;
+    }
+    read = 0;
+    while (curr != s_end && IS_DIGIT(*curr)) {
+      exponent = exponent * 10 + (*curr - '0');
+      curr++;
+      read++;
+    }
+    if (read == 0) {
+      return 0;
+    }
+  }
+
+  double a = 1.0;
+  double b = 1.0;
+  for (int i = 0; i < exponent; i++) {
+    a *= 5.0;
+    b *= 2.0;
+  }
+  if (exp_sign == '-') {
+    a = 1.0 / a;
+    b = 1.0 / b;
+  }
+  *result = (sign == '+' ? 1 : -1) * (mantissa * a * b);
+  return 1;
+}
+
+typedef enum { PARSER_LEGACY, PARSER_FAST, PARSER_STRTOF } Parser;
+
+static const char *parser_names[] = {"legacy", "tinyobj", "strtof"};
+
+static double elapsed_secs(const struct timespec *start) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - start->tv_sec) +
+         (double)(now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// parses every space separated token of `text` into out[]
+static size_t parse_all(Parser parser, const char *text, size_t len,
+                        float *out) {
+  const char *p = text;
+  const char *end = text + len;
+  size_t count = 0;
+  while (p < end) {
+    const char *token_end = p + until_space(p);
+    double d = 0.0;
+    float f = 0.0f;
+    switch (parser) {
+    case PARSER_LEGACY:
+      legacy_parse_double(p, token_end, &d);
+      f = (float)d;
+      break;
+    case PARSER_FAST:
+      tryParseFloat(p, token_end, &f);
+      break;
+    case PARSER_STRTOF:
+      f = strtof(p, NULL);
+      break;
+    }
+    out[count++] = f;
+    p = token_end + 1;
+  }
+  return count;
+}
+
+// times every parser over `text` and returns how many floats tinyobj got
+// wrong, taking strtof, which rounds correctly, as the reference
+static size_t bench_text(const char *label, const char *text, size_t len) {
+  float *values[3];
+  size_t count = 0;
+  printf("%s:\n", label);
+  for (int parser = 0; parser < 3; parser++) {
+    values[parser] = malloc(sizeof(float) * (len / 2 + 1));
+    double best = 1e9;
+    for (int run = 0; run < RUNS; run++) {
+      struct timespec start;
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      count = parse_all(parser, text, len, values[parser]);
+      double secs = elapsed_secs(&start);
+      best = secs < best ? secs : best;
+    }
+    printf("  %-8s %8.1f MB/s %8.1f Mfloats/s\n", parser_names[parser],
+           len / best / 1e6, count / best / 1e6);
+  }
+
+  size_t legacy_off = 0;
+  size_t fast_off = 0;
+  for (size_t i = 0; i < count; i++) {
+    legacy_off += memcmp(&values[PARSER_LEGACY][i], &values[PARSER_STRTOF][i],
+                         sizeof(float)) != 0;
+    fast_off += memcmp(&values[PARSER_FAST][i], &values[PARSER_STRTOF][i],
+                       sizeof(float)) != 0;
+  }
+  printf("  %zu floats from %.1f MB, not correctly rounded: legacy %zu, "
+         "tinyobj %zu\n",
+         count, len / 1e6, legacy_off, fast_off);
+
+  for (int parser = 0; parser < 3; parser++) {
+    free(values[parser]);
+  }
+  return fast_off;
+}
+
+int main() {
+  FILE *file = fopen(MODEL_PATH, "rb");
+  if (!file) {
+    fprintf(stderr, "failed to open %s\n", MODEL_PATH);
+    return 1;
+  }
+
+  // the numbers of every v, vt and vn line, one space apart, repeated until
+  // there are enough bytes to time
+  char *text = malloc(TARGET_BYTES + 4096);
+  size_t text_len = 0;
+  char line[4096];
+  while (text_len < TARGET_BYTES) {
+    if (!fgets(line, sizeof(line), file)) {
+      if (text_len == 0) {
+        fprintf(stderr, "no vertex data in %s\n", MODEL_PATH);
+        return 1;
+      }
+      rewind(file);
+      continue;
+    }
+    if (line[0] != 'v') {
+      continue;
+    }
+    const char *p = line + 1 + (line[1] == 't' || line[1] == 'n');
+    while (*p) {
+      skip_space(&p);
+      int len = until_space(p);
+      while (len > 0 && (p[len - 1] == '\n' || p[len - 1] == '\r')) {
+        len--;
+      }
+      if (len == 0) {
+        break;
+      }
+      memcpy(text + text_len, p, len);
+      text_len += len;
+      text[text_len++] = ' ';
+      p += until_space(p);
+    }
+  }
+  fclose(file);
+  text[text_len] = '\0';
+
+  // Blender writes six decimals, other exporters print every float with
+  // the nine significant digits it takes to round trip
+  float *reference = malloc(sizeof(float) * (text_len / 2 + 1));
+  size_t count = parse_all(PARSER_STRTOF, text, text_len, reference);
+  char *long_text = malloc((size_t)count * 17 + 1 + TINYOBJ_SCAN_PADDING);
+  size_t long_text_len = 0;
+  for (size_t i = 0; i < count; i++) {
+    long_text_len += sprintf(long_text + long_text_len, "%.9g ", reference[i]);
+  }
+
+  size_t off = bench_text("six decimals", text, text_len);
+  off += bench_text("nine significant digits", long_text, long_text_len);
+
+  free(reference);
+  free(long_text);
+  free(text);
+  return off != 0;
+}
@@ -0,0 +1,119 @@
+// Loads models/quads.glb and checks what load_glb() makes of it, so the
+// .glb path runs without a GPU. The file holds two quads: one stored like
+// PackedVertex under a node that only moves and scales it, which has to be
+// copied as it is, with an embedded PNG; and one with float attributes and
+// 8 bit indices under a child node, which has to be quantized into the same
+// range, with its texture named relative to the model.
+//
+//   ./build.sh glb_test --run
+
+#define main tutorial_main
+#include "tutorial.c"
+#undef main
+
+#include "check.h"
+
+#define GLB_TEST_PATH "models/quads.glb"
+#define QUAD_VERTICES 4
+#define QUAD_INDICES 6
+
+static const float expected_positions[2][QUAD_VERTICES][3] = {
+    {{-1.0f, -1.0f, 0.0f}, {1.0f, -1.0f, 0.0f}, {1.0f, 1.0f, 0.0f},
+     {-1.0f, 1.0f, 0.0f}},
+    {{-0.5f, -0.5f, 0.5f}, {0.5f, -0.5f, 0.5f}, {0.5f, 0.5f, 0.5f},
+     {-0.5f, 0.5f, 0.5f}},
+};
+static const float expected_tex_coords[QUAD_VERTICES][2] = {
+    {0.0f, 1.0f}, {1.0f, 1.0f}, {1.0f, 0.0f}, {0.0f, 0.0f}};
+static const uint32_t expected_indices[2][QUAD_INDICES] = {
+    {0, 1, 2, 0, 2, 3}, {0, 2, 1, 0, 3, 2}};
+
+static float dequantize(uint16_t value, float offset, float scale) {
+  return value / 65535.0f * scale + offset;
+}
+
+static void check_vertices() {
+  PackedVertex packed[2 * QUAD_VERTICES];
+  write_glb_vertices(packed);
+
+  float tolerance = 2.0f / 65535.0f;
+  for (int p = 0; p < 2; p++) {
+    const PackedVertex *quad = &packed[glb_primitives[p].vertex_offset];
+    for (int i = 0; i < QUAD_VERTICES; i++) {
+      for (int j = 0; j < 3; j++) {
+        float pos = dequantize(quad[i].pos[j], position_offset[j],
+                               position_scale[j]);
+        CHECK(fabsf(pos - expected_positions[p][i][j]) <= tolerance,
+              "quad %d vertex %d: position %d is %f, not %f\n", p, i, j, pos,
+              expected_positions[p][i][j]);
+      }
+      for (int j = 0; j < 2; j++) {
+        float tex_coord =
+            dequantize(quad[i].tex_coord[j], tex_coord_transform[j],
+                       tex_coord_transform[j + 2]);
+        CHECK(fabsf(tex_coord - expected_tex_coords[i][j]) <= tolerance,
+              "quad %d vertex %d: texture coordinate %d is %f, not %f\n", p,
+              i, j, tex_coord, expected_tex_coords[i][j]);
+      }
+    }
+  }
+}
+
+static void check_indices() {
+  uint32_t written[2 * QUAD_INDICES];
+  write_glb_indices(written, VK_INDEX_TYPE_UINT32);
+  for (int p = 0; p < 2; p++) {
+    const uint32_t *quad = &written[glb_primitives[p].index_offset];
+    CHECK(memcmp(quad, expected_indices[p], sizeof(expected_indices[p])) == 0,
+          "quad %d: wrong indices\n", p);
+  }
+}
+
+static void check_materials() {
+  CHECK(mesh_materials_len == 2, "%u materials, not 2\n", mesh_materials_len);
+  if (mesh_materials_len != 2) {
+    return;
+  }
+
+  const MeshMaterial *embedded = &mesh_materials[glb_primitives[0].material];
+  CHECK(strcmp(embedded->texture_path, GLB_TEST_PATH) == 0 &&
+            embedded->texture_size > 0,
+        "the first quad's image isn't embedded\n");
+  MappedFile file = map_file(GLB_TEST_PATH);
+  int width = 0, height = 0, channels;
+  stbi_uc *pixels = stbi_load_from_memory(
+      (const stbi_uc *)file.data + embedded->texture_offset,
+      (int)embedded->texture_size, &width, &height, &channels, STBI_rgb_alpha);
+  CHECK(pixels && width == 4 && height == 4,
+        "the embedded image doesn't decode to 4x4\n");
+  stbi_image_free(pixels);
+  unmap_file(file);
+
+  const MeshMaterial *external = &mesh_materials[glb_primitives[1].material];
+  CHECK(strcmp(external->texture_path, "models/../textures/texture.jpg") == 0 &&
+            external->texture_size == 0,
+        "the second quad's texture is %s\n", external->texture_path);
+}
+
+int main() {
+  set_model_path(GLB_TEST_PATH);
+  load_glb();
+
+  CHECK(glb_primitives_len == 2, "%u primitives, not 2\n",
+        glb_primitives_len);
+  CHECK(glb_vertices_len == 2 * QUAD_VERTICES, "%u vertices\n",
+        glb_vertices_len);
+  CHECK(glb_indices_len == 2 * QUAD_INDICES, "%u indices\n", glb_indices_len);
+  CHECK(batches_len == 2 && lods_len == 1, "%u batches, %u LODs\n",
+        batches_len, lods_len);
+  if (glb_primitives_len == 2) {
+    CHECK(glb_primitives[0].copy_vertices,
+          "the PackedVertex quad isn't copied\n");
+    CHECK(!glb_primitives[1].copy_vertices, "the float quad is copied\n");
+    check_vertices();
+    check_indices();
+    check_materials();
+  }
+
+  return report_checks();
+}
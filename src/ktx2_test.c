@@ -0,0 +1,129 @@
+// Loads the .ktx2 fixtures in textures/ and checks what load_ktx2() makes
+// of them, so the .ktx2 path runs without a GPU. Both hold an 8x4
+// R8G8B8A8_SRGB checker whose texel at x, y of level l is the one
+// expected_texel() computes: checker_mips.ktx2 with its 4 levels baked in,
+// smallest first, which have to come out as they are stored, and
+// checker_generate_mips.ktx2 with a level count of 0, whose level 0 has to
+// come out as pixels for the mipmap pass. A copy of the second claiming
+// BC7 has to be rejected, no chain is generated for block formats.
+//
+//   ./build.sh ktx2_test --run
+
+#define main tutorial_main
+#include "tutorial.c"
+#undef main
+
+#include "check.h"
+
+#define KTX2_MIPS_PATH "textures/checker_mips.ktx2"
+#define KTX2_GENERATE_MIPS_PATH "textures/checker_generate_mips.ktx2"
+#define KTX2_BC7_PATH "build/ktx2_test.ktx2"
+#define CHECKER_WIDTH 8
+#define CHECKER_HEIGHT 4
+#define CHECKER_LEVELS 4
+
+static void expected_texel(uint32_t level, uint32_t x, uint32_t y,
+                           uint8_t *texel) {
+  texel[0] = (uint8_t)(x * 32 + level * 8);
+  texel[1] = (uint8_t)(y * 64 + level * 8);
+  texel[2] = (uint8_t)(level * 60);
+  texel[3] = 255;
+}
+
+static int level_matches(const uint8_t *texels, uint32_t level) {
+  uint32_t width = mip_extent(CHECKER_WIDTH, level);
+  uint32_t height = mip_extent(CHECKER_HEIGHT, level);
+  for (uint32_t y = 0; y < height; y++) {
+    for (uint32_t x = 0; x < width; x++) {
+      uint8_t texel[4];
+      expected_texel(level, x, y, texel);
+      if (memcmp(&texels[(y * width + x) * 4], texel, 4) != 0) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+static DecodedImage decode_fixture(const char *path) {
+  MeshMaterial material = {0};
+  snprintf(material.texture_path, sizeof(material.texture_path), "%s", path);
+  return decode_image(&material);
+}
+
+static void check_baked_mips() {
+  DecodedImage image = decode_fixture(KTX2_MIPS_PATH);
+  CHECK(image.blocks && !image.pixels, "%s isn't mapped as a chain\n",
+        KTX2_MIPS_PATH);
+  if (!image.blocks) {
+    return;
+  }
+  CHECK(image.format == VK_FORMAT_R8G8B8A8_SRGB, "%s: format %d\n",
+        KTX2_MIPS_PATH, image.format);
+  CHECK(image.width == CHECKER_WIDTH && image.height == CHECKER_HEIGHT,
+        "%s is %dx%d\n", KTX2_MIPS_PATH, image.width, image.height);
+  CHECK(image.mip_levels == CHECKER_LEVELS, "%s has %u levels, not %d\n",
+        KTX2_MIPS_PATH, image.mip_levels, CHECKER_LEVELS);
+  CHECK(image.blocks_size ==
+            mip_chain_size(CHECKER_WIDTH, CHECKER_HEIGHT, CHECKER_LEVELS),
+        "%s: chain of %zu bytes\n", KTX2_MIPS_PATH, image.blocks_size);
+
+  for (uint32_t i = 0; i < image.mip_levels && i < CHECKER_LEVELS; i++) {
+    // smallest first, each level ends where the next larger one starts
+    if (i > 0) {
+      uint64_t size = texture_level_size(
+          image.format, mip_extent(CHECKER_WIDTH, i),
+          mip_extent(CHECKER_HEIGHT, i));
+      CHECK(image.level_offsets[i] + size == image.level_offsets[i - 1],
+            "level %u isn't stored right before level %u\n", i, i - 1);
+    }
+    CHECK(level_matches(image.blocks + image.level_offsets[i], i),
+          "level %u doesn't hold its texels\n", i);
+  }
+  release_texture_blocks(&image);
+}
+
+static void check_generated_mips() {
+  DecodedImage image = decode_fixture(KTX2_GENERATE_MIPS_PATH);
+  CHECK(image.pixels && !image.blocks &&
+            image.format == VK_FORMAT_UNDEFINED,
+        "%s isn't decoded to pixels\n", KTX2_GENERATE_MIPS_PATH);
+  if (!image.pixels) {
+    return;
+  }
+  CHECK(image.width == CHECKER_WIDTH && image.height == CHECKER_HEIGHT,
+        "%s is %dx%d\n", KTX2_GENERATE_MIPS_PATH, image.width, image.height);
+  CHECK(level_matches(image.pixels, 0), "%s: level 0 doesn't hold its texels\n",
+        KTX2_GENERATE_MIPS_PATH);
+  stbi_image_free(image.pixels);
+}
+
+static void check_block_format_rejected() {
+  MappedFile file = map_file(KTX2_GENERATE_MIPS_PATH);
+  Ktx2Header header;
+  memcpy(&header, file.data, sizeof(header));
+  header.vk_format = VK_FORMAT_BC7_SRGB_BLOCK;
+  FILE *f = fopen(KTX2_BC7_PATH, "wb");
+  CHECK(f, "can't write %s\n", KTX2_BC7_PATH);
+  if (!f) {
+    unmap_file(file);
+    return;
+  }
+  fwrite(&header, sizeof(header), 1, f);
+  fwrite(file.data + sizeof(header), file.len - sizeof(header), 1, f);
+  fclose(f);
+  unmap_file(file);
+
+  DecodedImage image = decode_fixture(KTX2_BC7_PATH);
+  CHECK(!image.pixels && !image.blocks,
+        "a BC7 texture asking for generated mips is loaded\n");
+  remove(KTX2_BC7_PATH);
+}
+
+int main() {
+  check_baked_mips();
+  check_generated_mips();
+  check_block_format_rejected();
+
+  return report_checks();
+}
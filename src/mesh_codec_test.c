@@ -0,0 +1,191 @@
+// Round trips vertices and indices through the .vmesh codecs. Vertices of
+// 12, 16 and 32 bytes decode on the SSE2 path where it is compiled in, 4
+// byte ones and the partial last group always take the scalar loop, as
+// does the last full group of 12 byte ones; build with NO_SIMD defined to
+// run everything through the scalar loop. Exits non-zero on a failure.
+//
+//   ./build.sh mesh_codec_test --run
+//   CFLAGS=-DNO_SIMD ./build.sh mesh_codec_test --run
+
+#define main tutorial_main
+#include "tutorial.c"
+#undef main
+
+#include "check.h"
+
+static uint32_t random_state = 1;
+
+static uint32_t next_random() {
+  random_state = random_state * 1664525 + 1013904223;
+  return random_state;
+}
+
+typedef enum {
+  // every vertex the same, all planes are empty
+  VERTICES_CONSTANT,
+  // floats along a smooth curve, the common case
+  VERTICES_SMOOTH,
+  // unrelated bits, every plane needs all 8 bits
+  VERTICES_RANDOM,
+  VERTICES_KIND_COUNT,
+} VerticesKind;
+
+static const char *vertices_kind_names[] = {"constant", "smooth", "random"};
+
+static void fill_vertices(char *data, uint32_t count, uint32_t vertex_size,
+                          VerticesKind kind) {
+  uint32_t words = vertex_size / 4;
+  for (uint32_t i = 0; i < count; i++) {
+    for (uint32_t w = 0; w < words; w++) {
+      uint32_t word;
+      if (kind == VERTICES_CONSTANT) {
+        word = 0x3f800000 + w;
+      } else if (kind == VERTICES_SMOOTH) {
+        float value = sinf(i * 0.01f + w) * (w + 1);
+        memcpy(&word, &value, sizeof(word));
+      } else {
+        word = next_random();
+      }
+      memcpy(data + (size_t)i * vertex_size + w * 4, &word, sizeof(word));
+    }
+  }
+}
+
+static void check_vertices(uint32_t count, uint32_t vertex_size,
+                           VerticesKind kind) {
+  size_t size = (size_t)count * vertex_size;
+  char *original = malloc(size + 1);
+  char *decoded = malloc(size + 1);
+  char *encoded = malloc(encode_vertices_bound(count, vertex_size) + 1);
+  fill_vertices(original, count, vertex_size, kind);
+
+  size_t encoded_len = encode_vertices(original, count, vertex_size, encoded);
+  CHECK(encoded_len <= encode_vertices_bound(count, vertex_size),
+        "%u %s vertices of %u bytes: coded past the bound\n", count,
+        vertices_kind_names[kind], vertex_size);
+
+  memset(decoded, 0xcd, size);
+  int ok = decode_vertices(decoded, count, vertex_size, encoded, encoded_len);
+  CHECK(ok && memcmp(original, decoded, size) == 0,
+        "%u %s vertices of %u bytes don't round trip\n", count,
+        vertices_kind_names[kind], vertex_size);
+
+  if (encoded_len > 0) {
+    CHECK(!decode_vertices(decoded, count, vertex_size, encoded,
+                           encoded_len - 1),
+          "%u %s vertices of %u bytes decode from truncated data\n", count,
+          vertices_kind_names[kind], vertex_size);
+  }
+
+  free(original);
+  free(decoded);
+  free(encoded);
+}
+
+static void check_indices(const char *name, const uint32_t *original,
+                          uint32_t count, uint32_t vertex_count) {
+  char *encoded = malloc(encode_indices_bound(count));
+  uint32_t *decoded = malloc(sizeof(uint32_t) * (count + 1));
+
+  size_t encoded_len = encode_indices(original, count, encoded);
+  CHECK(encoded_len <= encode_indices_bound(count),
+        "%s: coded past the bound\n", name);
+
+  int ok = decode_indices(decoded, count, vertex_count, encoded, encoded_len);
+  CHECK(ok, "%s: doesn't decode\n", name);
+
+  // a triangle may come out rotated, but has to keep its winding
+  for (uint32_t t = 0; ok && t < count; t += 3) {
+    const uint32_t *a = &original[t];
+    const uint32_t *b = &decoded[t];
+    int same = 0;
+    for (int r = 0; r < 3 && !same; r++) {
+      same = a[0] == b[r] && a[1] == b[(r + 1) % 3] && a[2] == b[(r + 2) % 3];
+    }
+    if (!same) {
+      CHECK(0, "%s: triangle %u is %u %u %u, not %u %u %u\n", name, t / 3,
+            b[0], b[1], b[2], a[0], a[1], a[2]);
+      break;
+    }
+  }
+
+  CHECK(!decode_indices(decoded, count, vertex_count, encoded,
+                        encoded_len - 1),
+        "%s: decodes from truncated data\n", name);
+  if (count > 0) {
+    uint32_t max_index = 0;
+    for (uint32_t i = 0; i < count; i++) {
+      max_index = original[i] > max_index ? original[i] : max_index;
+    }
+    CHECK(!decode_indices(decoded, count, max_index, encoded, encoded_len),
+          "%s: decodes with index %u out of range\n", name, max_index);
+  }
+
+  free(encoded);
+  free(decoded);
+}
+
+// two triangles per quad of a size x size grid, in row order
+static uint32_t build_grid(uint32_t *dst, uint32_t size) {
+  uint32_t len = 0;
+  for (uint32_t y = 0; y < size; y++) {
+    for (uint32_t x = 0; x < size; x++) {
+      uint32_t v = y * (size + 1) + x;
+      uint32_t quad[6] = {v, v + 1,        v + size + 2,
+                          v, v + size + 2, v + size + 1};
+      memcpy(&dst[len], quad, sizeof(quad));
+      len += 6;
+    }
+  }
+  return len;
+}
+
+int main() {
+#ifdef HAS_SSE2
+  printf("decoding 12, 16 and 32 byte vertices with SSE2\n");
+#else
+  printf("decoding every vertex with the scalar loop\n");
+#endif
+
+  static const uint32_t counts[] = {0, 1, 15, 16, 17, 33, 1000, 1001};
+  static const uint32_t vertex_sizes[] = {4, 12, 16, 32, 48};
+  for (int c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+    for (int s = 0; s < sizeof(vertex_sizes) / sizeof(vertex_sizes[0]); s++) {
+      for (int k = 0; k < VERTICES_KIND_COUNT; k++) {
+        check_vertices(counts[c], vertex_sizes[s], k);
+      }
+    }
+  }
+
+  check_indices("empty", NULL, 0, 1);
+
+  uint32_t grid[16 * 16 * 6];
+  uint32_t grid_len = build_grid(grid, 16);
+  check_indices("grid", grid, grid_len, 17 * 17);
+
+  // each triangle's vertices drawn from the whole mesh, mostly varints
+  uint32_t scattered[3000];
+  for (int i = 0; i < 3000; i++) {
+    scattered[i] = next_random() % 100000;
+  }
+  check_indices("scattered", scattered, 3000, 100000);
+
+  // repeated vertices, repeated triangles and a triangle reusing the edge
+  // of a degenerate one
+  static const uint32_t degenerate[] = {0, 0, 1, 1, 1, 1, 0, 1, 2, 0, 1, 2,
+                                        2, 1, 0, 2, 2, 2, 3, 3, 0, 0, 3, 3};
+  check_indices("degenerate", degenerate,
+                sizeof(degenerate) / sizeof(degenerate[0]), 4);
+
+  // the 16 and 32 bit primitive restart values as plain indices, which
+  // take the longest varints and the largest jumps back
+  static const uint32_t restart[] = {
+      0,          1,          0xffff,     0xffff,     1,
+      2,          0xfffffffe, 0,          0xffff,     0xfffffffe,
+      0xfffffffe, 0xfffffffe, 3,          0xfffffffe, 4,
+      0xffff,     0xfffffffe, 0x7fffffff};
+  check_indices("restart", restart, sizeof(restart) / sizeof(restart[0]),
+                UINT32_MAX);
+
+  return report_checks();
+}
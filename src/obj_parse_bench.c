@@ -0,0 +1,95 @@
+// Measures how tinyobj_parse_obj_mt() scales with its thread count on
+// MODEL_PATH repeated to 64 MB, next to the serial parse. Past the online
+// CPUs the chunks only take turns, so the curve flattens there.
+//
+//   ./build.sh obj_parse_bench --run
+
+#define main tutorial_main
+#include "tutorial.c"
+#undef main
+
+#define TARGET_BYTES (64 << 20)
+#define RUNS 3
+
+typedef struct {
+  char *data;
+  size_t len;
+} ObjText;
+
+static void read_obj_text(void *ctx, const char *filename, int is_mtl,
+                          const char *obj_filename, char **buf, size_t *len) {
+  ObjText *text = ctx;
+  *buf = is_mtl ? NULL : text->data;
+  *len = is_mtl ? 0 : text->len;
+}
+
+// the model's lines repeated, the faces of every copy index the first one
+static ObjText build_text() {
+  MappedFile file = map_file(MODEL_PATH);
+  if (file.len == 0) {
+    THROW("%s is empty!\n", MODEL_PATH);
+  }
+  size_t copies = (TARGET_BYTES + file.len) / (file.len + 1);
+  ObjText text = {malloc(copies * (file.len + 1)), 0};
+  if (!text.data) {
+    THROW("failed to allocate OBJ text!\n");
+  }
+  for (size_t i = 0; i < copies; i++) {
+    memcpy(text.data + text.len, file.data, file.len);
+    text.len += file.len;
+    text.data[text.len++] = '\n';
+  }
+  unmap_file(file);
+  return text;
+}
+
+static double parse_ms(ObjText *text, unsigned int flags,
+                       unsigned int threads) {
+  double best = 0.0;
+  for (int run = 0; run < RUNS; run++) {
+    tinyobj_attrib_t attrib;
+    tinyobj_shape_t *shapes = NULL;
+    size_t num_shapes = 0;
+    tinyobj_material_t *materials = NULL;
+    size_t num_materials = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (tinyobj_parse_obj_mt(&attrib, &shapes, &num_shapes, &materials,
+                             &num_materials, MODEL_PATH, read_obj_text, text,
+                             flags, threads) != TINYOBJ_SUCCESS) {
+      THROW("failed to parse %s!\n", MODEL_PATH);
+    }
+    double ms = elapsed_ms(&start);
+    if (run == 0 || ms < best) {
+      best = ms;
+    }
+    tinyobj_attrib_free(&attrib);
+    tinyobj_shapes_free(shapes, num_shapes);
+    tinyobj_materials_free(materials, num_materials);
+  }
+  return best;
+}
+
+int main() {
+  static const unsigned int thread_counts[] = {1, 2, 4, 8, 16, 32};
+
+  ObjText text = build_text();
+  printf("%.1f MB of %s, %u online CPUs\n", text.len / 1e6, MODEL_PATH,
+         default_num_threads());
+
+  double serial_ms = parse_ms(&text, TINYOBJ_FLAG_TRIANGULATE, 1);
+  printf("%8s %12s %12s %10s\n", "threads", "ms", "MB/s", "speedup");
+  printf("%8s %12.1f %12.1f %10.2f\n", "serial", serial_ms,
+         text.len / serial_ms / 1e3, 1.0);
+  for (size_t i = 0; i < sizeof(thread_counts) / sizeof(thread_counts[0]);
+       i++) {
+    double ms = parse_ms(&text,
+                         TINYOBJ_FLAG_TRIANGULATE | TINYOBJ_FLAG_PARALLEL,
+                         thread_counts[i]);
+    printf("%8u %12.1f %12.1f %10.2f\n", thread_counts[i], ms,
+           text.len / ms / 1e3, serial_ms / ms);
+  }
+
+  free(text.data);
+  return 0;
+}
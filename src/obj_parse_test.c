@@ -0,0 +1,252 @@
+// Checks that tinyobj_parse_obj_mt() on 1 to 32 threads gives exactly what
+// the serial parser gives, field by field. The OBJ is generated: objects
+// and groups, usemtl switches that include a material the .mtl doesn't
+// have, quads that are triangulated or not, faces with relative indices
+// reaching back across chunk boundaries, and enough lines that every
+// thread count gets a chunk per thread. Exits non-zero on a failure.
+//
+//   ./build.sh obj_parse_test --run
+
+#define main tutorial_main
+#include "tutorial.c"
+#undef main
+
+#include "check.h"
+
+#define FIXTURE_OBJ "fixture.obj"
+#define FIXTURE_OBJECTS 12
+#define FIXTURE_BLOCKS 1200
+// how far back the long relative faces reach, past the end of a chunk
+#define FIXTURE_REACH 2000
+#define MAX_TEST_THREADS 32
+
+static const char fixture_mtl[] = "newmtl red\nKd 1 0 0\n"
+                                  "newmtl green\nKd 0 1 0\n"
+                                  "newmtl blue\nKd 0 0 1\n";
+static const char *fixture_materials[] = {"red", "green", "missing", "blue"};
+
+typedef struct {
+  char *data;
+  size_t len;
+  size_t cap;
+  size_t lines;
+} Text;
+
+static void append(Text *text, const char *format, ...) {
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+  while (text->len + len + 1 > text->cap) {
+    text->cap = text->cap ? text->cap * 2 : 1 << 16;
+    text->data = realloc(text->data, text->cap);
+    if (!text->data) {
+      THROW("failed to allocate fixture!\n");
+    }
+  }
+  va_start(args, format);
+  vsnprintf(text->data + text->len, len + 1, format, args);
+  va_end(args);
+  text->len += len;
+  text->lines += 1;
+}
+
+// every block adds 4 positions, 4 texture coordinates and a normal, then
+// faces that only use relative indices, only absolute ones or a mix
+static Text build_fixture() {
+  Text text = {0};
+  append(&text, "mtllib fixture.mtl\n");
+  uint32_t v = 0;
+  for (uint32_t o = 0; o < FIXTURE_OBJECTS; o++) {
+    append(&text, "%s part%u\n", o % 2 ? "g" : "o", o);
+    for (uint32_t b = 0; b < FIXTURE_BLOCKS; b++) {
+      if (b % 7 == 0) {
+        append(&text, "usemtl %s\n", fixture_materials[(o + b / 7) % 4]);
+      }
+      for (uint32_t k = 0; k < 4; k++) {
+        append(&text, "v %u.%03u %d.5 -%u.25\n", v % 1000, (v * 37) % 1000,
+               (int)(k % 2) - (int)(b % 3), o);
+        append(&text, "vt 0.%03u %u.%u\n", (v * 13) % 1000, k / 2, b % 10);
+        v += 1;
+      }
+      append(&text, "vn 0 %d 0.%u\n", b % 2 ? 1 : -1, o);
+      append(&text, "f -4/-4/-1 -3/-3/-1 -2/-2/-1 -1/-1/-1\n");
+      if (b % 3 == 0) {
+        append(&text, "f -4//-1 -2//-1 -1//-1\n");
+      }
+      if (b % 5 == 0) {
+        append(&text, "f %u/%u %u/%u %u/%u\n", v - 3, v - 3, v - 2, v - 2, v,
+               v);
+      }
+      if (v > FIXTURE_REACH && b % 4 == 1) {
+        append(&text, "f -%u/-%u -3/-3 %u/%u\n", FIXTURE_REACH,
+               FIXTURE_REACH, v, v);
+      }
+    }
+  }
+  return text;
+}
+
+static void read_fixture(void *ctx, const char *filename, int is_mtl,
+                         const char *obj_filename, char **buf, size_t *len) {
+  const Text *obj = ctx;
+  if (is_mtl) {
+    *buf = (char *)fixture_mtl;
+    *len = sizeof(fixture_mtl) - 1;
+  } else {
+    *buf = obj->data;
+    *len = obj->len;
+  }
+}
+
+typedef struct {
+  tinyobj_attrib_t attrib;
+  tinyobj_shape_t *shapes;
+  size_t num_shapes;
+  tinyobj_material_t *materials;
+  size_t num_materials;
+} ParsedObj;
+
+static int parse_fixture(Text *obj, unsigned int flags, unsigned int threads,
+                         ParsedObj *parsed) {
+  memset(parsed, 0, sizeof(ParsedObj));
+  return tinyobj_parse_obj_mt(&parsed->attrib, &parsed->shapes,
+                              &parsed->num_shapes, &parsed->materials,
+                              &parsed->num_materials, FIXTURE_OBJ,
+                              read_fixture, obj, flags, threads) ==
+         TINYOBJ_SUCCESS;
+}
+
+static void free_parsed(ParsedObj *parsed) {
+  tinyobj_attrib_free(&parsed->attrib);
+  tinyobj_shapes_free(parsed->shapes, parsed->num_shapes);
+  tinyobj_materials_free(parsed->materials, parsed->num_materials);
+}
+
+// checks that two arrays of count elements match byte for byte, naming
+// the first element that doesn't
+static void check_array(const char *label, const char *field, const void *a,
+                        const void *b, size_t count, size_t size) {
+  for (size_t i = 0; i < count; i++) {
+    if (memcmp((const char *)a + i * size, (const char *)b + i * size,
+               size) != 0) {
+      CHECK(0, "%s: %s[%zu] differs\n", label, field, i);
+      return;
+    }
+  }
+}
+
+static void check_same(const char *label, const ParsedObj *got,
+                       const ParsedObj *want) {
+  const tinyobj_attrib_t *a = &got->attrib;
+  const tinyobj_attrib_t *b = &want->attrib;
+  CHECK(a->num_vertices == b->num_vertices &&
+            a->num_normals == b->num_normals &&
+            a->num_texcoords == b->num_texcoords &&
+            a->num_faces == b->num_faces &&
+            a->num_face_num_verts == b->num_face_num_verts,
+        "%s: counts differ\n", label);
+  if (a->num_vertices != b->num_vertices || a->num_normals != b->num_normals ||
+      a->num_texcoords != b->num_texcoords || a->num_faces != b->num_faces ||
+      a->num_face_num_verts != b->num_face_num_verts) {
+    return;
+  }
+  check_array(label, "vertices", a->vertices, b->vertices,
+              a->num_vertices * 3, sizeof(float));
+  check_array(label, "normals", a->normals, b->normals, a->num_normals * 3,
+              sizeof(float));
+  check_array(label, "texcoords", a->texcoords, b->texcoords,
+              a->num_texcoords * 2, sizeof(float));
+  check_array(label, "faces", a->faces, b->faces, a->num_faces,
+              sizeof(tinyobj_vertex_index_t));
+  check_array(label, "face_num_verts", a->face_num_verts, b->face_num_verts,
+              a->num_face_num_verts, sizeof(int));
+  check_array(label, "material_ids", a->material_ids, b->material_ids,
+              a->num_face_num_verts, sizeof(int));
+
+  CHECK(got->num_shapes == want->num_shapes, "%s: %zu shapes, not %zu\n",
+        label, got->num_shapes, want->num_shapes);
+  for (size_t i = 0; i < got->num_shapes && i < want->num_shapes; i++) {
+    const tinyobj_shape_t *x = &got->shapes[i];
+    const tinyobj_shape_t *y = &want->shapes[i];
+    CHECK((x->name && y->name ? strcmp(x->name, y->name) == 0
+                              : x->name == y->name) &&
+              x->face_offset == y->face_offset && x->length == y->length,
+          "%s: shape %zu differs\n", label, i);
+  }
+
+  CHECK(got->num_materials == want->num_materials,
+        "%s: %zu materials, not %zu\n", label, got->num_materials,
+        want->num_materials);
+  for (size_t i = 0; i < got->num_materials && i < want->num_materials; i++) {
+    CHECK(strcmp(got->materials[i].name, want->materials[i].name) == 0,
+          "%s: material %zu is %s, not %s\n", label, i,
+          got->materials[i].name, want->materials[i].name);
+  }
+}
+
+// the serial parse has to hold what the fixture was built from before the
+// threaded ones are compared with it
+static void check_serial(const ParsedObj *serial) {
+  CHECK(serial->attrib.num_vertices == FIXTURE_OBJECTS * FIXTURE_BLOCKS * 4,
+        "serial: %u vertices\n", serial->attrib.num_vertices);
+  CHECK(serial->num_shapes == FIXTURE_OBJECTS, "serial: %zu shapes\n",
+        serial->num_shapes);
+  CHECK(serial->num_materials == 3, "serial: %zu materials\n",
+        serial->num_materials);
+
+  int used[4] = {0};
+  const tinyobj_attrib_t *attrib = &serial->attrib;
+  for (uint32_t i = 0; i < attrib->num_face_num_verts; i++) {
+    int id = attrib->material_ids[i];
+    used[id >= 0 && id < 3 ? id : 3] = 1;
+  }
+  CHECK(used[0] && used[1] && used[2] && used[3],
+        "serial: not every material, and no material, is used\n");
+
+  // relative indices resolve to the vertices just before their line
+  int in_range = 1;
+  for (uint32_t i = 0; i < attrib->num_faces; i++) {
+    const tinyobj_vertex_index_t *index = &attrib->faces[i];
+    in_range &= index->v_idx >= 0 &&
+                (unsigned int)index->v_idx < attrib->num_vertices;
+  }
+  CHECK(in_range, "serial: a face index is out of range\n");
+}
+
+int main() {
+  Text obj = build_fixture();
+  CHECK(obj.lines >= MAX_TEST_THREADS * TINYOBJ_MIN_LINES_PER_THREAD,
+        "the fixture's %zu lines don't give 32 threads a chunk each\n",
+        obj.lines);
+
+  static const unsigned int flag_sets[] = {0, TINYOBJ_FLAG_TRIANGULATE};
+  for (int f = 0; f < 2; f++) {
+    ParsedObj serial;
+    if (!parse_fixture(&obj, flag_sets[f], 1, &serial)) {
+      CHECK(0, "the serial parse failed\n");
+      continue;
+    }
+    if (flag_sets[f] & TINYOBJ_FLAG_TRIANGULATE) {
+      check_serial(&serial);
+    }
+
+    for (unsigned int threads = 1; threads <= MAX_TEST_THREADS; threads++) {
+      char label[64];
+      snprintf(label, sizeof(label), "%u threads%s", threads,
+               flag_sets[f] ? ", triangulated" : "");
+      ParsedObj parsed;
+      if (!parse_fixture(&obj, flag_sets[f] | TINYOBJ_FLAG_PARALLEL, threads,
+                         &parsed)) {
+        CHECK(0, "%s: the parse failed\n", label);
+        continue;
+      }
+      check_same(label, &parsed, &serial);
+      free_parsed(&parsed);
+    }
+    free_parsed(&serial);
+  }
+
+  free(obj.data);
+  return report_checks();
+}
@@ -0,0 +1,91 @@
+// Measures how generate_tangent_space() scales from 10k to 10M triangles.
+// Every step of it is linear in the mesh, hashing each vertex once for the
+// weld included, so the cost per triangle should stay flat.
+//
+//   ./build.sh tangent_space_bench --run
+
+#define main tutorial_main
+#include "tutorial.c"
+#undef main
+
+#define RUNS 3
+// quads along the side of a texture tile, vertices on a tile's border are
+// split from the next tile's by their texture coordinates
+#define TILE_QUADS 16
+
+// a height field of tiles x tiles texture tiles, so the weld has seams to
+// join like in a scanned mesh
+static void build_tiles(uint32_t tiles) {
+  uint32_t side = TILE_QUADS + 1;
+  free_mesh();
+  reserve_array((void **)&vertices, &vertices_cap, tiles * tiles * side * side,
+                sizeof(Vertex));
+  reserve_array((void **)&indices, &indices_cap,
+                tiles * tiles * TILE_QUADS * TILE_QUADS * 6, sizeof(uint32_t));
+  vertices_len = 0;
+  indices_len = 0;
+  float scale = 1.0f / (tiles * TILE_QUADS);
+  for (uint32_t ty = 0; ty < tiles; ty++) {
+    for (uint32_t tx = 0; tx < tiles; tx++) {
+      uint32_t first = vertices_len;
+      for (uint32_t y = 0; y < side; y++) {
+        for (uint32_t x = 0; x < side; x++) {
+          float px = (tx * TILE_QUADS + x) * scale;
+          float py = (ty * TILE_QUADS + y) * scale;
+          vertices[vertices_len] = (Vertex){
+              .pos = {px, py, sinf(px * 7.0f) * cosf(py * 5.0f)},
+              .color = {1.0f, 1.0f, 1.0f},
+              .tex_coord = {(float)x / TILE_QUADS, (float)y / TILE_QUADS},
+          };
+          vertices_len++;
+        }
+      }
+      for (uint32_t y = 0; y < TILE_QUADS; y++) {
+        for (uint32_t x = 0; x < TILE_QUADS; x++) {
+          uint32_t a = first + y * side + x;
+          uint32_t quad[6] = {a, a + 1, a + side + 1, a, a + side + 1,
+                              a + side};
+          memcpy(&indices[indices_len], quad, sizeof(quad));
+          indices_len += 6;
+        }
+      }
+    }
+  }
+}
+
+static double tangent_space_ms() {
+  double best = 0.0;
+  for (int run = 0; run < RUNS; run++) {
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    generate_tangent_space();
+    double ms = elapsed_ms(&start);
+    if (run == 0 || ms < best) {
+      best = ms;
+    }
+  }
+  return best;
+}
+
+// generate_tangent_space() prints a line of its own for every run, each
+// row follows the lines of its runs
+int main() {
+  static const uint32_t sizes[] = {10000, 100000, 1000000, 10000000};
+
+  printf("%12s %12s %8s %12s %16s\n", "triangles", "vertices", "threads",
+         "ms", "ns/triangle");
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    uint32_t tiles = 1;
+    while (tiles * tiles * TILE_QUADS * TILE_QUADS * 2 < sizes[i]) {
+      tiles++;
+    }
+    build_tiles(tiles);
+    double ms = tangent_space_ms();
+    uint32_t triangles_len = indices_len / 3;
+    printf("%12u %12u %8u %12.2f %16.1f\n", triangles_len, vertices_len,
+           worker_threads_count(), ms, ms * 1e6 / triangles_len);
+  }
+
+  free_mesh();
+  return 0;
+}
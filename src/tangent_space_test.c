@@ -0,0 +1,159 @@
+// Checks generate_tangent_space() on meshes whose normals and tangents are
+// known: a UV-mapped plane, again with its texture mirrored, and a cube
+// with a vertex per face corner. The cube is split along the diagonals
+// through its even corners, so every corner gets the same share of its
+// three faces and the welded normal points straight out of the corner,
+// and each face's tangent is its u axis projected off that normal. Build
+// with NO_SIMD defined to check the scalar loops too. Exits non-zero on a
+// failure.
+//
+//   ./build.sh tangent_space_test --run
+//   CFLAGS=-DNO_SIMD ./build.sh tangent_space_test --run
+
+#define main tutorial_main
+#include "tutorial.c"
+#undef main
+
+#include "check.h"
+
+#define PLANE_SIZE 8
+#define TOLERANCE 1e-4f
+
+static void set_mesh(uint32_t new_vertices_len, uint32_t new_indices_len) {
+  free_mesh();
+  reserve_array((void **)&vertices, &vertices_cap, new_vertices_len,
+                sizeof(Vertex));
+  reserve_array((void **)&indices, &indices_cap, new_indices_len,
+                sizeof(uint32_t));
+  vertices_len = new_vertices_len;
+  indices_len = new_indices_len;
+}
+
+static int near(const float *a, const float *b, int len) {
+  for (int i = 0; i < len; i++) {
+    if (fabsf(a[i] - b[i]) > TOLERANCE) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// a PLANE_SIZE x PLANE_SIZE grid of quads at z = 0 facing +z, u running
+// along +x, or along -x when mirrored
+static void check_plane(int mirrored) {
+  uint32_t side = PLANE_SIZE + 1;
+  set_mesh(side * side, PLANE_SIZE * PLANE_SIZE * 6);
+  for (uint32_t y = 0; y < side; y++) {
+    for (uint32_t x = 0; x < side; x++) {
+      float u = (float)x / PLANE_SIZE;
+      float v = (float)y / PLANE_SIZE;
+      vertices[y * side + x] = (Vertex){
+          .pos = {(float)x, (float)y, 0.0f},
+          .color = {1.0f, 1.0f, 1.0f},
+          .tex_coord = {mirrored ? 1.0f - u : u, v},
+      };
+    }
+  }
+  uint32_t len = 0;
+  for (uint32_t y = 0; y < PLANE_SIZE; y++) {
+    for (uint32_t x = 0; x < PLANE_SIZE; x++) {
+      uint32_t a = y * side + x;
+      uint32_t quad[6] = {a, a + 1, a + side + 1, a, a + side + 1, a + side};
+      memcpy(&indices[len], quad, sizeof(quad));
+      len += 6;
+    }
+  }
+
+  generate_tangent_space();
+
+  vec3 normal = {0.0f, 0.0f, 1.0f};
+  // cross(normal, tangent) * w has to be +y, where v grows
+  vec4 tangent = {mirrored ? -1.0f : 1.0f, 0.0f, 0.0f,
+                  mirrored ? -1.0f : 1.0f};
+  const char *name = mirrored ? "mirrored plane" : "plane";
+  for (uint32_t v = 0; v < vertices_len; v++) {
+    CHECK(near(vertex_normals[v], normal, 3),
+          "%s: vertex %u has normal %.4f %.4f %.4f\n", name, v,
+          vertex_normals[v][0], vertex_normals[v][1], vertex_normals[v][2]);
+    CHECK(near(vertex_tangents[v], tangent, 4),
+          "%s: vertex %u has tangent %.4f %.4f %.4f %.0f\n", name, v,
+          vertex_tangents[v][0], vertex_tangents[v][1],
+          vertex_tangents[v][2], vertex_tangents[v][3]);
+  }
+}
+
+// the faces of the cube from -1 to 1 as their outward normal and u and v
+// axes, cross(u, v) = normal
+static const float cube_faces[6][3][3] = {
+    {{1, 0, 0}, {0, 1, 0}, {0, 0, 1}},  {{-1, 0, 0}, {0, 0, 1}, {0, 1, 0}},
+    {{0, 1, 0}, {0, 0, 1}, {1, 0, 0}},  {{0, -1, 0}, {1, 0, 0}, {0, 0, 1}},
+    {{0, 0, 1}, {1, 0, 0}, {0, 1, 0}},  {{0, 0, -1}, {0, 1, 0}, {1, 0, 0}},
+};
+
+static int is_even_corner(const float *pos) {
+  int positive = (pos[0] > 0.0f) + (pos[1] > 0.0f) + (pos[2] > 0.0f);
+  return positive % 2 == 0;
+}
+
+static void check_cube() {
+  set_mesh(6 * 4, 6 * 6);
+  for (uint32_t face = 0; face < 6; face++) {
+    const float *n = cube_faces[face][0];
+    const float *u = cube_faces[face][1];
+    const float *v = cube_faces[face][2];
+    // corners 0 to 3 are at uv 00, 10, 11, 01
+    static const float corner_uvs[4][2] = {{0, 0}, {1, 0}, {1, 1}, {0, 1}};
+    for (int c = 0; c < 4; c++) {
+      float cu = corner_uvs[c][0];
+      float cv = corner_uvs[c][1];
+      Vertex *vertex = &vertices[face * 4 + c];
+      for (int j = 0; j < 3; j++) {
+        vertex->pos[j] = n[j] + (2.0f * cu - 1.0f) * u[j] +
+                         (2.0f * cv - 1.0f) * v[j];
+        vertex->color[j] = 1.0f;
+      }
+      vertex->tex_coord[0] = cu;
+      vertex->tex_coord[1] = cv;
+    }
+    uint32_t a = face * 4;
+    uint32_t through_first[6] = {a, a + 1, a + 2, a, a + 2, a + 3};
+    uint32_t through_second[6] = {a, a + 1, a + 3, a + 1, a + 2, a + 3};
+    memcpy(&indices[face * 6],
+           is_even_corner(vertices[a].pos) ? through_first : through_second,
+           sizeof(through_first));
+  }
+
+  generate_tangent_space();
+
+  for (uint32_t i = 0; i < vertices_len; i++) {
+    const float *u = cube_faces[i / 4][1];
+    vec3 normal;
+    glm_vec3_normalize_to(vertices[i].pos, normal);
+    vec4 tangent;
+    float d = glm_vec3_dot((float *)u, normal);
+    for (int j = 0; j < 3; j++) {
+      tangent[j] = u[j] - d * normal[j];
+    }
+    glm_vec3_normalize(tangent);
+    tangent[3] = 1.0f;
+    CHECK(near(vertex_normals[i], normal, 3),
+          "cube: vertex %u has normal %.4f %.4f %.4f, not %.4f %.4f %.4f\n", i,
+          vertex_normals[i][0], vertex_normals[i][1], vertex_normals[i][2],
+          normal[0], normal[1], normal[2]);
+    CHECK(near(vertex_tangents[i], tangent, 4),
+          "cube: vertex %u has tangent %.4f %.4f %.4f %.0f, not %.4f %.4f "
+          "%.4f %.0f\n",
+          i, vertex_tangents[i][0], vertex_tangents[i][1],
+          vertex_tangents[i][2], vertex_tangents[i][3], tangent[0],
+          tangent[1], tangent[2], tangent[3]);
+  }
+}
+
+int main() {
+  check_plane(0);
+  check_plane(1);
+  check_cube();
+  free_mesh();
+
+  return report_checks();
+}
@@ -1,19 +1,44 @@
 #include "vulkan/vulkan_core.h"
 #include <GLFW/glfw3.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 #include <vulkan/vulkan.h>
 
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 #define TINYOBJ_LOADER_C_IMPLEMENTATION
 #include "tinyobj_loader_c.h"
 
+// the mesh codec decodes with SSE2 where it can, define NO_SIMD to always
+// use its scalar loops
+#if !defined(NO_SIMD) && (defined(__SSE2__) || defined(_M_X64))
+#include <emmintrin.h>
+#define HAS_SSE2 1
+// the CPU mip builder also has AVX2 loops, picked at runtime from CPUID
+// like tinyobj's line scanner
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAS_AVX2 1
+#endif
+#endif
+
 #define GLM_FORCE_RADIANS
 #define GLM_FORCE_DEPTH_ZERO_TO_ONE
 #define GLM_FORCE_DEFAULT_ALIGNED_GENTYPES
@@ -30,14 +55,93 @@
 #define DEVICE_EXTENSIONS_COUNT 2
 #define QUEUE_COUNT 2
 #define MAX_SWAP_CHAIN_IMAGES_COUNT 16
-#define MAX_SHADER_CODE 4096
 #define MAX_FRAMES_IN_FLIGHT 2
-#define ATTRIBUTE_DESCRIPTIONS_LEN 3
+#define ATTRIBUTE_DESCRIPTIONS_LEN 2
 #define MODEL_PATH "models/viking_room.obj"
+#define MESH_CACHE_PATH "models/viking_room.vmesh"
+#define MESH_CACHE_MAGIC 0x48534d56 // "VMSH"
+#define MESH_CACHE_VERSION 11
+#define MESH_CACHE_MAX_ARRAYS 10
+#define MESH_CACHE_ALIGNMENT 16
+#define VERTEX_CODEC_GROUP 16
+#define INDEX_CODEC_FIFO_SIZE 16
+#define INDEX_CODEC_PADDING 17 // the longest coding of a triangle
+#define MODEL_STREAM_THRESHOLD (64 << 20)
+#define FILE_READ_CHUNK_SIZE (1 << 20)
 #define TEXTURE_PATH "textures/viking_room.png"
-#define MAX_VERTEX_LEN 16384
-#define MAX_VERTEX_INDICES_LEN 16384
-#define MAX_MODEL_LEN 524288
+#define MAX_MIP_LEVELS 32
+#define CPU_MIPMAPS 0
+// build with -DCOMPARE_MIPMAPS=1 to build every compute mip chain with
+// blits as well and print how far apart their levels are, on lavapipe for
+// instance
+#ifndef COMPARE_MIPMAPS
+#define COMPARE_MIPMAPS 0
+#endif
+// the compute downsampler is opt-in with -DCOMPUTE_MIPMAPS=1 until a
+// COMPARE_MIPMAPS run, which turns it on as well, has matched the blits
+#ifndef COMPUTE_MIPMAPS
+#define COMPUTE_MIPMAPS COMPARE_MIPMAPS
+#endif
+// the levels the compute downsampler reaches, see shaders/downsample.comp
+#define COMPUTE_MIP_LEVELS 12
+#define COMPUTE_MIP_MAX_SIZE 4096
+#define COMPUTE_MIP_TILE_SIZE 64
+// the largest difference in sRGB bytes that counts as a match
+#define COMPARE_MIPMAPS_TOLERANCE 2
+#define MIP_KAISER_FILTER 1
+#define MIP_KAISER_ALPHA 4.0
+#define MIP_MIN_RANGE_TEXELS 65536
+#define COMPRESS_TEXTURES 1
+#define PREFER_BC7 1
+#define BLOCK_ENCODE_MIN_RANGE 256
+#define TEXTURE_CACHE_DIR "textures/cache"
+#define TEXTURE_CACHE_MAGIC 0x58455456 // "VTEX"
+#define TEXTURE_CACHE_VERSION 2
+#define TEXTURE_DECODE_THREADS 8
+#define TEXTURE_QUEUE_DEPTH 16
+#define VERT_SHADER_PATH "shaders/vert.spv"
+#define FRAG_SHADER_PATH "shaders/frag.spv"
+#define MIP_SHADER_PATH "shaders/downsample.spv"
+#define SPIRV_MAGIC 0x07230203
+#define ASSET_POLL_INTERVAL_MS 250
+#define MATERIAL_PATH_MAX 256
+#define MIN_ARRAY_CAPACITY 64
+#define OPTIMIZE_MESH 1
+#define SIMULATED_VERTEX_CACHE_SIZE 16
+#define OVERDRAW_THRESHOLD 1.05f
+#define OVERDRAW_GRID_SIZE 256
+// build with -DMEASURE_OVERDRAW=1 to have print_mesh_stats() rasterize the
+// mesh from 6 views for its overdraw, which takes longer than the rest of
+// an uncached load
+#ifndef MEASURE_OVERDRAW
+#define MEASURE_OVERDRAW 0
+#endif
+#define FETCH_CACHE_LINE_SIZE 64
+#define FETCH_CACHE_LINES 256
+// build with -DGENERATE_TANGENT_SPACE=1 to have the loader generate per
+// vertex normals and tangents and store them in the mesh cache. The vertex
+// format has no room for them yet, so they cost 28 bytes a vertex in every
+// .vmesh for nothing and are off by default.
+#ifndef GENERATE_TANGENT_SPACE
+#define GENERATE_TANGENT_SPACE 0
+#endif
+#define TANGENT_SPACE_MIN_RANGE 4096
+#define WELD_PARTITIONS_PER_THREAD 4
+#define MAX_WORKER_THREADS 64
+#define BUILD_MESHLETS 1
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+#define MESHLET_SEARCH_WINDOW 256
+#define MESHLET_CONE_WEIGHT 0.5f
+#define BUILD_LODS 1
+#define LOD_MAX_LEVELS 4
+#define LOD_MIN_REDUCTION 0.9f
+#define LOD_BORDER_WEIGHT 2.0f
+#define LOD_PASS_COST_SLACK 1.5f
+#define LOD_PIXEL_ERROR 1.0f
+#define CAMERA_FOV_DEGREES 45.0f
+#define CAMERA_NEAR 0.1f
+#define CAMERA_FAR 10.0f
 
 #define THROW(...)                                                             \
   do {                                                                         \
@@ -67,10 +171,6 @@ VkFormat swap_chain_image_format;
 VkExtent2D swap_chain_extent;
 uint32_t swap_chain_image_views_count = 0;
 VkImageView swap_chain_image_views[MAX_SWAP_CHAIN_IMAGES_COUNT];
-uint32_t vert_code_len = 0;
-char vert_shader_code[MAX_SHADER_CODE];
-uint32_t frag_code_len = 0;
-char frag_shader_code[MAX_SHADER_CODE];
 VkRenderPass render_pass;
 VkPipelineLayout pipeline_layout;
 VkPipeline graphics_pipeline;
@@ -82,9 +182,16 @@ VkSemaphore image_available_semaphores[MAX_FRAMES_IN_FLIGHT];
 VkSemaphore render_finished_semaphores[MAX_FRAMES_IN_FLIGHT];
 VkFence in_flight_fences[MAX_FRAMES_IN_FLIGHT];
 uint32_t current_frame = 0;
+// how many frames draw_frame() has submitted
+uint64_t frame_number = 0;
+// the uploads of an asset reload while reload_assets() records them,
+// VK_NULL_HANDLE otherwise
+VkCommandBuffer reload_commands = VK_NULL_HANDLE;
 int framebuffer_resized = 0;
 VkBuffer index_buffer;
 VkDeviceMemory index_buffer_memory;
+VkIndexType index_type = VK_INDEX_TYPE_UINT32;
+int index_type_uint8_supported = 0;
 VkDescriptorSetLayout descriptor_set_layout;
 uint32_t uniform_buffers_len;
 VkBuffer uniform_buffers[32];
@@ -93,17 +200,32 @@ VkDeviceMemory uniform_buffers_memory[32];
 uint32_t uniform_buffers_mapped_len;
 void *uniform_buffers_mapped[32];
 VkDescriptorPool descriptor_pool;
-VkDescriptorSet descriptor_sets[MAX_FRAMES_IN_FLIGHT];
-uint32_t mip_levels;
-VkImage texture_image;
-VkDeviceMemory texture_image_memory;
-VkImageView texture_image_view;
+// one set per frame and material, the uniform buffer is the same in all
+// the sets of a frame
+VkDescriptorSet *descriptor_sets[MAX_FRAMES_IN_FLIGHT];
+uint32_t descriptor_sets_cap[MAX_FRAMES_IN_FLIGHT];
+typedef struct {
+  VkImage image;
+  VkDeviceMemory memory;
+  VkImageView view;
+  VkFormat format;
+  uint32_t mip_levels;
+} Texture;
+// the texture of each of mesh_materials[], zeroed past the last of them
+Texture *textures;
+uint32_t textures_cap;
+// shaders/downsample.comp, mip_pipeline is VK_NULL_HANDLE when textures
+// can't be downsampled with it
+VkDescriptorSetLayout mip_descriptor_set_layout;
+VkPipelineLayout mip_pipeline_layout;
+VkPipeline mip_pipeline;
+// how many workgroups of a dispatch have finished, the last resets it
+VkBuffer mip_counter_buffer;
+VkDeviceMemory mip_counter_buffer_memory;
 VkSampler texture_sampler;
 VkImage depth_image;
 VkDeviceMemory depth_image_memory;
 VkImageView depth_image_view;
-char model_object_buffer[MAX_MODEL_LEN];
-char model_material_buffer[MAX_MODEL_LEN];
 VkSampleCountFlagBits msaa_samples = VK_SAMPLE_COUNT_1_BIT;
 VkImage color_image;
 VkDeviceMemory color_image_memory;
@@ -111,1761 +233,9416 @@ VkImageView color_image_view;
 
 static struct timespec start_timer;
 
+double elapsed_ms(struct timespec *since) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (double)(now.tv_sec - since->tv_sec) * 1000.0 +
+         (double)(now.tv_nsec - since->tv_nsec) / 1000000.0;
+}
+
 typedef struct {
   mat4 model;
   mat4 view;
   mat4 proj;
+  // undo the PackedVertex quantization: value * scale + offset, the texture
+  // coordinate transform holds the offset in xy and the scale in zw
+  vec4 position_offset;
+  vec4 position_scale;
+  vec4 tex_coord_transform;
 } UniformBufferObject;
 
+// full precision vertex the loader and mesh optimizer work on
 typedef struct {
   vec3 pos;
   vec3 color;
   vec2 tex_coord;
 } Vertex;
 
+// what the vertex buffer holds: unorm16 positions relative to the mesh
+// bounds (w is padding, three component 16 bit formats are rarely supported)
+// and unorm16 texture coordinates relative to their own bounds, color is
+// always white so it isn't uploaded
+typedef struct {
+  uint16_t pos[4];
+  uint16_t tex_coord[2];
+} PackedVertex;
+
+static vec4 position_offset;
+static vec4 position_scale;
+static vec4 tex_coord_transform;
+
+// the loader and mesh optimizer's working copy, freed once it is packed
 static uint32_t vertices_len = 0;
-static Vertex vertices[MAX_VERTEX_LEN];
+static uint32_t vertices_cap = 0;
+static Vertex *vertices = NULL;
+
+// vertices[] as the vertex buffer and the mesh cache hold them, with
+// position_offset, position_scale and tex_coord_transform to undo it
+static uint32_t packed_vertices_len = 0;
+static uint32_t packed_vertices_cap = 0;
+static PackedVertex *packed_vertices = NULL;
 
 static uint32_t indices_len = 0;
-static uint32_t indices[MAX_VERTEX_INDICES_LEN];
+static uint32_t indices_cap = 0;
+static uint32_t *indices = NULL;
+
+// per vertex of vertices[], and so of packed_vertices[], see
+// generate_tangent_space(). Tangents are
+// unit xyz with the bitangent's handedness in w. Nothing draws with them
+// yet, they aren't part of PackedVertex.
+static uint32_t vertex_normals_len = 0;
+static uint32_t vertex_normals_cap = 0;
+static vec3 *vertex_normals = NULL;
+
+static uint32_t vertex_tangents_len = 0;
+static uint32_t vertex_tangents_cap = 0;
+static vec4 *vertex_tangents = NULL;
+
+// a cluster of at most MESHLET_MAX_TRIANGLES triangles using at most
+// MESHLET_MAX_VERTICES vertices, drawn from indices[index_offset] onwards.
+// For mesh shading the same triangles are also stored as local indices in
+// meshlet_triangles[triangle_offset] that point into
+// meshlet_vertices[vertex_offset].
+typedef struct {
+  uint32_t index_offset;
+  uint32_t vertex_offset;
+  uint32_t triangle_offset;
+  uint16_t vertex_count;
+  uint16_t triangle_count;
+  // bounding sphere
+  float center[3];
+  float radius;
+  // every triangle faces away from the camera when
+  // dot(normalize(cone_apex - camera), cone_axis) >= cone_cutoff,
+  // a cutoff of 1 means the cone is too wide to ever cull
+  float cone_apex[3];
+  float cone_cutoff;
+  float cone_axis[3];
+  uint32_t padding;
+} Meshlet;
+
+static uint32_t meshlets_len = 0;
+static uint32_t meshlets_cap = 0;
+static Meshlet *meshlets = NULL;
+
+static uint32_t meshlet_vertices_len = 0;
+static uint32_t meshlet_vertices_cap = 0;
+static uint32_t *meshlet_vertices = NULL;
+
+static uint32_t meshlet_triangles_len = 0;
+static uint32_t meshlet_triangles_cap = 0;
+static uint8_t *meshlet_triangles = NULL;
+
+// what a face is drawn with. Materials only differ in their texture, so
+// the model drawn and the mesh cache written next to it, MODEL_PATH unless
+// another model is named on the command line
+const char *model_path = MODEL_PATH;
+char mesh_cache_path[MATERIAL_PATH_MAX] = MESH_CACHE_PATH;
+
+// .mtl materials sharing a texture become one MeshMaterial. An image
+// embedded in a .glb is the texture_size bytes at texture_offset of the
+// file named by texture_path, otherwise texture_size is 0.
+typedef struct {
+  char texture_path[MATERIAL_PATH_MAX];
+  uint64_t texture_offset;
+  uint64_t texture_size;
+} MeshMaterial;
 
-int find_vertex(Vertex *v1) {
-  for (int i = 0; i < vertices_len; i++) {
-    Vertex *v2 = &vertices[i];
+static uint32_t mesh_materials_len = 0;
+static uint32_t mesh_materials_cap = 0;
+static MeshMaterial *mesh_materials = NULL;
 
-    if (glm_vec3_eqv(v1->pos, v2->pos) && glm_vec3_eqv(v1->color, v2->color) &&
-        glm_vec2_eqv(v1->tex_coord, v2->tex_coord)) {
-      return i;
-    }
+// the triangles of one material in one level of detail, drawn from
+// indices[index_offset] with vertex_offset added to every index
+typedef struct {
+  uint32_t index_offset;
+  uint32_t index_count;
+  uint32_t material;
+  int32_t vertex_offset;
+} MeshBatch;
+
+static uint32_t batches_len = 0;
+static uint32_t batches_cap = 0;
+static MeshBatch *batches = NULL;
+
+// one level of detail, drawn as batches[batch_offset] onwards, which are
+// sorted by material. An .obj level holds each material at most once, a
+// .glb one has a batch per primitive. Every level shares the vertex
+// buffer, level 0 is the full mesh and `error` is how far, in model units,
+// a level's surface may stray from it.
+typedef struct {
+  uint32_t batch_offset;
+  uint32_t batch_count;
+  uint32_t index_count;
+  float error;
+} MeshLod;
+
+static uint32_t lods_len = 0;
+static uint32_t lods_cap = 0;
+static MeshLod *lods = NULL;
+
+// how an array is stored in a .vmesh file, see encode_vertices() and
+// encode_indices()
+typedef enum {
+  MESH_CODEC_NONE,
+  MESH_CODEC_VERTICES,
+  MESH_CODEC_INDICES,
+} MeshCodec;
+
+// every array the loaded mesh is made of, in .vmesh file order
+typedef struct {
+  void **data;
+  uint32_t *len;
+  uint32_t *cap;
+  uint32_t elem_size;
+  MeshCodec codec;
+} MeshArray;
+
+static const MeshArray mesh_arrays[] = {
+    {(void **)&packed_vertices, &packed_vertices_len, &packed_vertices_cap,
+     sizeof(PackedVertex), MESH_CODEC_VERTICES},
+    {(void **)&indices, &indices_len, &indices_cap, sizeof(uint32_t),
+     MESH_CODEC_INDICES},
+    {(void **)&meshlets, &meshlets_len, &meshlets_cap, sizeof(Meshlet),
+     MESH_CODEC_NONE},
+    {(void **)&meshlet_vertices, &meshlet_vertices_len, &meshlet_vertices_cap,
+     sizeof(uint32_t), MESH_CODEC_VERTICES},
+    {(void **)&meshlet_triangles, &meshlet_triangles_len,
+     &meshlet_triangles_cap, sizeof(uint8_t), MESH_CODEC_NONE},
+    {(void **)&lods, &lods_len, &lods_cap, sizeof(MeshLod), MESH_CODEC_NONE},
+    {(void **)&batches, &batches_len, &batches_cap, sizeof(MeshBatch),
+     MESH_CODEC_NONE},
+    {(void **)&mesh_materials, &mesh_materials_len, &mesh_materials_cap,
+     sizeof(MeshMaterial), MESH_CODEC_NONE},
+    {(void **)&vertex_normals, &vertex_normals_len, &vertex_normals_cap,
+     sizeof(vec3), MESH_CODEC_VERTICES},
+    {(void **)&vertex_tangents, &vertex_tangents_len, &vertex_tangents_cap,
+     sizeof(vec4), MESH_CODEC_VERTICES},
+};
+#define MESH_ARRAYS_LEN (sizeof(mesh_arrays) / sizeof(mesh_arrays[0]))
+
+static vec3 mesh_bounds_min;
+static vec3 mesh_bounds_max;
+
+#define GLTF_BYTE 5120
+#define GLTF_UNSIGNED_BYTE 5121
+#define GLTF_SHORT 5122
+#define GLTF_UNSIGNED_SHORT 5123
+#define GLTF_UNSIGNED_INT 5125
+#define GLTF_FLOAT 5126
+#define GLTF_TRIANGLES 4
+
+// an accessor of a .glb resolved to the mapped file, element i starts at
+// data + i * stride
+typedef struct {
+  const char *data;
+  uint32_t count;
+  uint32_t stride;
+  uint32_t component_type;
+  uint32_t components;
+  int normalized;
+} GlbAccessor;
+
+// one triangle list of a .glb scene. Its vertices go to the vertex buffer
+// at vertex_offset, unless an earlier primitive already put the same ones
+// there, and its indices, or 0 to index_count - 1 without an index
+// accessor, to the index buffer at index_offset. Vertices stored the way
+// PackedVertex is laid out are copied from the mapped file as they are.
+typedef struct {
+  GlbAccessor position;
+  GlbAccessor tex_coord;
+  GlbAccessor indices;
+  // column major node transform, and the bounds it moves the vertices to
+  float transform[16];
+  vec3 bounds_min;
+  vec3 bounds_max;
+  uint32_t material;
+  uint32_t index_count;
+  uint32_t vertex_offset;
+  uint32_t index_offset;
+  int shares_vertices;
+  int copy_vertices;
+} GlbPrimitive;
+
+// what load_glb() loaded, it leaves vertices[] and indices[] empty
+static uint32_t glb_primitives_len = 0;
+static uint32_t glb_primitives_cap = 0;
+static GlbPrimitive *glb_primitives = NULL;
+static uint32_t glb_vertices_len = 0;
+static uint32_t glb_indices_len = 0;
+
+// grows *data geometrically until it holds at least `needed` elements
+void reserve_array(void **data, uint32_t *cap, uint32_t needed,
+                   size_t elem_size) {
+  if (needed <= *cap) {
+    return;
   }
-  return -1;
+
+  uint32_t new_cap = *cap > MIN_ARRAY_CAPACITY ? *cap : MIN_ARRAY_CAPACITY;
+  while (new_cap < needed) {
+    new_cap = new_cap > UINT32_MAX / 2 ? UINT32_MAX : new_cap * 2;
+  }
+
+  void *new_data = realloc(*data, (size_t)new_cap * elem_size);
+  if (!new_data) {
+    THROW("failed to grow array to %u elements!\n", new_cap);
+  }
+  *data = new_data;
+  *cap = new_cap;
 }
 
-VkBuffer vertex_buffer;
-VkDeviceMemory vertex_buffer_memory;
+// reserve_array() that zeroes the elements it adds
+void reserve_zeroed_array(void **data, uint32_t *cap, uint32_t needed,
+                          size_t elem_size) {
+  uint32_t old_cap = *cap;
+  reserve_array(data, cap, needed, elem_size);
+  memset((char *)*data + (size_t)old_cap * elem_size, 0,
+         (size_t)(*cap - old_cap) * elem_size);
+}
 
-void create_color_resources();
-void create_depth_resources();
+// trims *data to exactly `len` elements
+void shrink_array(void **data, uint32_t *cap, uint32_t len, size_t elem_size) {
+  if (len == *cap || len == 0) {
+    return;
+  }
 
-VkSampleCountFlagBits get_max_usable_sample_count() {
-  VkPhysicalDeviceProperties physical_device_properties;
-  vkGetPhysicalDeviceProperties(physical_device, &physical_device_properties);
+  void *new_data = realloc(*data, (size_t)len * elem_size);
+  if (new_data) {
+    *data = new_data;
+    *cap = len;
+  }
+}
 
-  VkSampleCountFlags counts =
-      physical_device_properties.limits.framebufferColorSampleCounts &
-      physical_device_properties.limits.framebufferDepthSampleCounts;
+void free_vertices() {
+  free(vertices);
+  vertices = NULL;
+  vertices_len = 0;
+  vertices_cap = 0;
+}
 
-  if (counts & VK_SAMPLE_COUNT_64_BIT) {
-    return VK_SAMPLE_COUNT_64_BIT;
+// a zero capacity means the array points into a mapped mesh cache
+void free_mesh() {
+  for (int i = 0; i < MESH_ARRAYS_LEN; i++) {
+    if (*mesh_arrays[i].cap > 0) {
+      free(*mesh_arrays[i].data);
+    }
+    *mesh_arrays[i].data = NULL;
+    *mesh_arrays[i].len = 0;
+    *mesh_arrays[i].cap = 0;
   }
-  if (counts & VK_SAMPLE_COUNT_32_BIT) {
-    return VK_SAMPLE_COUNT_32_BIT;
+  free_vertices();
+}
+
+// online cores, capped at MAX_WORKER_THREADS
+uint32_t worker_threads_count() {
+  long n = sysconf(_SC_NPROCESSORS_ONLN);
+  if (n < 1) {
+    return 1;
   }
-  if (counts & VK_SAMPLE_COUNT_16_BIT) {
-    return VK_SAMPLE_COUNT_16_BIT;
+  return n < MAX_WORKER_THREADS ? (uint32_t)n : MAX_WORKER_THREADS;
+}
+
+typedef void (*RangeFn)(void *ctx, uint32_t begin, uint32_t end);
+
+typedef struct {
+  RangeFn fn;
+  void *ctx;
+  uint32_t begin;
+  uint32_t end;
+} RangeTask;
+
+static void *run_range_task(void *arg) {
+  RangeTask *task = arg;
+  task->fn(task->ctx, task->begin, task->end);
+  return NULL;
+}
+
+// how many cores parallel_for() may use on this thread, 0 for all of
+// them. Threads that already run beside each other, like the texture
+// decoders, split the cores rather than each starting one thread per core.
+static _Thread_local uint32_t parallel_for_cores = 0;
+
+// calls fn() on consecutive ranges covering [0, count), one per core but
+// none shorter than min_range, and returns once all of them are done. The
+// first range runs on the calling thread, as does any whose thread can't
+// be started.
+void parallel_for(uint32_t count, uint32_t min_range, RangeFn fn,
+                  void *ctx) {
+  uint32_t tasks_len = worker_threads_count();
+  if (parallel_for_cores > 0 && parallel_for_cores < tasks_len) {
+    tasks_len = parallel_for_cores;
   }
-  if (counts & VK_SAMPLE_COUNT_8_BIT) {
-    return VK_SAMPLE_COUNT_8_BIT;
+  uint32_t max_tasks = count / (min_range > 0 ? min_range : 1);
+  tasks_len = tasks_len < max_tasks ? tasks_len : max_tasks;
+  if (tasks_len <= 1) {
+    fn(ctx, 0, count);
+    return;
   }
-  if (counts & VK_SAMPLE_COUNT_4_BIT) {
-    return VK_SAMPLE_COUNT_4_BIT;
+
+  RangeTask tasks[MAX_WORKER_THREADS];
+  pthread_t threads[MAX_WORKER_THREADS];
+  int started[MAX_WORKER_THREADS];
+  for (uint32_t i = 0; i < tasks_len; i++) {
+    tasks[i].fn = fn;
+    tasks[i].ctx = ctx;
+    tasks[i].begin = (uint32_t)((uint64_t)count * i / tasks_len);
+    tasks[i].end = (uint32_t)((uint64_t)count * (i + 1) / tasks_len);
   }
-  if (counts & VK_SAMPLE_COUNT_2_BIT) {
-    return VK_SAMPLE_COUNT_2_BIT;
+  for (uint32_t i = 1; i < tasks_len; i++) {
+    started[i] =
+        pthread_create(&threads[i], NULL, run_range_task, &tasks[i]) == 0;
+    if (!started[i]) {
+      run_range_task(&tasks[i]);
+    }
+  }
+  run_range_task(&tasks[0]);
+  for (uint32_t i = 1; i < tasks_len; i++) {
+    if (started[i]) {
+      pthread_join(threads[i], NULL);
+    }
   }
+}
 
-  return VK_SAMPLE_COUNT_1_BIT;
+// open addressing map from vertex bit pattern to its index in vertices[],
+// slots hold index + 1 so that zero marks an empty slot
+typedef struct {
+  uint32_t *slots;
+  uint32_t capacity;
+} VertexMap;
+
+// largest power of two slot count a uint32_t holds
+#define VERTEX_MAP_MAX_CAPACITY (UINT32_C(1) << 31)
+
+static uint32_t hash_vertex(const Vertex *vertex) {
+  uint32_t words[sizeof(Vertex) / sizeof(uint32_t)];
+  memcpy(words, vertex, sizeof(Vertex));
+
+  uint32_t h = 0x811c9dc5;
+  for (int i = 0; i < sizeof(Vertex) / sizeof(uint32_t); i++) {
+    h ^= words[i];
+    h *= 0x01000193;
+    h ^= h >> 15;
+  }
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  return h;
 }
 
-static VkVertexInputBindingDescription get_binding_description() {
-  VkVertexInputBindingDescription binding_description = {0};
-  binding_description.binding = 0;
-  binding_description.stride = sizeof(Vertex);
-  binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-  return binding_description;
+void vertex_map_init(VertexMap *map, uint32_t expected_len) {
+  // keep the load factor at or below one half, in 64 bits so a huge
+  // expected_len can't wrap, the map still grows past the hint if needed
+  map->capacity = 16;
+  while (map->capacity < VERTEX_MAP_MAX_CAPACITY &&
+         map->capacity < (uint64_t)expected_len * 2) {
+    map->capacity *= 2;
+  }
+  map->slots = calloc(map->capacity, sizeof(uint32_t));
+  if (!map->slots) {
+    THROW("failed to allocate vertex map!\n");
+  }
 }
 
-static void
-get_attribute_descriptions(VkVertexInputAttributeDescription
-                               descriptions[ATTRIBUTE_DESCRIPTIONS_LEN]) {
-  descriptions[0].binding = 0;
-  descriptions[0].location = 0;
-  descriptions[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-  descriptions[0].offset = offsetof(Vertex, pos);
+// doubles the slot count and reinserts every vertex, since slots only hold
+// indices the vertices themselves stay where they are
+static void vertex_map_grow(VertexMap *map) {
+  if (map->capacity >= VERTEX_MAP_MAX_CAPACITY) {
+    THROW("too many vertices for the vertex map!\n");
+  }
+  free(map->slots);
+  map->capacity *= 2;
+  map->slots = calloc(map->capacity, sizeof(uint32_t));
+  if (!map->slots) {
+    THROW("failed to allocate vertex map!\n");
+  }
 
-  descriptions[1].binding = 0;
-  descriptions[1].location = 1;
-  descriptions[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-  descriptions[1].offset = offsetof(Vertex, color);
+  uint32_t mask = map->capacity - 1;
+  for (uint32_t i = 0; i < vertices_len; i++) {
+    uint32_t slot = hash_vertex(&vertices[i]) & mask;
+    while (map->slots[slot] != 0) {
+      slot = (slot + 1) & mask;
+    }
+    map->slots[slot] = i + 1;
+  }
+}
 
-  descriptions[2].binding = 0;
-  descriptions[2].location = 2;
-  descriptions[2].format = VK_FORMAT_R32G32_SFLOAT;
-  descriptions[2].offset = offsetof(Vertex, tex_coord);
+void vertex_map_free(VertexMap *map) {
+  free(map->slots);
+  map->slots = NULL;
+  map->capacity = 0;
+}
 
-  return;
+// returns the index of an equal vertex in vertices[], or appends the vertex
+uint32_t vertex_map_insert(VertexMap *map, Vertex *vertex) {
+  uint32_t mask = map->capacity - 1;
+  uint32_t slot = hash_vertex(vertex) & mask;
+
+  while (map->slots[slot] != 0) {
+    uint32_t index = map->slots[slot] - 1;
+    if (memcmp(&vertices[index], vertex, sizeof(Vertex)) == 0) {
+      return index;
+    }
+    slot = (slot + 1) & mask;
+  }
+
+  uint32_t index = vertices_len;
+  reserve_array((void **)&vertices, &vertices_cap, vertices_len + 1,
+                sizeof(Vertex));
+  vertices[vertices_len] = *vertex;
+  vertices_len += 1;
+  map->slots[slot] = index + 1;
+  if ((uint64_t)vertices_len * 2 > map->capacity) {
+    vertex_map_grow(map);
+  }
+  return index;
 }
 
+// fraction of vertex shader invocations a FIFO post-transform cache of
+// `cache_size` entries would miss: ACMR is misses per triangle (0.5 is the
+// ideal for large regular meshes, 3 the worst case) and ATVR is misses per
+// vertex (1 is the ideal)
 typedef struct {
-  VkSurfaceCapabilitiesKHR capabilities;
-  VkSurfaceFormatKHR formats[256];
-  uint32_t formats_len;
-  VkPresentModeKHR present_modes[16];
-  uint32_t present_modes_len;
-} SwapChainSupportDetails;
+  float acmr;
+  float atvr;
+} VertexCacheStats;
+
+// loads `count` cache entries through a FIFO cache of `cache_size` entries
+// and returns the number of misses: an entry is cached if fewer than
+// cache_size misses happened since it was last loaded, and `time` counts
+// misses so bumping it by cache_size + 1 flushes the whole cache
+static uint32_t update_fifo_cache(uint32_t *loaded_at, uint32_t *time,
+                                  const uint32_t *entries, uint32_t count,
+                                  uint32_t cache_size) {
+  uint32_t misses = 0;
+  for (int i = 0; i < count; i++) {
+    uint32_t entry = entries[i];
+    if (*time - loaded_at[entry] > cache_size) {
+      loaded_at[entry] = *time;
+      *time += 1;
+      misses += 1;
+    }
+  }
+  return misses;
+}
 
-void query_swap_chain_support(VkPhysicalDevice device,
-                              SwapChainSupportDetails *details) {
-  // capabilities
-  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface,
-                                            &(details->capabilities));
-  // formats
-  vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &(details->formats_len),
-                                       NULL);
-  if (details->formats_len != 0) {
-    vkGetPhysicalDeviceSurfaceFormatsKHR(
-        device, surface, &(details->formats_len), details->formats);
+VertexCacheStats simulate_vertex_cache(const uint32_t *indices,
+                                       uint32_t indices_len,
+                                       uint32_t vertices_len,
+                                       uint32_t cache_size) {
+  VertexCacheStats stats = {0};
+  if (indices_len == 0 || vertices_len == 0) {
+    return stats;
   }
 
-  // present mode
-  vkGetPhysicalDeviceSurfacePresentModesKHR(
-      device, surface, &(details->present_modes_len), NULL);
-  if (details->present_modes_len != 0) {
-    vkGetPhysicalDeviceSurfacePresentModesKHR(
-        device, surface, &(details->present_modes_len), details->present_modes);
+  uint32_t *loaded_at = calloc(vertices_len, sizeof(uint32_t));
+  if (!loaded_at) {
+    THROW("failed to allocate vertex cache simulator!\n");
   }
+
+  uint32_t time = cache_size + 1;
+  uint32_t misses =
+      update_fifo_cache(loaded_at, &time, indices, indices_len, cache_size);
+  free(loaded_at);
+
+  stats.acmr = (float)misses / (float)(indices_len / 3);
+  stats.atvr = (float)misses / (float)vertices_len;
+  return stats;
 }
 
+// per vertex lists of the triangles using it, vertex v's triangles are
+// triangles[offsets[v]] up to triangles[offsets[v] + counts[v]]
 typedef struct {
-  int32_t graphics_family;
-  int32_t present_family;
-} QueueFamilyIndices;
+  uint32_t *counts;
+  uint32_t *offsets;
+  uint32_t *triangles;
+} TriangleAdjacency;
+
+void build_triangle_adjacency(TriangleAdjacency *adjacency,
+                              const uint32_t *indices, uint32_t indices_len,
+                              uint32_t vertices_len) {
+  adjacency->counts = calloc(vertices_len, sizeof(uint32_t));
+  adjacency->offsets = malloc(sizeof(uint32_t) * (vertices_len + 1));
+  adjacency->triangles = malloc(sizeof(uint32_t) * (indices_len + 1));
+  if (!adjacency->counts || !adjacency->offsets || !adjacency->triangles) {
+    THROW("failed to allocate triangle adjacency!\n");
+  }
 
-int QFI_is_complete(QueueFamilyIndices *indices) {
-  return indices->present_family >= 0 && indices->present_family >= 0;
+  for (int i = 0; i < indices_len; i++) {
+    adjacency->counts[indices[i]] += 1;
+  }
+
+  adjacency->offsets[0] = 0;
+  for (int i = 0; i < vertices_len; i++) {
+    adjacency->offsets[i + 1] = adjacency->offsets[i] + adjacency->counts[i];
+    adjacency->counts[i] = 0;
+  }
+  for (int i = 0; i < indices_len; i++) {
+    uint32_t vertex = indices[i];
+    uint32_t slot = adjacency->offsets[vertex] + adjacency->counts[vertex];
+    adjacency->triangles[slot] = i / 3;
+    adjacency->counts[vertex] += 1;
+  }
 }
 
-static VKAPI_ATTR VkBool32 VKAPI_CALL
-debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
-               VkDebugUtilsMessageTypeFlagsEXT messageType,
-               const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
-               void *pUserData) {
+void free_triangle_adjacency(TriangleAdjacency *adjacency) {
+  free(adjacency->counts);
+  free(adjacency->offsets);
+  free(adjacency->triangles);
+  memset(adjacency, 0, sizeof(TriangleAdjacency));
+}
 
-  fprintf(stderr, "validation layer: %s\n", pCallbackData->pMessage);
-  return VK_FALSE;
+// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation": greedily emits the
+// triangle whose vertices score highest, where a vertex scores for sitting
+// near the front of a simulated LRU cache and for having few triangles left
+#define FORSYTH_CACHE_SIZE 32
+#define FORSYTH_MAX_VALENCE 32
+#define FORSYTH_CACHE_DECAY_POWER 1.5f
+#define FORSYTH_LAST_TRI_SCORE 0.75f
+#define FORSYTH_VALENCE_BOOST_SCALE 2.0f
+#define FORSYTH_VALENCE_BOOST_POWER 0.5f
+
+static float forsyth_cache_scores[FORSYTH_CACHE_SIZE];
+static float forsyth_valence_scores[FORSYTH_MAX_VALENCE + 1];
+
+static void init_forsyth_scores() {
+  for (int i = 0; i < FORSYTH_CACHE_SIZE; i++) {
+    if (i < 3) {
+      // the last triangle's vertices get a fixed score so the next triangle
+      // doesn't simply reuse the same edge every time
+      forsyth_cache_scores[i] = FORSYTH_LAST_TRI_SCORE;
+    } else {
+      float scale = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+      forsyth_cache_scores[i] =
+          powf(1.0f - (i - 3) * scale, FORSYTH_CACHE_DECAY_POWER);
+    }
+  }
+
+  forsyth_valence_scores[0] = 0.0f;
+  for (int i = 1; i <= FORSYTH_MAX_VALENCE; i++) {
+    forsyth_valence_scores[i] =
+        FORSYTH_VALENCE_BOOST_SCALE * powf(i, -FORSYTH_VALENCE_BOOST_POWER);
+  }
 }
 
-static void framebuffer_resize_callback(GLFWwindow *window, int width,
-                                        int height) {
-  framebuffer_resized = 1;
+static float forsyth_vertex_score(int32_t cache_position,
+                                  uint32_t live_triangles) {
+  if (live_triangles == 0) {
+    return -1.0f;
+  }
+
+  float score =
+      cache_position < 0 ? 0.0f : forsyth_cache_scores[cache_position];
+  uint32_t valence = live_triangles < FORSYTH_MAX_VALENCE ? live_triangles
+                                                          : FORSYTH_MAX_VALENCE;
+  return score + forsyth_valence_scores[valence];
 }
 
-void init_window() {
-  if (glfwInit() != GLFW_TRUE) {
-    THROW("failed to init glfw\n");
+// reorders whole triangles in place, keeping their winding
+void optimize_vertex_cache(uint32_t *indices, uint32_t indices_len,
+                           uint32_t vertices_len) {
+  uint32_t triangles_len = indices_len / 3;
+  if (triangles_len == 0) {
+    return;
+  }
+  if (forsyth_valence_scores[1] == 0.0f) {
+    init_forsyth_scores();
   }
 
-  glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+  // the adjacency counts become the triangles still to be emitted per
+  // vertex, the live ones are kept at the front of each vertex's list
+  TriangleAdjacency adjacency;
+  build_triangle_adjacency(&adjacency, indices, triangles_len * 3,
+                           vertices_len);
+  uint32_t *live_triangles = adjacency.counts;
+  float *vertex_scores = malloc(sizeof(float) * vertices_len);
+  int32_t *cache_positions = malloc(sizeof(int32_t) * vertices_len);
+  float *triangle_scores = malloc(sizeof(float) * triangles_len);
+  uint8_t *emitted = calloc(triangles_len, sizeof(uint8_t));
+  uint32_t *output = malloc(sizeof(uint32_t) * triangles_len * 3);
+  if (!vertex_scores || !cache_positions || !triangle_scores || !emitted ||
+      !output) {
+    THROW("failed to allocate vertex cache optimizer!\n");
+  }
 
-  window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", NULL, NULL);
-  glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
-}
+  for (int i = 0; i < vertices_len; i++) {
+    cache_positions[i] = -1;
+    vertex_scores[i] = forsyth_vertex_score(-1, live_triangles[i]);
+  }
 
-int check_validation_layer_support() {
-  uint32_t layer_count;
-  vkEnumerateInstanceLayerProperties(&layer_count, NULL);
+  uint32_t best_triangle = 0;
+  float best_score = -1.0f;
+  for (int i = 0; i < triangles_len; i++) {
+    triangle_scores[i] = vertex_scores[indices[i * 3 + 0]] +
+                         vertex_scores[indices[i * 3 + 1]] +
+                         vertex_scores[indices[i * 3 + 2]];
+    if (triangle_scores[i] > best_score) {
+      best_score = triangle_scores[i];
+      best_triangle = i;
+    }
+  }
 
-  VkLayerProperties available_layers[MAX_LAYERS];
-  vkEnumerateInstanceLayerProperties(&layer_count, available_layers);
+  // holds the three new vertices ahead of the old cache while it's rebuilt
+  uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+  uint32_t new_cache[FORSYTH_CACHE_SIZE + 3];
+  uint32_t cache_len = 0;
+  uint32_t next_unemitted = 0;
+
+  for (int n = 0; n < triangles_len; n++) {
+    if (best_score < 0.0f) {
+      // nothing in the cache touches a live triangle, restart from the
+      // first triangle not emitted yet
+      while (emitted[next_unemitted]) {
+        next_unemitted += 1;
+      }
+      best_triangle = next_unemitted;
+    }
 
-  for (int i = 0; i < VALIDATION_LAYER_COUNT; i++) {
-    int layer_found = 0;
+    uint32_t *triangle = &indices[best_triangle * 3];
+    memcpy(&output[n * 3], triangle, sizeof(uint32_t) * 3);
+    emitted[best_triangle] = 1;
+
+    uint32_t new_cache_len = 0;
+    for (int k = 0; k < 3; k++) {
+      uint32_t vertex = triangle[k];
+
+      // swap the emitted triangle out of the live part of the range
+      uint32_t *list = &adjacency.triangles[adjacency.offsets[vertex]];
+      uint32_t last = live_triangles[vertex] - 1;
+      for (int j = 0; j <= last; j++) {
+        if (list[j] == best_triangle) {
+          list[j] = list[last];
+          list[last] = best_triangle;
+          break;
+        }
+      }
+      live_triangles[vertex] -= 1;
 
-    for (int j = 0; j < layer_count; j++) {
-      if (strcmp(validation_layers[i], available_layers[j].layerName) == 0) {
-        layer_found = 1;
-        break;
+      if (cache_positions[vertex] != -2) {
+        // -2 marks a vertex already placed at the front this round
+        new_cache[new_cache_len] = vertex;
+        new_cache_len += 1;
+        cache_positions[vertex] = -2;
+      }
+    }
+    for (int i = 0; i < cache_len; i++) {
+      if (cache_positions[cache[i]] != -2) {
+        new_cache[new_cache_len] = cache[i];
+        new_cache_len += 1;
       }
     }
 
-    if (!layer_found) {
-      return 0;
+    // rescore everything that was or is in the cache, pushing the score
+    // deltas onto the live triangles around each vertex
+    best_score = -1.0f;
+    for (int i = 0; i < new_cache_len; i++) {
+      uint32_t vertex = new_cache[i];
+      cache_positions[vertex] = i < FORSYTH_CACHE_SIZE ? i : -1;
+
+      float score =
+          forsyth_vertex_score(cache_positions[vertex], live_triangles[vertex]);
+      float delta = score - vertex_scores[vertex];
+      vertex_scores[vertex] = score;
+
+      uint32_t *list = &adjacency.triangles[adjacency.offsets[vertex]];
+      for (int j = 0; j < live_triangles[vertex]; j++) {
+        triangle_scores[list[j]] += delta;
+      }
     }
+    for (int i = 0; i < new_cache_len && i < FORSYTH_CACHE_SIZE; i++) {
+      uint32_t vertex = new_cache[i];
+      uint32_t *list = &adjacency.triangles[adjacency.offsets[vertex]];
+      for (int j = 0; j < live_triangles[vertex]; j++) {
+        if (triangle_scores[list[j]] > best_score) {
+          best_score = triangle_scores[list[j]];
+          best_triangle = list[j];
+        }
+      }
+    }
+
+    cache_len = new_cache_len < FORSYTH_CACHE_SIZE ? new_cache_len
+                                                   : FORSYTH_CACHE_SIZE;
+    memcpy(cache, new_cache, sizeof(uint32_t) * cache_len);
   }
 
-  return 1;
+  memcpy(indices, output, sizeof(uint32_t) * triangles_len * 3);
+
+  free_triangle_adjacency(&adjacency);
+  free(vertex_scores);
+  free(cache_positions);
+  free(triangle_scores);
+  free(emitted);
+  free(output);
 }
 
-void get_required_extensions(uint32_t *count, const char **extensions) {
-  uint32_t glfw_extension_count = 0;
-  const char **glfw_extensions;
-  glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+// renumbers vertices in the order the index buffer first uses them so vertex
+// fetches walk vertices[] front to back, unreferenced vertices are dropped
+void optimize_vertex_fetch() {
+  uint32_t *remap = malloc(sizeof(uint32_t) * vertices_len);
+  Vertex *remapped = malloc(sizeof(Vertex) * vertices_len);
+  if (!remap || !remapped) {
+    THROW("failed to allocate vertex fetch optimizer!\n");
+  }
+  memset(remap, 0xff, sizeof(uint32_t) * vertices_len);
+
+  uint32_t remapped_len = 0;
+  for (int i = 0; i < indices_len; i++) {
+    uint32_t index = indices[i];
+    if (remap[index] == UINT32_MAX) {
+      remap[index] = remapped_len;
+      remapped[remapped_len] = vertices[index];
+      remapped_len += 1;
+    }
+    indices[i] = remap[index];
+  }
+  free(remap);
+
+  free(vertices);
+  vertices = remapped;
+  vertices_cap = vertices_len;
+  vertices_len = remapped_len;
+  shrink_array((void **)&vertices, &vertices_cap, vertices_len,
+               sizeof(Vertex));
+}
 
-  for (int i = 0; i < glfw_extension_count; i++) {
-    extensions[i] = glfw_extensions[i];
+// Normals are the area weighted sum of the faces around a position, so
+// vertices that are only split by their texture coordinates get the same
+// normal. Tangents follow MikkTSpace: at every corner of a vertex its
+// face's tangent, from the texture coordinate derivatives, is projected
+// onto the vertex normal, normalized and weighted by the corner's angle,
+// and w is +1 or -1 so that cross(normal, tangent) * w is the bitangent.
+// MikkTSpace splits a vertex whose faces disagree on w, here the faces
+// with the larger angle win.
+//
+// Both are gathered per vertex from the triangles around its position, so
+// every output has a single writer. Positions are welded by hashing every
+// vertex once into the bucket of its partition and then welding the
+// buckets side by side. Only building the triangle lists is shared between
+// the threads, and it is done with atomic counters.
+typedef struct {
+  // the lowest index of a vertex at the same position
+  uint32_t *welded;
+  // hash_position() of every vertex
+  uint32_t *hashes;
+  // buckets[bucket_offsets[p]] up to buckets[bucket_offsets[p + 1]] are
+  // the vertices of partition p, in index order
+  uint32_t *buckets;
+  uint32_t *bucket_offsets;
+  // vertices are hashed and scattered in chunks, chunk c's vertices of
+  // partition p are counted and then placed at chunk_offsets[c *
+  // partitions + p]
+  uint32_t *chunk_offsets;
+  uint32_t chunks;
+  uint32_t partitions;
+  // triangles[offsets[v]] up to triangles[offsets[v + 1]] are the
+  // triangles using position v, for v a welded index
+  _Atomic uint32_t *counts;
+  uint32_t *offsets;
+  uint32_t *triangles;
+} TangentSpaceBuilder;
+
+static uint32_t hash_position(const float *pos) {
+  uint32_t words[3];
+  memcpy(words, pos, sizeof(words));
+  uint32_t h = (words[0] * 0x9e3779b1u) ^ (words[1] * 0x85ebca77u) ^
+               (words[2] * 0xc2b2ae3du);
+  h ^= h >> 15;
+  h *= 0x2c1b3c6d;
+  h ^= h >> 12;
+  return h;
+}
+
+// the high bits of the hash pick the partition, the low ones the slot
+static uint32_t hash_partition(const TangentSpaceBuilder *builder,
+                               uint32_t hash) {
+  return (uint32_t)(((uint64_t)hash * builder->partitions) >> 32);
+}
+
+// bitwise, the way hash_position() sees them
+static int same_position(const float *a, const float *b) {
+  uint32_t wa[3], wb[3];
+  memcpy(wa, a, sizeof(wa));
+  memcpy(wb, b, sizeof(wb));
+  return ((wa[0] ^ wb[0]) | (wa[1] ^ wb[1]) | (wa[2] ^ wb[2])) == 0;
+}
+
+static uint32_t chunk_start(const TangentSpaceBuilder *builder,
+                            uint32_t chunk) {
+  return (uint32_t)((uint64_t)vertices_len * chunk / builder->chunks);
+}
+
+static void hash_positions(void *ctx, uint32_t begin, uint32_t end) {
+  TangentSpaceBuilder *builder = ctx;
+  for (uint32_t chunk = begin; chunk < end; chunk++) {
+    uint32_t *counts = &builder->chunk_offsets[chunk * builder->partitions];
+    for (uint32_t v = chunk_start(builder, chunk);
+         v < chunk_start(builder, chunk + 1); v++) {
+      uint32_t hash = hash_position(vertices[v].pos);
+      builder->hashes[v] = hash;
+      counts[hash_partition(builder, hash)] += 1;
+    }
   }
-  *count = glfw_extension_count;
+}
 
-  extensions[*count] = VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME;
-  *count += 1;
-  extensions[*count] = VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME;
-  *count += 1;
+// chunks are scattered in order into the ranges their counts reserved, so
+// every bucket lists its vertices by increasing index
+static void scatter_positions(void *ctx, uint32_t begin, uint32_t end) {
+  TangentSpaceBuilder *builder = ctx;
+  for (uint32_t chunk = begin; chunk < end; chunk++) {
+    uint32_t *offsets = &builder->chunk_offsets[chunk * builder->partitions];
+    for (uint32_t v = chunk_start(builder, chunk);
+         v < chunk_start(builder, chunk + 1); v++) {
+      uint32_t partition = hash_partition(builder, builder->hashes[v]);
+      builder->buckets[offsets[partition]] = v;
+      offsets[partition] += 1;
+    }
+  }
+}
 
-  if (ENABLE_VALICATION_LAYERS) {
-    extensions[*count] = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
-    *count += 1;
+// a partition owns every vertex at its positions, and the first vertex at
+// a position is the first one its bucket lists
+static void weld_partition(void *ctx, uint32_t begin, uint32_t end) {
+  TangentSpaceBuilder *builder = ctx;
+  for (uint32_t partition = begin; partition < end; partition++) {
+    const uint32_t *bucket =
+        &builder->buckets[builder->bucket_offsets[partition]];
+    uint32_t members = builder->bucket_offsets[partition + 1] -
+                       builder->bucket_offsets[partition];
+    uint32_t capacity = 16;
+    while (capacity < members + members / 2) {
+      capacity *= 2;
+    }
+    uint32_t mask = capacity - 1;
+    // slots hold index + 1 so that zero marks an empty slot
+    uint32_t *slots = calloc(capacity, sizeof(uint32_t));
+    if (!slots) {
+      THROW("failed to allocate position weld!\n");
+    }
+    for (uint32_t i = 0; i < members; i++) {
+      uint32_t v = bucket[i];
+      uint32_t slot = builder->hashes[v] & mask;
+      while (slots[slot] != 0 &&
+             !same_position(vertices[slots[slot] - 1].pos, vertices[v].pos)) {
+        slot = (slot + 1) & mask;
+      }
+      if (slots[slot] == 0) {
+        slots[slot] = v + 1;
+      }
+      builder->welded[v] = slots[slot] - 1;
+    }
+    free(slots);
   }
 }
 
-void populate_debug_messenger_create_info(
-    VkDebugUtilsMessengerCreateInfoEXT *create_info) {
-  create_info->sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
-  create_info->messageSeverity =
-      VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
-      VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
-      VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
-  create_info->messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
-                             VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
-                             VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
-  create_info->pfnUserCallback = debug_callback;
+// turns the per chunk counts into where each chunk's vertices of a
+// partition start, partition by partition
+static void place_buckets(TangentSpaceBuilder *builder) {
+  uint32_t offset = 0;
+  for (uint32_t p = 0; p < builder->partitions; p++) {
+    builder->bucket_offsets[p] = offset;
+    for (uint32_t c = 0; c < builder->chunks; c++) {
+      uint32_t *count = &builder->chunk_offsets[c * builder->partitions + p];
+      uint32_t len = *count;
+      *count = offset;
+      offset += len;
+    }
+  }
+  builder->bucket_offsets[builder->partitions] = offset;
 }
 
-void create_instance() {
-  if (ENABLE_VALICATION_LAYERS && !check_validation_layer_support()) {
-    THROW("validation layers requested, but not available!\n");
+static void count_position_triangles(void *ctx, uint32_t begin,
+                                     uint32_t end) {
+  TangentSpaceBuilder *builder = ctx;
+  for (uint32_t i = begin * 3; i < end * 3; i++) {
+    atomic_fetch_add_explicit(&builder->counts[builder->welded[indices[i]]],
+                              1, memory_order_relaxed);
   }
+}
 
-  VkApplicationInfo app_info = {0};
-  app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
-  app_info.pApplicationName = "Hello Triangle";
-  app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
-  app_info.pEngineName = "No Engine";
-  app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
-  app_info.apiVersion = VK_API_VERSION_1_0;
+// counts[] runs back down from the end of each list to its start
+static void fill_position_triangles(void *ctx, uint32_t begin, uint32_t end) {
+  TangentSpaceBuilder *builder = ctx;
+  for (uint32_t t = begin; t < end; t++) {
+    for (int k = 0; k < 3; k++) {
+      uint32_t position = builder->welded[indices[t * 3 + k]];
+      uint32_t slot = atomic_fetch_sub_explicit(&builder->counts[position], 1,
+                                                memory_order_relaxed);
+      builder->triangles[builder->offsets[position] + slot - 1] = t;
+    }
+  }
+}
 
-  VkInstanceCreateInfo create_info = {0};
-  create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
-  create_info.pApplicationInfo = &app_info;
-  create_info.flags |= VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
-
-  uint32_t required_extensions_count = 0;
-  const char *required_extensions[MAX_EXTENSIONS];
-  get_required_extensions(&required_extensions_count, required_extensions);
-
-  create_info.enabledExtensionCount = required_extensions_count;
-  create_info.ppEnabledExtensionNames = required_extensions;
+// Four faces at a time: the edges from their first corner to the other
+// two and the texture coordinates along them, SoA with one face per lane.
+typedef struct {
+  float e1[3][4];
+  float e2[3][4];
+  float uv1[2][4];
+  float uv2[2][4];
+} FaceBatch;
+
+// the faces are given as their corners' vertices, lanes past `len` are
+// filled with a face of zero size that adds nothing to any sum
+static void load_faces(FaceBatch *batch, uint32_t faces[4][3], int len) {
+  for (int lane = len; lane < 4; lane++) {
+    faces[lane][0] = faces[lane][1] = faces[lane][2] = faces[0][0];
+  }
+#ifdef HAS_SSE2
+  // a vertex is loaded as xyzr and, from its green onwards, as gbuv, so
+  // every lane's edges come out of one subtraction and a transpose
+  __m128 e1[4], e2[4], uv1[4], uv2[4];
+  for (int lane = 0; lane < 4; lane++) {
+    const Vertex *a = &vertices[faces[lane][0]];
+    const Vertex *b = &vertices[faces[lane][1]];
+    const Vertex *c = &vertices[faces[lane][2]];
+    __m128 pos = _mm_loadu_ps(a->pos);
+    __m128 uv = _mm_loadu_ps(&a->color[1]);
+    e1[lane] = _mm_sub_ps(_mm_loadu_ps(b->pos), pos);
+    e2[lane] = _mm_sub_ps(_mm_loadu_ps(c->pos), pos);
+    uv1[lane] = _mm_sub_ps(_mm_loadu_ps(&b->color[1]), uv);
+    uv2[lane] = _mm_sub_ps(_mm_loadu_ps(&c->color[1]), uv);
+  }
+  _MM_TRANSPOSE4_PS(e1[0], e1[1], e1[2], e1[3]);
+  _MM_TRANSPOSE4_PS(e2[0], e2[1], e2[2], e2[3]);
+  _MM_TRANSPOSE4_PS(uv1[0], uv1[1], uv1[2], uv1[3]);
+  _MM_TRANSPOSE4_PS(uv2[0], uv2[1], uv2[2], uv2[3]);
+  for (int j = 0; j < 3; j++) {
+    _mm_storeu_ps(batch->e1[j], e1[j]);
+    _mm_storeu_ps(batch->e2[j], e2[j]);
+  }
+  for (int j = 0; j < 2; j++) {
+    _mm_storeu_ps(batch->uv1[j], uv1[j + 2]);
+    _mm_storeu_ps(batch->uv2[j], uv2[j + 2]);
+  }
+#else
+  for (int lane = 0; lane < 4; lane++) {
+    const Vertex *a = &vertices[faces[lane][0]];
+    const Vertex *b = &vertices[faces[lane][1]];
+    const Vertex *c = &vertices[faces[lane][2]];
+    for (int j = 0; j < 3; j++) {
+      batch->e1[j][lane] = b->pos[j] - a->pos[j];
+      batch->e2[j][lane] = c->pos[j] - a->pos[j];
+    }
+    for (int j = 0; j < 2; j++) {
+      batch->uv1[j][lane] = b->tex_coord[j] - a->tex_coord[j];
+      batch->uv2[j][lane] = c->tex_coord[j] - a->tex_coord[j];
+    }
+  }
+#endif
+}
 
-  if (ENABLE_VALICATION_LAYERS) {
-    create_info.enabledLayerCount = VALIDATION_LAYER_COUNT;
-    create_info.ppEnabledLayerNames = validation_layers;
-    populate_debug_messenger_create_info(&debug_create_info);
-    create_info.pNext =
-        (VkDebugUtilsMessengerCreateInfoEXT *)&debug_create_info;
-  } else {
-    create_info.enabledLayerCount = 0;
-    create_info.pNext = NULL;
+// sum of cross(e1, e2), twice the area weighted normal, over the batch
+static void sum_face_normals(const FaceBatch *batch, float *sum) {
+#ifdef HAS_SSE2
+  __m128 e1[3], e2[3];
+  for (int j = 0; j < 3; j++) {
+    e1[j] = _mm_loadu_ps(batch->e1[j]);
+    e2[j] = _mm_loadu_ps(batch->e2[j]);
+  }
+  __m128 n[3];
+  n[0] = _mm_sub_ps(_mm_mul_ps(e1[1], e2[2]), _mm_mul_ps(e1[2], e2[1]));
+  n[1] = _mm_sub_ps(_mm_mul_ps(e1[2], e2[0]), _mm_mul_ps(e1[0], e2[2]));
+  n[2] = _mm_sub_ps(_mm_mul_ps(e1[0], e2[1]), _mm_mul_ps(e1[1], e2[0]));
+  for (int j = 0; j < 3; j++) {
+    float lanes[4];
+    _mm_storeu_ps(lanes, n[j]);
+    sum[j] += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+  }
+#else
+  for (int j = 0; j < 3; j++) {
+    int y = (j + 1) % 3;
+    int z = (j + 2) % 3;
+    float lanes[4];
+    for (int lane = 0; lane < 4; lane++) {
+      lanes[lane] = batch->e1[y][lane] * batch->e2[z][lane] -
+                    batch->e1[z][lane] * batch->e2[y][lane];
+    }
+    sum[j] += (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
   }
+#endif
+}
 
-  // check available extensions
-  VkResult result;
-  uint32_t avail_extension_count = 0;
-  // get count of available extensions
-  result = vkEnumerateInstanceExtensionProperties(NULL, &avail_extension_count,
-                                                  NULL);
-  if (result != VK_SUCCESS) {
-    THROW("%d failed to get number of available extensions!\n", result);
+#ifdef HAS_SSE2
+// 1 / sqrt(x) to about 23 bits, the estimate refined by a Newton step
+static __m128 reciprocal_sqrt(__m128 x) {
+  __m128 r = _mm_rsqrt_ps(x);
+  __m128 rrx = _mm_mul_ps(_mm_mul_ps(r, r), x);
+  return _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), r),
+                    _mm_sub_ps(_mm_set1_ps(3.0f), rrx));
+}
+#else
+// acos to within 7e-5 radians, Abramowitz and Stegun 4.4.45
+static float approx_acos(float x) {
+  float a = fabsf(x) < 1.0f ? fabsf(x) : 1.0f;
+  float r = sqrtf(1.0f - a) *
+            (1.5707288f + a * (-0.2121144f + a * (0.0742610f +
+                                                  a * -0.0187293f)));
+  return x < 0.0f ? GLM_PIf - r : r;
+}
+#endif
+
+// adds the MikkTSpace contribution of each face in the batch, at the
+// corner its edges start from, to `sum`: xyz the tangent, w the sign
+static void sum_corner_tangents(const FaceBatch *batch, const float *normal,
+                                float *sum) {
+  float tangents[3][4], angles[4], signs[4];
+#ifdef HAS_SSE2
+  __m128 n[3], e1[3], e2[3], t[3];
+  for (int j = 0; j < 3; j++) {
+    n[j] = _mm_set1_ps(normal[j]);
+    e1[j] = _mm_loadu_ps(batch->e1[j]);
+    e2[j] = _mm_loadu_ps(batch->e2[j]);
+  }
+  __m128 u1 = _mm_loadu_ps(batch->uv1[0]);
+  __m128 v1 = _mm_loadu_ps(batch->uv1[1]);
+  __m128 u2 = _mm_loadu_ps(batch->uv2[0]);
+  __m128 v2 = _mm_loadu_ps(batch->uv2[1]);
+  __m128 area = _mm_sub_ps(_mm_mul_ps(u1, v2), _mm_mul_ps(v1, u2));
+  __m128 flip = _mm_and_ps(area, _mm_set1_ps(-0.0f));
+  for (int j = 0; j < 3; j++) {
+    // (e1 * v2 - e2 * v1) / area, only its direction matters
+    t[j] = _mm_sub_ps(_mm_mul_ps(e1[j], v2), _mm_mul_ps(e2[j], v1));
+    t[j] = _mm_xor_ps(t[j], flip);
+  }
+  // the tangent and both edges projected onto the normal's plane
+  __m128 *vectors[3] = {t, e1, e2};
+  __m128 lengths2[3];
+  for (int i = 0; i < 3; i++) {
+    __m128 *w = vectors[i];
+    __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(w[0], n[0]),
+                                     _mm_mul_ps(w[1], n[1])),
+                          _mm_mul_ps(w[2], n[2]));
+    lengths2[i] = _mm_setzero_ps();
+    for (int j = 0; j < 3; j++) {
+      w[j] = _mm_sub_ps(w[j], _mm_mul_ps(d, n[j]));
+      lengths2[i] = _mm_add_ps(lengths2[i], _mm_mul_ps(w[j], w[j]));
+    }
+  }
+  __m128 zero = _mm_setzero_ps();
+  __m128 inv_t = _mm_and_ps(_mm_cmpgt_ps(lengths2[0], zero),
+                            reciprocal_sqrt(lengths2[0]));
+  __m128 edges = _mm_mul_ps(lengths2[1], lengths2[2]);
+  __m128 cos = _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(e1[0], e2[0]), _mm_mul_ps(e1[1], e2[1])),
+      _mm_mul_ps(e1[2], e2[2]));
+  cos = _mm_and_ps(_mm_cmpgt_ps(edges, zero),
+                   _mm_mul_ps(cos, reciprocal_sqrt(edges)));
+  for (int j = 0; j < 3; j++) {
+    _mm_storeu_ps(tangents[j], _mm_mul_ps(t[j], inv_t));
+  }
+  // acos to within 7e-5 radians, Abramowitz and Stegun 4.4.45:
+  // sqrt(1 - |x|) * p(|x|), mirrored for x < 0
+  __m128 x = _mm_andnot_ps(_mm_set1_ps(-0.0f), cos);
+  x = _mm_min_ps(x, _mm_set1_ps(1.0f));
+  __m128 p = _mm_set1_ps(-0.0187293f);
+  p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(0.0742610f));
+  p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(-0.2121144f));
+  p = _mm_add_ps(_mm_mul_ps(p, x), _mm_set1_ps(1.5707288f));
+  __m128 r = _mm_mul_ps(_mm_sqrt_ps(_mm_sub_ps(_mm_set1_ps(1.0f), x)), p);
+  __m128 negative = _mm_cmplt_ps(cos, zero);
+  r = _mm_or_ps(_mm_andnot_ps(negative, r),
+                _mm_and_ps(negative, _mm_sub_ps(_mm_set1_ps(GLM_PIf), r)));
+  _mm_storeu_ps(angles, _mm_and_ps(_mm_cmpgt_ps(edges, zero), r));
+  _mm_storeu_ps(signs, area);
+#else
+  for (int lane = 0; lane < 4; lane++) {
+    float u1 = batch->uv1[0][lane], v1 = batch->uv1[1][lane];
+    float u2 = batch->uv2[0][lane], v2 = batch->uv2[1][lane];
+    float area = u1 * v2 - v1 * u2;
+    vec3 t, e1, e2;
+    for (int j = 0; j < 3; j++) {
+      t[j] = batch->e1[j][lane] * v2 - batch->e2[j][lane] * v1;
+      t[j] = area < 0.0f ? -t[j] : t[j];
+      e1[j] = batch->e1[j][lane];
+      e2[j] = batch->e2[j][lane];
+    }
+    float *vectors[3] = {t, e1, e2};
+    float lengths[3];
+    for (int i = 0; i < 3; i++) {
+      float d = glm_vec3_dot(vectors[i], (float *)normal);
+      for (int j = 0; j < 3; j++) {
+        vectors[i][j] -= d * normal[j];
+      }
+      lengths[i] = glm_vec3_norm(vectors[i]);
+    }
+    for (int j = 0; j < 3; j++) {
+      tangents[j][lane] = lengths[0] > 0.0f ? t[j] / lengths[0] : 0.0f;
+    }
+    float edges = lengths[1] * lengths[2];
+    angles[lane] =
+        edges > 0.0f ? approx_acos(glm_vec3_dot(e1, e2) / edges) : 0.0f;
+    signs[lane] = area;
   }
+#endif
+  for (int lane = 0; lane < 4; lane++) {
+    for (int j = 0; j < 3; j++) {
+      sum[j] += tangents[j][lane] * angles[lane];
+    }
+    sum[3] += signs[lane] < 0.0f ? -angles[lane] : angles[lane];
+  }
+}
 
-  // get available extensions
-  VkExtensionProperties avail_extensions[MAX_EXTENSIONS];
-  result = vkEnumerateInstanceExtensionProperties(NULL, &avail_extension_count,
-                                                  avail_extensions);
-  if (result != VK_SUCCESS) {
-    THROW("%d failed to get available extensions!\n", result);
+static int compare_triangles(const void *a, const void *b) {
+  uint32_t ta = *(const uint32_t *)a;
+  uint32_t tb = *(const uint32_t *)b;
+  return ta < tb ? -1 : ta > tb;
+}
+
+// most positions are used by a handful of triangles, fans around a pole
+// can be used by thousands
+static void sort_triangle_list(uint32_t *list, uint32_t len) {
+  if (len > 32) {
+    qsort(list, len, sizeof(uint32_t), compare_triangles);
+    return;
   }
-  printf("available extensions %d:\n", avail_extension_count);
-  for (int i = 0; i < avail_extension_count; i++) {
-    printf("\t%s\n", avail_extensions[i].extensionName);
+  for (uint32_t i = 1; i < len; i++) {
+    uint32_t t = list[i];
+    uint32_t j = i;
+    while (j > 0 && list[j - 1] > t) {
+      list[j] = list[j - 1];
+      j--;
+    }
+    list[j] = t;
   }
+}
 
-  // check required extensions
-  printf("required extensions %d:\n", required_extensions_count);
-  for (int i = 0; i < required_extensions_count; i++) {
-    const char *required_extension = required_extensions[i];
-    int exist = 0;
-    for (int j = 0; j < avail_extension_count; j++) {
-      if (strcmp(required_extension, avail_extensions[j].extensionName) == 0) {
-        exist = 1;
-        break;
+// the lists were filled in whatever order the threads got to them, sorted
+// the sums over them come out the same on every run
+static void sort_position_triangles(void *ctx, uint32_t begin, uint32_t end) {
+  TangentSpaceBuilder *builder = ctx;
+  for (uint32_t v = begin; v < end; v++) {
+    if (builder->welded[v] == v) {
+      sort_triangle_list(&builder->triangles[builder->offsets[v]],
+                         builder->offsets[v + 1] - builder->offsets[v]);
+    }
+  }
+}
+
+// A vertex split off its position recomputes the position's normal rather
+// than wait for another thread's, the faces are in cache for its tangent
+// right after anyway.
+static void gather_tangent_space(void *ctx, uint32_t begin, uint32_t end) {
+  TangentSpaceBuilder *builder = ctx;
+  FaceBatch batch;
+  uint32_t faces[4][3];
+  for (uint32_t v = begin; v < end; v++) {
+    uint32_t position = builder->welded[v];
+    const uint32_t *list = &builder->triangles[builder->offsets[position]];
+    uint32_t len = builder->offsets[position + 1] - builder->offsets[position];
+
+    float *normal = vertex_normals[v];
+    vec3 normal_sum = {0.0f, 0.0f, 0.0f};
+    for (uint32_t i = 0; i < len; i += 4) {
+      int lanes = len - i < 4 ? len - i : 4;
+      for (int lane = 0; lane < lanes; lane++) {
+        memcpy(faces[lane], &indices[list[i + lane] * 3], sizeof(faces[0]));
       }
+      load_faces(&batch, faces, lanes);
+      sum_face_normals(&batch, normal_sum);
+    }
+    float len2 = glm_vec3_dot(normal_sum, normal_sum);
+    if (len2 > 0.0f) {
+      glm_vec3_scale(normal_sum, 1.0f / sqrtf(len2), normal);
+    } else {
+      glm_vec3_copy((vec3){0.0f, 0.0f, 1.0f}, normal);
     }
 
-    if (exist) {
-      printf("\t%s - ok\n", required_extension);
+    // only the faces using this very vertex, rotated to start at it
+    vec4 sum = {0.0f, 0.0f, 0.0f, 0.0f};
+    int lanes = 0;
+    for (uint32_t i = 0; i < len; i++) {
+      const uint32_t *tri = &indices[list[i] * 3];
+      int k = tri[0] == v ? 0 : tri[1] == v ? 1 : tri[2] == v ? 2 : -1;
+      if (k < 0) {
+        continue;
+      }
+      faces[lanes][0] = v;
+      faces[lanes][1] = tri[(k + 1) % 3];
+      faces[lanes][2] = tri[(k + 2) % 3];
+      lanes += 1;
+      if (lanes == 4) {
+        load_faces(&batch, faces, lanes);
+        sum_corner_tangents(&batch, normal, sum);
+        lanes = 0;
+      }
+    }
+    if (lanes > 0) {
+      load_faces(&batch, faces, lanes);
+      sum_corner_tangents(&batch, normal, sum);
+    }
+
+    float *tangent = vertex_tangents[v];
+    len2 = glm_vec3_dot(sum, sum);
+    if (len2 > 0.0f) {
+      glm_vec3_scale(sum, 1.0f / sqrtf(len2), tangent);
     } else {
-      printf("\t%s - fail\n", required_extension);
+      // no usable texture coordinates, any direction in the plane will do
+      vec3 axis = {1.0f, 0.0f, 0.0f};
+      if (fabsf(normal[0]) > 0.9f) {
+        glm_vec3_copy((vec3){0.0f, 1.0f, 0.0f}, axis);
+      }
+      glm_vec3_cross(normal, axis, tangent);
+      glm_vec3_normalize(tangent);
     }
+    tangent[3] = sum[3] < 0.0f ? -1.0f : 1.0f;
   }
+}
 
-  result = vkCreateInstance(&create_info, NULL, &instance);
-  if (result != VK_SUCCESS) {
-    THROW("%d failed to create instance!\n", result);
+// fills vertex_normals[] and vertex_tangents[] from the triangles of
+// indices[], spread over every core
+void generate_tangent_space() {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  uint32_t triangles_len = indices_len / 3;
+
+  reserve_array((void **)&vertex_normals, &vertex_normals_cap, vertices_len,
+                sizeof(vec3));
+  reserve_array((void **)&vertex_tangents, &vertex_tangents_cap,
+                vertices_len, sizeof(vec4));
+  vertex_normals_len = vertices_len;
+  vertex_tangents_len = vertices_len;
+
+  uint32_t threads = worker_threads_count();
+  TangentSpaceBuilder builder = {0};
+  builder.chunks = threads;
+  builder.partitions = threads * WELD_PARTITIONS_PER_THREAD;
+  builder.welded = malloc(sizeof(uint32_t) * (vertices_len + 1));
+  builder.hashes = malloc(sizeof(uint32_t) * (vertices_len + 1));
+  builder.buckets = malloc(sizeof(uint32_t) * (vertices_len + 1));
+  builder.bucket_offsets =
+      malloc(sizeof(uint32_t) * (builder.partitions + 1));
+  builder.chunk_offsets =
+      calloc(builder.chunks * builder.partitions, sizeof(uint32_t));
+  builder.counts = calloc(vertices_len + 1, sizeof(uint32_t));
+  builder.offsets = malloc(sizeof(uint32_t) * (vertices_len + 1));
+  builder.triangles = malloc(sizeof(uint32_t) * (triangles_len * 3 + 1));
+  if (!builder.welded || !builder.hashes || !builder.buckets ||
+      !builder.bucket_offsets || !builder.chunk_offsets || !builder.counts ||
+      !builder.offsets || !builder.triangles) {
+    THROW("failed to allocate tangent space builder!\n");
   }
-}
 
-VkResult create_debug_utils_messenger_ext(
-    VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
-    const VkAllocationCallbacks *pAllocator,
-    VkDebugUtilsMessengerEXT *pDebugMessenger) {
-  PFN_vkCreateDebugUtilsMessengerEXT func =
-      (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
-          instance, "vkCreateDebugUtilsMessengerEXT");
-  if (func != NULL) {
-    return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
-  } else {
-    return VK_ERROR_EXTENSION_NOT_PRESENT;
+  parallel_for(builder.chunks, 1, hash_positions, &builder);
+  place_buckets(&builder);
+  parallel_for(builder.chunks, 1, scatter_positions, &builder);
+  parallel_for(builder.partitions, 1, weld_partition, &builder);
+  free(builder.hashes);
+  free(builder.buckets);
+  free(builder.bucket_offsets);
+  free(builder.chunk_offsets);
+  parallel_for(triangles_len, TANGENT_SPACE_MIN_RANGE,
+               count_position_triangles, &builder);
+  builder.offsets[0] = 0;
+  for (uint32_t v = 0; v < vertices_len; v++) {
+    builder.offsets[v + 1] = builder.offsets[v] + builder.counts[v];
   }
+  parallel_for(triangles_len, TANGENT_SPACE_MIN_RANGE,
+               fill_position_triangles, &builder);
+  parallel_for(vertices_len, TANGENT_SPACE_MIN_RANGE,
+               sort_position_triangles, &builder);
+  parallel_for(vertices_len, TANGENT_SPACE_MIN_RANGE, gather_tangent_space,
+               &builder);
+
+  free(builder.welded);
+  free((void *)builder.counts);
+  free(builder.offsets);
+  free(builder.triangles);
+  printf("generated normals and tangents of %u vertices on %u threads in "
+         "%.2f ms\n",
+         vertices_len, threads, elapsed_ms(&start));
 }
 
-void destroy_debug_utils_messenger_ext(
-    VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger,
-    const VkAllocationCallbacks *pAllocator) {
-  PFN_vkDestroyDebugUtilsMessengerEXT func =
-      (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
-          instance, "vkDestroyDebugUtilsMessengerEXT");
-  if (func != NULL) {
-    func(instance, debugMessenger, pAllocator);
+typedef struct {
+  float key;
+  uint32_t cluster;
+} ClusterSortKey;
+
+static int compare_cluster_keys(const void *a, const void *b) {
+  const ClusterSortKey *ka = a;
+  const ClusterSortKey *kb = b;
+  if (ka->key != kb->key) {
+    return ka->key > kb->key ? -1 : 1;
   }
+  return ka->cluster < kb->cluster ? -1 : ka->cluster > kb->cluster;
 }
 
-void setup_debug_messenger() {
-  if (!ENABLE_VALICATION_LAYERS)
+// Sander et al. "Fast Triangle Reordering for Vertex Locality and Reduced
+// Overdraw": cuts the cache optimized triangle order into clusters wherever
+// the cache was flushed, or where the running ACMR is already within
+// `threshold` of the cluster's ACMR, then draws the clusters facing away from
+// the mesh center first so they occlude the rest from most view directions
+void optimize_overdraw(uint32_t *indices, uint32_t indices_len,
+                       Vertex *vertices, uint32_t vertices_len,
+                       float threshold) {
+  uint32_t triangles_len = indices_len / 3;
+  if (triangles_len == 0) {
     return;
-  VkDebugUtilsMessengerCreateInfoEXT create_info = {0};
-  populate_debug_messenger_create_info(&create_info);
+  }
 
-  if (create_debug_utils_messenger_ext(instance, &create_info, NULL,
-                                       &debug_messenger) != VK_SUCCESS) {
-    THROW("failed to set up debug messenger!\n");
+  uint32_t *loaded_at = calloc(vertices_len, sizeof(uint32_t));
+  uint32_t *hard_starts = malloc(sizeof(uint32_t) * (triangles_len + 1));
+  uint32_t *cluster_starts = malloc(sizeof(uint32_t) * (triangles_len + 1));
+  if (!loaded_at || !hard_starts || !cluster_starts) {
+    THROW("failed to allocate overdraw optimizer!\n");
   }
-}
 
-QueueFamilyIndices find_queue_families(VkPhysicalDevice device) {
-  QueueFamilyIndices indices;
-  uint32_t queue_family_count = 0;
-  vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, NULL);
-  VkQueueFamilyProperties queue_families[64];
-  vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count,
-                                           queue_families);
+  // a triangle that misses on all three vertices follows a cache flush
+  uint32_t cache_size = SIMULATED_VERTEX_CACHE_SIZE;
+  uint32_t time = cache_size + 1;
+  uint32_t hard_len = 0;
+  for (int i = 0; i < triangles_len; i++) {
+    uint32_t misses =
+        update_fifo_cache(loaded_at, &time, &indices[i * 3], 3, cache_size);
+    if (i == 0 || misses == 3) {
+      hard_starts[hard_len] = i;
+      hard_len += 1;
+    }
+  }
+  hard_starts[hard_len] = triangles_len;
+
+  uint32_t clusters_len = 0;
+  for (int c = 0; c < hard_len; c++) {
+    uint32_t start = hard_starts[c];
+    uint32_t end = hard_starts[c + 1];
+
+    time += cache_size + 1;
+    uint32_t cluster_misses =
+        update_fifo_cache(loaded_at, &time, &indices[start * 3],
+                          (end - start) * 3, cache_size);
+    float cluster_threshold =
+        threshold * (float)cluster_misses / (float)(end - start);
+
+    time += cache_size + 1;
+    uint32_t running_misses = 0;
+    uint32_t running_triangles = 0;
+    cluster_starts[clusters_len] = start;
+    clusters_len += 1;
+    for (uint32_t i = start; i + 1 < end; i++) {
+      running_misses +=
+          update_fifo_cache(loaded_at, &time, &indices[i * 3], 3, cache_size);
+      running_triangles += 1;
+      if (running_misses <= cluster_threshold * running_triangles) {
+        cluster_starts[clusters_len] = i + 1;
+        clusters_len += 1;
+        time += cache_size + 1;
+        running_misses = 0;
+        running_triangles = 0;
+      }
+    }
+  }
+  cluster_starts[clusters_len] = triangles_len;
+  free(loaded_at);
+  free(hard_starts);
 
-  for (int i = 0; i < queue_family_count; i++) {
-    if (queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-      indices.graphics_family = i;
+  vec3 mesh_center = {0};
+  for (int i = 0; i < vertices_len; i++) {
+    glm_vec3_add(mesh_center, vertices[i].pos, mesh_center);
+  }
+  glm_vec3_scale(mesh_center, 1.0f / vertices_len, mesh_center);
+
+  // key each cluster by how far its area weighted center lies along its
+  // average normal, outward facing clusters sort first
+  ClusterSortKey *keys = malloc(sizeof(ClusterSortKey) * clusters_len);
+  if (!keys) {
+    THROW("failed to allocate overdraw optimizer!\n");
+  }
+  for (int c = 0; c < clusters_len; c++) {
+    vec3 center = {0};
+    vec3 normal = {0};
+    float area = 0.0f;
+    for (uint32_t i = cluster_starts[c]; i < cluster_starts[c + 1]; i++) {
+      float *p0 = vertices[indices[i * 3 + 0]].pos;
+      float *p1 = vertices[indices[i * 3 + 1]].pos;
+      float *p2 = vertices[indices[i * 3 + 2]].pos;
+
+      vec3 edge1, edge2, triangle_normal, triangle_center;
+      glm_vec3_sub(p1, p0, edge1);
+      glm_vec3_sub(p2, p0, edge2);
+      glm_vec3_cross(edge1, edge2, triangle_normal);
+      float triangle_area = glm_vec3_norm(triangle_normal);
+
+      glm_vec3_add(p0, p1, triangle_center);
+      glm_vec3_add(triangle_center, p2, triangle_center);
+      glm_vec3_scale(triangle_center, triangle_area / 3.0f, triangle_center);
+      glm_vec3_add(center, triangle_center, center);
+      glm_vec3_add(normal, triangle_normal, normal);
+      area += triangle_area;
     }
-    VkBool32 present_support = 0;
-    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
-    if (present_support) {
-      indices.present_family = i;
+
+    if (area > 0.0f) {
+      glm_vec3_scale(center, 1.0f / area, center);
     }
+    glm_vec3_sub(center, mesh_center, center);
+    glm_vec3_normalize(normal);
+
+    keys[c].key = glm_vec3_dot(center, normal);
+    keys[c].cluster = c;
   }
+  qsort(keys, clusters_len, sizeof(ClusterSortKey), compare_cluster_keys);
 
-  return indices;
+  uint32_t *output = malloc(sizeof(uint32_t) * triangles_len * 3);
+  if (!output) {
+    THROW("failed to allocate overdraw optimizer!\n");
+  }
+  uint32_t output_len = 0;
+  for (int c = 0; c < clusters_len; c++) {
+    uint32_t start = cluster_starts[keys[c].cluster];
+    uint32_t end = cluster_starts[keys[c].cluster + 1];
+    memcpy(&output[output_len], &indices[start * 3],
+           sizeof(uint32_t) * (end - start) * 3);
+    output_len += (end - start) * 3;
+  }
+  memcpy(indices, output, sizeof(uint32_t) * output_len);
+
+  free(output);
+  free(keys);
+  free(cluster_starts);
 }
 
-int check_device_extension_support(VkPhysicalDevice device) {
-  uint32_t extension_count = 0;
-  vkEnumerateDeviceExtensionProperties(device, NULL, &extension_count, NULL);
-  VkExtensionProperties available_extensions[256];
-  vkEnumerateDeviceExtensionProperties(device, NULL, &extension_count,
-                                       available_extensions);
+// bytes pulled through a FIFO cache of 64 byte lines per byte of vertex
+// data, 1 means every vertex was fetched exactly once
+float analyze_vertex_fetch(const uint32_t *indices, uint32_t indices_len,
+                           uint32_t vertices_len, size_t vertex_size) {
+  if (indices_len == 0 || vertices_len == 0) {
+    return 0.0f;
+  }
 
-  for (int i = 0; i < DEVICE_EXTENSIONS_COUNT; i++) {
-    int found = 0;
-    for (int j = 0; j < extension_count; j++) {
-      if (strcmp(device_extensions[i], available_extensions[j].extensionName) ==
-          0) {
-        found = 1;
-        break;
-      }
-    }
+  uint32_t lines_len = (vertices_len * vertex_size) / FETCH_CACHE_LINE_SIZE + 2;
+  uint32_t *loaded_at = calloc(lines_len, sizeof(uint32_t));
+  if (!loaded_at) {
+    THROW("failed to allocate vertex fetch simulator!\n");
+  }
 
-    if (!found) {
-      return 0;
+  uint32_t time = FETCH_CACHE_LINES + 1;
+  uint32_t misses = 0;
+  for (int i = 0; i < indices_len; i++) {
+    size_t begin = indices[i] * vertex_size;
+    uint32_t first = begin / FETCH_CACHE_LINE_SIZE;
+    uint32_t last = (begin + vertex_size - 1) / FETCH_CACHE_LINE_SIZE;
+    for (uint32_t line = first; line <= last; line++) {
+      misses +=
+          update_fifo_cache(loaded_at, &time, &line, 1, FETCH_CACHE_LINES);
     }
   }
+  free(loaded_at);
 
-  return 1;
+  return (float)misses * FETCH_CACHE_LINE_SIZE /
+         (float)(vertices_len * vertex_size);
 }
 
-int is_device_suitable(VkPhysicalDevice device) {
-  QueueFamilyIndices indices = find_queue_families(device);
-  int extensions_supported = check_device_extension_support(device);
-  int swap_chain_adequate = 0;
-  if (extensions_supported) {
-    SwapChainSupportDetails swap_chain_support = {0};
-    query_swap_chain_support(device, &swap_chain_support);
+// rasterizes the mesh with a depth test from both ends of each axis and
+// returns shaded pixels per covered pixel, 1 means no overdraw at all
+float analyze_overdraw(const uint32_t *indices, uint32_t indices_len,
+                       Vertex *vertices, uint32_t vertices_len) {
+  if (indices_len == 0 || vertices_len == 0) {
+    return 0.0f;
+  }
 
-    swap_chain_adequate = swap_chain_support.formats_len > 0 &&
-                          swap_chain_support.present_modes_len > 0;
+  vec3 bounds_min, bounds_max;
+  glm_vec3_fill(bounds_min, INFINITY);
+  glm_vec3_fill(bounds_max, -INFINITY);
+  for (int i = 0; i < vertices_len; i++) {
+    glm_vec3_minv(bounds_min, vertices[i].pos, bounds_min);
+    glm_vec3_maxv(bounds_max, vertices[i].pos, bounds_max);
+  }
+  float extent = fmaxf(bounds_max[0] - bounds_min[0],
+                       fmaxf(bounds_max[1] - bounds_min[1],
+                             bounds_max[2] - bounds_min[2]));
+  float scale = extent > 0.0f ? (OVERDRAW_GRID_SIZE - 1) / extent : 0.0f;
+
+  float *depth =
+      malloc(sizeof(float) * OVERDRAW_GRID_SIZE * OVERDRAW_GRID_SIZE);
+  if (!depth) {
+    THROW("failed to allocate overdraw simulator!\n");
   }
-  int is_complete = QFI_is_complete(&indices);
 
-  VkPhysicalDeviceFeatures supported_features;
-  vkGetPhysicalDeviceFeatures(device, &supported_features);
+  uint64_t shaded = 0;
+  uint64_t covered = 0;
+  for (int view = 0; view < 6; view++) {
+    int axis = view / 2;
+    float direction = view % 2 ? -1.0f : 1.0f;
+    int u = (axis + 1) % 3;
+    int v = (axis + 2) % 3;
 
-  return is_complete && extensions_supported && swap_chain_adequate &&
-         supported_features.samplerAnisotropy;
-}
+    for (int i = 0; i < OVERDRAW_GRID_SIZE * OVERDRAW_GRID_SIZE; i++) {
+      depth[i] = INFINITY;
+    }
 
-VkSurfaceFormatKHR
-choose_swap_surface_format(uint32_t count,
-                           VkSurfaceFormatKHR available_formats[]) {
-  for (int i = 0; i < count; i++) {
-    if (available_formats[i].format == VK_FORMAT_B8G8R8A8_SRGB &&
-        available_formats[i].colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
-      return available_formats[i];
+    for (int t = 0; t < indices_len / 3; t++) {
+      float *p[3];
+      float x[3], y[3], z[3];
+      for (int k = 0; k < 3; k++) {
+        p[k] = vertices[indices[t * 3 + k]].pos;
+        x[k] = (p[k][u] - bounds_min[u]) * scale;
+        y[k] = (p[k][v] - bounds_min[v]) * scale;
+        z[k] = (p[k][axis] - bounds_min[axis]) * direction;
+      }
+
+      // back faces are culled like the pipeline does
+      vec3 edge1, edge2, normal;
+      glm_vec3_sub(p[1], p[0], edge1);
+      glm_vec3_sub(p[2], p[0], edge2);
+      glm_vec3_cross(edge1, edge2, normal);
+      if (normal[axis] * direction >= 0.0f) {
+        continue;
+      }
+
+      float area =
+          (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+      if (area == 0.0f) {
+        continue;
+      }
+
+      int min_x = (int)fmaxf(0.0f, floorf(fminf(x[0], fminf(x[1], x[2]))));
+      int max_x = (int)fminf(OVERDRAW_GRID_SIZE - 1,
+                             ceilf(fmaxf(x[0], fmaxf(x[1], x[2]))));
+      int min_y = (int)fmaxf(0.0f, floorf(fminf(y[0], fminf(y[1], y[2]))));
+      int max_y = (int)fminf(OVERDRAW_GRID_SIZE - 1,
+                             ceilf(fmaxf(y[0], fmaxf(y[1], y[2]))));
+
+      for (int py = min_y; py <= max_y; py++) {
+        for (int px = min_x; px <= max_x; px++) {
+          float cx = px + 0.5f;
+          float cy = py + 0.5f;
+          float w0 = ((x[1] - cx) * (y[2] - cy) - (x[2] - cx) * (y[1] - cy)) /
+                     area;
+          float w1 = ((x[2] - cx) * (y[0] - cy) - (x[0] - cx) * (y[2] - cy)) /
+                     area;
+          float w2 = 1.0f - w0 - w1;
+          if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) {
+            continue;
+          }
+
+          float fragment_depth = w0 * z[0] + w1 * z[1] + w2 * z[2];
+          float *stored = &depth[py * OVERDRAW_GRID_SIZE + px];
+          if (fragment_depth < *stored) {
+            *stored = fragment_depth;
+            shaded += 1;
+          }
+        }
+      }
     }
-  }
-  return available_formats[0];
-}
 
-VkPresentModeKHR
-choose_swap_present_mode(uint32_t count,
-                         VkPresentModeKHR available_present_modes[]) {
-  for (int i = 0; i < count; i++) {
-    if (available_present_modes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
-      return available_present_modes[i];
+    for (int i = 0; i < OVERDRAW_GRID_SIZE * OVERDRAW_GRID_SIZE; i++) {
+      covered += depth[i] != INFINITY;
     }
   }
-  return VK_PRESENT_MODE_FIFO_KHR;
-}
+  free(depth);
 
-VkExtent2D choose_swap_extent(VkSurfaceCapabilitiesKHR *capabilities) {
-  if (capabilities->currentExtent.width != UINT32_MAX) {
-    return capabilities->currentExtent;
-  } else {
-    int width, height;
-    glfwGetFramebufferSize(window, &width, &height);
-    VkExtent2D actual_extent = {width, height};
-    if (actual_extent.width < capabilities->minImageExtent.width)
-      actual_extent.width = capabilities->minImageExtent.width;
-    if (actual_extent.width > capabilities->maxImageExtent.width)
-      actual_extent.width = capabilities->maxImageExtent.width;
-    if (actual_extent.height < capabilities->minImageExtent.height)
-      actual_extent.height = capabilities->minImageExtent.height;
-    if (actual_extent.height > capabilities->maxImageExtent.height)
-      actual_extent.height = capabilities->maxImageExtent.height;
+  return covered > 0 ? (float)shaded / (float)covered : 0.0f;
+}
 
-    return actual_extent;
+// bounding sphere around the meshlet's vertices and the cone bounding its
+// triangle normals, following the culling test described on Meshlet
+static void compute_meshlet_bounds(Meshlet *meshlet) {
+  uint32_t *local_vertices = &meshlet_vertices[meshlet->vertex_offset];
+  uint8_t *local_triangles = &meshlet_triangles[meshlet->triangle_offset];
+
+  vec3 bounds_min, bounds_max, center;
+  glm_vec3_fill(bounds_min, INFINITY);
+  glm_vec3_fill(bounds_max, -INFINITY);
+  for (int i = 0; i < meshlet->vertex_count; i++) {
+    glm_vec3_minv(bounds_min, vertices[local_vertices[i]].pos, bounds_min);
+    glm_vec3_maxv(bounds_max, vertices[local_vertices[i]].pos, bounds_max);
   }
-}
+  glm_vec3_add(bounds_min, bounds_max, center);
+  glm_vec3_scale(center, 0.5f, center);
 
-void pick_physical_device() {
-  uint32_t device_count = 0;
-  vkEnumeratePhysicalDevices(instance, &device_count, NULL);
-  if (device_count == 0) {
-    THROW("failed to find GPUs with Vulkan support!\n");
+  float radius = 0.0f;
+  for (int i = 0; i < meshlet->vertex_count; i++) {
+    float *pos = vertices[local_vertices[i]].pos;
+    radius = fmaxf(radius, glm_vec3_distance(center, pos));
   }
-  VkPhysicalDevice devices[MAX_DEVICES] = {0};
-  vkEnumeratePhysicalDevices(instance, &device_count, devices);
 
-  for (int i = 0; i < device_count; i++) {
-    if (is_device_suitable(devices[i])) {
-      physical_device = devices[i];
-      msaa_samples = get_max_usable_sample_count();
-      break;
+  vec3 normals[MESHLET_MAX_TRIANGLES];
+  vec3 corners[MESHLET_MAX_TRIANGLES];
+  uint32_t normals_len = 0;
+  vec3 axis = {0};
+  for (int i = 0; i < meshlet->triangle_count; i++) {
+    float *p0 = vertices[local_vertices[local_triangles[i * 3 + 0]]].pos;
+    float *p1 = vertices[local_vertices[local_triangles[i * 3 + 1]]].pos;
+    float *p2 = vertices[local_vertices[local_triangles[i * 3 + 2]]].pos;
+
+    vec3 edge1, edge2, normal;
+    glm_vec3_sub(p1, p0, edge1);
+    glm_vec3_sub(p2, p0, edge2);
+    glm_vec3_cross(edge1, edge2, normal);
+    float area = glm_vec3_norm(normal);
+    if (area == 0.0f) {
+      continue;
     }
+
+    glm_vec3_scale(normal, 1.0f / area, normals[normals_len]);
+    glm_vec3_copy(p0, corners[normals_len]);
+    glm_vec3_add(axis, normals[normals_len], axis);
+    normals_len += 1;
   }
 
-  if (physical_device == VK_NULL_HANDLE) {
-    THROW("failed to find suitable GPU!\n");
+  glm_vec3_copy(center, meshlet->center);
+  meshlet->radius = radius;
+  glm_vec3_copy(center, meshlet->cone_apex);
+  glm_vec3_zero(meshlet->cone_axis);
+  meshlet->cone_cutoff = 1.0f;
+
+  float axis_len = glm_vec3_norm(axis);
+  if (axis_len == 0.0f) {
+    return;
   }
-}
+  glm_vec3_scale(axis, 1.0f / axis_len, axis);
+  glm_vec3_copy(axis, meshlet->cone_axis);
 
-void create_logical_device() {
-  QueueFamilyIndices indices = find_queue_families(physical_device);
-  if (!QFI_is_complete(&indices)) {
-    THROW("Can't find a queue family");
+  float min_dot = 1.0f;
+  for (int i = 0; i < normals_len; i++) {
+    min_dot = fminf(min_dot, glm_vec3_dot(normals[i], axis));
+  }
+  // past roughly 84 degrees from the axis the cone culls almost nothing and
+  // the apex below runs off to infinity
+  if (min_dot <= 0.1f) {
+    return;
   }
 
-  uint32_t queue_len = 0;
-  VkDeviceQueueCreateInfo queue_create_infos[QUEUE_COUNT] = {0};
-  uint32_t unique_queue_families[QUEUE_COUNT] = {indices.graphics_family,
-                                                 indices.present_family};
+  // move the apex back along the axis until it lies behind every triangle
+  // plane, so a camera in front of any triangle can't fall inside the cone
+  float max_t = 0.0f;
+  for (int i = 0; i < normals_len; i++) {
+    vec3 to_center;
+    glm_vec3_sub(center, corners[i], to_center);
+    float t = glm_vec3_dot(to_center, normals[i]) /
+              glm_vec3_dot(axis, normals[i]);
+    max_t = fmaxf(max_t, t);
+  }
+  for (int j = 0; j < 3; j++) {
+    meshlet->cone_apex[j] = center[j] - axis[j] * max_t;
+  }
+  meshlet->cone_cutoff = sqrtf(1.0f - min_dot * min_dot);
+}
 
-  // push unique queue
-  for (int i = 0; i < QUEUE_COUNT; i++) {
-    int unique = 1;
-    for (int j = 0; j < queue_len; j++) {
-      if (unique_queue_families[i] == unique_queue_families[j]) {
-        unique = 0;
-      }
-    }
-    if (unique) {
-      unique_queue_families[queue_len] = unique_queue_families[i];
-      queue_len += 1;
-    }
+// appends the meshlet and starts the next one where it ended
+static void finish_meshlet(Meshlet *meshlet, uint8_t *local_index) {
+  if (meshlet->triangle_count == 0) {
+    return;
   }
 
-  printf("Found %d unique queue\n", queue_len);
+  compute_meshlet_bounds(meshlet);
+  for (int i = 0; i < meshlet->vertex_count; i++) {
+    local_index[meshlet_vertices[meshlet->vertex_offset + i]] = UINT8_MAX;
+  }
 
-  float queue_priority = 1.0f;
+  reserve_array((void **)&meshlets, &meshlets_cap, meshlets_len + 1,
+                sizeof(Meshlet));
+  meshlets[meshlets_len] = *meshlet;
+  meshlets_len += 1;
 
-  for (int i = 0; i < queue_len; i++) {
-    VkDeviceQueueCreateInfo *queue_create_info = &queue_create_infos[i];
-    queue_create_info->sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
-    queue_create_info->queueFamilyIndex = unique_queue_families[i];
-    queue_create_info->queueCount = 1;
-    queue_create_info->pQueuePriorities = &queue_priority;
-  }
+  uint32_t index_offset = meshlet->index_offset + meshlet->triangle_count * 3;
+  memset(meshlet, 0, sizeof(Meshlet));
+  meshlet->index_offset = index_offset;
+  meshlet->vertex_offset = meshlet_vertices_len;
+  meshlet->triangle_offset = meshlet_triangles_len;
+}
 
-  VkPhysicalDeviceFeatures device_features = {0};
-  device_features.samplerAnisotropy = VK_TRUE;
-  device_features.sampleRateShading = VK_TRUE;
-  VkDeviceCreateInfo create_info = {0};
-  create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
-  create_info.pQueueCreateInfos = queue_create_infos;
-  create_info.queueCreateInfoCount = queue_len;
-  create_info.pEnabledFeatures = &device_features;
-  create_info.enabledExtensionCount = DEVICE_EXTENSIONS_COUNT;
-  create_info.ppEnabledExtensionNames = device_extensions;
-  if (ENABLE_VALICATION_LAYERS) {
-    create_info.enabledLayerCount = VALIDATION_LAYER_COUNT;
-    create_info.ppEnabledLayerNames = validation_layers;
-  } else {
-    create_info.enabledLayerCount = 0;
+static const Vertex *position_sort_vertices;
+
+static int compare_vertex_positions(const void *a, const void *b) {
+  return memcmp(position_sort_vertices[*(const uint32_t *)a].pos,
+                position_sort_vertices[*(const uint32_t *)b].pos,
+                sizeof(vec3));
+}
+
+// maps every vertex to the first vertex sharing its position, so triangles
+// on both sides of a texture seam can be treated as adjacent
+uint32_t *remap_vertices_by_position() {
+  uint32_t *order = malloc(sizeof(uint32_t) * (vertices_len + 1));
+  uint32_t *remap = malloc(sizeof(uint32_t) * (vertices_len + 1));
+  if (!order || !remap) {
+    THROW("failed to allocate position remap!\n");
   }
 
-  if (vkCreateDevice(physical_device, &create_info, NULL, &device) !=
-      VK_SUCCESS) {
-    THROW("failed to create logical device!\n");
+  for (int i = 0; i < vertices_len; i++) {
+    order[i] = i;
+  }
+  position_sort_vertices = vertices;
+  qsort(order, vertices_len, sizeof(uint32_t), compare_vertex_positions);
+  for (int i = 0; i < vertices_len; i++) {
+    int same = i > 0 && compare_vertex_positions(&order[i], &order[i - 1]) == 0;
+    remap[order[i]] = same ? remap[order[i - 1]] : order[i];
   }
+  free(order);
+  return remap;
+}
 
-  vkGetDeviceQueue(device, indices.graphics_family, 0, &graphics_queue);
-  vkGetDeviceQueue(device, indices.present_family, 0, &present_queue);
+static uint32_t count_new_vertices(const uint32_t *triangle,
+                                   const uint8_t *local_index) {
+  return (local_index[triangle[0]] == UINT8_MAX) +
+         (local_index[triangle[1]] == UINT8_MAX &&
+          triangle[1] != triangle[0]) +
+         (local_index[triangle[2]] == UINT8_MAX &&
+          triangle[2] != triangle[0] && triangle[2] != triangle[1]);
 }
 
-void create_surface() {
-  if (glfwVulkanSupported() != GLFW_TRUE) {
-    THROW("glfw not support vulkan\n");
+// grows each meshlet from a seed triangle by repeatedly adding the
+// neighbouring triangle that brings in the fewest new vertices, with a
+// penalty for normals that disagree with the meshlet's so its normal cone
+// stays narrow. Seeds are taken in index buffer order so meshlets roughly
+// follow the optimized triangle order, and indices[] is rewritten so every
+// meshlet is a contiguous range of it.
+void build_meshlets() {
+  uint32_t triangles_len = indices_len / 3;
+  uint32_t *position_remap = remap_vertices_by_position();
+  uint32_t *position_indices = malloc(sizeof(uint32_t) * (indices_len + 1));
+  if (!position_indices) {
+    THROW("failed to allocate meshlet builder!\n");
   }
-  VkResult r = glfwCreateWindowSurface(instance, window, NULL, &surface);
-  if (r != VK_SUCCESS) {
-    THROW("failed to create window surface! err: %d\n", r);
+  for (int i = 0; i < indices_len; i++) {
+    position_indices[i] = position_remap[indices[i]];
   }
-}
-
-void create_swap_chain() {
-  SwapChainSupportDetails swap_chain_support = {0};
-  query_swap_chain_support(physical_device, &swap_chain_support);
-  VkSurfaceFormatKHR surface_format = choose_swap_surface_format(
-      swap_chain_support.formats_len, swap_chain_support.formats);
-  VkPresentModeKHR present_mode = choose_swap_present_mode(
-      swap_chain_support.present_modes_len, swap_chain_support.present_modes);
-  VkExtent2D extent = choose_swap_extent(&swap_chain_support.capabilities);
-  uint32_t image_count = swap_chain_support.capabilities.minImageCount + 1;
-  if (swap_chain_support.capabilities.maxImageCount > 0 &&
-      image_count > swap_chain_support.capabilities.maxImageCount) {
-    image_count = swap_chain_support.capabilities.maxImageCount;
+  TriangleAdjacency adjacency;
+  build_triangle_adjacency(&adjacency, position_indices, triangles_len * 3,
+                           vertices_len);
+  free(position_indices);
+
+  vec3 *normals = malloc(sizeof(vec3) * (triangles_len + 1));
+  uint8_t *emitted = calloc(triangles_len + 1, sizeof(uint8_t));
+  uint8_t *local_index = malloc(vertices_len + 1);
+  uint32_t *output = malloc(sizeof(uint32_t) * (triangles_len * 3 + 1));
+  if (!normals || !emitted || !local_index || !output) {
+    THROW("failed to allocate meshlet builder!\n");
   }
-
-  VkSwapchainCreateInfoKHR create_info = {0};
-  create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
-  create_info.surface = surface;
-  create_info.minImageCount = image_count;
-  create_info.imageFormat = surface_format.format;
-  create_info.imageColorSpace = surface_format.colorSpace;
-  create_info.imageExtent = extent;
-  create_info.imageArrayLayers = 1;
-  create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
-  QueueFamilyIndices indices = find_queue_families(physical_device);
-  uint32_t queue_family_indices[] = {indices.graphics_family,
-                                     indices.present_family};
-  if (indices.graphics_family != indices.present_family) {
-    create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
-    create_info.queueFamilyIndexCount = 2;
-    create_info.pQueueFamilyIndices = queue_family_indices;
-  } else {
-    create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    create_info.queueFamilyIndexCount = 0;
-    create_info.pQueueFamilyIndices = NULL;
+  memset(local_index, UINT8_MAX, vertices_len);
+
+  for (int t = 0; t < triangles_len; t++) {
+    vec3 edge1, edge2;
+    glm_vec3_sub(vertices[indices[t * 3 + 1]].pos,
+                 vertices[indices[t * 3 + 0]].pos, edge1);
+    glm_vec3_sub(vertices[indices[t * 3 + 2]].pos,
+                 vertices[indices[t * 3 + 0]].pos, edge2);
+    glm_vec3_cross(edge1, edge2, normals[t]);
+    float area = glm_vec3_norm(normals[t]);
+    glm_vec3_scale(normals[t], area > 0.0f ? 1.0f / area : 0.0f, normals[t]);
   }
 
-  create_info.preTransform = swap_chain_support.capabilities.currentTransform;
-  create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+  reserve_array((void **)&meshlet_vertices, &meshlet_vertices_cap,
+                vertices_len, sizeof(uint32_t));
+  reserve_array((void **)&meshlet_triangles, &meshlet_triangles_cap,
+                indices_len, sizeof(uint8_t));
+
+  Meshlet meshlet = {0};
+  vec3 meshlet_normal = {0};
+  // meshlets don't cross batches, so each one is drawn with one material
+  for (int b = 0; b < batches_len; b++) {
+    uint32_t batch_begin = batches[b].index_offset / 3;
+    uint32_t batch_end = batch_begin + batches[b].index_count / 3;
+    uint32_t next_seed = batch_begin;
+    for (uint32_t n = batch_begin; n < batch_end; n++) {
+      int64_t best_triangle = -1;
+      float best_score = INFINITY;
+
+      vec3 axis;
+      glm_vec3_copy(meshlet_normal, axis);
+      float axis_len = glm_vec3_norm(axis);
+      glm_vec3_scale(axis, axis_len > 0.0f ? 1.0f / axis_len : 0.0f, axis);
+
+      uint32_t *local_vertices = &meshlet_vertices[meshlet.vertex_offset];
+      for (int i = 0; i < meshlet.vertex_count; i++) {
+        uint32_t vertex = position_remap[local_vertices[i]];
+        uint32_t *list = &adjacency.triangles[adjacency.offsets[vertex]];
+        for (int j = 0; j < adjacency.counts[vertex]; j++) {
+          uint32_t candidate = list[j];
+          if (emitted[candidate] || candidate < batch_begin ||
+              candidate >= batch_end) {
+            continue;
+          }
+
+          uint32_t new_vertices =
+              count_new_vertices(&indices[candidate * 3], local_index);
+          if (meshlet.vertex_count + new_vertices > MESHLET_MAX_VERTICES) {
+            continue;
+          }
+
+          float spread = 1.0f - glm_vec3_dot(normals[candidate], axis);
+          float score = new_vertices + MESHLET_CONE_WEIGHT * spread;
+          if (score < best_score) {
+            best_score = score;
+            best_triangle = candidate;
+          }
+        }
+      }
 
-  create_info.presentMode = present_mode;
-  create_info.clipped = VK_TRUE;
-  create_info.oldSwapchain = VK_NULL_HANDLE;
+      if (best_triangle < 0 && meshlet.triangle_count > 0) {
+        // nothing adjacent fits, look for the closest triangle that does among
+        // the next MESHLET_SEARCH_WINDOW in index order before giving up on
+        // this meshlet
+        vec3 center = {0};
+        for (int i = 0; i < meshlet.vertex_count; i++) {
+          glm_vec3_add(center, vertices[local_vertices[i]].pos, center);
+        }
+        glm_vec3_scale(center, 1.0f / meshlet.vertex_count, center);
+        float radius = 0.0f;
+        for (int i = 0; i < meshlet.vertex_count; i++) {
+          float *pos = vertices[local_vertices[i]].pos;
+          radius = fmaxf(radius, glm_vec3_distance(center, pos));
+        }
+
+        while (emitted[next_seed]) {
+          next_seed += 1;
+        }
+        uint32_t window_end = next_seed + MESHLET_SEARCH_WINDOW;
+        for (uint32_t t = next_seed; t < batch_end && t < window_end; t++) {
+          if (emitted[t]) {
+            continue;
+          }
+
+          uint32_t new_vertices =
+              count_new_vertices(&indices[t * 3], local_index);
+          if (meshlet.vertex_count + new_vertices > MESHLET_MAX_VERTICES) {
+            continue;
+          }
+
+          // only pull in triangles close enough to keep the bounds tight
+          float distance =
+              glm_vec3_distance(center, vertices[indices[t * 3]].pos);
+          float spread = 1.0f - glm_vec3_dot(normals[t], axis);
+          float score = distance * (1.0f + MESHLET_CONE_WEIGHT * spread);
+          if (distance <= 2.0f * radius && score < best_score) {
+            best_score = score;
+            best_triangle = t;
+          }
+        }
+      }
 
-  if (vkCreateSwapchainKHR(device, &create_info, NULL, &swap_chain) !=
-      VK_SUCCESS) {
-    THROW("failed to create swap chain!\n");
+      if (best_triangle < 0) {
+        // nothing nearby fits, start a new meshlet from the next seed
+        finish_meshlet(&meshlet, local_index);
+        glm_vec3_zero(meshlet_normal);
+        while (emitted[next_seed]) {
+          next_seed += 1;
+        }
+        best_triangle = next_seed;
+      }
+
+      uint32_t *triangle = &indices[best_triangle * 3];
+      for (int k = 0; k < 3; k++) {
+        uint32_t vertex = triangle[k];
+        if (local_index[vertex] == UINT8_MAX) {
+          local_index[vertex] = meshlet.vertex_count;
+          reserve_array((void **)&meshlet_vertices, &meshlet_vertices_cap,
+                        meshlet_vertices_len + 1, sizeof(uint32_t));
+          meshlet_vertices[meshlet_vertices_len] = vertex;
+          meshlet_vertices_len += 1;
+          meshlet.vertex_count += 1;
+        }
+        meshlet_triangles[meshlet_triangles_len] = local_index[vertex];
+        meshlet_triangles_len += 1;
+        output[n * 3 + k] = vertex;
+      }
+      emitted[best_triangle] = 1;
+      glm_vec3_add(meshlet_normal, normals[best_triangle], meshlet_normal);
+      meshlet.triangle_count += 1;
+
+      if (meshlet.triangle_count == MESHLET_MAX_TRIANGLES) {
+        finish_meshlet(&meshlet, local_index);
+        glm_vec3_zero(meshlet_normal);
+      }
+    }
+    finish_meshlet(&meshlet, local_index);
+    glm_vec3_zero(meshlet_normal);
+  }
+  memcpy(indices, output, sizeof(uint32_t) * triangles_len * 3);
+
+  free(position_remap);
+  free(normals);
+  free(emitted);
+  free(local_index);
+  free(output);
+  free_triangle_adjacency(&adjacency);
+
+  shrink_array((void **)&meshlets, &meshlets_cap, meshlets_len,
+               sizeof(Meshlet));
+  shrink_array((void **)&meshlet_vertices, &meshlet_vertices_cap,
+               meshlet_vertices_len, sizeof(uint32_t));
+
+  uint32_t cullable = 0;
+  for (int i = 0; i < meshlets_len; i++) {
+    cullable += meshlets[i].cone_cutoff < 1.0f;
   }
+  printf("built %u meshlets: %.1f vertices and %.1f triangles on average, "
+         "%u with a usable normal cone\n",
+         meshlets_len, (float)meshlet_vertices_len / meshlets_len,
+         (float)meshlet_triangles_len / 3 / meshlets_len, cullable);
+}
 
-  vkGetSwapchainImagesKHR(device, swap_chain, &swap_chain_images_count, NULL);
-  vkGetSwapchainImagesKHR(device, swap_chain, &swap_chain_images_count,
-                          swap_chain_images);
-  swap_chain_image_format = surface_format.format;
-  swap_chain_extent = extent;
+void print_mesh_stats(const char *label) {
+  VertexCacheStats cache = simulate_vertex_cache(
+      indices, indices_len, vertices_len, SIMULATED_VERTEX_CACHE_SIZE);
+  float overfetch = analyze_vertex_fetch(indices, indices_len, vertices_len,
+                                         sizeof(PackedVertex));
+  printf("%s: acmr %.3f, atvr %.3f, overfetch %.3f", label, cache.acmr,
+         cache.atvr, overfetch);
+  if (MEASURE_OVERDRAW) {
+    printf(", overdraw %.3f",
+           analyze_overdraw(indices, indices_len, vertices, vertices_len));
+  }
+  printf("\n");
 }
 
-VkImageView create_image_view(VkImage image, VkFormat format,
-                              VkImageAspectFlags aspect_flags,
-                              uint32_t mip_levels) {
-  VkImageViewCreateInfo view_info = {0};
-  view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
-  view_info.image = image;
-  view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
-  view_info.format = format;
-  view_info.subresourceRange.aspectMask = aspect_flags;
-  view_info.subresourceRange.baseMipLevel = 0;
-  view_info.subresourceRange.levelCount = mip_levels;
-  view_info.subresourceRange.baseArrayLayer = 0;
-  view_info.subresourceRange.layerCount = 1;
+// symmetric 4x4 error quadric of Garland and Heckbert's "Surface
+// Simplification Using Quadric Error Metrics", stored as the upper triangle
+// of A, the vector b and the constant c of p'Ap + 2b'p + c. `weight` is the
+// total area that went into it so the error can be normalized.
+typedef struct {
+  double a00, a11, a22, a01, a02, a12;
+  double b0, b1, b2;
+  double c;
+  double weight;
+} Quadric;
+
+// squared distance to the plane n.p + d = 0, times weight
+static void quadric_from_plane(Quadric *q, const vec3 n, float d,
+                               float weight) {
+  q->a00 = (double)n[0] * n[0] * weight;
+  q->a11 = (double)n[1] * n[1] * weight;
+  q->a22 = (double)n[2] * n[2] * weight;
+  q->a01 = (double)n[0] * n[1] * weight;
+  q->a02 = (double)n[0] * n[2] * weight;
+  q->a12 = (double)n[1] * n[2] * weight;
+  q->b0 = (double)n[0] * d * weight;
+  q->b1 = (double)n[1] * d * weight;
+  q->b2 = (double)n[2] * d * weight;
+  q->c = (double)d * d * weight;
+  q->weight = weight;
+}
 
-  VkImageView image_view;
-  if (vkCreateImageView(device, &view_info, NULL, &image_view) != VK_SUCCESS) {
-    THROW("failed to create texture image view!\n");
+static void quadric_add(Quadric *dst, const Quadric *src) {
+  dst->a00 += src->a00;
+  dst->a11 += src->a11;
+  dst->a22 += src->a22;
+  dst->a01 += src->a01;
+  dst->a02 += src->a02;
+  dst->a12 += src->a12;
+  dst->b0 += src->b0;
+  dst->b1 += src->b1;
+  dst->b2 += src->b2;
+  dst->c += src->c;
+  dst->weight += src->weight;
+}
+
+// mean squared distance from p to the planes accumulated in q
+static double quadric_error(const Quadric *q, const float *p) {
+  double x = p[0], y = p[1], z = p[2];
+  double rx = q->a00 * x + q->a01 * y + q->a02 * z + 2.0 * q->b0;
+  double ry = q->a01 * x + q->a11 * y + q->a12 * z + 2.0 * q->b1;
+  double rz = q->a02 * x + q->a12 * y + q->a22 * z + 2.0 * q->b2;
+  double error = rx * x + ry * y + rz * z + q->c;
+  return q->weight > 0.0 ? fabs(error) / q->weight : 0.0;
+}
+
+// an edge between two positions, key holds the smaller position in the high
+// half, corner is the index of the edge's first corner in the index list
+typedef struct {
+  uint64_t key;
+  uint32_t corner;
+} MeshEdge;
+
+static int compare_mesh_edges(const void *a, const void *b) {
+  uint64_t ka = ((const MeshEdge *)a)->key;
+  uint64_t kb = ((const MeshEdge *)b)->key;
+  return ka < kb ? -1 : ka > kb;
+}
+
+// every edge of every triangle, sorted so the triangles sharing an edge are
+// next to each other
+static MeshEdge *sort_mesh_edges(const uint32_t *indices,
+                                 const uint32_t *position_remap,
+                                 uint32_t indices_len) {
+  MeshEdge *edges = malloc(sizeof(MeshEdge) * (indices_len + 1));
+  if (!edges) {
+    THROW("failed to allocate mesh edges!\n");
   }
 
-  return image_view;
+  for (int i = 0; i < indices_len; i++) {
+    uint64_t a = position_remap[indices[i]];
+    uint64_t b = position_remap[indices[i - i % 3 + (i + 1) % 3]];
+    edges[i].key = a < b ? a << 32 | b : b << 32 | a;
+    edges[i].corner = i;
+  }
+  qsort(edges, indices_len, sizeof(MeshEdge), compare_mesh_edges);
+  return edges;
 }
 
-void create_image_views() {
-  swap_chain_image_views_count = swap_chain_images_count;
-  for (int i = 0; i < swap_chain_images_count; i++) {
-    swap_chain_image_views[i] =
-        create_image_view(swap_chain_images[i], swap_chain_image_format,
-                          VK_IMAGE_ASPECT_COLOR_BIT, 1);
+static uint32_t count_equal_edges(const MeshEdge *edges, uint32_t edges_len,
+                                  uint32_t first) {
+  uint32_t count = 1;
+  while (first + count < edges_len &&
+         edges[first + count].key == edges[first].key) {
+    count += 1;
   }
+  return count;
 }
 
-uint32_t read_file(char *filename, char *buffer) {
-  FILE *f = fopen(filename, "rb");
-  fseek(f, 0, SEEK_END);
-  uint32_t filelen = ftell(f);
-  rewind(f);
-  fread(buffer, filelen, 1, f);
-  fclose(f);
-  return filelen;
+typedef struct {
+  uint32_t from;
+  uint32_t to;
+  float cost;
+} Collapse;
+
+static int compare_collapses(const void *a, const void *b) {
+  float ca = ((const Collapse *)a)->cost;
+  float cb = ((const Collapse *)b)->cost;
+  return ca < cb ? -1 : ca > cb;
 }
 
-VkShaderModule create_shader_module(char *code, uint32_t size) {
-  VkShaderModuleCreateInfo create_info = {0};
-  create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
-  create_info.codeSize = size;
-  create_info.pCode = (const uint32_t *)code;
-  VkShaderModule shader_module;
-  if (vkCreateShaderModule(device, &create_info, NULL, &shader_module) !=
-      VK_SUCCESS) {
-    THROW("failed to create shader module!\n");
+// state shared by the passes of one simplify_mesh() call. Quadrics and the
+// flags are kept per position, i.e. indexed by the representative vertex
+// from remap_vertices_by_position().
+typedef struct {
+  const uint32_t *position_remap;
+  // links the vertices sharing a position into a cycle
+  uint32_t *wedge_next;
+  uint32_t *vertex_remap;
+  Quadric *quadrics;
+  uint8_t *border;
+  uint8_t *locked;
+  // squared error of the worst collapse performed
+  double max_error;
+} Simplifier;
+
+// would moving position `from` onto `to` turn one of the triangles around
+// `from` over?
+static int collapse_flips(const uint32_t *position_indices,
+                          const TriangleAdjacency *adjacency, uint32_t from,
+                          uint32_t to) {
+  const uint32_t *list = &adjacency->triangles[adjacency->offsets[from]];
+  for (int i = 0; i < adjacency->counts[from]; i++) {
+    const uint32_t *triangle = &position_indices[list[i] * 3];
+    if (triangle[0] == to || triangle[1] == to || triangle[2] == to) {
+      continue;
+    }
+
+    float *before[3], *after[3];
+    for (int k = 0; k < 3; k++) {
+      before[k] = vertices[triangle[k]].pos;
+      after[k] = triangle[k] == from ? vertices[to].pos : before[k];
+    }
+
+    vec3 edge1, edge2, normal_before, normal_after;
+    glm_vec3_sub(before[1], before[0], edge1);
+    glm_vec3_sub(before[2], before[0], edge2);
+    glm_vec3_cross(edge1, edge2, normal_before);
+    glm_vec3_sub(after[1], after[0], edge1);
+    glm_vec3_sub(after[2], after[0], edge2);
+    glm_vec3_cross(edge1, edge2, normal_after);
+    if (glm_vec3_dot(normal_before, normal_after) <= 0.0f) {
+      return 1;
+    }
   }
-  return shader_module;
+  return 0;
 }
 
-void create_descriptor_set_layout() {
-  VkDescriptorSetLayoutBinding uboLayoutBinding = {0};
-  uboLayoutBinding.binding = 0;
-  uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  uboLayoutBinding.descriptorCount = 1;
-  uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-  uboLayoutBinding.pImmutableSamplers = NULL;
+// every vertex of position `from` still in use has to move onto the vertex
+// of position `to` it shares a triangle with, otherwise the collapse would
+// tear a texture seam open. Fills vertex_remap and returns 1 on success.
+static int pair_collapse_wedges(Simplifier *s, const uint32_t *indices,
+                                const TriangleAdjacency *adjacency,
+                                uint32_t from, uint32_t to) {
+  const uint32_t *list = &adjacency->triangles[adjacency->offsets[from]];
+  uint32_t wedge = from;
+  do {
+    int used = 0;
+    uint32_t partner = UINT32_MAX;
+    for (int i = 0; i < adjacency->counts[from]; i++) {
+      const uint32_t *triangle = &indices[list[i] * 3];
+      if (triangle[0] != wedge && triangle[1] != wedge &&
+          triangle[2] != wedge) {
+        continue;
+      }
+      used = 1;
+      for (int k = 0; k < 3; k++) {
+        if (s->position_remap[triangle[k]] == to) {
+          partner = triangle[k];
+        }
+      }
+    }
 
-  VkDescriptorSetLayoutBinding sampler_layout_binding = {0};
-  sampler_layout_binding.binding = 1;
-  sampler_layout_binding.descriptorCount = 1;
-  sampler_layout_binding.descriptorType =
-      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  sampler_layout_binding.pImmutableSamplers = NULL;
-  sampler_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+    if (used && partner == UINT32_MAX) {
+      for (uint32_t w = from; w != wedge; w = s->wedge_next[w]) {
+        s->vertex_remap[w] = w;
+      }
+      return 0;
+    }
+    if (used) {
+      s->vertex_remap[wedge] = partner;
+    }
+    wedge = s->wedge_next[wedge];
+  } while (wedge != from);
+  return 1;
+}
 
-  VkDescriptorSetLayoutBinding bindings[] = {uboLayoutBinding,
-                                             sampler_layout_binding};
+static int collapse_allowed(Simplifier *s, const uint32_t *indices,
+                            const uint32_t *position_indices,
+                            const TriangleAdjacency *adjacency, uint32_t from,
+                            uint32_t to) {
+  if (collapse_flips(position_indices, adjacency, from, to) ||
+      !pair_collapse_wedges(s, indices, adjacency, from, to)) {
+    return 0;
+  }
+  uint32_t wedge = from;
+  do {
+    s->vertex_remap[wedge] = wedge;
+    wedge = s->wedge_next[wedge];
+  } while (wedge != from);
+  return 1;
+}
 
-  VkDescriptorSetLayoutCreateInfo layout_info = {0};
-  layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-  layout_info.bindingCount = 2;
-  layout_info.pBindings = bindings;
+// plane quadrics for every triangle plus, along the border, quadrics for the
+// planes standing perpendicular on it so open edges keep their outline
+static void init_simplifier_quadrics(Simplifier *s, const uint32_t *indices,
+                                     uint32_t indices_len) {
+  const uint32_t *position_remap = s->position_remap;
+  for (int i = 0; i < indices_len; i += 3) {
+    uint32_t triangle[3] = {position_remap[indices[i + 0]],
+                            position_remap[indices[i + 1]],
+                            position_remap[indices[i + 2]]};
+    vec3 edge1, edge2, normal;
+    glm_vec3_sub(vertices[triangle[1]].pos, vertices[triangle[0]].pos, edge1);
+    glm_vec3_sub(vertices[triangle[2]].pos, vertices[triangle[0]].pos, edge2);
+    glm_vec3_cross(edge1, edge2, normal);
+    float area = glm_vec3_norm(normal) * 0.5f;
+    if (area == 0.0f) {
+      continue;
+    }
 
-  if (vkCreateDescriptorSetLayout(device, &layout_info, NULL,
-                                  &descriptor_set_layout) != VK_SUCCESS) {
-    THROW("failed to create descriptor set layout!\n");
+    glm_vec3_normalize(normal);
+    Quadric q;
+    quadric_from_plane(&q, normal,
+                       -glm_vec3_dot(normal, vertices[triangle[0]].pos), area);
+    for (int k = 0; k < 3; k++) {
+      quadric_add(&s->quadrics[triangle[k]], &q);
+    }
   }
+
+  MeshEdge *edges = sort_mesh_edges(indices, position_remap, indices_len);
+  for (uint32_t i = 0; i < indices_len;) {
+    uint32_t count = count_equal_edges(edges, indices_len, i);
+    if (count == 1) {
+      uint32_t corner = edges[i].corner;
+      uint32_t first = corner - corner % 3;
+      uint32_t a = position_remap[indices[corner]];
+      uint32_t b = position_remap[indices[first + (corner + 1) % 3]];
+      uint32_t c = position_remap[indices[first + (corner + 2) % 3]];
+
+      vec3 edge, other, normal, plane;
+      glm_vec3_sub(vertices[b].pos, vertices[a].pos, edge);
+      glm_vec3_sub(vertices[c].pos, vertices[a].pos, other);
+      glm_vec3_cross(edge, other, normal);
+      glm_vec3_cross(edge, normal, plane);
+      float length_sq = glm_vec3_dot(edge, edge);
+      if (glm_vec3_norm(plane) > 0.0f) {
+        glm_vec3_normalize(plane);
+        Quadric q;
+        quadric_from_plane(&q, plane,
+                           -glm_vec3_dot(plane, vertices[a].pos),
+                           length_sq * LOD_BORDER_WEIGHT);
+        quadric_add(&s->quadrics[a], &q);
+        quadric_add(&s->quadrics[b], &q);
+      }
+    }
+    i += count;
+  }
+  free(edges);
 }
 
-void create_graphics_pipeline() {
-  vert_code_len = read_file("shaders/vert.spv", vert_shader_code);
-  frag_code_len = read_file("shaders/frag.spv", frag_shader_code);
+// one round of edge collapses: every edge gets the cost of its cheaper
+// direction, then the cheapest collapses whose neighbourhoods don't overlap
+// are performed. Returns the new index count.
+static uint32_t simplify_pass(Simplifier *s, uint32_t *indices,
+                              uint32_t indices_len, uint32_t target_len) {
+  // zeroed, -Wall can't tell the loop below writes every entry it reads
+  uint32_t *position_indices = calloc(indices_len + 1, sizeof(uint32_t));
+  Collapse *collapses = malloc(sizeof(Collapse) * (indices_len + 1));
+  if (!position_indices || !collapses) {
+    THROW("failed to allocate mesh simplifier!\n");
+  }
 
-  VkShaderModule vert_shader_module =
-      create_shader_module(vert_shader_code, vert_code_len);
-  VkShaderModule frag_shader_module =
-      create_shader_module(frag_shader_code, frag_code_len);
+  for (int i = 0; i < indices_len; i++) {
+    position_indices[i] = s->position_remap[indices[i]];
+    s->border[position_indices[i]] = 0;
+    s->locked[position_indices[i]] = 0;
+  }
+  TriangleAdjacency adjacency;
+  build_triangle_adjacency(&adjacency, position_indices, indices_len,
+                           vertices_len);
+
+  // an edge used by one triangle lies on the border, one used by three or
+  // more is non-manifold and neither of its ends may move
+  MeshEdge *edges = sort_mesh_edges(indices, s->position_remap, indices_len);
+  for (uint32_t i = 0; i < indices_len;) {
+    uint32_t count = count_equal_edges(edges, indices_len, i);
+    uint32_t a = edges[i].key >> 32;
+    uint32_t b = edges[i].key & UINT32_MAX;
+    if (count == 1) {
+      s->border[a] = s->border[b] = 1;
+    } else if (count > 2) {
+      s->locked[a] = s->locked[b] = 1;
+    }
+    i += count;
+  }
 
-  VkPipelineShaderStageCreateInfo vert_shader_stage_info = {0};
-  vert_shader_stage_info.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
-  vert_shader_stage_info.module = vert_shader_module;
-  vert_shader_stage_info.pName = "main";
+  // border positions may only slide along the border, and a direction that
+  // would flip a triangle or tear a seam is dropped here already so it
+  // doesn't crowd out the usable ones below
+  uint32_t collapses_len = 0;
+  for (uint32_t i = 0; i < indices_len;) {
+    uint32_t count = count_equal_edges(edges, indices_len, i);
+    uint32_t a = edges[i].key >> 32;
+    uint32_t b = edges[i].key & UINT32_MAX;
+    i += count;
+
+    double cost_ab = INFINITY;
+    double cost_ba = INFINITY;
+    if (!s->locked[a] && (!s->border[a] || count == 1) &&
+        collapse_allowed(s, indices, position_indices, &adjacency, a, b)) {
+      cost_ab = quadric_error(&s->quadrics[a], vertices[b].pos);
+    }
+    if (!s->locked[b] && (!s->border[b] || count == 1) &&
+        collapse_allowed(s, indices, position_indices, &adjacency, b, a)) {
+      cost_ba = quadric_error(&s->quadrics[b], vertices[a].pos);
+    }
+    if (cost_ab == INFINITY && cost_ba == INFINITY) {
+      continue;
+    }
 
-  VkPipelineShaderStageCreateInfo frag_shader_stage_info = {0};
-  frag_shader_stage_info.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-  frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-  frag_shader_stage_info.module = frag_shader_module;
-  frag_shader_stage_info.pName = "main";
+    Collapse *collapse = &collapses[collapses_len];
+    collapse->from = cost_ab <= cost_ba ? a : b;
+    collapse->to = cost_ab <= cost_ba ? b : a;
+    collapse->cost = (float)(cost_ab <= cost_ba ? cost_ab : cost_ba);
+    collapses_len += 1;
+  }
+  free(edges);
+  qsort(collapses, collapses_len, sizeof(Collapse), compare_collapses);
 
-  VkPipelineShaderStageCreateInfo shader_stages[] = {vert_shader_stage_info,
-                                                     frag_shader_stage_info};
+  // from here on `locked` marks the positions whose triangles already
+  // changed in this pass
+  for (int i = 0; i < indices_len; i++) {
+    s->locked[position_indices[i]] = 0;
+  }
 
-  VkDynamicState dynamic_states[] = {
-      VK_DYNAMIC_STATE_VIEWPORT,
-      VK_DYNAMIC_STATE_SCISSOR,
-  };
-  VkPipelineDynamicStateCreateInfo dynamic_state = {0};
-  dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-  dynamic_state.dynamicStateCount = 2;
-  dynamic_state.pDynamicStates = dynamic_states;
+  // an interior collapse removes two triangles. Locks keep a pass from
+  // reaching that many, so the pass also stops at collapses much more
+  // expensive than the goal'th cheapest rather than take bad ones early;
+  // the next pass gets to pick again.
+  uint32_t goal = (indices_len - target_len) / 6 + 1;
+  uint32_t performed = 0;
+  float cost_limit = 0.0f;
+  if (collapses_len > 0) {
+    uint32_t last = goal < collapses_len ? goal : collapses_len - 1;
+    cost_limit = collapses[last].cost * LOD_PASS_COST_SLACK;
+  }
+  for (int i = 0; i < collapses_len && performed < goal; i++) {
+    uint32_t from = collapses[i].from;
+    uint32_t to = collapses[i].to;
+    if (performed > 0 && collapses[i].cost > cost_limit) {
+      break;
+    }
+    if (s->locked[from] || s->locked[to]) {
+      continue;
+    }
+    // nothing around `from` moved yet, so this pairs up as it did above
+    pair_collapse_wedges(s, indices, &adjacency, from, to);
 
-  VkPipelineVertexInputStateCreateInfo vertex_input_info = {0};
+    const uint32_t *list = &adjacency.triangles[adjacency.offsets[from]];
+    for (int j = 0; j < adjacency.counts[from]; j++) {
+      for (int k = 0; k < 3; k++) {
+        s->locked[position_indices[list[j] * 3 + k]] = 1;
+      }
+    }
 
-  VkVertexInputBindingDescription binding_description =
-      get_binding_description();
-  VkVertexInputAttributeDescription
+    quadric_add(&s->quadrics[to], &s->quadrics[from]);
+    s->max_error = fmax(s->max_error, collapses[i].cost);
+    performed += 1;
+  }
+
+  // move the collapsed vertices and drop the triangles that became lines
+  uint32_t result_len = 0;
+  for (int i = 0; i < indices_len; i += 3) {
+    uint32_t a = s->vertex_remap[indices[i + 0]];
+    uint32_t b = s->vertex_remap[indices[i + 1]];
+    uint32_t c = s->vertex_remap[indices[i + 2]];
+    uint32_t pa = s->position_remap[a];
+    uint32_t pb = s->position_remap[b];
+    uint32_t pc = s->position_remap[c];
+    if (pa == pb || pb == pc || pa == pc) {
+      continue;
+    }
+    indices[result_len + 0] = a;
+    indices[result_len + 1] = b;
+    indices[result_len + 2] = c;
+    result_len += 3;
+  }
+  for (int i = 0; i < vertices_len; i++) {
+    s->vertex_remap[i] = i;
+  }
+
+  free(position_indices);
+  free(collapses);
+  free_triangle_adjacency(&adjacency);
+  return result_len;
+}
+
+void init_simplifier(Simplifier *s, const uint32_t *position_remap,
+                     const uint32_t *indices, uint32_t indices_len) {
+  memset(s, 0, sizeof(Simplifier));
+  s->position_remap = position_remap;
+  s->wedge_next = malloc(sizeof(uint32_t) * (vertices_len + 1));
+  s->vertex_remap = malloc(sizeof(uint32_t) * (vertices_len + 1));
+  s->quadrics = calloc(vertices_len + 1, sizeof(Quadric));
+  s->border = calloc(vertices_len + 1, sizeof(uint8_t));
+  s->locked = calloc(vertices_len + 1, sizeof(uint8_t));
+  if (!s->wedge_next || !s->vertex_remap || !s->quadrics || !s->border ||
+      !s->locked) {
+    THROW("failed to allocate mesh simplifier!\n");
+  }
+
+  for (int i = 0; i < vertices_len; i++) {
+    s->wedge_next[i] = i;
+    s->vertex_remap[i] = i;
+  }
+  for (int i = 0; i < vertices_len; i++) {
+    uint32_t position = position_remap[i];
+    if (position != i) {
+      s->wedge_next[i] = s->wedge_next[position];
+      s->wedge_next[position] = i;
+    }
+  }
+
+  init_simplifier_quadrics(s, indices, indices_len);
+}
+
+void free_simplifier(Simplifier *s) {
+  free(s->wedge_next);
+  free(s->vertex_remap);
+  free(s->quadrics);
+  free(s->border);
+  free(s->locked);
+  memset(s, 0, sizeof(Simplifier));
+}
+
+// collapses edges of the mesh in `indices` in place until about
+// `target_len` indices are left or nothing more can go, and returns the new
+// length. Calls can be repeated with smaller targets on the result since
+// the quadrics keep accumulating in `s`.
+uint32_t simplify_mesh(Simplifier *s, uint32_t *indices, uint32_t indices_len,
+                       uint32_t target_len) {
+  while (indices_len > target_len) {
+    uint32_t len = simplify_pass(s, indices, indices_len, target_len);
+    if (len == indices_len) {
+      break;
+    }
+    indices_len = len;
+  }
+  return indices_len;
+}
+
+// the largest distance, in model units, between the simplified and the
+// original surface so far as estimated by the quadrics
+float simplifier_error(const Simplifier *s) {
+  return (float)sqrt(s->max_error);
+}
+
+// one batch's simplified version for one level of detail, kept aside until
+// it's known whether the level is worth drawing
+typedef struct {
+  uint32_t scratch_offset;
+  uint32_t index_count;
+  float error;
+  // the level these indices were built for, lower when the batch couldn't
+  // be simplified any further and keeps drawing an earlier level
+  uint32_t level;
+} BatchLod;
+
+// appends simplified copies of the full detail mesh, each with about half
+// the triangles of the previous level, to the index buffer. Every batch is
+// simplified on its own, which keeps the boundaries between materials in
+// place like borders. They all share the vertex buffer, select_lod() picks
+// one per frame.
+void build_lods() {
+  uint32_t lod0_len = indices_len;
+  uint32_t lod0_batches = batches_len;
+  uint32_t max_levels = BUILD_LODS ? LOD_MAX_LEVELS : 1;
+  reserve_array((void **)&lods, &lods_cap, max_levels, sizeof(MeshLod));
+  lods[0].batch_offset = 0;
+  lods[0].batch_count = lod0_batches;
+  lods[0].index_count = lod0_len;
+  lods[0].error = 0.0f;
+  lods_len = 1;
+
+  uint32_t *position_remap = remap_vertices_by_position();
+  uint32_t *lod_indices = malloc(sizeof(uint32_t) * (lod0_len + 1));
+  BatchLod *batch_lods =
+      malloc(sizeof(BatchLod) * (lod0_batches * max_levels + 1));
+  if (!lod_indices || !batch_lods) {
+    THROW("failed to allocate LOD indices!\n");
+  }
+  uint32_t scratch_len = 0;
+  uint32_t scratch_cap = 0;
+  uint32_t *scratch = NULL;
+
+  for (int b = 0; b < lod0_batches; b++) {
+    MeshBatch batch = batches[b];
+    BatchLod *levels = &batch_lods[b * max_levels];
+    levels[0].scratch_offset = 0;
+    levels[0].index_count = batch.index_count;
+    levels[0].error = 0.0f;
+    levels[0].level = 0;
+    memcpy(lod_indices, &indices[batch.index_offset],
+           sizeof(uint32_t) * batch.index_count);
+    Simplifier simplifier;
+    init_simplifier(&simplifier, position_remap, lod_indices,
+                    batch.index_count);
+
+    // each level continues simplifying the previous one, so the quadrics
+    // carry the error of every collapse so far
+    uint32_t len = batch.index_count;
+    for (int level = 1; level < max_levels; level++) {
+      uint32_t target_len = (batch.index_count >> level) / 3 * 3;
+      len = simplify_mesh(&simplifier, lod_indices, len, target_len);
+      // once the simplifier gets stuck on seams and borders the batch keeps
+      // its last level
+      if (len == 0 || len > levels[level - 1].index_count * LOD_MIN_REDUCTION) {
+        for (; level < max_levels; level++) {
+          levels[level] = levels[level - 1];
+        }
+        break;
+      }
+
+      reserve_array((void **)&scratch, &scratch_cap, scratch_len + len,
+                    sizeof(uint32_t));
+      memcpy(&scratch[scratch_len], lod_indices, sizeof(uint32_t) * len);
+      levels[level].scratch_offset = scratch_len;
+      levels[level].index_count = len;
+      levels[level].error = simplifier_error(&simplifier);
+      levels[level].level = level;
+      scratch_len += len;
+    }
+    free_simplifier(&simplifier);
+  }
+
+  for (int level = 1; level < max_levels; level++) {
+    const MeshLod *previous = &lods[level - 1];
+    uint32_t index_count = 0;
+    float error = 0.0f;
+    for (int b = 0; b < lod0_batches; b++) {
+      index_count += batch_lods[b * max_levels + level].index_count;
+      error = fmaxf(error, batch_lods[b * max_levels + level].error);
+    }
+    if (index_count > previous->index_count * LOD_MIN_REDUCTION) {
+      break;
+    }
+
+    // every level has a batch for each material, in the same order
+    reserve_array((void **)&batches, &batches_cap, batches_len + lod0_batches,
+                  sizeof(MeshBatch));
+    MeshLod *lod = &lods[lods_len];
+    lod->batch_offset = batches_len;
+    lod->batch_count = lod0_batches;
+    lod->index_count = index_count;
+    lod->error = error;
+    for (int b = 0; b < lod0_batches; b++) {
+      const BatchLod *batch_lod = &batch_lods[b * max_levels + level];
+      MeshBatch *batch = &batches[batches_len];
+      if (batch_lod->level < level) {
+        *batch = batches[lods[batch_lod->level].batch_offset + b];
+      } else {
+        reserve_array((void **)&indices, &indices_cap,
+                      indices_len + batch_lod->index_count, sizeof(uint32_t));
+        memcpy(&indices[indices_len], &scratch[batch_lod->scratch_offset],
+               sizeof(uint32_t) * batch_lod->index_count);
+        optimize_vertex_cache(&indices[indices_len], batch_lod->index_count,
+                              vertices_len);
+        batch->index_offset = indices_len;
+        batch->index_count = batch_lod->index_count;
+        batch->material = batches[b].material;
+        batch->vertex_offset = batches[b].vertex_offset;
+        indices_len += batch_lod->index_count;
+      }
+      batches_len += 1;
+    }
+    lods_len += 1;
+  }
+
+  free(batch_lods);
+  free(scratch);
+  free(lod_indices);
+  free(position_remap);
+  shrink_array((void **)&indices, &indices_cap, indices_len, sizeof(uint32_t));
+  shrink_array((void **)&batches, &batches_cap, batches_len,
+               sizeof(MeshBatch));
+  shrink_array((void **)&lods, &lods_cap, lods_len, sizeof(MeshLod));
+
+  for (int i = 0; i < lods_len; i++) {
+    printf("lod %d: %u triangles (%.1f%%) in %u batches, error %g\n", i,
+           lods[i].index_count / 3, 100.0f * lods[i].index_count / lod0_len,
+           lods[i].batch_count, lods[i].error);
+  }
+}
+
+VkBuffer vertex_buffer;
+VkDeviceMemory vertex_buffer_memory;
+VkBuffer meshlet_buffer = VK_NULL_HANDLE;
+VkDeviceMemory meshlet_buffer_memory = VK_NULL_HANDLE;
+VkDeviceSize meshlet_vertices_offset;
+VkDeviceSize meshlet_triangles_offset;
+
+void create_color_resources();
+void create_depth_resources();
+
+VkSampleCountFlagBits get_max_usable_sample_count() {
+  VkPhysicalDeviceProperties physical_device_properties;
+  vkGetPhysicalDeviceProperties(physical_device, &physical_device_properties);
+
+  VkSampleCountFlags counts =
+      physical_device_properties.limits.framebufferColorSampleCounts &
+      physical_device_properties.limits.framebufferDepthSampleCounts;
+
+  if (counts & VK_SAMPLE_COUNT_64_BIT) {
+    return VK_SAMPLE_COUNT_64_BIT;
+  }
+  if (counts & VK_SAMPLE_COUNT_32_BIT) {
+    return VK_SAMPLE_COUNT_32_BIT;
+  }
+  if (counts & VK_SAMPLE_COUNT_16_BIT) {
+    return VK_SAMPLE_COUNT_16_BIT;
+  }
+  if (counts & VK_SAMPLE_COUNT_8_BIT) {
+    return VK_SAMPLE_COUNT_8_BIT;
+  }
+  if (counts & VK_SAMPLE_COUNT_4_BIT) {
+    return VK_SAMPLE_COUNT_4_BIT;
+  }
+  if (counts & VK_SAMPLE_COUNT_2_BIT) {
+    return VK_SAMPLE_COUNT_2_BIT;
+  }
+
+  return VK_SAMPLE_COUNT_1_BIT;
+}
+
+static VkVertexInputBindingDescription get_binding_description() {
+  VkVertexInputBindingDescription binding_description = {0};
+  binding_description.binding = 0;
+  binding_description.stride = sizeof(PackedVertex);
+  binding_description.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  return binding_description;
+}
+
+static void
+get_attribute_descriptions(VkVertexInputAttributeDescription
+                               descriptions[ATTRIBUTE_DESCRIPTIONS_LEN]) {
+  descriptions[0].binding = 0;
+  descriptions[0].location = 0;
+  descriptions[0].format = VK_FORMAT_R16G16B16A16_UNORM;
+  descriptions[0].offset = offsetof(PackedVertex, pos);
+
+  descriptions[1].binding = 0;
+  descriptions[1].location = 1;
+  descriptions[1].format = VK_FORMAT_R16G16_UNORM;
+  descriptions[1].offset = offsetof(PackedVertex, tex_coord);
+
+  return;
+}
+
+typedef struct {
+  VkSurfaceCapabilitiesKHR capabilities;
+  VkSurfaceFormatKHR formats[256];
+  uint32_t formats_len;
+  VkPresentModeKHR present_modes[16];
+  uint32_t present_modes_len;
+} SwapChainSupportDetails;
+
+void query_swap_chain_support(VkPhysicalDevice device,
+                              SwapChainSupportDetails *details) {
+  // capabilities
+  vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface,
+                                            &(details->capabilities));
+  // formats
+  vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &(details->formats_len),
+                                       NULL);
+  if (details->formats_len != 0) {
+    vkGetPhysicalDeviceSurfaceFormatsKHR(
+        device, surface, &(details->formats_len), details->formats);
+  }
+
+  // present mode
+  vkGetPhysicalDeviceSurfacePresentModesKHR(
+      device, surface, &(details->present_modes_len), NULL);
+  if (details->present_modes_len != 0) {
+    vkGetPhysicalDeviceSurfacePresentModesKHR(
+        device, surface, &(details->present_modes_len), details->present_modes);
+  }
+}
+
+typedef struct {
+  int32_t graphics_family;
+  int32_t present_family;
+} QueueFamilyIndices;
+
+int QFI_is_complete(QueueFamilyIndices *indices) {
+  return indices->present_family >= 0 && indices->present_family >= 0;
+}
+
+static VKAPI_ATTR VkBool32 VKAPI_CALL
+debug_callback(VkDebugUtilsMessageSeverityFlagBitsEXT messageSeverity,
+               VkDebugUtilsMessageTypeFlagsEXT messageType,
+               const VkDebugUtilsMessengerCallbackDataEXT *pCallbackData,
+               void *pUserData) {
+
+  fprintf(stderr, "validation layer: %s\n", pCallbackData->pMessage);
+  return VK_FALSE;
+}
+
+static void framebuffer_resize_callback(GLFWwindow *window, int width,
+                                        int height) {
+  framebuffer_resized = 1;
+}
+
+void init_window() {
+  if (glfwInit() != GLFW_TRUE) {
+    THROW("failed to init glfw\n");
+  }
+
+  glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+
+  window = glfwCreateWindow(WIDTH, HEIGHT, "Vulkan", NULL, NULL);
+  glfwSetFramebufferSizeCallback(window, framebuffer_resize_callback);
+}
+
+int check_validation_layer_support() {
+  uint32_t layer_count;
+  vkEnumerateInstanceLayerProperties(&layer_count, NULL);
+
+  VkLayerProperties available_layers[MAX_LAYERS];
+  vkEnumerateInstanceLayerProperties(&layer_count, available_layers);
+
+  for (int i = 0; i < VALIDATION_LAYER_COUNT; i++) {
+    int layer_found = 0;
+
+    for (int j = 0; j < layer_count; j++) {
+      if (strcmp(validation_layers[i], available_layers[j].layerName) == 0) {
+        layer_found = 1;
+        break;
+      }
+    }
+
+    if (!layer_found) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+void get_required_extensions(uint32_t *count, const char **extensions) {
+  uint32_t glfw_extension_count = 0;
+  const char **glfw_extensions;
+  glfw_extensions = glfwGetRequiredInstanceExtensions(&glfw_extension_count);
+
+  for (int i = 0; i < glfw_extension_count; i++) {
+    extensions[i] = glfw_extensions[i];
+  }
+  *count = glfw_extension_count;
+
+  extensions[*count] = VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME;
+  *count += 1;
+  extensions[*count] = VK_KHR_PORTABILITY_ENUMERATION_EXTENSION_NAME;
+  *count += 1;
+
+  if (ENABLE_VALICATION_LAYERS) {
+    extensions[*count] = VK_EXT_DEBUG_UTILS_EXTENSION_NAME;
+    *count += 1;
+  }
+}
+
+void populate_debug_messenger_create_info(
+    VkDebugUtilsMessengerCreateInfoEXT *create_info) {
+  create_info->sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_MESSENGER_CREATE_INFO_EXT;
+  create_info->messageSeverity =
+      VK_DEBUG_UTILS_MESSAGE_SEVERITY_VERBOSE_BIT_EXT |
+      VK_DEBUG_UTILS_MESSAGE_SEVERITY_WARNING_BIT_EXT |
+      VK_DEBUG_UTILS_MESSAGE_SEVERITY_ERROR_BIT_EXT;
+  create_info->messageType = VK_DEBUG_UTILS_MESSAGE_TYPE_GENERAL_BIT_EXT |
+                             VK_DEBUG_UTILS_MESSAGE_TYPE_VALIDATION_BIT_EXT |
+                             VK_DEBUG_UTILS_MESSAGE_TYPE_PERFORMANCE_BIT_EXT;
+  create_info->pfnUserCallback = debug_callback;
+}
+
+void create_instance() {
+  if (ENABLE_VALICATION_LAYERS && !check_validation_layer_support()) {
+    THROW("validation layers requested, but not available!\n");
+  }
+
+  VkApplicationInfo app_info = {0};
+  app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  app_info.pApplicationName = "Hello Triangle";
+  app_info.applicationVersion = VK_MAKE_VERSION(1, 0, 0);
+  app_info.pEngineName = "No Engine";
+  app_info.engineVersion = VK_MAKE_VERSION(1, 0, 0);
+  app_info.apiVersion = VK_API_VERSION_1_1;
+
+  VkInstanceCreateInfo create_info = {0};
+  create_info.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  create_info.pApplicationInfo = &app_info;
+  create_info.flags |= VK_INSTANCE_CREATE_ENUMERATE_PORTABILITY_BIT_KHR;
+
+  uint32_t required_extensions_count = 0;
+  const char *required_extensions[MAX_EXTENSIONS];
+  get_required_extensions(&required_extensions_count, required_extensions);
+
+  create_info.enabledExtensionCount = required_extensions_count;
+  create_info.ppEnabledExtensionNames = required_extensions;
+
+  if (ENABLE_VALICATION_LAYERS) {
+    create_info.enabledLayerCount = VALIDATION_LAYER_COUNT;
+    create_info.ppEnabledLayerNames = validation_layers;
+    populate_debug_messenger_create_info(&debug_create_info);
+    create_info.pNext =
+        (VkDebugUtilsMessengerCreateInfoEXT *)&debug_create_info;
+  } else {
+    create_info.enabledLayerCount = 0;
+    create_info.pNext = NULL;
+  }
+
+  // check available extensions
+  VkResult result;
+  uint32_t avail_extension_count = 0;
+  // get count of available extensions
+  result = vkEnumerateInstanceExtensionProperties(NULL, &avail_extension_count,
+                                                  NULL);
+  if (result != VK_SUCCESS) {
+    THROW("%d failed to get number of available extensions!\n", result);
+  }
+
+  // get available extensions
+  VkExtensionProperties avail_extensions[MAX_EXTENSIONS];
+  result = vkEnumerateInstanceExtensionProperties(NULL, &avail_extension_count,
+                                                  avail_extensions);
+  if (result != VK_SUCCESS) {
+    THROW("%d failed to get available extensions!\n", result);
+  }
+  printf("available extensions %d:\n", avail_extension_count);
+  for (int i = 0; i < avail_extension_count; i++) {
+    printf("\t%s\n", avail_extensions[i].extensionName);
+  }
+
+  // check required extensions
+  printf("required extensions %d:\n", required_extensions_count);
+  for (int i = 0; i < required_extensions_count; i++) {
+    const char *required_extension = required_extensions[i];
+    int exist = 0;
+    for (int j = 0; j < avail_extension_count; j++) {
+      if (strcmp(required_extension, avail_extensions[j].extensionName) == 0) {
+        exist = 1;
+        break;
+      }
+    }
+
+    if (exist) {
+      printf("\t%s - ok\n", required_extension);
+    } else {
+      printf("\t%s - fail\n", required_extension);
+    }
+  }
+
+  result = vkCreateInstance(&create_info, NULL, &instance);
+  if (result != VK_SUCCESS) {
+    THROW("%d failed to create instance!\n", result);
+  }
+}
+
+VkResult create_debug_utils_messenger_ext(
+    VkInstance instance, const VkDebugUtilsMessengerCreateInfoEXT *pCreateInfo,
+    const VkAllocationCallbacks *pAllocator,
+    VkDebugUtilsMessengerEXT *pDebugMessenger) {
+  PFN_vkCreateDebugUtilsMessengerEXT func =
+      (PFN_vkCreateDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
+          instance, "vkCreateDebugUtilsMessengerEXT");
+  if (func != NULL) {
+    return func(instance, pCreateInfo, pAllocator, pDebugMessenger);
+  } else {
+    return VK_ERROR_EXTENSION_NOT_PRESENT;
+  }
+}
+
+void destroy_debug_utils_messenger_ext(
+    VkInstance instance, VkDebugUtilsMessengerEXT debugMessenger,
+    const VkAllocationCallbacks *pAllocator) {
+  PFN_vkDestroyDebugUtilsMessengerEXT func =
+      (PFN_vkDestroyDebugUtilsMessengerEXT)vkGetInstanceProcAddr(
+          instance, "vkDestroyDebugUtilsMessengerEXT");
+  if (func != NULL) {
+    func(instance, debugMessenger, pAllocator);
+  }
+}
+
+void setup_debug_messenger() {
+  if (!ENABLE_VALICATION_LAYERS)
+    return;
+  VkDebugUtilsMessengerCreateInfoEXT create_info = {0};
+  populate_debug_messenger_create_info(&create_info);
+
+  if (create_debug_utils_messenger_ext(instance, &create_info, NULL,
+                                       &debug_messenger) != VK_SUCCESS) {
+    THROW("failed to set up debug messenger!\n");
+  }
+}
+
+QueueFamilyIndices find_queue_families(VkPhysicalDevice device) {
+  QueueFamilyIndices indices;
+  uint32_t queue_family_count = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count, NULL);
+  VkQueueFamilyProperties queue_families[64];
+  vkGetPhysicalDeviceQueueFamilyProperties(device, &queue_family_count,
+                                           queue_families);
+
+  for (int i = 0; i < queue_family_count; i++) {
+    if (queue_families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+      indices.graphics_family = i;
+    }
+    VkBool32 present_support = 0;
+    vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &present_support);
+    if (present_support) {
+      indices.present_family = i;
+    }
+  }
+
+  return indices;
+}
+
+int has_device_extension(VkPhysicalDevice device, const char *name) {
+  uint32_t extension_count = 0;
+  vkEnumerateDeviceExtensionProperties(device, NULL, &extension_count, NULL);
+  VkExtensionProperties available_extensions[256];
+  if (extension_count > 256) {
+    extension_count = 256;
+  }
+  vkEnumerateDeviceExtensionProperties(device, NULL, &extension_count,
+                                       available_extensions);
+
+  for (int i = 0; i < extension_count; i++) {
+    if (strcmp(name, available_extensions[i].extensionName) == 0) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int check_device_extension_support(VkPhysicalDevice device) {
+  for (int i = 0; i < DEVICE_EXTENSIONS_COUNT; i++) {
+    if (!has_device_extension(device, device_extensions[i])) {
+      return 0;
+    }
+  }
+
+  return 1;
+}
+
+// the instance asks for 1.1, but a device may still report 1.0 and then
+// has no vkGetPhysicalDeviceFeatures2 or extended image usage
+int device_supports_vulkan_1_1(VkPhysicalDevice device) {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(device, &properties);
+  return properties.apiVersion >= VK_API_VERSION_1_1;
+}
+
+int check_index_type_uint8_support(VkPhysicalDevice device) {
+  if (!has_device_extension(device, VK_EXT_INDEX_TYPE_UINT8_EXTENSION_NAME)) {
+    return 0;
+  }
+  // the feature can only be queried through the chained struct, so a 1.0
+  // device keeps the 16 bit indices
+  if (!device_supports_vulkan_1_1(device)) {
+    return 0;
+  }
+
+  VkPhysicalDeviceIndexTypeUint8FeaturesEXT uint8_features = {0};
+  uint8_features.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_INDEX_TYPE_UINT8_FEATURES_EXT;
+  VkPhysicalDeviceFeatures2 features = {0};
+  features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+  features.pNext = &uint8_features;
+  vkGetPhysicalDeviceFeatures2(device, &features);
+  return uint8_features.indexTypeUint8;
+}
+
+int is_device_suitable(VkPhysicalDevice device) {
+  QueueFamilyIndices indices = find_queue_families(device);
+  int extensions_supported = check_device_extension_support(device);
+  int swap_chain_adequate = 0;
+  if (extensions_supported) {
+    SwapChainSupportDetails swap_chain_support = {0};
+    query_swap_chain_support(device, &swap_chain_support);
+
+    swap_chain_adequate = swap_chain_support.formats_len > 0 &&
+                          swap_chain_support.present_modes_len > 0;
+  }
+  int is_complete = QFI_is_complete(&indices);
+
+  VkPhysicalDeviceFeatures supported_features;
+  vkGetPhysicalDeviceFeatures(device, &supported_features);
+
+  return is_complete && extensions_supported && swap_chain_adequate &&
+         supported_features.samplerAnisotropy;
+}
+
+VkSurfaceFormatKHR
+choose_swap_surface_format(uint32_t count,
+                           VkSurfaceFormatKHR available_formats[]) {
+  for (int i = 0; i < count; i++) {
+    if (available_formats[i].format == VK_FORMAT_B8G8R8A8_SRGB &&
+        available_formats[i].colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
+      return available_formats[i];
+    }
+  }
+  return available_formats[0];
+}
+
+VkPresentModeKHR
+choose_swap_present_mode(uint32_t count,
+                         VkPresentModeKHR available_present_modes[]) {
+  for (int i = 0; i < count; i++) {
+    if (available_present_modes[i] == VK_PRESENT_MODE_MAILBOX_KHR) {
+      return available_present_modes[i];
+    }
+  }
+  return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+VkExtent2D choose_swap_extent(VkSurfaceCapabilitiesKHR *capabilities) {
+  if (capabilities->currentExtent.width != UINT32_MAX) {
+    return capabilities->currentExtent;
+  } else {
+    int width, height;
+    glfwGetFramebufferSize(window, &width, &height);
+    VkExtent2D actual_extent = {width, height};
+    if (actual_extent.width < capabilities->minImageExtent.width)
+      actual_extent.width = capabilities->minImageExtent.width;
+    if (actual_extent.width > capabilities->maxImageExtent.width)
+      actual_extent.width = capabilities->maxImageExtent.width;
+    if (actual_extent.height < capabilities->minImageExtent.height)
+      actual_extent.height = capabilities->minImageExtent.height;
+    if (actual_extent.height > capabilities->maxImageExtent.height)
+      actual_extent.height = capabilities->maxImageExtent.height;
+
+    return actual_extent;
+  }
+}
+
+void pick_physical_device() {
+  uint32_t device_count = 0;
+  vkEnumeratePhysicalDevices(instance, &device_count, NULL);
+  if (device_count == 0) {
+    THROW("failed to find GPUs with Vulkan support!\n");
+  }
+  VkPhysicalDevice devices[MAX_DEVICES] = {0};
+  vkEnumeratePhysicalDevices(instance, &device_count, devices);
+
+  for (int i = 0; i < device_count; i++) {
+    if (is_device_suitable(devices[i])) {
+      physical_device = devices[i];
+      msaa_samples = get_max_usable_sample_count();
+      break;
+    }
+  }
+
+  if (physical_device == VK_NULL_HANDLE) {
+    THROW("failed to find suitable GPU!\n");
+  }
+}
+
+void create_logical_device() {
+  QueueFamilyIndices indices = find_queue_families(physical_device);
+  if (!QFI_is_complete(&indices)) {
+    THROW("Can't find a queue family");
+  }
+
+  uint32_t queue_len = 0;
+  VkDeviceQueueCreateInfo queue_create_infos[QUEUE_COUNT] = {0};
+  uint32_t unique_queue_families[QUEUE_COUNT] = {indices.graphics_family,
+                                                 indices.present_family};
+
+  // push unique queue
+  for (int i = 0; i < QUEUE_COUNT; i++) {
+    int unique = 1;
+    for (int j = 0; j < queue_len; j++) {
+      if (unique_queue_families[i] == unique_queue_families[j]) {
+        unique = 0;
+      }
+    }
+    if (unique) {
+      unique_queue_families[queue_len] = unique_queue_families[i];
+      queue_len += 1;
+    }
+  }
+
+  printf("Found %d unique queue\n", queue_len);
+
+  float queue_priority = 1.0f;
+
+  for (int i = 0; i < queue_len; i++) {
+    VkDeviceQueueCreateInfo *queue_create_info = &queue_create_infos[i];
+    queue_create_info->sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+    queue_create_info->queueFamilyIndex = unique_queue_families[i];
+    queue_create_info->queueCount = 1;
+    queue_create_info->pQueuePriorities = &queue_priority;
+  }
+
+  VkPhysicalDeviceFeatures supported_features;
+  vkGetPhysicalDeviceFeatures(physical_device, &supported_features);
+  VkPhysicalDeviceFeatures device_features = {0};
+  device_features.samplerAnisotropy = VK_TRUE;
+  device_features.sampleRateShading = VK_TRUE;
+  // compressed textures fall back to RGBA8 without it
+  device_features.textureCompressionBC =
+      supported_features.textureCompressionBC;
+  VkDeviceCreateInfo create_info = {0};
+  create_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  create_info.pQueueCreateInfos = queue_create_infos;
+  create_info.queueCreateInfoCount = queue_len;
+  create_info.pEnabledFeatures = &device_features;
+
+  // optional extensions are appended after the required ones
+  uint32_t extensions_len = DEVICE_EXTENSIONS_COUNT;
+  const char *extensions[DEVICE_EXTENSIONS_COUNT + 1];
+  memcpy(extensions, device_extensions, sizeof(device_extensions));
+
+  VkPhysicalDeviceIndexTypeUint8FeaturesEXT uint8_features = {0};
+  index_type_uint8_supported = check_index_type_uint8_support(physical_device);
+  if (index_type_uint8_supported) {
+    extensions[extensions_len] = VK_EXT_INDEX_TYPE_UINT8_EXTENSION_NAME;
+    extensions_len += 1;
+    uint8_features.sType =
+        VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_INDEX_TYPE_UINT8_FEATURES_EXT;
+    uint8_features.indexTypeUint8 = VK_TRUE;
+    create_info.pNext = &uint8_features;
+  }
+
+  create_info.enabledExtensionCount = extensions_len;
+  create_info.ppEnabledExtensionNames = extensions;
+  if (ENABLE_VALICATION_LAYERS) {
+    create_info.enabledLayerCount = VALIDATION_LAYER_COUNT;
+    create_info.ppEnabledLayerNames = validation_layers;
+  } else {
+    create_info.enabledLayerCount = 0;
+  }
+
+  if (vkCreateDevice(physical_device, &create_info, NULL, &device) !=
+      VK_SUCCESS) {
+    THROW("failed to create logical device!\n");
+  }
+
+  vkGetDeviceQueue(device, indices.graphics_family, 0, &graphics_queue);
+  vkGetDeviceQueue(device, indices.present_family, 0, &present_queue);
+}
+
+void create_surface() {
+  if (glfwVulkanSupported() != GLFW_TRUE) {
+    THROW("glfw not support vulkan\n");
+  }
+  VkResult r = glfwCreateWindowSurface(instance, window, NULL, &surface);
+  if (r != VK_SUCCESS) {
+    THROW("failed to create window surface! err: %d\n", r);
+  }
+}
+
+void create_swap_chain() {
+  SwapChainSupportDetails swap_chain_support = {0};
+  query_swap_chain_support(physical_device, &swap_chain_support);
+  VkSurfaceFormatKHR surface_format = choose_swap_surface_format(
+      swap_chain_support.formats_len, swap_chain_support.formats);
+  VkPresentModeKHR present_mode = choose_swap_present_mode(
+      swap_chain_support.present_modes_len, swap_chain_support.present_modes);
+  VkExtent2D extent = choose_swap_extent(&swap_chain_support.capabilities);
+  uint32_t image_count = swap_chain_support.capabilities.minImageCount + 1;
+  if (swap_chain_support.capabilities.maxImageCount > 0 &&
+      image_count > swap_chain_support.capabilities.maxImageCount) {
+    image_count = swap_chain_support.capabilities.maxImageCount;
+  }
+
+  VkSwapchainCreateInfoKHR create_info = {0};
+  create_info.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
+  create_info.surface = surface;
+  create_info.minImageCount = image_count;
+  create_info.imageFormat = surface_format.format;
+  create_info.imageColorSpace = surface_format.colorSpace;
+  create_info.imageExtent = extent;
+  create_info.imageArrayLayers = 1;
+  create_info.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+  QueueFamilyIndices indices = find_queue_families(physical_device);
+  uint32_t queue_family_indices[] = {indices.graphics_family,
+                                     indices.present_family};
+  if (indices.graphics_family != indices.present_family) {
+    create_info.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
+    create_info.queueFamilyIndexCount = 2;
+    create_info.pQueueFamilyIndices = queue_family_indices;
+  } else {
+    create_info.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    create_info.queueFamilyIndexCount = 0;
+    create_info.pQueueFamilyIndices = NULL;
+  }
+
+  create_info.preTransform = swap_chain_support.capabilities.currentTransform;
+  create_info.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
+
+  create_info.presentMode = present_mode;
+  create_info.clipped = VK_TRUE;
+  create_info.oldSwapchain = VK_NULL_HANDLE;
+
+  if (vkCreateSwapchainKHR(device, &create_info, NULL, &swap_chain) !=
+      VK_SUCCESS) {
+    THROW("failed to create swap chain!\n");
+  }
+
+  vkGetSwapchainImagesKHR(device, swap_chain, &swap_chain_images_count, NULL);
+  vkGetSwapchainImagesKHR(device, swap_chain, &swap_chain_images_count,
+                          swap_chain_images);
+  swap_chain_image_format = surface_format.format;
+  swap_chain_extent = extent;
+}
+
+VkImageView create_image_view(VkImage image, VkFormat format,
+                              VkImageAspectFlags aspect_flags,
+                              uint32_t mip_levels) {
+  VkImageViewCreateInfo view_info = {0};
+  view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  view_info.image = image;
+  view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  view_info.format = format;
+  view_info.subresourceRange.aspectMask = aspect_flags;
+  view_info.subresourceRange.baseMipLevel = 0;
+  view_info.subresourceRange.levelCount = mip_levels;
+  view_info.subresourceRange.baseArrayLayer = 0;
+  view_info.subresourceRange.layerCount = 1;
+
+  VkImageView image_view;
+  if (vkCreateImageView(device, &view_info, NULL, &image_view) != VK_SUCCESS) {
+    THROW("failed to create texture image view!\n");
+  }
+
+  return image_view;
+}
+
+void create_image_views() {
+  swap_chain_image_views_count = swap_chain_images_count;
+  for (int i = 0; i < swap_chain_images_count; i++) {
+    swap_chain_image_views[i] =
+        create_image_view(swap_chain_images[i], swap_chain_image_format,
+                          VK_IMAGE_ASPECT_COLOR_BIT, 1);
+  }
+}
+
+typedef struct {
+  char *data;
+  size_t len;
+} MappedFile;
+
+// files stay mapped until cleanup() so callers can keep pointers into them.
+// The asset worker and the texture decoders map files too, hence the lock.
+uint32_t mapped_files_len = 0;
+static uint32_t mapped_files_cap = 0;
+MappedFile *mapped_files = NULL;
+pthread_mutex_t mapped_files_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// what an empty file maps to, mmap() takes no zero length mapping
+static char empty_file[1];
+
+// maps a whole file read-only, returns data = NULL if it can't be opened.
+// An empty file has len = 0 and data pointing at nothing to read, callers
+// that need contents check len.
+MappedFile map_file(const char *filename) {
+  MappedFile file = {0};
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0) {
+    return file;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return file;
+  }
+  if (st.st_size == 0) {
+    close(fd);
+    file.data = empty_file;
+    return file;
+  }
+
+  void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    THROW("failed to map file %s!\n", filename);
+  }
+
+  // every reader walks the file front to back exactly once
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+  madvise(data, st.st_size, MADV_WILLNEED);
+
+  file.data = data;
+  file.len = st.st_size;
+  pthread_mutex_lock(&mapped_files_lock);
+  reserve_array((void **)&mapped_files, &mapped_files_cap,
+                mapped_files_len + 1, sizeof(MappedFile));
+  mapped_files[mapped_files_len] = file;
+  mapped_files_len += 1;
+  pthread_mutex_unlock(&mapped_files_lock);
+  return file;
+}
+
+// unmaps one file from map_file() before cleanup(), for files that are
+// read again when they change
+void unmap_file(MappedFile file) {
+  pthread_mutex_lock(&mapped_files_lock);
+  for (int i = 0; i < mapped_files_len; i++) {
+    if (mapped_files[i].data == file.data) {
+      munmap(file.data, file.len);
+      mapped_files_len -= 1;
+      mapped_files[i] = mapped_files[mapped_files_len];
+      break;
+    }
+  }
+  pthread_mutex_unlock(&mapped_files_lock);
+}
+
+static int has_extension(const char *path, const char *extension) {
+  size_t len = strlen(path);
+  size_t extension_len = strlen(extension);
+  return len >= extension_len &&
+         strcmp(path + len - extension_len, extension) == 0;
+}
+
+void unmap_files() {
+  for (int i = 0; i < mapped_files_len; i++) {
+    munmap(mapped_files[i].data, mapped_files[i].len);
+  }
+  mapped_files_len = 0;
+  free(mapped_files);
+  mapped_files = NULL;
+  mapped_files_cap = 0;
+}
+
+// the .glb load_glb() loaded, its buffers and embedded images are read
+// straight from the mapping
+static MappedFile glb_source;
+// the mesh cache load_mesh_cache() loaded, its raw arrays point into it
+static MappedFile mesh_cache_file;
+
+VkShaderModule create_shader_module(const char *code, size_t size) {
+  VkShaderModuleCreateInfo create_info = {0};
+  create_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
+  create_info.codeSize = size;
+  create_info.pCode = (const uint32_t *)code;
+  VkShaderModule shader_module;
+  if (vkCreateShaderModule(device, &create_info, NULL, &shader_module) !=
+      VK_SUCCESS) {
+    THROW("failed to create shader module!\n");
+  }
+  return shader_module;
+}
+
+void create_descriptor_set_layout() {
+  VkDescriptorSetLayoutBinding uboLayoutBinding = {0};
+  uboLayoutBinding.binding = 0;
+  uboLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  uboLayoutBinding.descriptorCount = 1;
+  uboLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  uboLayoutBinding.pImmutableSamplers = NULL;
+
+  VkDescriptorSetLayoutBinding sampler_layout_binding = {0};
+  sampler_layout_binding.binding = 1;
+  sampler_layout_binding.descriptorCount = 1;
+  sampler_layout_binding.descriptorType =
+      VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  sampler_layout_binding.pImmutableSamplers = NULL;
+  sampler_layout_binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+  VkDescriptorSetLayoutBinding bindings[] = {uboLayoutBinding,
+                                             sampler_layout_binding};
+
+  VkDescriptorSetLayoutCreateInfo layout_info = {0};
+  layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layout_info.bindingCount = 2;
+  layout_info.pBindings = bindings;
+
+  if (vkCreateDescriptorSetLayout(device, &layout_info, NULL,
+                                  &descriptor_set_layout) != VK_SUCCESS) {
+    THROW("failed to create descriptor set layout!\n");
+  }
+}
+
+void create_graphics_pipeline() {
+  MappedFile vert_shader_code = map_file(VERT_SHADER_PATH);
+  MappedFile frag_shader_code = map_file(FRAG_SHADER_PATH);
+  if (vert_shader_code.len == 0 || frag_shader_code.len == 0) {
+    THROW("failed to read shader code!\n");
+  }
+
+  VkShaderModule vert_shader_module =
+      create_shader_module(vert_shader_code.data, vert_shader_code.len);
+  VkShaderModule frag_shader_module =
+      create_shader_module(frag_shader_code.data, frag_shader_code.len);
+  unmap_file(vert_shader_code);
+  unmap_file(frag_shader_code);
+
+  VkPipelineShaderStageCreateInfo vert_shader_stage_info = {0};
+  vert_shader_stage_info.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  vert_shader_stage_info.stage = VK_SHADER_STAGE_VERTEX_BIT;
+  vert_shader_stage_info.module = vert_shader_module;
+  vert_shader_stage_info.pName = "main";
+
+  VkPipelineShaderStageCreateInfo frag_shader_stage_info = {0};
+  frag_shader_stage_info.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  frag_shader_stage_info.stage = VK_SHADER_STAGE_FRAGMENT_BIT;
+  frag_shader_stage_info.module = frag_shader_module;
+  frag_shader_stage_info.pName = "main";
+
+  VkPipelineShaderStageCreateInfo shader_stages[] = {vert_shader_stage_info,
+                                                     frag_shader_stage_info};
+
+  VkDynamicState dynamic_states[] = {
+      VK_DYNAMIC_STATE_VIEWPORT,
+      VK_DYNAMIC_STATE_SCISSOR,
+  };
+  VkPipelineDynamicStateCreateInfo dynamic_state = {0};
+  dynamic_state.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dynamic_state.dynamicStateCount = 2;
+  dynamic_state.pDynamicStates = dynamic_states;
+
+  VkPipelineVertexInputStateCreateInfo vertex_input_info = {0};
+
+  VkVertexInputBindingDescription binding_description =
+      get_binding_description();
+  VkVertexInputAttributeDescription
       attribute_descriptions[ATTRIBUTE_DESCRIPTIONS_LEN];
   get_attribute_descriptions(attribute_descriptions);
 
-  vertex_input_info.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertex_input_info.vertexBindingDescriptionCount = 1;
-  vertex_input_info.pVertexBindingDescriptions = &binding_description;
-  vertex_input_info.vertexAttributeDescriptionCount =
-      ATTRIBUTE_DESCRIPTIONS_LEN;
-  vertex_input_info.pVertexAttributeDescriptions = attribute_descriptions;
+  vertex_input_info.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  vertex_input_info.vertexBindingDescriptionCount = 1;
+  vertex_input_info.pVertexBindingDescriptions = &binding_description;
+  vertex_input_info.vertexAttributeDescriptionCount =
+      ATTRIBUTE_DESCRIPTIONS_LEN;
+  vertex_input_info.pVertexAttributeDescriptions = attribute_descriptions;
+
+  VkPipelineInputAssemblyStateCreateInfo input_assembly = {0};
+  input_assembly.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  input_assembly.primitiveRestartEnable = VK_FALSE;
+
+  VkViewport viewport = {0};
+  viewport.x = 0.0f;
+  viewport.y = 0.0f;
+  viewport.width = (float)swap_chain_extent.width;
+  viewport.height = (float)swap_chain_extent.height;
+  viewport.minDepth = 0.0f;
+  viewport.maxDepth = 1.0f;
+
+  VkRect2D scissor = {0};
+  scissor.extent = swap_chain_extent;
+
+  VkPipelineViewportStateCreateInfo viewport_state = {0};
+  viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  viewport_state.viewportCount = 1;
+  viewport_state.scissorCount = 1;
+
+  VkPipelineRasterizationStateCreateInfo rasterizer = {0};
+  rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  rasterizer.depthClampEnable = VK_FALSE;
+  rasterizer.rasterizerDiscardEnable = VK_FALSE;
+  rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+  rasterizer.lineWidth = 1.0f;
+  rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+  rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
+  rasterizer.depthBiasEnable = VK_FALSE;
+  rasterizer.depthBiasConstantFactor = 0.0f;
+  rasterizer.depthBiasClamp = 0.0f;
+  rasterizer.depthBiasSlopeFactor = 0.0f;
+
+  VkPipelineMultisampleStateCreateInfo multisampling = {0};
+  multisampling.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  multisampling.sampleShadingEnable = VK_TRUE;
+  multisampling.rasterizationSamples = msaa_samples;
+  multisampling.minSampleShading = .2f;
+  multisampling.pSampleMask = NULL;
+  multisampling.alphaToCoverageEnable = VK_FALSE;
+  multisampling.alphaToOneEnable = VK_FALSE;
+
+  VkPipelineColorBlendAttachmentState color_blend_attachment = {0};
+  color_blend_attachment.colorWriteMask =
+      VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
+      VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
+  color_blend_attachment.blendEnable = VK_FALSE;
+  color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+  color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+  color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
+  color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+  color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+  color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+  VkPipelineColorBlendStateCreateInfo color_blending = {0};
+  color_blending.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  color_blending.logicOpEnable = VK_FALSE;
+  color_blending.logicOp = VK_LOGIC_OP_COPY;
+  color_blending.attachmentCount = 1;
+  color_blending.pAttachments = &color_blend_attachment;
+  color_blending.blendConstants[0] = 0.0f;
+  color_blending.blendConstants[1] = 0.0f;
+  color_blending.blendConstants[2] = 0.0f;
+  color_blending.blendConstants[3] = 0.0f;
+
+  VkPipelineLayoutCreateInfo pipeline_layout_info = {0};
+  pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipeline_layout_info.setLayoutCount = 1;
+  pipeline_layout_info.pSetLayouts = &descriptor_set_layout;
+  pipeline_layout_info.pushConstantRangeCount = 0;
+  pipeline_layout_info.pPushConstantRanges = NULL;
+
+  if (vkCreatePipelineLayout(device, &pipeline_layout_info, NULL,
+                             &pipeline_layout) != VK_SUCCESS) {
+    THROW("failed to create pipeline layout!\n");
+  }
+
+  VkPipelineDepthStencilStateCreateInfo depth_stencil = {0};
+  depth_stencil.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  depth_stencil.depthTestEnable = VK_TRUE;
+  depth_stencil.depthWriteEnable = VK_TRUE;
+  depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS;
+  depth_stencil.depthBoundsTestEnable = VK_FALSE;
+  depth_stencil.minDepthBounds = 0.0f;
+  depth_stencil.maxDepthBounds = 1.0f;
+  depth_stencil.stencilTestEnable = VK_FALSE;
+
+  VkGraphicsPipelineCreateInfo pipeline_info = {0};
+  pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+  pipeline_info.stageCount = 2;
+  pipeline_info.pStages = shader_stages;
+  pipeline_info.pVertexInputState = &vertex_input_info;
+  pipeline_info.pInputAssemblyState = &input_assembly;
+  pipeline_info.pViewportState = &viewport_state;
+  pipeline_info.pRasterizationState = &rasterizer;
+  pipeline_info.pMultisampleState = &multisampling;
+  pipeline_info.pDepthStencilState = &depth_stencil;
+  pipeline_info.pColorBlendState = &color_blending;
+  pipeline_info.pDynamicState = &dynamic_state;
+  pipeline_info.layout = pipeline_layout;
+  pipeline_info.renderPass = render_pass;
+  pipeline_info.subpass = 0;
+  pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
+  pipeline_info.basePipelineIndex = -1;
+
+  if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, NULL,
+                                &graphics_pipeline) != VK_SUCCESS) {
+    THROW("failed to create graphics pipeline!\n");
+  }
+
+  vkDestroyShaderModule(device, frag_shader_module, NULL);
+  vkDestroyShaderModule(device, vert_shader_module, NULL);
+}
+
+VkFormat find_supported_format(uint32_t candidates_len, VkFormat candidates[],
+                               VkImageTiling tiling,
+                               VkFormatFeatureFlags features) {
+  for (int i = 0; i < candidates_len; i++) {
+    VkFormat format = candidates[i];
+    VkFormatProperties props;
+    vkGetPhysicalDeviceFormatProperties(physical_device, format, &props);
+
+    if (tiling == VK_IMAGE_TILING_LINEAR &&
+        (props.linearTilingFeatures & features) == features) {
+      return format;
+    } else if (tiling == VK_IMAGE_TILING_OPTIMAL &&
+               (props.optimalTilingFeatures & features) == features) {
+      return format;
+    }
+  }
+
+  THROW("failed to find supported format!\n");
+}
+
+VkFormat find_depth_format() {
+  VkFormat candidates[] = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT,
+                           VK_FORMAT_D24_UNORM_S8_UINT};
+  return find_supported_format(3, candidates, VK_IMAGE_TILING_OPTIMAL,
+                               VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+}
+
+void create_render_pass() {
+  VkAttachmentDescription color_attachment = {0};
+  color_attachment.format = swap_chain_image_format;
+  color_attachment.samples = msaa_samples;
+  color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference color_attachment_ref = {0};
+  color_attachment_ref.attachment = 0;
+  color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentDescription color_attachment_resolve = {0};
+  color_attachment_resolve.format = swap_chain_image_format;
+  color_attachment_resolve.samples = VK_SAMPLE_COUNT_1_BIT;
+  color_attachment_resolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  color_attachment_resolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  color_attachment_resolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  color_attachment_resolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  color_attachment_resolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  color_attachment_resolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+  VkAttachmentReference color_attachment_resolve_ref = {0};
+  color_attachment_resolve_ref.attachment = 2;
+  color_attachment_resolve_ref.layout =
+      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentDescription depth_attachment = {0};
+  depth_attachment.format = find_depth_format();
+  depth_attachment.samples = msaa_samples;
+  depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  depth_attachment.finalLayout =
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference depth_attachment_ref = {0};
+  depth_attachment_ref.attachment = 1;
+  depth_attachment_ref.layout =
+      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  VkSubpassDescription subpass = {0};
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &color_attachment_ref;
+  subpass.pDepthStencilAttachment = &depth_attachment_ref;
+  subpass.pResolveAttachments = &color_attachment_resolve_ref;
+
+  VkSubpassDependency dependency = {0};
+  dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependency.dstSubpass = 0;
+  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependency.srcAccessMask = 0;
+  dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
+                            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                             VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+  VkAttachmentDescription attachments[] = {color_attachment, depth_attachment,
+                                           color_attachment_resolve};
+
+  VkRenderPassCreateInfo render_pass_info = {0};
+  render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  render_pass_info.attachmentCount = 3;
+  render_pass_info.pAttachments = attachments;
+  render_pass_info.subpassCount = 1;
+  render_pass_info.pSubpasses = &subpass;
+  render_pass_info.dependencyCount = 1;
+  render_pass_info.pDependencies = &dependency;
+
+  if (vkCreateRenderPass(device, &render_pass_info, NULL, &render_pass) !=
+      VK_SUCCESS) {
+    THROW("failed to create render pass!\n");
+  }
+}
+
+void create_framebuffers() {
+  swap_chain_framebuffers_count = swap_chain_image_views_count;
+  for (int i = 0; i < swap_chain_image_views_count; i++) {
+    VkImageView attachments[] = {
+        color_image_view,
+        depth_image_view,
+        swap_chain_image_views[i],
+    };
+
+    VkFramebufferCreateInfo framebuffer_info = {0};
+    framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+    framebuffer_info.renderPass = render_pass;
+    framebuffer_info.attachmentCount = 3;
+    framebuffer_info.pAttachments = attachments;
+    framebuffer_info.width = swap_chain_extent.width;
+    framebuffer_info.height = swap_chain_extent.height;
+    framebuffer_info.layers = 1;
+
+    if (vkCreateFramebuffer(device, &framebuffer_info, NULL,
+                            &swap_chain_framebuffers[i]) != VK_SUCCESS) {
+      THROW("failed to create framebuffer!\n");
+    }
+  }
+}
+
+void create_command_pool() {
+  QueueFamilyIndices queue_family_indices =
+      find_queue_families(physical_device);
+  VkCommandPoolCreateInfo pool_info = {0};
+  pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_info.queueFamilyIndex = queue_family_indices.graphics_family;
+  if (vkCreateCommandPool(device, &pool_info, NULL, &command_pool) !=
+      VK_SUCCESS) {
+    THROW("failed to create command pool!\n");
+  }
+}
+
+vec3 camera_eye = {2.0f, 2.0f, 2.0f};
+mat4 model_matrix = GLM_MAT4_IDENTITY_INIT;
+
+// the coarsest level whose error, projected at the mesh's distance from the
+// camera, stays below LOD_PIXEL_ERROR pixels
+const MeshLod *select_lod() {
+  vec3 center, extent, world_center;
+  glm_vec3_add(mesh_bounds_min, mesh_bounds_max, center);
+  glm_vec3_scale(center, 0.5f, center);
+  glm_vec3_sub(mesh_bounds_max, mesh_bounds_min, extent);
+  float radius = glm_vec3_norm(extent) * 0.5f;
+  glm_mat4_mulv3(model_matrix, center, 1.0f, world_center);
+
+  // pixels per model unit at the nearest point of the bounding sphere
+  float distance = glm_vec3_distance(camera_eye, world_center) - radius;
+  distance = distance > CAMERA_NEAR ? distance : CAMERA_NEAR;
+  float pixels_per_unit =
+      swap_chain_extent.height /
+      (2.0f * tanf(glm_rad(CAMERA_FOV_DEGREES) * 0.5f) * distance);
+
+  const MeshLod *lod = &lods[0];
+  for (int i = 1; i < lods_len; i++) {
+    if (lods[i].error * pixels_per_unit <= LOD_PIXEL_ERROR) {
+      lod = &lods[i];
+    }
+  }
+  return lod;
+}
+
+void record_command_buffer(VkCommandBuffer command_buffer,
+                           uint32_t image_index) {
+  VkCommandBufferBeginInfo begin_info = {0};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = 0;
+  begin_info.pInheritanceInfo = NULL;
+
+  if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
+    THROW("failed to begin recording command buffer!\n");
+  }
+
+  VkClearValue clear_values[2] = {0};
+  clear_values[0].color.float32[3] = 1.0f;
+  clear_values[1].depthStencil.depth = 1.0f;
+
+  VkRenderPassBeginInfo render_pass_info = {0};
+  render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  render_pass_info.renderPass = render_pass;
+  render_pass_info.framebuffer = swap_chain_framebuffers[image_index];
+  render_pass_info.renderArea.extent = swap_chain_extent;
+
+  render_pass_info.clearValueCount = 2;
+  render_pass_info.pClearValues = clear_values;
+
+  vkCmdBeginRenderPass(command_buffer, &render_pass_info,
+                       VK_SUBPASS_CONTENTS_INLINE);
+
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                    graphics_pipeline);
+  VkBuffer vertex_buffers[] = {vertex_buffer};
+  VkDeviceSize offsets[] = {0};
+  vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
+  vkCmdBindIndexBuffer(command_buffer, index_buffer, 0, index_type);
+
+  VkViewport viewport = {0};
+  viewport.x = 0.0f;
+  viewport.y = 0.0f;
+  viewport.width = (float)swap_chain_extent.width;
+  viewport.height = (float)swap_chain_extent.height;
+  viewport.minDepth = 0.0f;
+  viewport.maxDepth = 1.0f;
+  vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+
+  VkRect2D scissor = {0};
+  scissor.extent = swap_chain_extent;
+  vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+
+  // a level's batches are sorted by material when the mesh is built, so
+  // each material's descriptor set is bound once
+  const MeshLod *lod = select_lod();
+  uint32_t bound_material = UINT32_MAX;
+  for (int i = 0; i < lod->batch_count; i++) {
+    const MeshBatch *batch = &batches[lod->batch_offset + i];
+    if (batch->material != bound_material) {
+      vkCmdBindDescriptorSets(
+          command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout, 0,
+          1, &descriptor_sets[current_frame][batch->material], 0, NULL);
+      bound_material = batch->material;
+    }
+    vkCmdDrawIndexed(command_buffer, batch->index_count, 1,
+                     batch->index_offset, batch->vertex_offset, 0);
+  }
+  vkCmdEndRenderPass(command_buffer);
+  if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
+    THROW("failed to record command buffer!\n");
+  }
+}
+
+void create_command_buffers() {
+  VkCommandBufferAllocateInfo alloc_info = {0};
+  alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  alloc_info.commandPool = command_pool;
+  alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  alloc_info.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
+  if (vkAllocateCommandBuffers(device, &alloc_info, command_buffers) !=
+      VK_SUCCESS) {
+    THROW("failed to allocate command buffers!");
+  }
+}
+
+void create_sync_objects() {
+  VkSemaphoreCreateInfo semaphore_info = {0};
+  semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+  VkFenceCreateInfo fence_info = {0};
+  fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+
+  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    if (vkCreateSemaphore(device, &semaphore_info, NULL,
+                          &image_available_semaphores[i]) != VK_SUCCESS ||
+        vkCreateSemaphore(device, &semaphore_info, NULL,
+                          &render_finished_semaphores[i]) != VK_SUCCESS ||
+        vkCreateFence(device, &fence_info, NULL, &in_flight_fences[i]) !=
+            VK_SUCCESS) {
+      THROW("failed to create semaphores!\n");
+    }
+  }
+}
+
+void cleanup_swap_chain() {
+  vkDestroyImageView(device, color_image_view, NULL);
+  vkDestroyImage(device, color_image, NULL);
+  vkFreeMemory(device, color_image_memory, NULL);
+
+  vkDestroyImageView(device, depth_image_view, NULL);
+  vkDestroyImage(device, depth_image, NULL);
+  vkFreeMemory(device, depth_image_memory, NULL);
+
+  for (int i = 0; i < swap_chain_framebuffers_count; i++) {
+    vkDestroyFramebuffer(device, swap_chain_framebuffers[i], NULL);
+  }
+
+  for (int i = 0; i < swap_chain_images_count; i++) {
+    vkDestroyImageView(device, swap_chain_image_views[i], NULL);
+  }
+
+  vkDestroySwapchainKHR(device, swap_chain, NULL);
+}
+
+void recreate_swap_chain() {
+  int width = 0, height = 0;
+  glfwGetFramebufferSize(window, &width, &height);
+  while (width == 0 || height == 0) {
+    glfwGetFramebufferSize(window, &width, &height);
+    glfwWaitEvents();
+  }
+
+  vkDeviceWaitIdle(device);
+
+  cleanup_swap_chain();
+
+  create_swap_chain();
+  create_image_views();
+  create_color_resources();
+  create_depth_resources();
+  create_framebuffers();
+}
+
+uint32_t find_memory_type(uint32_t type_filter,
+                          VkMemoryPropertyFlags properties) {
+  VkPhysicalDeviceMemoryProperties mem_properties;
+  vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_properties);
+
+  for (int i = 0; i < mem_properties.memoryTypeCount; i++) {
+    if (type_filter & (1 << i) && (mem_properties.memoryTypes[i].propertyFlags &
+                                   properties) == properties) {
+      return i;
+    }
+  }
+
+  THROW("failed to find suitable memory type!\n");
+}
+
+void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                   VkMemoryPropertyFlags properties, VkBuffer *buffer,
+                   VkDeviceMemory *buffer_memory) {
+  VkBufferCreateInfo buffer_info = {0};
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = size;
+  buffer_info.usage = usage;
+  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  if (vkCreateBuffer(device, &buffer_info, NULL, buffer) != VK_SUCCESS) {
+    THROW("failed to create vertex buffer!\n");
+  }
+
+  VkMemoryRequirements mem_requirements;
+  vkGetBufferMemoryRequirements(device, *buffer, &mem_requirements);
+
+  VkMemoryAllocateInfo alloc_info = {0};
+  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  alloc_info.allocationSize = mem_requirements.size;
+  alloc_info.memoryTypeIndex =
+      find_memory_type(mem_requirements.memoryTypeBits, properties);
+
+  if (vkAllocateMemory(device, &alloc_info, NULL, buffer_memory) !=
+      VK_SUCCESS) {
+    THROW("failed to allocate vertex buffer memory!\n");
+  }
+
+  vkBindBufferMemory(device, *buffer, *buffer_memory, 0);
+}
+
+// the size of mip `level` of a width x height image, halved and rounded
+// down like vkCmdBlitImage() does it, never below 1
+static uint32_t mip_extent(uint32_t size, uint32_t level) {
+  return size >> level > 0 ? size >> level : 1;
+}
+
+// the levels of a full chain, down to 1x1
+uint32_t texture_mip_levels(uint32_t width, uint32_t height) {
+  return (uint32_t)floorf(log2f(glm_max(width, height))) + 1;
+}
+
+// the bytes of an RGBA8 mip chain with its levels packed one after the
+// other, the layout build_mip_chain() writes and copy_buffer_to_image()
+// reads
+VkDeviceSize mip_chain_size(uint32_t width, uint32_t height,
+                            uint32_t mip_levels) {
+  VkDeviceSize size = 0;
+  for (uint32_t i = 0; i < mip_levels; i++) {
+    size += (VkDeviceSize)mip_extent(width, i) * mip_extent(height, i) * 4;
+  }
+  return size;
+}
+
+// every level is filtered from the one above it by a separable 4 tap
+// kernel at source offsets -1.5, -0.5, 0.5 and 1.5, a Kaiser windowed sinc
+// when MIP_KAISER_FILTER is set, otherwise a 2x2 box
+static float mip_weights[2];
+static float srgb_to_linear[256];
+// the sRGB byte of linear intensity i / 65535, fine enough to get every
+// dark byte right. Padded for the AVX2 loop, which reads 4 bytes at a time.
+static uint8_t linear_to_srgb[65536 + 3];
+static pthread_once_t mip_tables_once = PTHREAD_ONCE_INIT;
+
+// the modified Bessel function of the first kind, order 0, its series
+// converges fast for the small arguments of a Kaiser window
+static double bessel_i0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; k < 32; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+static void init_mip_tables() {
+  if (MIP_KAISER_FILTER) {
+    // a half band sinc under a window as wide as the kernel
+    double weights[2];
+    for (int i = 0; i < 2; i++) {
+      double d = 0.5 + i;
+      double x = GLM_PI * d * 0.5;
+      double window = bessel_i0(MIP_KAISER_ALPHA *
+                                sqrt(1.0 - (d / 2.0) * (d / 2.0))) /
+                      bessel_i0(MIP_KAISER_ALPHA);
+      weights[i] = sin(x) / x * window;
+    }
+    double total = 2.0 * (weights[0] + weights[1]);
+    mip_weights[0] = (float)(weights[0] / total);
+    mip_weights[1] = (float)(weights[1] / total);
+  } else {
+    mip_weights[0] = 0.5f;
+    mip_weights[1] = 0.0f;
+  }
+
+  for (int i = 0; i < 256; i++) {
+    double c = i / 255.0;
+    srgb_to_linear[i] = (float)(c <= 0.04045 ? c / 12.92
+                                             : pow((c + 0.055) / 1.055, 2.4));
+  }
+  for (int i = 0; i < 65536; i++) {
+    double l = i / 65535.0;
+    double c = l <= 0.0031308 ? l * 12.92 : 1.055 * pow(l, 1.0 / 2.4) - 0.055;
+    linear_to_srgb[i] = (uint8_t)(c * 255.0 + 0.5);
+  }
+}
+
+typedef struct MipLevelJob MipLevelJob;
+
+// one level of the chain, its rows are what a thread is given. The row
+// loops are the widest the CPU runs, see select_mip_row_loops().
+struct MipLevelJob {
+  const uint8_t *src;
+  uint32_t src_width;
+  uint32_t src_height;
+  uint8_t *dst;
+  uint32_t dst_width;
+  void (*filter_row)(const MipLevelJob *job, uint32_t y, float *decoded,
+                     float *row);
+  void (*write_row)(const float **taps, uint8_t *dst, uint32_t len);
+};
+
+// source row `y` decoded to linear RGBA and filtered horizontally, one
+// output texel per 4 floats
+static void filter_mip_row(const MipLevelJob *job, uint32_t y,
+                           float *decoded, float *row) {
+  const uint8_t *src = job->src + (size_t)y * job->src_width * 4;
+  for (uint32_t x = 0; x < job->src_width * 4; x += 4) {
+    decoded[x] = srgb_to_linear[src[x]];
+    decoded[x + 1] = srgb_to_linear[src[x + 1]];
+    decoded[x + 2] = srgb_to_linear[src[x + 2]];
+    decoded[x + 3] = src[x + 3] * (1.0f / 255.0f);
+  }
+  int32_t last = (int32_t)job->src_width - 1;
+  for (uint32_t x = 0; x < job->dst_width; x++) {
+    int32_t taps[4];
+    for (int k = 0; k < 4; k++) {
+      int32_t tap = (int32_t)x * 2 - 1 + k;
+      taps[k] = tap < 0 ? 0 : tap > last ? last : tap;
+    }
+#ifdef HAS_SSE2
+    __m128 inner = _mm_add_ps(_mm_loadu_ps(&decoded[taps[1] * 4]),
+                              _mm_loadu_ps(&decoded[taps[2] * 4]));
+    __m128 outer = _mm_add_ps(_mm_loadu_ps(&decoded[taps[0] * 4]),
+                              _mm_loadu_ps(&decoded[taps[3] * 4]));
+    _mm_storeu_ps(&row[x * 4],
+                  _mm_add_ps(_mm_mul_ps(inner, _mm_set1_ps(mip_weights[0])),
+                             _mm_mul_ps(outer, _mm_set1_ps(mip_weights[1]))));
+#else
+    for (int c = 0; c < 4; c++) {
+      row[x * 4 + c] = (decoded[taps[1] * 4 + c] + decoded[taps[2] * 4 + c]) *
+                           mip_weights[0] +
+                       (decoded[taps[0] * 4 + c] + decoded[taps[3] * 4 + c]) *
+                           mip_weights[1];
+    }
+#endif
+  }
+}
+
+// the `len` floats of an output row filtered vertically from its 4
+// horizontally filtered source rows, then encoded to sRGB
+static void write_mip_row(const float **taps, uint8_t *dst, uint32_t len) {
+  for (uint32_t x = 0; x < len; x += 4) {
+    int32_t quantized[4];
+#ifdef HAS_SSE2
+    __m128 inner =
+        _mm_add_ps(_mm_loadu_ps(&taps[1][x]), _mm_loadu_ps(&taps[2][x]));
+    __m128 outer =
+        _mm_add_ps(_mm_loadu_ps(&taps[0][x]), _mm_loadu_ps(&taps[3][x]));
+    __m128 texel = _mm_add_ps(_mm_mul_ps(inner, _mm_set1_ps(mip_weights[0])),
+                              _mm_mul_ps(outer, _mm_set1_ps(mip_weights[1])));
+    texel =
+        _mm_min_ps(_mm_max_ps(texel, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    texel =
+        _mm_mul_ps(texel, _mm_setr_ps(65535.0f, 65535.0f, 65535.0f, 255.0f));
+    _mm_storeu_si128((__m128i *)quantized, _mm_cvtps_epi32(texel));
+#else
+    for (int c = 0; c < 4; c++) {
+      float texel = (taps[1][x + c] + taps[2][x + c]) * mip_weights[0] +
+                    (taps[0][x + c] + taps[3][x + c]) * mip_weights[1];
+      texel = texel < 0.0f ? 0.0f : texel > 1.0f ? 1.0f : texel;
+      quantized[c] = (int32_t)(texel * (c < 3 ? 65535.0f : 255.0f) + 0.5f);
+    }
+#endif
+    dst[x] = linear_to_srgb[quantized[0]];
+    dst[x + 1] = linear_to_srgb[quantized[1]];
+    dst[x + 2] = linear_to_srgb[quantized[2]];
+    dst[x + 3] = (uint8_t)quantized[3];
+  }
+}
+
+#ifdef HAS_AVX2
+// filter_mip_row() 2 texels at a time, the color bytes decoded with a
+// gather from the table. Same operations in the same order, so the
+// results match the SSE2 loop bit for bit.
+__attribute__((target("avx2"))) static void
+filter_mip_row_avx2(const MipLevelJob *job, uint32_t y, float *decoded,
+                    float *row) {
+  const uint8_t *src = job->src + (size_t)y * job->src_width * 4;
+  uint32_t len = job->src_width * 4;
+  uint32_t i = 0;
+  for (; i + 8 <= len; i += 8) {
+    __m256i bytes =
+        _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)&src[i]));
+    __m256 color = _mm256_i32gather_ps(srgb_to_linear, bytes, 4);
+    __m256 alpha = _mm256_mul_ps(_mm256_cvtepi32_ps(bytes),
+                                 _mm256_set1_ps(1.0f / 255.0f));
+    _mm256_storeu_ps(&decoded[i], _mm256_blend_ps(color, alpha, 0x88));
+  }
+  for (; i < len; i += 4) {
+    decoded[i] = srgb_to_linear[src[i]];
+    decoded[i + 1] = srgb_to_linear[src[i + 1]];
+    decoded[i + 2] = srgb_to_linear[src[i + 2]];
+    decoded[i + 3] = src[i + 3] * (1.0f / 255.0f);
+  }
+
+  __m256 inner_weight = _mm256_set1_ps(mip_weights[0]);
+  __m256 outer_weight = _mm256_set1_ps(mip_weights[1]);
+  int32_t last = (int32_t)job->src_width - 1;
+  int32_t last_out = (int32_t)job->dst_width - 1;
+  for (int32_t x = 0; x <= last_out; x += 2) {
+    __m256 inner, outer;
+    if (x > 0 && x * 2 + 4 <= last) {
+      // the 6 source texels of the pair are in range, 3 loads and a
+      // shuffle across lanes for each sum
+      __m256 a = _mm256_loadu_ps(&decoded[(x * 2 - 1) * 4]);
+      __m256 b = _mm256_loadu_ps(&decoded[(x * 2 + 1) * 4]);
+      __m256 c = _mm256_loadu_ps(&decoded[(x * 2 + 3) * 4]);
+      inner = _mm256_add_ps(_mm256_permute2f128_ps(a, b, 0x31),
+                            _mm256_permute2f128_ps(b, c, 0x20));
+      outer = _mm256_add_ps(_mm256_permute2f128_ps(a, b, 0x20),
+                            _mm256_permute2f128_ps(b, c, 0x31));
+    } else {
+      // clamped at the edges, the second texel of the last pair repeats
+      // the first when the width is odd and is left out of the row
+      __m256 taps[4];
+      for (int k = 0; k < 4; k++) {
+        int32_t tap[2];
+        for (int j = 0; j < 2; j++) {
+          int32_t out = x + j < last_out ? x + j : last_out;
+          tap[j] = out * 2 - 1 + k;
+          tap[j] = tap[j] < 0 ? 0 : tap[j] > last ? last : tap[j];
+        }
+        taps[k] = _mm256_insertf128_ps(
+            _mm256_castps128_ps256(_mm_loadu_ps(&decoded[tap[0] * 4])),
+            _mm_loadu_ps(&decoded[tap[1] * 4]), 1);
+      }
+      inner = _mm256_add_ps(taps[1], taps[2]);
+      outer = _mm256_add_ps(taps[0], taps[3]);
+    }
+    __m256 texels = _mm256_add_ps(_mm256_mul_ps(inner, inner_weight),
+                                  _mm256_mul_ps(outer, outer_weight));
+    if (x < last_out) {
+      _mm256_storeu_ps(&row[x * 4], texels);
+    } else {
+      _mm_storeu_ps(&row[x * 4], _mm256_castps256_ps128(texels));
+    }
+  }
+}
+
+// 2 texels of write_mip_row() quantized, colors as linear_to_srgb[]
+// indices and alpha as the byte itself
+__attribute__((target("avx2"))) static __m256i
+quantize_mip_texels_avx2(const float **taps, uint32_t x) {
+  __m256 inner = _mm256_add_ps(_mm256_loadu_ps(&taps[1][x]),
+                               _mm256_loadu_ps(&taps[2][x]));
+  __m256 outer = _mm256_add_ps(_mm256_loadu_ps(&taps[0][x]),
+                               _mm256_loadu_ps(&taps[3][x]));
+  __m256 texels =
+      _mm256_add_ps(_mm256_mul_ps(inner, _mm256_set1_ps(mip_weights[0])),
+                    _mm256_mul_ps(outer, _mm256_set1_ps(mip_weights[1])));
+  texels = _mm256_min_ps(_mm256_max_ps(texels, _mm256_setzero_ps()),
+                         _mm256_set1_ps(1.0f));
+  __m256 scale = _mm256_setr_ps(65535.0f, 65535.0f, 65535.0f, 255.0f,
+                                65535.0f, 65535.0f, 65535.0f, 255.0f);
+  return _mm256_cvtps_epi32(_mm256_mul_ps(texels, scale));
+}
+
+// write_mip_row() 4 texels at a time, the sRGB bytes gathered 4 at a time
+// from the padded table with the 3 bytes past each one masked off
+__attribute__((target("avx2"))) static void
+write_mip_row_avx2(const float **taps, uint8_t *dst, uint32_t len) {
+  const __m256i byte_mask = _mm256_set1_epi32(0xff);
+  const __m256i texel_order = _mm256_setr_epi32(0, 4, 1, 5, 0, 4, 1, 5);
+  uint32_t x = 0;
+  for (; x + 16 <= len; x += 16) {
+    __m256i bytes[2];
+    for (int i = 0; i < 2; i++) {
+      __m256i quantized = quantize_mip_texels_avx2(taps, x + i * 8);
+      __m256i srgb = _mm256_and_si256(
+          _mm256_i32gather_epi32((const int *)linear_to_srgb, quantized, 1),
+          byte_mask);
+      bytes[i] = _mm256_blend_epi32(srgb, quantized, 0x88);
+    }
+    // packing works within each 128 bit lane, which leaves the texels
+    // as 0 2 | 1 3 in the low dword of each half
+    __m256i packed = _mm256_packus_epi16(
+        _mm256_packus_epi32(bytes[0], bytes[1]), _mm256_setzero_si256());
+    packed = _mm256_permutevar8x32_epi32(packed, texel_order);
+    _mm_storeu_si128((__m128i *)&dst[x], _mm256_castsi256_si128(packed));
+  }
+  if (x < len) {
+    const float *rest[4] = {&taps[0][x], &taps[1][x], &taps[2][x],
+                            &taps[3][x]};
+    write_mip_row(rest, &dst[x], len - x);
+  }
+}
+#endif
+
+// the AVX2 row loops where the build and the CPU have them, otherwise the
+// SSE2 or scalar ones
+static void select_mip_row_loops(MipLevelJob *job) {
+#ifdef HAS_AVX2
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    job->filter_row = filter_mip_row_avx2;
+    job->write_row = write_mip_row_avx2;
+    return;
+  }
+#endif
+  job->filter_row = filter_mip_row;
+  job->write_row = write_mip_row;
+}
+
+// filters output rows [begin, end) vertically from the 4 horizontally
+// filtered source rows each of them covers, kept in a ring as consecutive
+// output rows share 2 of them
+static void build_mip_rows(void *ctx, uint32_t begin, uint32_t end) {
+  const MipLevelJob *job = ctx;
+  uint32_t row_len = job->dst_width * 4;
+  float *decoded = malloc(sizeof(float) * job->src_width * 4);
+  float *rows = malloc(sizeof(float) * row_len * 4);
+  if (!decoded || !rows) {
+    THROW("failed to allocate mip rows!\n");
+  }
+  int64_t ring[4] = {-1, -1, -1, -1};
+  int32_t last = (int32_t)job->src_height - 1;
+
+  for (uint32_t y = begin; y < end; y++) {
+    const float *taps[4];
+    for (int k = 0; k < 4; k++) {
+      int32_t tap = (int32_t)y * 2 - 1 + k;
+      tap = tap < 0 ? 0 : tap > last ? last : tap;
+      float *row = &rows[(tap & 3) * row_len];
+      if (ring[tap & 3] != tap) {
+        job->filter_row(job, tap, decoded, row);
+        ring[tap & 3] = tap;
+      }
+      taps[k] = row;
+    }
+    job->write_row(taps, job->dst + (size_t)y * row_len, row_len);
+  }
+  free(decoded);
+  free(rows);
+}
+
+// Fills `dst`, mip_chain_size() bytes, with the whole mip chain of an sRGB
+// RGBA8 image: level 0 copied from `pixels`, the others filtered in linear
+// light on every core. It needs no device, so it can bake chains offline
+// as well as stand in for generate_mipmaps() where blits can't filter.
+// Each level is read back to build the next, so `dst` shouldn't be write
+// combined memory such as a mapped staging buffer.
+void build_mip_chain(const uint8_t *pixels, uint32_t width, uint32_t height,
+                     uint32_t mip_levels, uint8_t *dst) {
+  pthread_once(&mip_tables_once, init_mip_tables);
+  memcpy(dst, pixels, (size_t)width * height * 4);
+
+  MipLevelJob job = {0};
+  job.src = pixels;
+  job.src_width = width;
+  job.src_height = height;
+  job.dst = dst;
+  select_mip_row_loops(&job);
+  for (uint32_t i = 1; i < mip_levels; i++) {
+    job.dst += (size_t)job.src_width * job.src_height * 4;
+    job.dst_width = mip_extent(width, i);
+    uint32_t dst_height = mip_extent(height, i);
+    parallel_for(dst_height, MIP_MIN_RANGE_TEXELS / job.dst_width + 1,
+                 build_mip_rows, &job);
+    job.src = job.dst;
+    job.src_width = job.dst_width;
+    job.src_height = dst_height;
+  }
+}
+
+// whether vkCmdBlitImage() can filter `format` linearly, which
+// generate_mipmaps() relies on
+int supports_linear_blit(VkFormat format) {
+  VkFormatProperties format_properties;
+  vkGetPhysicalDeviceFormatProperties(physical_device, format,
+                                      &format_properties);
+  return (format_properties.optimalTilingFeatures &
+          VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) != 0;
+}
+
+// bytes per 4x4 block of the block compressed texture formats, 0 for the
+// others
+uint32_t texture_block_size(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+  case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    return 8;
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+  case VK_FORMAT_BC3_UNORM_BLOCK:
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+    return 16;
+  default:
+    return 0;
+  }
+}
+
+// the bytes a width x height level of `format` takes in a buffer, block
+// compressed levels are padded to whole blocks
+VkDeviceSize texture_level_size(VkFormat format, uint32_t width,
+                                uint32_t height) {
+  uint32_t block_size = texture_block_size(format);
+  if (block_size == 0) {
+    return (VkDeviceSize)width * height * 4;
+  }
+  return (VkDeviceSize)((width + 3) / 4) * ((height + 3) / 4) * block_size;
+}
+
+VkDeviceSize texture_chain_size(VkFormat format, uint32_t width,
+                                uint32_t height, uint32_t mip_levels) {
+  VkDeviceSize size = 0;
+  for (uint32_t i = 0; i < mip_levels; i++) {
+    size += texture_level_size(format, mip_extent(width, i),
+                               mip_extent(height, i));
+  }
+  return size;
+}
+
+const char *block_format_name(VkFormat format) {
+  switch (format) {
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+  case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    return "BC1";
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+  case VK_FORMAT_BC3_UNORM_BLOCK:
+    return "BC3";
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+    return "BC7";
+  default:
+    return "RGBA8";
+  }
+}
+
+// BC7 everywhere when PREFER_BC7 is set, otherwise BC1 for opaque images,
+// which halves them again, and BC3 for the others
+VkFormat choose_block_format(const uint8_t *pixels, size_t texels) {
+  if (PREFER_BC7) {
+    return VK_FORMAT_BC7_SRGB_BLOCK;
+  }
+  for (size_t i = 0; i < texels; i++) {
+    if (pixels[i * 4 + 3] != 255) {
+      return VK_FORMAT_BC3_SRGB_BLOCK;
+    }
+  }
+  return VK_FORMAT_BC1_RGB_SRGB_BLOCK;
+}
+
+// the 16 texels of a block, one row of 16 per channel, in 0..255. The
+// encoders work on sRGB values directly, as the hardware interpolates them.
+typedef struct {
+  float c[4][16];
+} TexelBlock;
+
+static void load_texel_block(const uint8_t *level, uint32_t width,
+                             uint32_t height, uint32_t bx, uint32_t by,
+                             TexelBlock *block) {
+  // a level smaller than a block repeats its last row and column
+  for (uint32_t i = 0; i < 16; i++) {
+    uint32_t x = bx * 4 + i % 4, y = by * 4 + i / 4;
+    x = x < width ? x : width - 1;
+    y = y < height ? y : height - 1;
+    const uint8_t *texel = &level[((size_t)y * width + x) * 4];
+    for (int c = 0; c < 4; c++) {
+      block->c[c][i] = texel[c];
+    }
+  }
+}
+
+// picks the palette entry nearest to each texel, channels weighted by
+// `weights`, and returns the total weighted squared error
+static float select_block_indices(const TexelBlock *block,
+                                  const float (*palette)[4],
+                                  uint32_t palette_len, const float *weights,
+                                  uint8_t *indices) {
+#ifdef HAS_SSE2
+  __m128 total = _mm_setzero_ps();
+  for (int i = 0; i < 16; i += 4) {
+    __m128 texel[4];
+    for (int c = 0; c < 4; c++) {
+      texel[c] = _mm_loadu_ps(&block->c[c][i]);
+    }
+    __m128 best = _mm_set1_ps(INFINITY);
+    __m128i best_index = _mm_setzero_si128();
+    for (uint32_t k = 0; k < palette_len; k++) {
+      __m128 error = _mm_setzero_ps();
+      for (int c = 0; c < 4; c++) {
+        __m128 d = _mm_sub_ps(texel[c], _mm_set1_ps(palette[k][c]));
+        error = _mm_add_ps(error,
+                           _mm_mul_ps(_mm_mul_ps(d, d),
+                                      _mm_set1_ps(weights[c])));
+      }
+      __m128i better = _mm_castps_si128(_mm_cmplt_ps(error, best));
+      best = _mm_min_ps(error, best);
+      best_index =
+          _mm_or_si128(_mm_and_si128(better, _mm_set1_epi32(k)),
+                       _mm_andnot_si128(better, best_index));
+    }
+    total = _mm_add_ps(total, best);
+    int32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, best_index);
+    for (int j = 0; j < 4; j++) {
+      indices[i + j] = (uint8_t)lanes[j];
+    }
+  }
+  float sums[4];
+  _mm_storeu_ps(sums, total);
+  return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+  float total = 0.0f;
+  for (int i = 0; i < 16; i++) {
+    float best = INFINITY;
+    for (uint32_t k = 0; k < palette_len; k++) {
+      float error = 0.0f;
+      for (int c = 0; c < 4; c++) {
+        float d = block->c[c][i] - palette[k][c];
+        error += d * d * weights[c];
+      }
+      if (error < best) {
+        best = error;
+        indices[i] = (uint8_t)k;
+      }
+    }
+    total += best;
+  }
+  return total;
+#endif
+}
+
+// endpoints spanning the texels along their principal axis, found by power
+// iteration on the covariance of the first `channels` channels
+static void principal_endpoints(const TexelBlock *block, int channels,
+                                float *e0, float *e1) {
+  float mean[4] = {0};
+  float lo[4], hi[4];
+  for (int c = 0; c < 4; c++) {
+    lo[c] = hi[c] = block->c[c][0];
+    for (int i = 0; i < 16; i++) {
+      mean[c] += block->c[c][i];
+      lo[c] = fminf(lo[c], block->c[c][i]);
+      hi[c] = fmaxf(hi[c], block->c[c][i]);
+    }
+    mean[c] /= 16.0f;
+  }
+  float covariance[4][4] = {0};
+  for (int i = 0; i < 16; i++) {
+    for (int a = 0; a < channels; a++) {
+      for (int b = a; b < channels; b++) {
+        covariance[a][b] +=
+            (block->c[a][i] - mean[a]) * (block->c[b][i] - mean[b]);
+      }
+    }
+  }
+  for (int a = 0; a < channels; a++) {
+    for (int b = 0; b < a; b++) {
+      covariance[a][b] = covariance[b][a];
+    }
+  }
+
+  float axis[4] = {0};
+  for (int c = 0; c < channels; c++) {
+    axis[c] = hi[c] - lo[c];
+  }
+  for (int iteration = 0; iteration < 8; iteration++) {
+    float next[4] = {0};
+    float length = 0.0f;
+    for (int a = 0; a < channels; a++) {
+      for (int b = 0; b < channels; b++) {
+        next[a] += covariance[a][b] * axis[b];
+      }
+      length = fmaxf(length, fabsf(next[a]));
+    }
+    if (length == 0.0f) {
+      break;
+    }
+    for (int c = 0; c < channels; c++) {
+      axis[c] = next[c] / length;
+    }
+  }
+  float length_sq = 0.0f;
+  for (int c = 0; c < channels; c++) {
+    length_sq += axis[c] * axis[c];
+  }
+
+  float t0 = 0.0f, t1 = 0.0f;
+  if (length_sq > 0.0f) {
+    t0 = INFINITY;
+    t1 = -INFINITY;
+    for (int i = 0; i < 16; i++) {
+      float t = 0.0f;
+      for (int c = 0; c < channels; c++) {
+        t += (block->c[c][i] - mean[c]) * axis[c];
+      }
+      t0 = fminf(t0, t / length_sq);
+      t1 = fmaxf(t1, t / length_sq);
+    }
+  }
+  for (int c = 0; c < 4; c++) {
+    e0[c] = c < channels ? mean[c] + axis[c] * t0 : mean[c];
+    e1[c] = c < channels ? mean[c] + axis[c] * t1 : mean[c];
+    e0[c] = glm_clamp(e0[c], 0.0f, 255.0f);
+    e1[c] = glm_clamp(e1[c], 0.0f, 255.0f);
+  }
+}
+
+// the least squares endpoints for the texels' current indices, where index
+// k sits at `weights[k]` of the way from e0 to e1. Leaves the endpoints
+// alone when every texel shares a weight.
+static void fit_endpoints(const TexelBlock *block, const uint8_t *indices,
+                          const float *weights, float *e0, float *e1) {
+  float a = 0.0f, b = 0.0f, c = 0.0f;
+  float x0[4] = {0}, x1[4] = {0};
+  for (int i = 0; i < 16; i++) {
+    float w = weights[indices[i]];
+    a += (1.0f - w) * (1.0f - w);
+    b += (1.0f - w) * w;
+    c += w * w;
+    for (int k = 0; k < 4; k++) {
+      x0[k] += (1.0f - w) * block->c[k][i];
+      x1[k] += w * block->c[k][i];
+    }
+  }
+  float det = a * c - b * b;
+  if (fabsf(det) < 1e-6f) {
+    return;
+  }
+  for (int k = 0; k < 4; k++) {
+    e0[k] = glm_clamp((c * x0[k] - b * x1[k]) / det, 0.0f, 255.0f);
+    e1[k] = glm_clamp((a * x1[k] - b * x0[k]) / det, 0.0f, 255.0f);
+  }
+}
+
+// appends `bits` bits of `value` to a 128 bit block, least significant
+// bit first
+typedef struct {
+  uint64_t words[2];
+  uint32_t len;
+} BlockWriter;
+
+static void write_block_bits(BlockWriter *writer, uint32_t value,
+                             uint32_t bits) {
+  for (uint32_t i = 0; i < bits; i++, writer->len++) {
+    writer->words[writer->len / 64] |= (uint64_t)((value >> i) & 1)
+                                       << (writer->len % 64);
+  }
+}
+
+static void store_block(const BlockWriter *writer, uint8_t *dst,
+                        uint32_t size) {
+  for (uint32_t i = 0; i < size; i++) {
+    dst[i] = (uint8_t)(writer->words[i / 8] >> (i % 8 * 8));
+  }
+}
+
+// BC7 mode 6 stores each endpoint as 7 bits per channel plus a shared low
+// bit, and interpolates them with these weights in 64ths
+static const uint8_t bc7_weights[16] = {0,  4,  9,  13, 17, 21, 26, 30,
+                                        34, 38, 43, 47, 51, 55, 60, 64};
+
+// rounds an endpoint to mode 6 precision, returns its 7 bit channels and
+// picks the low bit that keeps it closest
+static uint32_t quantize_bc7_endpoint(const float *e, uint8_t *q) {
+  uint32_t best_p = 0;
+  float best = INFINITY;
+  for (uint32_t p = 0; p < 2; p++) {
+    float error = 0.0f;
+    for (int c = 0; c < 4; c++) {
+      float v = glm_clamp(roundf((e[c] - p) * 0.5f), 0.0f, 127.0f);
+      float d = e[c] - (v * 2.0f + p);
+      error += d * d;
+    }
+    if (error < best) {
+      best = error;
+      best_p = p;
+    }
+  }
+  for (int c = 0; c < 4; c++) {
+    q[c] = (uint8_t)glm_clamp(roundf((e[c] - best_p) * 0.5f), 0.0f, 127.0f);
+  }
+  return best_p;
+}
+
+typedef struct {
+  uint8_t q[2][4];
+  uint32_t p[2];
+  uint8_t indices[16];
+  float error;
+} Bc7Candidate;
+
+static void evaluate_bc7_endpoints(const TexelBlock *block, const float *e0,
+                                   const float *e1, Bc7Candidate *candidate) {
+  static const float weights[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+  candidate->p[0] = quantize_bc7_endpoint(e0, candidate->q[0]);
+  candidate->p[1] = quantize_bc7_endpoint(e1, candidate->q[1]);
+  float palette[16][4];
+  for (int k = 0; k < 16; k++) {
+    for (int c = 0; c < 4; c++) {
+      uint32_t a = candidate->q[0][c] * 2 + candidate->p[0];
+      uint32_t b = candidate->q[1][c] * 2 + candidate->p[1];
+      palette[k][c] =
+          (float)(((64 - bc7_weights[k]) * a + bc7_weights[k] * b + 32) >> 6);
+    }
+  }
+  candidate->error = select_block_indices(block, (const float(*)[4])palette,
+                                          16, weights, candidate->indices);
+}
+
+static void encode_bc7_block(const TexelBlock *block, uint8_t *dst) {
+  float e0[4], e1[4];
+  principal_endpoints(block, 4, e0, e1);
+  Bc7Candidate best, refined;
+  evaluate_bc7_endpoints(block, e0, e1, &best);
+
+  float index_weights[16];
+  for (int k = 0; k < 16; k++) {
+    index_weights[k] = bc7_weights[k] / 64.0f;
+  }
+  fit_endpoints(block, best.indices, index_weights, e0, e1);
+  evaluate_bc7_endpoints(block, e0, e1, &refined);
+  if (refined.error < best.error) {
+    best = refined;
+  }
+
+  // the first texel's index has an implied high bit of 0
+  int swap = best.indices[0] >= 8;
+  BlockWriter writer = {0};
+  write_block_bits(&writer, 1 << 6, 7);
+  for (int c = 0; c < 4; c++) {
+    write_block_bits(&writer, best.q[swap][c], 7);
+    write_block_bits(&writer, best.q[!swap][c], 7);
+  }
+  write_block_bits(&writer, best.p[swap], 1);
+  write_block_bits(&writer, best.p[!swap], 1);
+  for (int i = 0; i < 16; i++) {
+    uint32_t index = swap ? 15 - best.indices[i] : best.indices[i];
+    write_block_bits(&writer, index, i == 0 ? 3 : 4);
+  }
+  store_block(&writer, dst, 16);
+}
+
+static uint16_t pack_rgb565(const float *e) {
+  uint32_t r = (uint32_t)glm_clamp(roundf(e[0] * 31.0f / 255.0f), 0, 31);
+  uint32_t g = (uint32_t)glm_clamp(roundf(e[1] * 63.0f / 255.0f), 0, 63);
+  uint32_t b = (uint32_t)glm_clamp(roundf(e[2] * 31.0f / 255.0f), 0, 31);
+  return (uint16_t)(r << 11 | g << 5 | b);
+}
+
+static void unpack_rgb565(uint16_t packed, float *e) {
+  uint32_t r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+  e[0] = (float)(r << 3 | r >> 2);
+  e[1] = (float)(g << 2 | g >> 4);
+  e[2] = (float)(b << 3 | b >> 2);
+  e[3] = 0.0f;
+}
+
+static float evaluate_color_endpoints(const TexelBlock *block,
+                                      const float *e0, const float *e1,
+                                      uint16_t *packed, uint8_t *indices) {
+  static const float weights[4] = {1.0f, 1.0f, 1.0f, 0.0f};
+  packed[0] = pack_rgb565(e0);
+  packed[1] = pack_rgb565(e1);
+  float palette[4][4];
+  unpack_rgb565(packed[0], palette[0]);
+  unpack_rgb565(packed[1], palette[1]);
+  for (int c = 0; c < 4; c++) {
+    palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+    palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+  }
+  return select_block_indices(block, (const float(*)[4])palette, 4, weights,
+                              indices);
+}
+
+// the 8 byte color block of BC1 and BC3, always in its 4 color mode
+static void encode_color_block(const TexelBlock *block, uint8_t *dst) {
+  static const float index_weights[4] = {0.0f, 1.0f, 1.0f / 3.0f,
+                                         2.0f / 3.0f};
+  float e0[4], e1[4];
+  principal_endpoints(block, 3, e0, e1);
+  uint16_t packed[2], refined_packed[2];
+  uint8_t indices[16], refined_indices[16];
+  float error = evaluate_color_endpoints(block, e0, e1, packed, indices);
+  fit_endpoints(block, indices, index_weights, e0, e1);
+  if (evaluate_color_endpoints(block, e0, e1, refined_packed,
+                               refined_indices) < error) {
+    memcpy(packed, refined_packed, sizeof(packed));
+    memcpy(indices, refined_indices, sizeof(indices));
+  }
+
+  // the first endpoint has to be the larger for 4 colors, swapping them
+  // swaps indices 0 and 1 and indices 2 and 3
+  int swap = packed[0] < packed[1];
+  BlockWriter writer = {0};
+  write_block_bits(&writer, packed[swap], 16);
+  write_block_bits(&writer, packed[!swap], 16);
+  for (int i = 0; i < 16; i++) {
+    uint32_t index = packed[0] == packed[1] ? 0 : indices[i] ^ swap;
+    write_block_bits(&writer, index, 2);
+  }
+  store_block(&writer, dst, 8);
+}
+
+// the 8 byte alpha block of BC3, spanning the block's alpha range with 8
+// levels
+static void encode_alpha_block(const TexelBlock *block, uint8_t *dst) {
+  static const float weights[4] = {0.0f, 0.0f, 0.0f, 1.0f};
+  float lo = block->c[3][0], hi = block->c[3][0];
+  for (int i = 1; i < 16; i++) {
+    lo = fminf(lo, block->c[3][i]);
+    hi = fmaxf(hi, block->c[3][i]);
+  }
+  uint32_t a0 = (uint32_t)hi, a1 = (uint32_t)lo;
+  float palette[8][4] = {0};
+  palette[0][3] = a0;
+  palette[1][3] = a1;
+  for (int k = 2; k < 8; k++) {
+    palette[k][3] = (float)(((8 - k) * a0 + (k - 1) * a1) / 7);
+  }
+  uint8_t indices[16] = {0};
+  if (a0 > a1) {
+    select_block_indices(block, (const float(*)[4])palette, 8, weights,
+                         indices);
+  }
+  BlockWriter writer = {0};
+  write_block_bits(&writer, a0, 8);
+  write_block_bits(&writer, a1, 8);
+  for (int i = 0; i < 16; i++) {
+    write_block_bits(&writer, indices[i], 3);
+  }
+  store_block(&writer, dst, 8);
+}
+
+typedef struct {
+  const uint8_t *chain;
+  uint8_t *dst;
+  VkFormat format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t mip_levels;
+  // the first block row of each level and the total after the last
+  uint32_t first_rows[MAX_MIP_LEVELS + 1];
+  size_t src_offsets[MAX_MIP_LEVELS];
+  size_t dst_offsets[MAX_MIP_LEVELS];
+} BlockEncodeJob;
+
+// encodes block rows [begin, end) counted across every level of the chain
+static void encode_block_rows(void *ctx, uint32_t begin, uint32_t end) {
+  const BlockEncodeJob *job = ctx;
+  uint32_t block_size = texture_block_size(job->format);
+  uint32_t level = 0;
+  for (uint32_t row = begin; row < end; row++) {
+    while (row >= job->first_rows[level + 1]) {
+      level++;
+    }
+    uint32_t width = mip_extent(job->width, level);
+    uint32_t height = mip_extent(job->height, level);
+    uint32_t blocks_wide = (width + 3) / 4;
+    uint32_t by = row - job->first_rows[level];
+    const uint8_t *src = job->chain + job->src_offsets[level];
+    uint8_t *dst = job->dst + job->dst_offsets[level] +
+                   (size_t)by * blocks_wide * block_size;
+    for (uint32_t bx = 0; bx < blocks_wide; bx++) {
+      TexelBlock block;
+      load_texel_block(src, width, height, bx, by, &block);
+      uint8_t *out = dst + (size_t)bx * block_size;
+      if (job->format == VK_FORMAT_BC7_SRGB_BLOCK) {
+        encode_bc7_block(&block, out);
+      } else if (job->format == VK_FORMAT_BC3_SRGB_BLOCK) {
+        encode_alpha_block(&block, out);
+        encode_color_block(&block, out + 8);
+      } else {
+        encode_color_block(&block, out);
+      }
+    }
+  }
+}
+
+// Encodes an RGBA8 mip chain laid out the way build_mip_chain() writes it
+// to `format`, one of the formats texture_block_size() knows, on every
+// core. `dst` takes texture_chain_size() bytes.
+void encode_texture_blocks(const uint8_t *chain, uint32_t width,
+                           uint32_t height, uint32_t mip_levels,
+                           VkFormat format, uint8_t *dst) {
+  BlockEncodeJob job = {0};
+  job.chain = chain;
+  job.dst = dst;
+  job.format = format;
+  job.width = width;
+  job.height = height;
+  job.mip_levels = mip_levels;
+  size_t src_offset = 0, dst_offset = 0;
+  for (uint32_t i = 0; i < mip_levels; i++) {
+    uint32_t level_width = mip_extent(width, i);
+    uint32_t level_height = mip_extent(height, i);
+    job.src_offsets[i] = src_offset;
+    job.dst_offsets[i] = dst_offset;
+    job.first_rows[i + 1] = job.first_rows[i] + (level_height + 3) / 4;
+    src_offset += (size_t)level_width * level_height * 4;
+    dst_offset += texture_level_size(format, level_width, level_height);
+  }
+  uint32_t blocks_wide = (width + 3) / 4;
+  parallel_for(job.first_rows[mip_levels],
+               BLOCK_ENCODE_MIN_RANGE / blocks_wide + 1, encode_block_rows,
+               &job);
+}
+
+// whether textures can be sampled in block compressed `format`
+int supports_block_format(VkFormat format) {
+  VkFormatProperties format_properties;
+  vkGetPhysicalDeviceFormatProperties(physical_device, format,
+                                      &format_properties);
+  VkFormatFeatureFlags needed =
+      VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT | VK_FORMAT_FEATURE_TRANSFER_DST_BIT;
+  return (format_properties.optimalTilingFeatures & needed) == needed;
+}
+
+// a resource that was replaced while frames using it may still be in
+// flight, handles left VK_NULL_HANDLE are skipped
+typedef struct {
+  uint64_t frame;
+  VkBuffer buffer;
+  VkImage image;
+  VkImageView view;
+  VkDeviceMemory memory;
+  VkPipeline pipeline;
+  VkPipelineLayout pipeline_layout;
+  VkDescriptorPool descriptor_pool;
+  VkCommandBuffer command_buffer;
+} RetiredResource;
+
+static uint32_t retired_resources_len = 0;
+static uint32_t retired_resources_cap = 0;
+static RetiredResource *retired_resources = NULL;
+
+// queues `resource` for destruction once the frames submitted so far and
+// the one being recorded have completed
+void retire_resource(RetiredResource resource) {
+  resource.frame = frame_number;
+  reserve_array((void **)&retired_resources, &retired_resources_cap,
+                retired_resources_len + 1, sizeof(RetiredResource));
+  retired_resources[retired_resources_len] = resource;
+  retired_resources_len += 1;
+}
+
+static void destroy_resource(const RetiredResource *resource) {
+  vkDestroyPipeline(device, resource->pipeline, NULL);
+  vkDestroyPipelineLayout(device, resource->pipeline_layout, NULL);
+  vkDestroyDescriptorPool(device, resource->descriptor_pool, NULL);
+  vkDestroyImageView(device, resource->view, NULL);
+  vkDestroyImage(device, resource->image, NULL);
+  vkDestroyBuffer(device, resource->buffer, NULL);
+  vkFreeMemory(device, resource->memory, NULL);
+  if (resource->command_buffer != VK_NULL_HANDLE) {
+    vkFreeCommandBuffers(device, command_pool, 1, &resource->command_buffer);
+  }
+}
+
+// destroys the retired resources no frame in flight can use any more, or
+// all of them when `all` is set and the device is idle. Called after
+// waiting for the fence of frame_number's slot, which is the fence of
+// frame_number - MAX_FRAMES_IN_FLIGHT, so every frame before that one has
+// completed too.
+void destroy_retired_resources(int all) {
+  uint32_t kept = 0;
+  for (int i = 0; i < retired_resources_len; i++) {
+    RetiredResource *resource = &retired_resources[i];
+    if (!all && frame_number < resource->frame + MAX_FRAMES_IN_FLIGHT) {
+      retired_resources[kept] = *resource;
+      kept += 1;
+      continue;
+    }
+    destroy_resource(resource);
+  }
+  retired_resources_len = kept;
+}
+
+// destroys what single time commands used once they are done with it.
+// During an asset reload they are part of reload_commands, which haven't
+// even been submitted yet, so it is retired instead.
+void destroy_transient_resource(RetiredResource resource) {
+  if (reload_commands != VK_NULL_HANDLE) {
+    retire_resource(resource);
+    return;
+  }
+  destroy_resource(&resource);
+}
+
+void destroy_staging_buffer(VkBuffer buffer, VkDeviceMemory memory) {
+  destroy_transient_resource(
+      (RetiredResource){.buffer = buffer, .memory = memory});
+}
+
+// outside an asset reload, a command buffer that is submitted and waited
+// for by end_single_time_commands(). During one, the commands are
+// appended to reload_commands instead.
+VkCommandBuffer begin_single_time_commands() {
+  if (reload_commands != VK_NULL_HANDLE) {
+    return reload_commands;
+  }
+
+  VkCommandBufferAllocateInfo alloc_info = {0};
+  alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  alloc_info.commandPool = command_pool;
+  alloc_info.commandBufferCount = 1;
+
+  VkCommandBuffer command_buffer;
+  vkAllocateCommandBuffers(device, &alloc_info, &command_buffer);
+
+  VkCommandBufferBeginInfo begin_info = {0};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  vkBeginCommandBuffer(command_buffer, &begin_info);
+
+  return command_buffer;
+}
+
+void end_single_time_commands(VkCommandBuffer command_buffer) {
+  if (command_buffer == reload_commands) {
+    return;
+  }
+  vkEndCommandBuffer(command_buffer);
+
+  VkSubmitInfo submit_info = {0};
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &command_buffer;
+
+  vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
+  vkQueueWaitIdle(graphics_queue);
+
+  vkFreeCommandBuffers(device, command_pool, 1, &command_buffer);
+}
+
+// copies the first mip_levels levels of an image, packed in `buffer` the
+// way mip_chain_size() lays them out
+void copy_buffer_to_image(VkBuffer buffer, VkImage image, VkFormat format,
+                          uint32_t width, uint32_t height,
+                          uint32_t mip_levels) {
+  VkCommandBuffer command_buffer = begin_single_time_commands();
+
+  VkBufferImageCopy regions[MAX_MIP_LEVELS] = {0};
+  VkDeviceSize offset = 0;
+  for (uint32_t i = 0; i < mip_levels; i++) {
+    VkBufferImageCopy *region = &regions[i];
+    region->bufferOffset = offset;
+    region->bufferRowLength = 0;
+    region->bufferImageHeight = 0;
+
+    region->imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region->imageSubresource.mipLevel = i;
+    region->imageSubresource.baseArrayLayer = 0;
+    region->imageSubresource.layerCount = 1;
+
+    region->imageExtent.height = mip_extent(height, i);
+    region->imageExtent.width = mip_extent(width, i);
+    region->imageExtent.depth = 1;
+    offset += texture_level_size(format, region->imageExtent.width,
+                                 region->imageExtent.height);
+  }
+
+  vkCmdCopyBufferToImage(command_buffer, buffer, image,
+                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mip_levels,
+                         regions);
+  end_single_time_commands(command_buffer);
+}
+
+int has_stencil_component(VkFormat format) {
+  return format == VK_FORMAT_D32_SFLOAT_S8_UINT ||
+         format == VK_FORMAT_D24_UNORM_S8_UINT;
+}
+
+void transition_image_layout(VkImage image, VkFormat format,
+                             VkImageLayout old_layout, VkImageLayout new_layout,
+                             uint32_t mip_levels) {
+
+  VkCommandBuffer command_buffer = begin_single_time_commands();
+
+  VkImageMemoryBarrier barrier = {0};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.oldLayout = old_layout;
+  barrier.newLayout = new_layout;
+
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+
+  barrier.image = image;
+
+  if (new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
+
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
+    if (has_stencil_component(format)) {
+      barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+    }
+  } else {
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  }
+
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = mip_levels;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+
+  VkPipelineStageFlags source_stage;
+  VkPipelineStageFlags destination_stage;
+  if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED &&
+      new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    destination_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  } else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
+             new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    source_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    destination_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  } else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED &&
+             new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
+    barrier.srcAccessMask = 0;
+    barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+                            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    destination_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+  } else {
+    THROW("unsupported layout transition!\n");
+  }
+
+  vkCmdPipelineBarrier(command_buffer, source_stage, destination_stage, 0, 0,
+                       NULL, 0, NULL, 1, &barrier);
+  end_single_time_commands(command_buffer);
+}
+
+void copy_buffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size) {
+  VkCommandBuffer command_buffer = begin_single_time_commands();
+
+  VkBufferCopy copy_region = {0};
+  copy_region.size = size;
+  vkCmdCopyBuffer(command_buffer, src_buffer, dst_buffer, 1, &copy_region);
+
+  end_single_time_commands(command_buffer);
+}
+
+static uint16_t quantize_unorm16(float value, float offset, float scale) {
+  if (scale <= 0.0f) {
+    return 0;
+  }
+  float normalized = (value - offset) / scale;
+  normalized = normalized < 0.0f ? 0.0f : normalized > 1.0f ? 1.0f : normalized;
+  return (uint16_t)(normalized * 65535.0f + 0.5f);
+}
+
+// quantizes vertices[] into `dst` and sets the matching dequantization
+// parameters for the uniform buffer
+void write_packed_vertices(PackedVertex *dst) {
+  vec2 tex_coord_min = {INFINITY, INFINITY};
+  vec2 tex_coord_max = {-INFINITY, -INFINITY};
+  for (int i = 0; i < vertices_len; i++) {
+    glm_vec2_minv(tex_coord_min, vertices[i].tex_coord, tex_coord_min);
+    glm_vec2_maxv(tex_coord_max, vertices[i].tex_coord, tex_coord_max);
+  }
+
+  glm_vec4_zero(position_offset);
+  glm_vec4_zero(position_scale);
+  glm_vec4_zero(tex_coord_transform);
+  if (vertices_len > 0) {
+    for (int j = 0; j < 3; j++) {
+      position_offset[j] = mesh_bounds_min[j];
+      position_scale[j] = mesh_bounds_max[j] - mesh_bounds_min[j];
+    }
+    tex_coord_transform[0] = tex_coord_min[0];
+    tex_coord_transform[1] = tex_coord_min[1];
+    tex_coord_transform[2] = tex_coord_max[0] - tex_coord_min[0];
+    tex_coord_transform[3] = tex_coord_max[1] - tex_coord_min[1];
+  }
+
+  for (int i = 0; i < vertices_len; i++) {
+    PackedVertex packed = {0};
+    for (int j = 0; j < 3; j++) {
+      packed.pos[j] = quantize_unorm16(vertices[i].pos[j], position_offset[j],
+                                       position_scale[j]);
+    }
+    for (int j = 0; j < 2; j++) {
+      packed.tex_coord[j] =
+          quantize_unorm16(vertices[i].tex_coord[j], tex_coord_transform[j],
+                           tex_coord_transform[j + 2]);
+    }
+    dst[i] = packed;
+  }
+}
+
+// replaces vertices[] by packed_vertices[], the loader is done with them
+void pack_vertices() {
+  reserve_array((void **)&packed_vertices, &packed_vertices_cap,
+                vertices_len, sizeof(PackedVertex));
+  write_packed_vertices(packed_vertices);
+  packed_vertices_len = vertices_len;
+  free_vertices();
+}
+
+static uint32_t glb_component_size(uint32_t component_type) {
+  switch (component_type) {
+  case GLTF_BYTE:
+  case GLTF_UNSIGNED_BYTE:
+    return 1;
+  case GLTF_SHORT:
+  case GLTF_UNSIGNED_SHORT:
+    return 2;
+  case GLTF_UNSIGNED_INT:
+  case GLTF_FLOAT:
+    return 4;
+  default:
+    return 0;
+  }
+}
+
+// maps a stored integer to [0, 1] or [-1, 1] if the accessor is normalized
+static float glb_normalize(const GlbAccessor *accessor, double value) {
+  if (!accessor->normalized) {
+    return value;
+  }
+  switch (accessor->component_type) {
+  case GLTF_BYTE:
+    return fmax(value / INT8_MAX, -1.0);
+  case GLTF_UNSIGNED_BYTE:
+    return value / UINT8_MAX;
+  case GLTF_SHORT:
+    return fmax(value / INT16_MAX, -1.0);
+  case GLTF_UNSIGNED_SHORT:
+    return value / UINT16_MAX;
+  default:
+    return value;
+  }
+}
+
+// one component of element i of a .glb accessor as a float
+static float glb_component(const GlbAccessor *accessor, uint32_t i,
+                           uint32_t component) {
+  const char *element = accessor->data + (size_t)accessor->stride * i;
+  switch (accessor->component_type) {
+  case GLTF_BYTE:
+    return glb_normalize(accessor, ((const int8_t *)element)[component]);
+  case GLTF_UNSIGNED_BYTE:
+    return glb_normalize(accessor, ((const uint8_t *)element)[component]);
+  case GLTF_SHORT: {
+    int16_t value;
+    memcpy(&value, element + sizeof(value) * component, sizeof(value));
+    return glb_normalize(accessor, value);
+  }
+  case GLTF_UNSIGNED_SHORT: {
+    uint16_t value;
+    memcpy(&value, element + sizeof(value) * component, sizeof(value));
+    return glb_normalize(accessor, value);
+  }
+  case GLTF_UNSIGNED_INT: {
+    uint32_t value;
+    memcpy(&value, element + sizeof(value) * component, sizeof(value));
+    return glb_normalize(accessor, value);
+  }
+  default: {
+    float value;
+    memcpy(&value, element + sizeof(value) * component, sizeof(value));
+    return value;
+  }
+  }
+}
+
+// vertex i of a .glb primitive moved by its node
+static void glb_position(const GlbPrimitive *prim, uint32_t i,
+                         mat4 transform, vec3 dst) {
+  vec3 pos;
+  for (int j = 0; j < 3; j++) {
+    pos[j] = glb_component(&prim->position, i, j);
+  }
+  glm_mat4_mulv3(transform, pos, 1.0f, dst);
+}
+
+// copies the vertices of every .glb primitive that are already laid out
+// as PackedVertex into `dst` and quantizes the others like
+// write_packed_vertices(), with the parameters load_glb() chose
+void write_glb_vertices(PackedVertex *dst) {
+  uint32_t copied = 0;
+  for (int p = 0; p < glb_primitives_len; p++) {
+    const GlbPrimitive *prim = &glb_primitives[p];
+    PackedVertex *out = &dst[prim->vertex_offset];
+    if (prim->shares_vertices) {
+      continue;
+    }
+    if (prim->copy_vertices) {
+      memcpy(out, prim->position.data,
+             sizeof(PackedVertex) * prim->position.count);
+      copied += prim->position.count;
+      continue;
+    }
+
+    mat4 transform;
+    memcpy(transform, prim->transform, sizeof(mat4));
+    for (uint32_t i = 0; i < prim->position.count; i++) {
+      PackedVertex packed = {0};
+      vec3 pos;
+      glb_position(prim, i, transform, pos);
+      for (int j = 0; j < 3; j++) {
+        packed.pos[j] =
+            quantize_unorm16(pos[j], position_offset[j], position_scale[j]);
+      }
+      for (int j = 0; j < 2 && prim->tex_coord.count > 0; j++) {
+        packed.tex_coord[j] = quantize_unorm16(
+            glb_component(&prim->tex_coord, i, j), tex_coord_transform[j],
+            tex_coord_transform[j + 2]);
+      }
+      out[i] = packed;
+    }
+  }
+  printf("copied %u of %u vertices straight from %s\n", copied,
+         glb_vertices_len, model_path);
+}
+
+void create_vertex_buffer() {
+  uint32_t vertex_count =
+      glb_primitives_len > 0 ? glb_vertices_len : packed_vertices_len;
+  VkDeviceSize buffer_size = sizeof(PackedVertex) * vertex_count;
+
+  VkBuffer staging_buffer;
+  VkDeviceMemory staging_buffer_memory;
+
+  create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                &staging_buffer, &staging_buffer_memory);
+
+  void *data;
+  vkMapMemory(device, staging_buffer_memory, 0, buffer_size, 0, &data);
+  if (glb_primitives_len > 0) {
+    write_glb_vertices(data);
+  } else if (buffer_size > 0) {
+    memcpy(data, packed_vertices, buffer_size);
+  }
+  vkUnmapMemory(device, staging_buffer_memory);
+
+  printf("vertex buffer: %u vertices, %zu bytes each, %llu bytes\n",
+         vertex_count, sizeof(PackedVertex), (unsigned long long)buffer_size);
+
+  create_buffer(buffer_size,
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vertex_buffer,
+                &vertex_buffer_memory);
+  copy_buffer(staging_buffer, vertex_buffer, buffer_size);
+
+  destroy_staging_buffer(staging_buffer, staging_buffer_memory);
+}
+
+// primitive restart is never enabled, so 0xff and 0xffff are ordinary
+// indices and each width can address its full range
+VkIndexType choose_index_type(uint32_t vertex_count) {
+  if (index_type_uint8_supported && vertex_count <= UINT8_MAX + 1) {
+    return VK_INDEX_TYPE_UINT8_EXT;
+  }
+  if (vertex_count <= UINT16_MAX + 1) {
+    return VK_INDEX_TYPE_UINT16;
+  }
+  return VK_INDEX_TYPE_UINT32;
+}
+
+size_t index_type_size(VkIndexType type) {
+  switch (type) {
+  case VK_INDEX_TYPE_UINT8_EXT:
+    return sizeof(uint8_t);
+  case VK_INDEX_TYPE_UINT16:
+    return sizeof(uint16_t);
+  default:
+    return sizeof(uint32_t);
+  }
+}
+
+// narrows the indices while copying them into `dst`
+void write_indices(void *dst, VkIndexType type) {
+  if (type == VK_INDEX_TYPE_UINT8_EXT) {
+    uint8_t *out = dst;
+    for (int i = 0; i < indices_len; i++) {
+      out[i] = (uint8_t)indices[i];
+    }
+  } else if (type == VK_INDEX_TYPE_UINT16) {
+    uint16_t *out = dst;
+    for (int i = 0; i < indices_len; i++) {
+      out[i] = (uint16_t)indices[i];
+    }
+  } else {
+    memcpy(dst, indices, sizeof(uint32_t) * indices_len);
+  }
+}
+
+// index i of a .glb index accessor
+static uint32_t glb_index(const GlbAccessor *accessor, uint32_t i) {
+  const char *element = accessor->data + (size_t)accessor->stride * i;
+  if (accessor->component_type == GLTF_UNSIGNED_BYTE) {
+    return *(const uint8_t *)element;
+  }
+  if (accessor->component_type == GLTF_UNSIGNED_SHORT) {
+    uint16_t index;
+    memcpy(&index, element, sizeof(index));
+    return index;
+  }
+  uint32_t index;
+  memcpy(&index, element, sizeof(index));
+  return index;
+}
+
+// the narrowest type that fits the largest .glb primitive, as indices are
+// relative to their batch's vertex_offset, unless every primitive stores
+// its indices in a type no wider than that, which can then be copied
+VkIndexType choose_glb_index_type() {
+  uint32_t max_vertices = 0;
+  uint32_t component_type = 0;
+  int same_type = 1;
+  for (int p = 0; p < glb_primitives_len; p++) {
+    const GlbPrimitive *prim = &glb_primitives[p];
+    if (prim->position.count > max_vertices) {
+      max_vertices = prim->position.count;
+    }
+    if (prim->indices.count == 0 ||
+        (component_type != 0 &&
+         prim->indices.component_type != component_type)) {
+      same_type = 0;
+    }
+    component_type = prim->indices.component_type;
+  }
+
+  VkIndexType type = choose_index_type(max_vertices);
+  VkIndexType stored = component_type == GLTF_UNSIGNED_BYTE
+                           ? VK_INDEX_TYPE_UINT8_EXT
+                       : component_type == GLTF_UNSIGNED_SHORT
+                           ? VK_INDEX_TYPE_UINT16
+                           : VK_INDEX_TYPE_UINT32;
+  if (!same_type || index_type_size(stored) > index_type_size(type) ||
+      (stored == VK_INDEX_TYPE_UINT8_EXT && !index_type_uint8_supported)) {
+    return type;
+  }
+  return stored;
+}
+
+// copies the indices of every .glb primitive stored as `type` into `dst`
+// and converts the others
+void write_glb_indices(void *dst, VkIndexType type) {
+  size_t index_size = index_type_size(type);
+  uint32_t copied = 0;
+  for (int p = 0; p < glb_primitives_len; p++) {
+    const GlbPrimitive *prim = &glb_primitives[p];
+    const GlbAccessor *accessor = &prim->indices;
+    char *out = (char *)dst + index_size * prim->index_offset;
+    if (accessor->count > 0 && accessor->stride == index_size &&
+        glb_component_size(accessor->component_type) == index_size) {
+      memcpy(out, accessor->data, index_size * accessor->count);
+      copied += accessor->count;
+      continue;
+    }
+
+    for (uint32_t i = 0; i < prim->index_count; i++) {
+      uint32_t index = accessor->count > 0 ? glb_index(accessor, i) : i;
+      if (type == VK_INDEX_TYPE_UINT8_EXT) {
+        ((uint8_t *)out)[i] = (uint8_t)index;
+      } else if (type == VK_INDEX_TYPE_UINT16) {
+        ((uint16_t *)out)[i] = (uint16_t)index;
+      } else {
+        ((uint32_t *)out)[i] = index;
+      }
+    }
+  }
+  printf("copied %u of %u indices straight from %s\n", copied,
+         glb_indices_len, model_path);
+}
+
+void create_index_buffer() {
+  uint32_t index_count = indices_len;
+  index_type = choose_index_type(packed_vertices_len);
+  if (glb_primitives_len > 0) {
+    index_count = glb_indices_len;
+    index_type = choose_glb_index_type();
+  }
+  VkDeviceSize buffer_size = index_type_size(index_type) * index_count;
+  VkBuffer staging_buffer;
+  VkDeviceMemory staging_buffer_memory;
+  create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                &staging_buffer, &staging_buffer_memory);
+
+  void *data;
+  vkMapMemory(device, staging_buffer_memory, 0, buffer_size, 0, &data);
+  if (glb_primitives_len > 0) {
+    write_glb_indices(data, index_type);
+  } else {
+    write_indices(data, index_type);
+  }
+  vkUnmapMemory(device, staging_buffer_memory);
+
+  printf("index buffer: %u indices, %zu bit, %llu bytes\n", index_count,
+         index_type_size(index_type) * 8, (unsigned long long)buffer_size);
+
+  create_buffer(
+      buffer_size,
+      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &index_buffer, &index_buffer_memory);
+
+  copy_buffer(staging_buffer, index_buffer, buffer_size);
+
+  destroy_staging_buffer(staging_buffer, staging_buffer_memory);
+}
+
+// meshlets, meshlet_vertices and meshlet_triangles share one storage
+// buffer, each section aligned so it can be bound at its own offset
+void create_meshlet_buffer() {
+  if (meshlets_len == 0) {
+    return;
+  }
+
+  VkPhysicalDeviceProperties properties = {0};
+  vkGetPhysicalDeviceProperties(physical_device, &properties);
+  VkDeviceSize alignment = properties.limits.minStorageBufferOffsetAlignment;
+
+  VkDeviceSize meshlets_size = sizeof(Meshlet) * meshlets_len;
+  VkDeviceSize vertices_size = sizeof(uint32_t) * meshlet_vertices_len;
+  meshlet_vertices_offset = (meshlets_size + alignment - 1) & ~(alignment - 1);
+  meshlet_triangles_offset =
+      (meshlet_vertices_offset + vertices_size + alignment - 1) &
+      ~(alignment - 1);
+  VkDeviceSize buffer_size = meshlet_triangles_offset + meshlet_triangles_len;
+
+  VkBuffer staging_buffer;
+  VkDeviceMemory staging_buffer_memory;
+  create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                &staging_buffer, &staging_buffer_memory);
+
+  char *data;
+  vkMapMemory(device, staging_buffer_memory, 0, buffer_size, 0,
+              (void **)&data);
+  memcpy(data, meshlets, (size_t)meshlets_size);
+  memcpy(data + meshlet_vertices_offset, meshlet_vertices,
+         (size_t)vertices_size);
+  memcpy(data + meshlet_triangles_offset, meshlet_triangles,
+         meshlet_triangles_len);
+  vkUnmapMemory(device, staging_buffer_memory);
+
+  create_buffer(buffer_size,
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+                    VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &meshlet_buffer,
+                &meshlet_buffer_memory);
+  copy_buffer(staging_buffer, meshlet_buffer, buffer_size);
+
+  destroy_staging_buffer(staging_buffer, staging_buffer_memory);
+}
+
+void create_uniform_buffers() {
+  VkDeviceSize buffer_size = sizeof(UniformBufferObject);
+
+  uniform_buffers_len = MAX_FRAMES_IN_FLIGHT;
+  uniform_buffers_memory_len = MAX_FRAMES_IN_FLIGHT;
+  uniform_buffers_mapped_len = MAX_FRAMES_IN_FLIGHT;
+
+  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    create_buffer(buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                  &uniform_buffers[i], &uniform_buffers_memory[i]);
+    vkMapMemory(device, uniform_buffers_memory[i], 0, buffer_size, 0,
+                &uniform_buffers_mapped[i]);
+  }
+}
+
+void create_descriptor_pool() {
+  uint32_t sets_count = MAX_FRAMES_IN_FLIGHT * mesh_materials_len;
+  VkDescriptorPoolSize pool_size[2] = {0};
+  pool_size[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  pool_size[0].descriptorCount = sets_count;
+  pool_size[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  pool_size[1].descriptorCount = sets_count;
+
+  VkDescriptorPoolCreateInfo pool_info = {0};
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.poolSizeCount = 2;
+  pool_info.pPoolSizes = pool_size;
+  pool_info.maxSets = sets_count;
+
+  if (vkCreateDescriptorPool(device, &pool_info, NULL, &descriptor_pool) !=
+      VK_SUCCESS) {
+    THROW("failed to create descriptor pool!\n");
+  }
+}
+
+void create_descriptor_sets() {
+  VkDescriptorSetLayout *layouts =
+      malloc(sizeof(VkDescriptorSetLayout) * mesh_materials_len);
+  if (!layouts) {
+    THROW("failed to allocate descriptor set layouts!\n");
+  }
+  for (int i = 0; i < mesh_materials_len; i++) {
+    layouts[i] = descriptor_set_layout;
+  }
+
+  VkDescriptorSetAllocateInfo alloc_info = {0};
+  alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  alloc_info.descriptorPool = descriptor_pool;
+  alloc_info.descriptorSetCount = mesh_materials_len;
+  alloc_info.pSetLayouts = layouts;
+
+  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    reserve_array((void **)&descriptor_sets[i], &descriptor_sets_cap[i],
+                  mesh_materials_len, sizeof(VkDescriptorSet));
+    if (vkAllocateDescriptorSets(device, &alloc_info, descriptor_sets[i]) !=
+        VK_SUCCESS) {
+      THROW("failed to allocate descriptor sets!\n");
+    }
+  }
+  free(layouts);
+  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    for (int m = 0; m < mesh_materials_len; m++) {
+      VkDescriptorBufferInfo buffer_info = {0};
+      buffer_info.buffer = uniform_buffers[i];
+      buffer_info.offset = 0;
+      buffer_info.range = sizeof(UniformBufferObject);
+
+      VkDescriptorImageInfo image_info = {0};
+      image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+      image_info.imageView = textures[m].view;
+      image_info.sampler = texture_sampler;
+
+      VkWriteDescriptorSet descriptor_writes[2] = {0};
+      descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      descriptor_writes[0].dstSet = descriptor_sets[i][m];
+      descriptor_writes[0].dstBinding = 0;
+      descriptor_writes[0].dstArrayElement = 0;
+      descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+      descriptor_writes[0].descriptorCount = 1;
+      descriptor_writes[0].pBufferInfo = &buffer_info;
+
+      descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      descriptor_writes[1].dstSet = descriptor_sets[i][m];
+      descriptor_writes[1].dstBinding = 1;
+      descriptor_writes[1].dstArrayElement = 0;
+      descriptor_writes[1].descriptorType =
+          VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+      descriptor_writes[1].descriptorCount = 1;
+      descriptor_writes[1].pImageInfo = &image_info;
+
+      vkUpdateDescriptorSets(device, 2, descriptor_writes, 0, NULL);
+    }
+  }
+}
+
+void create_image(uint32_t width, uint32_t height, uint32_t mip_levels,
+                  VkSampleCountFlagBits num_samples, VkFormat format,
+                  VkImageTiling tiling, VkImageCreateFlags flags,
+                  VkImageUsageFlags usage, VkMemoryPropertyFlags properties,
+                  VkImage *image, VkDeviceMemory *image_memory) {
+  VkImageCreateInfo image_info = {0};
+  image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  image_info.flags = flags;
+  image_info.imageType = VK_IMAGE_TYPE_2D;
+  image_info.extent.width = width;
+  image_info.extent.height = height;
+  image_info.extent.depth = 1;
+  image_info.mipLevels = mip_levels;
+  image_info.arrayLayers = 1;
+  image_info.format = format;
+  image_info.tiling = tiling;
+  image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  image_info.usage = usage;
+  image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  image_info.samples = num_samples;
+
+  if (vkCreateImage(device, &image_info, NULL, image) != VK_SUCCESS) {
+    THROW("failed to create image!\n");
+  }
+
+  VkMemoryRequirements mem_requirements;
+  vkGetImageMemoryRequirements(device, *image, &mem_requirements);
+
+  VkMemoryAllocateInfo alloc_info = {0};
+  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  alloc_info.allocationSize = mem_requirements.size;
+  alloc_info.memoryTypeIndex =
+      find_memory_type(mem_requirements.memoryTypeBits, properties);
+  if (vkAllocateMemory(device, &alloc_info, NULL, image_memory) != VK_SUCCESS) {
+    THROW("failed to allocate image memory!\n");
+  }
+  vkBindImageMemory(device, *image, *image_memory, 0);
+}
+
+void generate_mipmaps(VkImage image, VkFormat image_format, int32_t tex_width,
+                      int32_t tex_height, uint32_t mip_levels) {
+
+  if (!supports_linear_blit(image_format)) {
+    THROW("texture image format does not support linear blitting!\n");
+  }
+
+  VkCommandBuffer command_buffer = begin_single_time_commands();
+
+  VkImageMemoryBarrier barrier = {0};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.image = image;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  barrier.subresourceRange.levelCount = 1;
+
+  int32_t mip_width = tex_width;
+  int32_t mip_height = tex_height;
+
+  for (int i = 1; i < mip_levels; i++) {
+
+    barrier.subresourceRange.baseMipLevel = i - 1;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1,
+                         &barrier);
+
+    VkImageBlit blit = {0};
+    blit.srcOffsets[0].x = 0;
+    blit.srcOffsets[0].y = 0;
+    blit.srcOffsets[0].z = 0;
+
+    blit.srcOffsets[1].x = mip_width;
+    blit.srcOffsets[1].y = mip_height;
+    blit.srcOffsets[1].z = 1;
+
+    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.srcSubresource.mipLevel = i - 1;
+    blit.srcSubresource.baseArrayLayer = 0;
+    blit.srcSubresource.layerCount = 1;
+
+    blit.dstOffsets[0].x = 0;
+    blit.dstOffsets[0].y = 0;
+    blit.dstOffsets[0].z = 0;
+
+    blit.dstOffsets[1].x = mip_width > 1 ? mip_width / 2 : 1;
+    blit.dstOffsets[1].y = mip_height > 1 ? mip_height / 2 : 1;
+    blit.dstOffsets[1].z = 1;
+
+    blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    blit.dstSubresource.mipLevel = i;
+    blit.dstSubresource.baseArrayLayer = 0;
+    blit.dstSubresource.layerCount = 1;
+
+    vkCmdBlitImage(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                   image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                   VK_FILTER_LINEAR);
+
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0,
+                         NULL, 1, &barrier);
+    if (mip_width > 1)
+      mip_width /= 2;
+    if (mip_height > 1)
+      mip_height /= 2;
+  }
+
+  barrier.subresourceRange.baseMipLevel = mip_levels - 1;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0,
+                       NULL, 1, &barrier);
+
+  end_single_time_commands(command_buffer);
+}
+
+// the push constants of shaders/downsample.comp
+typedef struct {
+  int32_t size[2];
+  int32_t mip_levels;
+  int32_t workgroups;
+} MipPushConstants;
+
+// sets up shaders/downsample.comp when the device can write R8G8B8A8_UNORM
+// storage images from the graphics queue, textures fall back to blits
+// otherwise. The textures it writes need
+// VK_IMAGE_CREATE_EXTENDED_USAGE_BIT, which is Vulkan 1.1, and it binds a
+// storage image for each level.
+void create_mip_pipeline() {
+  mip_pipeline = VK_NULL_HANDLE;
+  if (!COMPUTE_MIPMAPS) {
+    return;
+  }
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(physical_device, &properties);
+  if (!device_supports_vulkan_1_1(physical_device) ||
+      properties.limits.maxPerStageDescriptorStorageImages <
+          COMPUTE_MIP_LEVELS + 1) {
+    printf("no compute mipmaps, the device needs Vulkan 1.1 and %d storage "
+           "images per stage\n",
+           COMPUTE_MIP_LEVELS + 1);
+    return;
+  }
+  VkFormatProperties format_properties;
+  vkGetPhysicalDeviceFormatProperties(physical_device, VK_FORMAT_R8G8B8A8_UNORM,
+                                      &format_properties);
+  QueueFamilyIndices queue_families = find_queue_families(physical_device);
+  VkQueueFamilyProperties families[64];
+  uint32_t families_count = 64;
+  vkGetPhysicalDeviceQueueFamilyProperties(physical_device, &families_count,
+                                           families);
+  if (!(format_properties.optimalTilingFeatures &
+        VK_FORMAT_FEATURE_STORAGE_IMAGE_BIT) ||
+      queue_families.graphics_family >= families_count ||
+      !(families[queue_families.graphics_family].queueFlags &
+        VK_QUEUE_COMPUTE_BIT)) {
+    printf("no compute mipmaps, storage images are unsupported\n");
+    return;
+  }
+  MappedFile shader_code = map_file(MIP_SHADER_PATH);
+  if (shader_code.len == 0) {
+    fprintf(stderr,
+            "no compute mipmaps, %s is missing! Run ./compile-shaders.sh, "
+            "textures fall back to blits\n",
+            MIP_SHADER_PATH);
+    return;
+  }
+  VkShaderModule shader_module =
+      create_shader_module(shader_code.data, shader_code.len);
+  unmap_file(shader_code);
+
+  VkDescriptorSetLayoutBinding bindings[2] = {0};
+  bindings[0].binding = 0;
+  bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  bindings[0].descriptorCount = COMPUTE_MIP_LEVELS + 1;
+  bindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  bindings[1].binding = 1;
+  bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  bindings[1].descriptorCount = 1;
+  bindings[1].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+
+  VkDescriptorSetLayoutCreateInfo layout_info = {0};
+  layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layout_info.bindingCount = 2;
+  layout_info.pBindings = bindings;
+  if (vkCreateDescriptorSetLayout(device, &layout_info, NULL,
+                                  &mip_descriptor_set_layout) != VK_SUCCESS) {
+    THROW("failed to create mip descriptor set layout!\n");
+  }
+
+  VkPushConstantRange push_constants = {0};
+  push_constants.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+  push_constants.size = sizeof(MipPushConstants);
+
+  VkPipelineLayoutCreateInfo pipeline_layout_info = {0};
+  pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipeline_layout_info.setLayoutCount = 1;
+  pipeline_layout_info.pSetLayouts = &mip_descriptor_set_layout;
+  pipeline_layout_info.pushConstantRangeCount = 1;
+  pipeline_layout_info.pPushConstantRanges = &push_constants;
+  if (vkCreatePipelineLayout(device, &pipeline_layout_info, NULL,
+                             &mip_pipeline_layout) != VK_SUCCESS) {
+    THROW("failed to create mip pipeline layout!\n");
+  }
+
+  VkComputePipelineCreateInfo pipeline_info = {0};
+  pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipeline_info.stage.sType =
+      VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipeline_info.stage.module = shader_module;
+  pipeline_info.stage.pName = "main";
+  pipeline_info.layout = mip_pipeline_layout;
+  if (vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipeline_info,
+                               NULL, &mip_pipeline) != VK_SUCCESS) {
+    THROW("failed to create mip pipeline!\n");
+  }
+  vkDestroyShaderModule(device, shader_module, NULL);
+
+  create_buffer(sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                &mip_counter_buffer, &mip_counter_buffer_memory);
+  void *data;
+  vkMapMemory(device, mip_counter_buffer_memory, 0, sizeof(uint32_t), 0,
+              &data);
+  memset(data, 0, sizeof(uint32_t));
+  vkUnmapMemory(device, mip_counter_buffer_memory);
+}
+
+void destroy_mip_pipeline() {
+  if (mip_pipeline == VK_NULL_HANDLE) {
+    return;
+  }
+  vkDestroyBuffer(device, mip_counter_buffer, NULL);
+  vkFreeMemory(device, mip_counter_buffer_memory, NULL);
+  vkDestroyPipeline(device, mip_pipeline, NULL);
+  vkDestroyPipelineLayout(device, mip_pipeline_layout, NULL);
+  vkDestroyDescriptorSetLayout(device, mip_descriptor_set_layout, NULL);
+}
+
+// whether generate_mipmaps_compute() can build the whole chain of a
+// texture, its shader stops at level 12
+int can_compute_mipmaps(uint32_t width, uint32_t height) {
+  return mip_pipeline != VK_NULL_HANDLE && width <= COMPUTE_MIP_MAX_SIZE &&
+         height <= COMPUTE_MIP_MAX_SIZE;
+}
+
+// The compute counterpart of generate_mipmaps(): one dispatch builds every
+// level below level 0, with a barrier before and after it rather than two
+// per level. The image has to be created with
+// VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT and storage usage, its levels are
+// written through R8G8B8A8_UNORM views.
+void generate_mipmaps_compute(VkImage image, uint32_t width, uint32_t height,
+                              uint32_t mip_levels) {
+  VkDescriptorPoolSize pool_sizes[2] = {0};
+  pool_sizes[0].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  pool_sizes[0].descriptorCount = COMPUTE_MIP_LEVELS + 1;
+  pool_sizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  pool_sizes[1].descriptorCount = 1;
+
+  VkDescriptorPoolCreateInfo pool_info = {0};
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.poolSizeCount = 2;
+  pool_info.pPoolSizes = pool_sizes;
+  pool_info.maxSets = 1;
+  VkDescriptorPool pool;
+  if (vkCreateDescriptorPool(device, &pool_info, NULL, &pool) != VK_SUCCESS) {
+    THROW("failed to create mip descriptor pool!\n");
+  }
+
+  VkDescriptorSetAllocateInfo alloc_info = {0};
+  alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  alloc_info.descriptorPool = pool;
+  alloc_info.descriptorSetCount = 1;
+  alloc_info.pSetLayouts = &mip_descriptor_set_layout;
+  VkDescriptorSet descriptor_set;
+  if (vkAllocateDescriptorSets(device, &alloc_info, &descriptor_set) !=
+      VK_SUCCESS) {
+    THROW("failed to allocate mip descriptor set!\n");
+  }
+
+  // slots past the last level repeat it, the shader never touches them
+  VkImageView views[COMPUTE_MIP_LEVELS + 1];
+  VkDescriptorImageInfo image_infos[COMPUTE_MIP_LEVELS + 1];
+  for (uint32_t i = 0; i <= COMPUTE_MIP_LEVELS; i++) {
+    if (i < mip_levels) {
+      VkImageViewCreateInfo view_info = {0};
+      view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+      view_info.image = image;
+      view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+      view_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+      view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      view_info.subresourceRange.baseMipLevel = i;
+      view_info.subresourceRange.levelCount = 1;
+      view_info.subresourceRange.baseArrayLayer = 0;
+      view_info.subresourceRange.layerCount = 1;
+      if (vkCreateImageView(device, &view_info, NULL, &views[i]) !=
+          VK_SUCCESS) {
+        THROW("failed to create mip image view!\n");
+      }
+    }
+    image_infos[i].sampler = VK_NULL_HANDLE;
+    image_infos[i].imageView = views[i < mip_levels ? i : mip_levels - 1];
+    image_infos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+  }
+  VkDescriptorBufferInfo buffer_info = {0};
+  buffer_info.buffer = mip_counter_buffer;
+  buffer_info.offset = 0;
+  buffer_info.range = sizeof(uint32_t);
+
+  VkWriteDescriptorSet descriptor_writes[2] = {0};
+  descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  descriptor_writes[0].dstSet = descriptor_set;
+  descriptor_writes[0].dstBinding = 0;
+  descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+  descriptor_writes[0].descriptorCount = COMPUTE_MIP_LEVELS + 1;
+  descriptor_writes[0].pImageInfo = image_infos;
+  descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  descriptor_writes[1].dstSet = descriptor_set;
+  descriptor_writes[1].dstBinding = 1;
+  descriptor_writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  descriptor_writes[1].descriptorCount = 1;
+  descriptor_writes[1].pBufferInfo = &buffer_info;
+  vkUpdateDescriptorSets(device, 2, descriptor_writes, 0, NULL);
+
+  VkCommandBuffer command_buffer = begin_single_time_commands();
+
+  VkImageMemoryBarrier barrier = {0};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.image = image;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = mip_levels;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, NULL, 0,
+                       NULL, 1, &barrier);
+
+  MipPushConstants push_constants = {0};
+  uint32_t groups_x =
+      (width + COMPUTE_MIP_TILE_SIZE - 1) / COMPUTE_MIP_TILE_SIZE;
+  uint32_t groups_y =
+      (height + COMPUTE_MIP_TILE_SIZE - 1) / COMPUTE_MIP_TILE_SIZE;
+  push_constants.size[0] = width;
+  push_constants.size[1] = height;
+  push_constants.mip_levels = mip_levels - 1;
+  push_constants.workgroups = groups_x * groups_y;
+  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                    mip_pipeline);
+  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE,
+                          mip_pipeline_layout, 0, 1, &descriptor_set, 0,
+                          NULL);
+  vkCmdPushConstants(command_buffer, mip_pipeline_layout,
+                     VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push_constants),
+                     &push_constants);
+  vkCmdDispatch(command_buffer, groups_x, groups_y, 1);
+
+  // the counter is shared by every dispatch, the next one waits for this
+  // one to have reset it
+  VkMemoryBarrier counter_barrier = {0};
+  counter_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  counter_barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  counter_barrier.dstAccessMask =
+      VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                       VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT |
+                           VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                       0, 1, &counter_barrier, 0, NULL, 1, &barrier);
 
-  VkPipelineInputAssemblyStateCreateInfo input_assembly = {0};
-  input_assembly.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-  input_assembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-  input_assembly.primitiveRestartEnable = VK_FALSE;
+  end_single_time_commands(command_buffer);
 
-  VkViewport viewport = {0};
-  viewport.x = 0.0f;
-  viewport.y = 0.0f;
-  viewport.width = (float)swap_chain_extent.width;
-  viewport.height = (float)swap_chain_extent.height;
-  viewport.minDepth = 0.0f;
-  viewport.maxDepth = 1.0f;
+  for (uint32_t i = 0; i < mip_levels && i <= COMPUTE_MIP_LEVELS; i++) {
+    destroy_transient_resource((RetiredResource){.view = views[i]});
+  }
+  destroy_transient_resource((RetiredResource){.descriptor_pool = pool});
+}
 
-  VkRect2D scissor = {0};
-  scissor.extent = swap_chain_extent;
+// records copying every level of an RGBA8 texture that shaders read into
+// `buffer`, packed the way mip_chain_size() lays them out, and makes the
+// copy visible to the host
+static void copy_mip_chain_to_buffer(VkCommandBuffer command_buffer,
+                                     VkImage image, uint32_t width,
+                                     uint32_t height, uint32_t mip_levels,
+                                     VkBuffer buffer) {
+  VkImageMemoryBarrier barrier = {0};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.image = image;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  barrier.subresourceRange.baseMipLevel = 0;
+  barrier.subresourceRange.levelCount = mip_levels;
+  barrier.subresourceRange.baseArrayLayer = 0;
+  barrier.subresourceRange.layerCount = 1;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.srcAccessMask =
+      VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+                       VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL,
+                       1, &barrier);
+
+  VkBufferImageCopy regions[MAX_MIP_LEVELS] = {0};
+  VkDeviceSize offset = 0;
+  for (uint32_t i = 0; i < mip_levels; i++) {
+    regions[i].bufferOffset = offset;
+    regions[i].imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    regions[i].imageSubresource.mipLevel = i;
+    regions[i].imageSubresource.baseArrayLayer = 0;
+    regions[i].imageSubresource.layerCount = 1;
+    regions[i].imageExtent.width = mip_extent(width, i);
+    regions[i].imageExtent.height = mip_extent(height, i);
+    regions[i].imageExtent.depth = 1;
+    offset += (VkDeviceSize)regions[i].imageExtent.width *
+              regions[i].imageExtent.height * 4;
+  }
+  vkCmdCopyImageToBuffer(command_buffer, image,
+                         VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer,
+                         mip_levels, regions);
+
+  VkMemoryBarrier host_barrier = {0};
+  host_barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  host_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  host_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+                           VK_PIPELINE_STAGE_HOST_BIT,
+                       0, 1, &host_barrier, 0, NULL, 1, &barrier);
+}
 
-  VkPipelineViewportStateCreateInfo viewport_state = {0};
-  viewport_state.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-  viewport_state.viewportCount = 1;
-  viewport_state.scissorCount = 1;
+// COMPARE_MIPMAPS: reads back a chain generate_mipmaps_compute() built and
+// one generate_mipmaps() built from the same level 0, and prints how far
+// apart each level is. Waits for the device, so not during a reload.
+static void compare_mip_chains(VkImage compute_image, VkImage blit_image,
+                               uint32_t width, uint32_t height,
+                               uint32_t mip_levels) {
+  VkDeviceSize size = mip_chain_size(width, height, mip_levels);
+  VkImage images[2] = {compute_image, blit_image};
+  VkBuffer buffers[2];
+  VkDeviceMemory memories[2];
+  VkCommandBuffer command_buffer = begin_single_time_commands();
+  for (int i = 0; i < 2; i++) {
+    create_buffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                  &buffers[i], &memories[i]);
+    copy_mip_chain_to_buffer(command_buffer, images[i], width, height,
+                             mip_levels, buffers[i]);
+  }
+  end_single_time_commands(command_buffer);
 
-  VkPipelineRasterizationStateCreateInfo rasterizer = {0};
-  rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-  rasterizer.depthClampEnable = VK_FALSE;
-  rasterizer.rasterizerDiscardEnable = VK_FALSE;
-  rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
-  rasterizer.lineWidth = 1.0f;
-  rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
-  rasterizer.frontFace = VK_FRONT_FACE_COUNTER_CLOCKWISE;
-  rasterizer.depthBiasEnable = VK_FALSE;
-  rasterizer.depthBiasConstantFactor = 0.0f;
-  rasterizer.depthBiasClamp = 0.0f;
-  rasterizer.depthBiasSlopeFactor = 0.0f;
+  const uint8_t *chains[2];
+  for (int i = 0; i < 2; i++) {
+    vkMapMemory(device, memories[i], 0, size, 0, (void **)&chains[i]);
+  }
+  int worst = 0;
+  size_t offset = 0;
+  for (uint32_t level = 0; level < mip_levels; level++) {
+    uint32_t level_width = mip_extent(width, level);
+    uint32_t level_height = mip_extent(height, level);
+    size_t len = (size_t)level_width * level_height * 4;
+    int most = 0;
+    uint64_t total = 0;
+    for (size_t i = offset; i < offset + len; i++) {
+      int difference = abs((int)chains[0][i] - (int)chains[1][i]);
+      most = difference > most ? difference : most;
+      total += difference;
+    }
+    printf("mip level %u, %ux%u: compute and blits differ by %d at most, "
+           "%.3f on average\n",
+           level, level_width, level_height, most, (double)total / len);
+    worst = most > worst ? most : worst;
+    offset += len;
+  }
+  if (worst > COMPARE_MIPMAPS_TOLERANCE) {
+    fprintf(stderr, "the compute mip chain of a %ux%u texture is off by up "
+                    "to %d from the blits!\n",
+            width, height, worst);
+  } else {
+    printf("the compute mip chain of a %ux%u texture matches the blits\n",
+           width, height);
+  }
+  for (int i = 0; i < 2; i++) {
+    vkUnmapMemory(device, memories[i]);
+    destroy_staging_buffer(buffers[i], memories[i]);
+  }
+}
 
-  VkPipelineMultisampleStateCreateInfo multisampling = {0};
-  multisampling.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-  multisampling.sampleShadingEnable = VK_TRUE;
-  multisampling.rasterizationSamples = msaa_samples;
-  multisampling.minSampleShading = .2f;
-  multisampling.pSampleMask = NULL;
-  multisampling.alphaToCoverageEnable = VK_FALSE;
-  multisampling.alphaToOneEnable = VK_FALSE;
+uint64_t hash_bytes(const char *data, size_t len);
 
-  VkPipelineColorBlendAttachmentState color_blend_attachment = {0};
-  color_blend_attachment.colorWriteMask =
-      VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
-      VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-  color_blend_attachment.blendEnable = VK_FALSE;
-  color_blend_attachment.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
-  color_blend_attachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
-  color_blend_attachment.colorBlendOp = VK_BLEND_OP_ADD;
-  color_blend_attachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
-  color_blend_attachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-  color_blend_attachment.alphaBlendOp = VK_BLEND_OP_ADD;
+// an image decoded to RGBA8, or block compressed with its whole mip chain,
+// waiting for create_texture_image(). An image that failed to decode has
+// neither pixels nor blocks.
+typedef struct {
+  stbi_uc *pixels;
+  int width;
+  int height;
+  // VK_FORMAT_UNDEFINED unless a whole chain was compressed or read into
+  // `blocks`, which points into blocks_file when it came from the texture
+  // cache or a .ktx2 and is malloc'd otherwise. blocks_size is the size of
+  // the chain packed largest level first, level_offsets[] where each level
+  // starts in `blocks`.
+  VkFormat format;
+  uint32_t mip_levels;
+  uint8_t *blocks;
+  size_t blocks_size;
+  MappedFile blocks_file;
+  uint64_t level_offsets[MAX_MIP_LEVELS];
+  // where the pixels are decoded from after all on a device that can't
+  // sample `format`
+  MeshMaterial material;
+  // how long stb_image took to decode it, 0 for an image read from the
+  // texture cache or a .ktx2
+  double decode_ms;
+} DecodedImage;
+
+// layout of a .vtex file: this header, then the mip chain in `format` with
+// its levels packed largest first, in native byte order
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t source_hash;
+  uint64_t source_len;
+  uint32_t format;
+  uint32_t width;
+  uint32_t height;
+  uint32_t mip_levels;
+  // the image the chain was built from, so the chains of its earlier
+  // contents can be found, see prune_texture_cache()
+  uint64_t source_offset;
+  char source_path[MATERIAL_PATH_MAX];
+} TextureCacheHeader;
+
+// cached textures are named by the hash of their encoded source, so an
+// image embedded in a .glb is found as well as one in its own file
+static void texture_cache_path(uint64_t source_hash, char *path, size_t len) {
+  snprintf(path, len, "%s/%016llx.vtex", TEXTURE_CACHE_DIR,
+           (unsigned long long)source_hash);
+}
 
-  VkPipelineColorBlendStateCreateInfo color_blending = {0};
-  color_blending.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-  color_blending.logicOpEnable = VK_FALSE;
-  color_blending.logicOp = VK_LOGIC_OP_COPY;
-  color_blending.attachmentCount = 1;
-  color_blending.pAttachments = &color_blend_attachment;
-  color_blending.blendConstants[0] = 0.0f;
-  color_blending.blendConstants[1] = 0.0f;
-  color_blending.blendConstants[2] = 0.0f;
-  color_blending.blendConstants[3] = 0.0f;
+// whether a chain cached in `format` is what choose_block_format() would
+// pick for it now
+static int wanted_block_format(VkFormat format) {
+  if (PREFER_BC7) {
+    return format == VK_FORMAT_BC7_SRGB_BLOCK;
+  }
+  return format == VK_FORMAT_BC1_RGB_SRGB_BLOCK ||
+         format == VK_FORMAT_BC3_SRGB_BLOCK;
+}
 
-  VkPipelineLayoutCreateInfo pipeline_layout_info = {0};
-  pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipeline_layout_info.setLayoutCount = 1;
-  pipeline_layout_info.pSetLayouts = &descriptor_set_layout;
-  pipeline_layout_info.pushConstantRangeCount = 0;
-  pipeline_layout_info.pPushConstantRanges = NULL;
+// level_offsets[] of a chain in `blocks` packed largest level first
+static void pack_level_offsets(DecodedImage *image) {
+  uint64_t offset = 0;
+  for (uint32_t i = 0; i < image->mip_levels; i++) {
+    image->level_offsets[i] = offset;
+    offset += texture_level_size(image->format, mip_extent(image->width, i),
+                                 mip_extent(image->height, i));
+  }
+}
 
-  if (vkCreatePipelineLayout(device, &pipeline_layout_info, NULL,
-                             &pipeline_layout) != VK_SUCCESS) {
-    THROW("failed to create pipeline layout!\n");
+// points `image` at the cached chain of the source if there is one built
+// with the current settings, returns 0 otherwise
+static int load_texture_cache(uint64_t source_hash, uint64_t source_len,
+                              DecodedImage *image) {
+  char path[256];
+  texture_cache_path(source_hash, path, sizeof(path));
+  MappedFile file = map_file(path);
+  if (!file.data) {
+    return 0;
   }
 
-  VkPipelineDepthStencilStateCreateInfo depth_stencil = {0};
-  depth_stencil.sType =
-      VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-  depth_stencil.depthTestEnable = VK_TRUE;
-  depth_stencil.depthWriteEnable = VK_TRUE;
-  depth_stencil.depthCompareOp = VK_COMPARE_OP_LESS;
-  depth_stencil.depthBoundsTestEnable = VK_FALSE;
-  depth_stencil.minDepthBounds = 0.0f;
-  depth_stencil.maxDepthBounds = 1.0f;
-  depth_stencil.stencilTestEnable = VK_FALSE;
+  TextureCacheHeader header = {0};
+  if (file.len >= sizeof(header)) {
+    memcpy(&header, file.data, sizeof(header));
+  }
+  if (header.magic != TEXTURE_CACHE_MAGIC ||
+      header.version != TEXTURE_CACHE_VERSION ||
+      header.source_hash != source_hash || header.source_len != source_len ||
+      !wanted_block_format(header.format) || header.width == 0 ||
+      header.height == 0 ||
+      header.mip_levels != texture_mip_levels(header.width, header.height) ||
+      file.len != sizeof(header) +
+                      texture_chain_size(header.format, header.width,
+                                         header.height, header.mip_levels)) {
+    unmap_file(file);
+    return 0;
+  }
 
-  VkGraphicsPipelineCreateInfo pipeline_info = {0};
-  pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-  pipeline_info.stageCount = 2;
-  pipeline_info.pStages = shader_stages;
-  pipeline_info.pVertexInputState = &vertex_input_info;
-  pipeline_info.pInputAssemblyState = &input_assembly;
-  pipeline_info.pViewportState = &viewport_state;
-  pipeline_info.pRasterizationState = &rasterizer;
-  pipeline_info.pMultisampleState = &multisampling;
-  pipeline_info.pDepthStencilState = &depth_stencil;
-  pipeline_info.pColorBlendState = &color_blending;
-  pipeline_info.pDynamicState = &dynamic_state;
-  pipeline_info.layout = pipeline_layout;
-  pipeline_info.renderPass = render_pass;
-  pipeline_info.subpass = 0;
-  pipeline_info.basePipelineHandle = VK_NULL_HANDLE;
-  pipeline_info.basePipelineIndex = -1;
+  image->width = header.width;
+  image->height = header.height;
+  image->format = header.format;
+  image->mip_levels = header.mip_levels;
+  image->blocks = (uint8_t *)file.data + sizeof(header);
+  image->blocks_size = file.len - sizeof(header);
+  image->blocks_file = file;
+  pack_level_offsets(image);
+  return 1;
+}
 
-  if (vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipeline_info, NULL,
-                                &graphics_pipeline) != VK_SUCCESS) {
-    THROW("failed to create graphics pipeline!\n");
+// Removes the chains cached for earlier contents of a material's image,
+// which nobody looks up once its source has changed, and those written by
+// another version of the cache. Run after its new chain is written.
+static void prune_texture_cache(uint64_t source_hash,
+                                const MeshMaterial *material) {
+  DIR *dir = opendir(TEXTURE_CACHE_DIR);
+  if (!dir) {
+    return;
+  }
+  struct dirent *entry;
+  while ((entry = readdir(dir))) {
+    if (!has_extension(entry->d_name, ".vtex")) {
+      continue;
+    }
+    char path[512];
+    snprintf(path, sizeof(path), "%s/%s", TEXTURE_CACHE_DIR, entry->d_name);
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+      continue;
+    }
+    TextureCacheHeader header = {0};
+    size_t read = fread(&header, 1, sizeof(header), f);
+    fclose(f);
+    if (read < 2 * sizeof(uint32_t) || header.magic != TEXTURE_CACHE_MAGIC) {
+      continue;
+    }
+    int stale = header.version != TEXTURE_CACHE_VERSION ||
+                (read == sizeof(header) && header.source_hash != source_hash &&
+                 header.source_offset == material->texture_offset &&
+                 strncmp(header.source_path, material->texture_path,
+                         sizeof(header.source_path)) == 0);
+    if (stale && remove(path) == 0) {
+      printf("removed stale texture cache %s\n", path);
+    }
+  }
+  closedir(dir);
+}
+
+// like the mesh cache, a texture cache that can't be written only costs
+// the next launch an encode, so failures are reported and otherwise ignored
+static void write_texture_cache(uint64_t source_hash, uint64_t source_len,
+                                const DecodedImage *image) {
+  TextureCacheHeader header = {0};
+  header.magic = TEXTURE_CACHE_MAGIC;
+  header.version = TEXTURE_CACHE_VERSION;
+  header.source_hash = source_hash;
+  header.source_len = source_len;
+  header.format = image->format;
+  header.width = image->width;
+  header.height = image->height;
+  header.mip_levels = image->mip_levels;
+  header.source_offset = image->material.texture_offset;
+  snprintf(header.source_path, sizeof(header.source_path), "%s",
+           image->material.texture_path);
+
+  // images with the same source can be decoding on two threads at once,
+  // each writes its own temporary file
+  static atomic_uint texture_cache_writes;
+  char path[256];
+  char tmp_path[sizeof(path) + 16];
+  texture_cache_path(source_hash, path, sizeof(path));
+  snprintf(tmp_path, sizeof(tmp_path), "%s.%u.tmp", path,
+           atomic_fetch_add(&texture_cache_writes, 1));
+  mkdir(TEXTURE_CACHE_DIR, 0755);
+  FILE *f = fopen(tmp_path, "wb");
+  if (!f) {
+    fprintf(stderr, "failed to create texture cache %s!\n", tmp_path);
+    return;
+  }
+  int ok = fwrite(&header, sizeof(header), 1, f) == 1 &&
+           fwrite(image->blocks, image->blocks_size, 1, f) == 1;
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp_path, path) != 0) {
+    fprintf(stderr, "failed to write texture cache %s!\n", path);
+    remove(tmp_path);
+    return;
+  }
+  printf("wrote texture cache %s: %.1f KB\n", path,
+         (sizeof(header) + image->blocks_size) / 1e3);
+  prune_texture_cache(source_hash, &image->material);
+}
+
+static void release_texture_blocks(DecodedImage *image) {
+  if (image->blocks_file.data) {
+    unmap_file(image->blocks_file);
+  } else {
+    free(image->blocks);
+  }
+  image->blocks = NULL;
+  image->blocks_size = 0;
+  image->blocks_file = (MappedFile){0};
+  image->format = VK_FORMAT_UNDEFINED;
+}
+
+// the encoded bytes of a material's image, its file is mapped into `file`
+// unless the image is embedded in the .glb. NULL if the file can't be read.
+static const stbi_uc *map_texture_source(const MeshMaterial *material,
+                                         MappedFile *file, size_t *size) {
+  *file = (MappedFile){0};
+  if (material->texture_size > 0) {
+    *size = material->texture_size;
+    return (const stbi_uc *)glb_source.data + material->texture_offset;
+  }
+  *file = map_file(material->texture_path);
+  if (!file->data) {
+    fprintf(stderr, "failed to read texture image %s!\n",
+            material->texture_path);
+    return NULL;
+  }
+  *size = file->len;
+  return (const stbi_uc *)file->data;
+}
+
+// returns 0 if stb_image can't decode the source, a half written file
+// among others
+static int decode_pixels(DecodedImage *image, const stbi_uc *source,
+                         size_t size) {
+  struct timespec decode_start;
+  clock_gettime(CLOCK_MONOTONIC, &decode_start);
+  int channels;
+  image->pixels =
+      stbi_load_from_memory(source, (int)size, &image->width, &image->height,
+                            &channels, STBI_rgb_alpha);
+  if (!image->pixels) {
+    fprintf(stderr, "failed to decode texture image %s!\n",
+            image->material.texture_path);
+    return 0;
+  }
+  image->decode_ms = elapsed_ms(&decode_start);
+  return 1;
+}
+
+// replaces the pixels of `image` with its whole mip chain block compressed
+static void compress_image(DecodedImage *image) {
+  struct timespec compress_start;
+  clock_gettime(CLOCK_MONOTONIC, &compress_start);
+  uint32_t width = image->width;
+  uint32_t height = image->height;
+  uint32_t mip_levels = texture_mip_levels(width, height);
+  uint8_t *chain = malloc(mip_chain_size(width, height, mip_levels));
+  if (!chain) {
+    THROW("failed to allocate mip chain!\n");
+  }
+  build_mip_chain(image->pixels, width, height, mip_levels, chain);
+  stbi_image_free(image->pixels);
+  image->pixels = NULL;
+
+  image->format = choose_block_format(chain, (size_t)width * height);
+  image->mip_levels = mip_levels;
+  image->blocks_size =
+      texture_chain_size(image->format, width, height, mip_levels);
+  image->blocks = malloc(image->blocks_size);
+  if (!image->blocks) {
+    THROW("failed to allocate texture blocks!\n");
+  }
+  encode_texture_blocks(chain, width, height, mip_levels, image->format,
+                        image->blocks);
+  free(chain);
+  pack_level_offsets(image);
+
+  double compress_ms = elapsed_ms(&compress_start);
+  printf("compressed a %ux%u texture with %u mip levels to %s in %.2f ms, "
+         "%.1f MB/s\n",
+         width, height, mip_levels, block_format_name(image->format),
+         compress_ms, (double)width * height * 4 / 1e3 / compress_ms);
+}
+
+// the start of a .ktx2 file, followed by one Ktx2Level per mip level,
+// level 0 first. Only the fields a 2D texture needs are read.
+typedef struct {
+  uint8_t identifier[12];
+  uint32_t vk_format;
+  uint32_t type_size;
+  uint32_t pixel_width;
+  uint32_t pixel_height;
+  uint32_t pixel_depth;
+  uint32_t layer_count;
+  uint32_t face_count;
+  uint32_t level_count;
+  uint32_t supercompression_scheme;
+  uint32_t dfd_byte_offset;
+  uint32_t dfd_byte_length;
+  uint32_t kvd_byte_offset;
+  uint32_t kvd_byte_length;
+  uint64_t sgd_byte_offset;
+  uint64_t sgd_byte_length;
+} Ktx2Header;
+
+typedef struct {
+  uint64_t byte_offset;
+  uint64_t byte_length;
+  uint64_t uncompressed_byte_length;
+} Ktx2Level;
+
+_Static_assert(sizeof(Ktx2Header) == 80, "KTX2 header layout");
+
+static const uint8_t ktx2_identifier[12] = {0xab, 0x4b, 0x54, 0x58,
+                                            0x20, 0x32, 0x30, 0xbb,
+                                            0x0d, 0x0a, 0x1a, 0x0a};
+
+// Maps a .ktx2 with its mip chain baked in, so neither stb_image nor a
+// mipmap pass runs for it. The file stores the smallest level first, the
+// upload copies each one from the mapping to its place in the staging
+// buffer. Only 2D textures without supercompression in RGBA8 or a format
+// texture_block_size() knows are read, returns 0 for any other file.
+// A level count of 0 asks for the chain to be generated: level 0 is copied
+// into `pixels` and the rest built by whichever method
+// choose_mipmap_method() picks, which only works for R8G8B8A8_SRGB, the
+// format that path uploads.
+static int load_ktx2(DecodedImage *image) {
+  const char *filename = image->material.texture_path;
+  MappedFile file = map_file(filename);
+  Ktx2Header header = {0};
+  if (file.data && file.len >= sizeof(header)) {
+    memcpy(&header, file.data, sizeof(header));
+  }
+  VkFormat format = header.vk_format;
+  uint32_t level_count = header.level_count > 0 ? header.level_count : 1;
+  if (memcmp(header.identifier, ktx2_identifier, sizeof(ktx2_identifier)) !=
+          0 ||
+      (format != VK_FORMAT_R8G8B8A8_SRGB &&
+       format != VK_FORMAT_R8G8B8A8_UNORM &&
+       texture_block_size(format) == 0) ||
+      header.pixel_width == 0 || header.pixel_height == 0 ||
+      header.pixel_depth > 1 || header.layer_count > 1 ||
+      header.face_count != 1 || header.supercompression_scheme != 0 ||
+      level_count > texture_mip_levels(header.pixel_width,
+                                       header.pixel_height) ||
+      file.len < sizeof(header) + level_count * sizeof(Ktx2Level)) {
+    fprintf(stderr, "%s isn't a 2D KTX2 texture in a supported format!\n",
+            filename);
+    if (file.data) {
+      unmap_file(file);
+    }
+    return 0;
+  }
+  if (header.level_count == 0 && format != VK_FORMAT_R8G8B8A8_SRGB) {
+    fprintf(stderr,
+            "%s asks for a generated mip chain, which only R8G8B8A8_SRGB "
+            "textures get!\n",
+            filename);
+    unmap_file(file);
+    return 0;
+  }
+
+  image->width = header.pixel_width;
+  image->height = header.pixel_height;
+  image->format = format;
+  image->mip_levels = level_count;
+  image->blocks = (uint8_t *)file.data;
+  image->blocks_size = texture_chain_size(format, header.pixel_width,
+                                          header.pixel_height, level_count);
+  image->blocks_file = file;
+  for (uint32_t i = 0; i < level_count; i++) {
+    Ktx2Level level;
+    memcpy(&level, file.data + sizeof(header) + i * sizeof(level),
+           sizeof(level));
+    uint64_t size = texture_level_size(format, mip_extent(image->width, i),
+                                       mip_extent(image->height, i));
+    if (level.byte_length != size || level.byte_offset > file.len ||
+        file.len - level.byte_offset < size) {
+      fprintf(stderr, "level %u of %s is truncated!\n", i, filename);
+      release_texture_blocks(image);
+      return 0;
+    }
+    image->level_offsets[i] = level.byte_offset;
+  }
+
+  if (header.level_count == 0) {
+    size_t size = image->blocks_size;
+    image->pixels = malloc(size);
+    if (!image->pixels) {
+      THROW("failed to allocate texture image %s!\n", filename);
+    }
+    memcpy(image->pixels, image->blocks + image->level_offsets[0], size);
+    release_texture_blocks(image);
+    image->mip_levels = 0;
+  }
+  return 1;
+}
+
+// decodes a material's image, or with COMPRESS_TEXTURES finds its
+// compressed chain in the texture cache, compressing it on a miss. A .ktx2
+// is read as it is. Errors are reported and leave the image empty.
+DecodedImage decode_image(const MeshMaterial *material) {
+  DecodedImage image = {0};
+  image.material = *material;
+  if (material->texture_size == 0 &&
+      has_extension(material->texture_path, ".ktx2")) {
+    load_ktx2(&image);
+    return image;
+  }
+  MappedFile file;
+  size_t size;
+  const stbi_uc *source = map_texture_source(material, &file, &size);
+  if (!source) {
+    return image;
+  }
+  uint64_t source_hash = 0;
+  if (COMPRESS_TEXTURES) {
+    source_hash = hash_bytes((const char *)source, size);
+    if (load_texture_cache(source_hash, size, &image)) {
+      if (file.data) {
+        unmap_file(file);
+      }
+      return image;
+    }
+  }
+
+  int decoded = decode_pixels(&image, source, size);
+  if (file.data) {
+    unmap_file(file);
+  }
+  if (decoded && COMPRESS_TEXTURES) {
+    compress_image(&image);
+    write_texture_cache(source_hash, size, &image);
+  }
+  return image;
+}
+
+// how a texture's mip chain is made
+typedef enum {
+  MIPMAPS_BLIT,
+  MIPMAPS_COMPUTE,
+  MIPMAPS_CPU,
+} MipmapMethod;
+
+// the compute downsampler when the device has it, then the blits, which
+// need linear filtering, then the CPU, which CPU_MIPMAPS forces
+MipmapMethod choose_mipmap_method(uint32_t width, uint32_t height) {
+  if (CPU_MIPMAPS) {
+    return MIPMAPS_CPU;
+  }
+  if (can_compute_mipmaps(width, height)) {
+    return MIPMAPS_COMPUTE;
+  }
+  if (supports_linear_blit(VK_FORMAT_R8G8B8A8_SRGB)) {
+    return MIPMAPS_BLIT;
+  }
+  return MIPMAPS_CPU;
+}
+
+// uploads a whole chain as it is, all levels in one copy
+static void create_block_texture_image(DecodedImage *image,
+                                       Texture *texture) {
+  uint32_t width = image->width;
+  uint32_t height = image->height;
+  VkDeviceSize image_size = image->blocks_size;
+  texture->format = image->format;
+  texture->mip_levels = image->mip_levels;
+
+  VkBuffer staging_buffer;
+  VkDeviceMemory staging_buffer_memory;
+  create_buffer(image_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                &staging_buffer, &staging_buffer_memory);
+  void *data;
+  vkMapMemory(device, staging_buffer_memory, 0, image_size, 0, &data);
+  VkDeviceSize offset = 0;
+  for (uint32_t i = 0; i < texture->mip_levels; i++) {
+    VkDeviceSize size = texture_level_size(
+        texture->format, mip_extent(width, i), mip_extent(height, i));
+    memcpy((uint8_t *)data + offset, image->blocks + image->level_offsets[i],
+           (size_t)size);
+    offset += size;
+  }
+  vkUnmapMemory(device, staging_buffer_memory);
+  release_texture_blocks(image);
+
+  create_image(width, height, texture->mip_levels, VK_SAMPLE_COUNT_1_BIT,
+               texture->format, VK_IMAGE_TILING_OPTIMAL, 0,
+               VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &texture->image,
+               &texture->memory);
+  transition_image_layout(texture->image, texture->format,
+                          VK_IMAGE_LAYOUT_UNDEFINED,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                          texture->mip_levels);
+  copy_buffer_to_image(staging_buffer, texture->image, texture->format, width,
+                       height, texture->mip_levels);
+  destroy_staging_buffer(staging_buffer, staging_buffer_memory);
+  transition_image_layout(texture->image, texture->format,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                          VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                          texture->mip_levels);
+}
+
+// uploads and frees a decoded image. A whole chain goes up as it is,
+// unless the device can't sample it and the image is decoded again.
+// Otherwise see choose_mipmap_method() for how the other levels are made,
+// a chain built on the CPU goes up with level 0 in a single copy. Returns
+// 0 without touching `texture` if there is nothing it can upload.
+int create_texture_image(DecodedImage *image, Texture *texture) {
+  if (image->blocks && !supports_block_format(image->format)) {
+    if (image->material.texture_size == 0 &&
+        has_extension(image->material.texture_path, ".ktx2")) {
+      fprintf(stderr, "the device can't sample %s!\n",
+              image->material.texture_path);
+      release_texture_blocks(image);
+      return 0;
+    }
+    printf("the device can't sample %s, uploading %s uncompressed\n",
+           block_format_name(image->format), image->material.texture_path);
+    release_texture_blocks(image);
+    MappedFile file;
+    size_t size;
+    const stbi_uc *source = map_texture_source(&image->material, &file, &size);
+    if (source) {
+      decode_pixels(image, source, size);
+    }
+    if (file.data) {
+      unmap_file(file);
+    }
+  }
+  if (image->blocks) {
+    create_block_texture_image(image, texture);
+    return 1;
+  }
+  if (!image->pixels) {
+    return 0;
+  }
+
+  int tex_width = image->width;
+  int tex_height = image->height;
+  stbi_uc *pixels = image->pixels;
+  image->pixels = NULL;
+
+  uint32_t mip_levels = texture_mip_levels(tex_width, tex_height);
+  texture->format = VK_FORMAT_R8G8B8A8_SRGB;
+  texture->mip_levels = mip_levels;
+  MipmapMethod mipmap_method = choose_mipmap_method(tex_width, tex_height);
+  int cpu_mipmaps = mipmap_method == MIPMAPS_CPU;
+  uint32_t staged_levels = cpu_mipmaps ? mip_levels : 1;
+  VkDeviceSize image_size =
+      mip_chain_size(tex_width, tex_height, staged_levels);
+
+  stbi_uc *chain = pixels;
+  if (cpu_mipmaps) {
+    struct timespec mip_start;
+    clock_gettime(CLOCK_MONOTONIC, &mip_start);
+    chain = malloc(image_size);
+    if (!chain) {
+      THROW("failed to allocate mip chain!\n");
+    }
+    build_mip_chain(pixels, tex_width, tex_height, mip_levels, chain);
+    stbi_image_free(pixels);
+    printf("built %u mip levels of a %dx%d texture on the CPU in %.2f ms\n",
+           mip_levels, tex_width, tex_height, elapsed_ms(&mip_start));
+  }
+
+  VkBuffer staging_buffer;
+  VkDeviceMemory staging_buffer_memory;
+
+  create_buffer(image_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+                &staging_buffer, &staging_buffer_memory);
+  void *data;
+  vkMapMemory(device, staging_buffer_memory, 0, image_size, 0, &data);
+  memcpy(data, chain, (size_t)image_size);
+  vkUnmapMemory(device, staging_buffer_memory);
+  if (cpu_mipmaps) {
+    free(chain);
+  } else {
+    stbi_image_free(chain);
   }
 
-  vkDestroyShaderModule(device, frag_shader_module, NULL);
-  vkDestroyShaderModule(device, vert_shader_module, NULL);
-}
-
-VkFormat find_supported_format(uint32_t candidates_len, VkFormat candidates[],
-                               VkImageTiling tiling,
-                               VkFormatFeatureFlags features) {
-  for (int i = 0; i < candidates_len; i++) {
-    VkFormat format = candidates[i];
-    VkFormatProperties props;
-    vkGetPhysicalDeviceFormatProperties(physical_device, format, &props);
+  // the compute downsampler writes through R8G8B8A8_UNORM views, which
+  // the sRGB format itself needn't support storage for
+  VkImageCreateFlags flags = 0;
+  VkImageUsageFlags usage = VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                            VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                            VK_IMAGE_USAGE_SAMPLED_BIT;
+  if (mipmap_method == MIPMAPS_COMPUTE) {
+    flags = VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT |
+            VK_IMAGE_CREATE_EXTENDED_USAGE_BIT;
+    usage |= VK_IMAGE_USAGE_STORAGE_BIT;
+  }
+  create_image(tex_width, tex_height, mip_levels, VK_SAMPLE_COUNT_1_BIT,
+               VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, flags, usage,
+               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &texture->image,
+               &texture->memory);
 
-    if (tiling == VK_IMAGE_TILING_LINEAR &&
-        (props.linearTilingFeatures & features) == features) {
-      return format;
-    } else if (tiling == VK_IMAGE_TILING_OPTIMAL &&
-               (props.optimalTilingFeatures & features) == features) {
-      return format;
-    }
+  transition_image_layout(texture->image, VK_FORMAT_R8G8B8A8_SRGB,
+                          VK_IMAGE_LAYOUT_UNDEFINED,
+                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mip_levels);
+  copy_buffer_to_image(staging_buffer, texture->image, texture->format,
+                       tex_width, tex_height, staged_levels);
+
+  // COMPARE_MIPMAPS builds the chain a second time with blits, from the
+  // same level 0
+  VkImage blit_image = VK_NULL_HANDLE;
+  VkDeviceMemory blit_image_memory = VK_NULL_HANDLE;
+  if (COMPARE_MIPMAPS && mipmap_method == MIPMAPS_COMPUTE &&
+      reload_commands == VK_NULL_HANDLE &&
+      supports_linear_blit(VK_FORMAT_R8G8B8A8_SRGB)) {
+    create_image(tex_width, tex_height, mip_levels, VK_SAMPLE_COUNT_1_BIT,
+                 VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL, 0,
+                 VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                     VK_IMAGE_USAGE_TRANSFER_DST_BIT |
+                     VK_IMAGE_USAGE_SAMPLED_BIT,
+                 VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &blit_image,
+                 &blit_image_memory);
+    transition_image_layout(blit_image, VK_FORMAT_R8G8B8A8_SRGB,
+                            VK_IMAGE_LAYOUT_UNDEFINED,
+                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mip_levels);
+    copy_buffer_to_image(staging_buffer, blit_image, texture->format,
+                         tex_width, tex_height, 1);
+    generate_mipmaps(blit_image, VK_FORMAT_R8G8B8A8_SRGB, tex_width,
+                     tex_height, mip_levels);
+  }
+  destroy_staging_buffer(staging_buffer, staging_buffer_memory);
+  switch (mipmap_method) {
+  case MIPMAPS_BLIT:
+    generate_mipmaps(texture->image, VK_FORMAT_R8G8B8A8_SRGB, tex_width,
+                     tex_height, mip_levels);
+    break;
+  case MIPMAPS_COMPUTE:
+    generate_mipmaps_compute(texture->image, tex_width, tex_height,
+                             mip_levels);
+    break;
+  case MIPMAPS_CPU:
+    transition_image_layout(texture->image, VK_FORMAT_R8G8B8A8_SRGB,
+                            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                            mip_levels);
+    break;
   }
 
-  THROW("failed to find supported format!\n");
+  if (blit_image != VK_NULL_HANDLE) {
+    compare_mip_chains(texture->image, blit_image, tex_width, tex_height,
+                       mip_levels);
+    destroy_transient_resource((RetiredResource){
+        .image = blit_image, .memory = blit_image_memory});
+  }
+  return 1;
 }
 
-VkFormat find_depth_format() {
-  VkFormat candidates[] = {VK_FORMAT_D32_SFLOAT, VK_FORMAT_D32_SFLOAT_S8_UINT,
-                           VK_FORMAT_D24_UNORM_S8_UINT};
-  return find_supported_format(3, candidates, VK_IMAGE_TILING_OPTIMAL,
-                               VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+void create_texture_image_view(Texture *texture) {
+  texture->view =
+      create_image_view(texture->image, texture->format,
+                        VK_IMAGE_ASPECT_COLOR_BIT, texture->mip_levels);
 }
 
-void create_render_pass() {
-  VkAttachmentDescription color_attachment = {0};
-  color_attachment.format = swap_chain_image_format;
-  color_attachment.samples = msaa_samples;
-  color_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  color_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-  color_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-  color_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  color_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  color_attachment.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-
-  VkAttachmentReference color_attachment_ref = {0};
-  color_attachment_ref.attachment = 0;
-  color_attachment_ref.layout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+// Decodes the textures of a list of materials on a few threads while the
+// main thread uploads the ones already done, in the order they finish. At
+// most TEXTURE_QUEUE_DEPTH images are decoding or waiting for their upload
+// at a time, which bounds the memory a scene with many textures takes.
+typedef struct {
+  uint32_t material;
+  DecodedImage image;
+} LoadedTexture;
 
-  VkAttachmentDescription color_attachment_resolve = {0};
-  color_attachment_resolve.format = swap_chain_image_format;
-  color_attachment_resolve.samples = VK_SAMPLE_COUNT_1_BIT;
-  color_attachment_resolve.loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-  color_attachment_resolve.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-  color_attachment_resolve.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-  color_attachment_resolve.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  color_attachment_resolve.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  color_attachment_resolve.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+typedef struct {
+  pthread_t threads[TEXTURE_DECODE_THREADS];
+  uint32_t threads_len;
+  // the cores each worker's parallel_for() calls may use
+  uint32_t worker_cores;
+  pthread_mutex_t lock;
+  // signalled when an image is queued and when a queue slot frees up
+  pthread_cond_t decoded;
+  pthread_cond_t uploaded;
+  // the materials to load, the workers take them in order from `next`
+  uint32_t *materials;
+  uint32_t materials_cap;
+  uint32_t count;
+  uint32_t next;
+  // the images next_loaded_texture() has yet to return
+  uint32_t remaining;
+  uint32_t in_flight;
+  LoadedTexture queue[TEXTURE_QUEUE_DEPTH];
+  uint32_t queue_head;
+  uint32_t queue_len;
+  // the image next_loaded_texture() returned last
+  LoadedTexture current;
+  struct timespec start;
+  double load_ms;
+  // of the images stb_image decoded, texture cache hits and .ktx2 files
+  // take no decoding. decode_ms is summed over the workers, the aggregate
+  // rate divides by load_ms instead.
+  uint32_t decoded_count;
+  double decoded_bytes;
+  double decode_ms;
+} TextureLoader;
+
+static TextureLoader texture_loader = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .decoded = PTHREAD_COND_INITIALIZER,
+    .uploaded = PTHREAD_COND_INITIALIZER,
+};
+
+static void *decode_textures(void *arg) {
+  TextureLoader *loader = arg;
+  parallel_for_cores = loader->worker_cores;
+  pthread_mutex_lock(&loader->lock);
+  for (;;) {
+    while (loader->next < loader->count &&
+           loader->in_flight >= TEXTURE_QUEUE_DEPTH) {
+      pthread_cond_wait(&loader->uploaded, &loader->lock);
+    }
+    if (loader->next == loader->count) {
+      break;
+    }
+    uint32_t m = loader->materials[loader->next];
+    loader->next++;
+    loader->in_flight++;
+    pthread_mutex_unlock(&loader->lock);
+
+    DecodedImage image = decode_image(&mesh_materials[m]);
+
+    pthread_mutex_lock(&loader->lock);
+    LoadedTexture *slot =
+        &loader->queue[(loader->queue_head + loader->queue_len) %
+                       TEXTURE_QUEUE_DEPTH];
+    slot->material = m;
+    slot->image = image;
+    loader->queue_len++;
+    if (image.decode_ms > 0.0) {
+      loader->decoded_count++;
+      loader->decoded_bytes += (double)image.width * image.height * 4;
+      loader->decode_ms += image.decode_ms;
+    }
+    loader->load_ms = elapsed_ms(&loader->start);
+    pthread_cond_signal(&loader->decoded);
+  }
+  pthread_mutex_unlock(&loader->lock);
+  return NULL;
+}
 
-  VkAttachmentReference color_attachment_resolve_ref = {0};
-  color_attachment_resolve_ref.attachment = 2;
-  color_attachment_resolve_ref.layout =
-      VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+// starts decoding the textures of `count` materials, the ones listed in
+// `materials` or with NULL the first `count` of mesh_materials[], hand
+// them to the uploads with next_loaded_texture()
+void start_texture_loading(const uint32_t *materials, uint32_t count) {
+  TextureLoader *loader = &texture_loader;
+  reserve_array((void **)&loader->materials, &loader->materials_cap, count,
+                sizeof(uint32_t));
+  for (uint32_t i = 0; i < count; i++) {
+    loader->materials[i] = materials ? materials[i] : i;
+  }
+  loader->count = count;
+  loader->next = 0;
+  loader->remaining = count;
+  loader->in_flight = 0;
+  loader->queue_head = 0;
+  loader->queue_len = 0;
+  loader->load_ms = 0.0;
+  loader->decoded_count = 0;
+  loader->decoded_bytes = 0.0;
+  loader->decode_ms = 0.0;
+  clock_gettime(CLOCK_MONOTONIC, &loader->start);
+
+  uint32_t cores = worker_threads_count();
+  uint32_t threads_len =
+      cores < TEXTURE_DECODE_THREADS ? cores : TEXTURE_DECODE_THREADS;
+  threads_len = threads_len < count ? threads_len : count;
+  loader->worker_cores = threads_len > 0 ? cores / threads_len : cores;
+  for (loader->threads_len = 0; loader->threads_len < threads_len;
+       loader->threads_len++) {
+    if (pthread_create(&loader->threads[loader->threads_len], NULL,
+                       decode_textures, loader) != 0) {
+      THROW("failed to start texture decoding thread!\n");
+    }
+  }
+}
 
-  VkAttachmentDescription depth_attachment = {0};
-  depth_attachment.format = find_depth_format();
-  depth_attachment.samples = msaa_samples;
-  depth_attachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-  depth_attachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-  depth_attachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
-  depth_attachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
-  depth_attachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  depth_attachment.finalLayout =
-      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+// the next decoded image, waiting for one if none is ready, and the
+// material it belongs to. It stays valid until the next call. Returns NULL
+// once every image was returned, with the workers stopped.
+DecodedImage *next_loaded_texture(uint32_t *material) {
+  TextureLoader *loader = &texture_loader;
+  pthread_mutex_lock(&loader->lock);
+  if (loader->remaining == 0) {
+    pthread_mutex_unlock(&loader->lock);
+    for (uint32_t i = 0; i < loader->threads_len; i++) {
+      pthread_join(loader->threads[i], NULL);
+    }
+    if (loader->count > 0) {
+      printf("loaded %u textures on %u threads in %.2f ms", loader->count,
+             loader->threads_len, loader->load_ms);
+      if (loader->decoded_count > 0) {
+        printf(", stb_image decoded %u of them at %.1f MB/s of texels, "
+               "%.1f MB/s per thread",
+               loader->decoded_count,
+               loader->decoded_bytes / 1e3 / fmax(loader->load_ms, 1e-3),
+               loader->decoded_bytes / 1e3 / fmax(loader->decode_ms, 1e-3));
+      }
+      printf("\n");
+    }
+    loader->threads_len = 0;
+    loader->count = 0;
+    return NULL;
+  }
+  while (loader->queue_len == 0) {
+    pthread_cond_wait(&loader->decoded, &loader->lock);
+  }
+  loader->current = loader->queue[loader->queue_head];
+  loader->queue_head = (loader->queue_head + 1) % TEXTURE_QUEUE_DEPTH;
+  loader->queue_len--;
+  loader->remaining--;
+  loader->in_flight--;
+  pthread_cond_signal(&loader->uploaded);
+  pthread_mutex_unlock(&loader->lock);
+  *material = loader->current.material;
+  return &loader->current.image;
+}
 
-  VkAttachmentReference depth_attachment_ref = {0};
-  depth_attachment_ref.attachment = 1;
-  depth_attachment_ref.layout =
-      VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+// uploads the texture of each material as the loader decodes it, the next
+// one decodes while this one is copied
+void create_textures() {
+  reserve_zeroed_array((void **)&textures, &textures_cap, mesh_materials_len,
+                       sizeof(Texture));
+  uint32_t m;
+  DecodedImage *image;
+  while ((image = next_loaded_texture(&m))) {
+    if (!create_texture_image(image, &textures[m])) {
+      THROW("failed to load texture image %s!\n",
+            image->material.texture_path);
+    }
+    create_texture_image_view(&textures[m]);
+  }
+}
 
-  VkSubpassDescription subpass = {0};
-  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
-  subpass.colorAttachmentCount = 1;
-  subpass.pColorAttachments = &color_attachment_ref;
-  subpass.pDepthStencilAttachment = &depth_attachment_ref;
-  subpass.pResolveAttachments = &color_attachment_resolve_ref;
+void create_texture_sampler() {
+  VkSamplerCreateInfo sampler_info = {0};
+  sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  sampler_info.magFilter = VK_FILTER_LINEAR;
+  sampler_info.minFilter = VK_FILTER_LINEAR;
+  sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  sampler_info.anisotropyEnable = VK_TRUE;
 
-  VkSubpassDependency dependency = {0};
-  dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-  dependency.dstSubpass = 0;
-  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
-                            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-  dependency.srcAccessMask = 0;
-  dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT |
-                            VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-  dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
-                             VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+  VkPhysicalDeviceProperties properties = {0};
+  vkGetPhysicalDeviceProperties(physical_device, &properties);
 
-  VkAttachmentDescription attachments[] = {color_attachment, depth_attachment,
-                                           color_attachment_resolve};
+  sampler_info.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
+  sampler_info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
+  sampler_info.unnormalizedCoordinates = VK_FALSE;
+  sampler_info.compareEnable = VK_FALSE;
+  sampler_info.compareOp = VK_COMPARE_OP_ALWAYS;
 
-  VkRenderPassCreateInfo render_pass_info = {0};
-  render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
-  render_pass_info.attachmentCount = 3;
-  render_pass_info.pAttachments = attachments;
-  render_pass_info.subpassCount = 1;
-  render_pass_info.pSubpasses = &subpass;
-  render_pass_info.dependencyCount = 1;
-  render_pass_info.pDependencies = &dependency;
+  sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+  sampler_info.mipLodBias = 0.0f;
+  sampler_info.minLod = 0.0f;
+  // shared by every texture, whatever its number of mip levels
+  sampler_info.maxLod = VK_LOD_CLAMP_NONE;
 
-  if (vkCreateRenderPass(device, &render_pass_info, NULL, &render_pass) !=
+  if (vkCreateSampler(device, &sampler_info, NULL, &texture_sampler) !=
       VK_SUCCESS) {
-    THROW("failed to create render pass!\n");
+    THROW("failed to create texture sampler!\n");
   }
 }
 
-void create_framebuffers() {
-  swap_chain_framebuffers_count = swap_chain_image_views_count;
-  for (int i = 0; i < swap_chain_image_views_count; i++) {
-    VkImageView attachments[] = {
-        color_image_view,
-        depth_image_view,
-        swap_chain_image_views[i],
-    };
-
-    VkFramebufferCreateInfo framebuffer_info = {0};
-    framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-    framebuffer_info.renderPass = render_pass;
-    framebuffer_info.attachmentCount = 3;
-    framebuffer_info.pAttachments = attachments;
-    framebuffer_info.width = swap_chain_extent.width;
-    framebuffer_info.height = swap_chain_extent.height;
-    framebuffer_info.layers = 1;
+void create_depth_resources() {
+  VkFormat depth_format = find_depth_format();
+  create_image(swap_chain_extent.width, swap_chain_extent.height, 1,
+               msaa_samples, depth_format, VK_IMAGE_TILING_OPTIMAL, 0,
+               VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
+               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &depth_image,
+               &depth_image_memory);
+  depth_image_view = create_image_view(depth_image, depth_format,
+                                       VK_IMAGE_ASPECT_DEPTH_BIT, 1);
+  transition_image_layout(depth_image, depth_format, VK_IMAGE_LAYOUT_UNDEFINED,
+                          VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
+}
 
-    if (vkCreateFramebuffer(device, &framebuffer_info, NULL,
-                            &swap_chain_framebuffers[i]) != VK_SUCCESS) {
-      THROW("failed to create framebuffer!\n");
+// state of one .obj load, shared by the tinyobj callbacks below
+typedef struct {
+  int fd;
+  // the whole .obj when it is parsed in one piece, unused when streamed
+  MappedFile source;
+  // the .mtl files, only read while tinyobj parses
+  uint32_t mtl_files_len;
+  uint32_t mtl_files_cap;
+  MappedFile *mtl_files;
+  VertexMap vertex_map;
+  // the .mtl material of every triangle in indices[], -1 for none
+  uint32_t triangle_materials_len;
+  uint32_t triangle_materials_cap;
+  int32_t *triangle_materials;
+} ObjLoader;
+
+// reads exactly len bytes unless the file ends first
+static size_t read_fully(int fd, char *buf, size_t len) {
+  size_t done = 0;
+  while (done < len) {
+    ssize_t n = read(fd, buf + done, len - done);
+    if (n < 0) {
+      THROW("failed to read file!\n");
+    }
+    if (n == 0) {
+      break;
     }
+    done += n;
   }
+  return done;
 }
 
-void create_command_pool() {
-  QueueFamilyIndices queue_family_indices =
-      find_queue_families(physical_device);
-  VkCommandPoolCreateInfo pool_info = {0};
-  pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-  pool_info.queueFamilyIndex = queue_family_indices.graphics_family;
-  if (vkCreateCommandPool(device, &pool_info, NULL, &command_pool) !=
-      VK_SUCCESS) {
-    THROW("failed to create command pool!\n");
-  }
+static size_t read_obj_stream(void *ctx, char *buf, size_t len) {
+  return read_fully(((ObjLoader *)ctx)->fd, buf, len);
 }
 
-void record_command_buffer(VkCommandBuffer command_buffer,
-                           uint32_t image_index) {
-  VkCommandBufferBeginInfo begin_info = {0};
-  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  begin_info.flags = 0;
-  begin_info.pInheritanceInfo = NULL;
-
-  if (vkBeginCommandBuffer(command_buffer, &begin_info) != VK_SUCCESS) {
-    THROW("failed to begin recording command buffer!\n");
+// dedups the corners of one face into vertices[] and appends their indices
+static void add_obj_face(void *ctx, const tinyobj_attrib_t *attrib,
+                         const tinyobj_vertex_index_t *face, int num_verts,
+                         int material_id) {
+  ObjLoader *loader = ctx;
+  reserve_array((void **)&indices, &indices_cap, indices_len + num_verts,
+                sizeof(uint32_t));
+  reserve_array((void **)&loader->triangle_materials,
+                &loader->triangle_materials_cap,
+                loader->triangle_materials_len + num_verts / 3,
+                sizeof(int32_t));
+  for (int j = 0; j < num_verts / 3; j++) {
+    loader->triangle_materials[loader->triangle_materials_len] = material_id;
+    loader->triangle_materials_len += 1;
   }
 
-  VkClearValue clear_values[2] = {0};
-  clear_values[0].color.float32[3] = 1.0f;
-  clear_values[1].depthStencil.depth = 1.0f;
+  for (int j = 0; j < num_verts; j++) {
+    Vertex vertex = {0};
 
-  VkRenderPassBeginInfo render_pass_info = {0};
-  render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
-  render_pass_info.renderPass = render_pass;
-  render_pass_info.framebuffer = swap_chain_framebuffers[image_index];
-  render_pass_info.renderArea.extent = swap_chain_extent;
+    tinyobj_vertex_index_t idx = face[j];
 
-  render_pass_info.clearValueCount = 2;
-  render_pass_info.pClearValues = clear_values;
+    vertex.pos[0] = attrib->vertices[3 * idx.v_idx + 0];
+    vertex.pos[1] = attrib->vertices[3 * idx.v_idx + 1];
+    vertex.pos[2] = attrib->vertices[3 * idx.v_idx + 2];
 
-  vkCmdBeginRenderPass(command_buffer, &render_pass_info,
-                       VK_SUBPASS_CONTENTS_INLINE);
+    vertex.tex_coord[0] = attrib->texcoords[2 * idx.vt_idx + 0];
+    vertex.tex_coord[1] = 1.0f - attrib->texcoords[2 * idx.vt_idx + 1];
 
-  vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    graphics_pipeline);
-  VkBuffer vertex_buffers[] = {vertex_buffer};
-  VkDeviceSize offsets[] = {0};
-  vkCmdBindVertexBuffers(command_buffer, 0, 1, vertex_buffers, offsets);
-  vkCmdBindIndexBuffer(command_buffer, index_buffer, 0, VK_INDEX_TYPE_UINT32);
+    vertex.color[0] = 1.0f;
+    vertex.color[1] = 1.0f;
+    vertex.color[2] = 1.0f;
 
-  VkViewport viewport = {0};
-  viewport.x = 0.0f;
-  viewport.y = 0.0f;
-  viewport.width = (float)swap_chain_extent.width;
-  viewport.height = (float)swap_chain_extent.height;
-  viewport.minDepth = 0.0f;
-  viewport.maxDepth = 1.0f;
-  vkCmdSetViewport(command_buffer, 0, 1, &viewport);
+    indices[indices_len] = vertex_map_insert(&loader->vertex_map, &vertex);
+    indices_len += 1;
+  }
+}
 
-  VkRect2D scissor = {0};
-  scissor.extent = swap_chain_extent;
-  vkCmdSetScissor(command_buffer, 0, 1, &scissor);
+// ctx is the ObjLoader, whose already mapped .obj isn't mapped a second
+// time and which unmaps the .mtl files once tinyobj is done with them
+static void get_file_data(void *ctx, const char *filename, const int is_mtl,
+                          const char *obj_filename, char **data, size_t *len) {
+  if (!filename) {
+    fprintf(stderr, "null filename\n");
+    (*data) = NULL;
+    (*len) = 0;
+    return;
+  }
 
-  vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                          pipeline_layout, 0, 1,
-                          &descriptor_sets[current_frame], 0, NULL);
-  vkCmdDrawIndexed(command_buffer, indices_len, 1, 0, 0, 0);
-  vkCmdEndRenderPass(command_buffer);
-  if (vkEndCommandBuffer(command_buffer) != VK_SUCCESS) {
-    THROW("failed to record command buffer!\n");
+  ObjLoader *loader = ctx;
+  MappedFile file = is_mtl ? map_file(filename) : loader->source;
+  if (is_mtl && file.data) {
+    reserve_array((void **)&loader->mtl_files, &loader->mtl_files_cap,
+                  loader->mtl_files_len + 1, sizeof(MappedFile));
+    loader->mtl_files[loader->mtl_files_len] = file;
+    loader->mtl_files_len += 1;
   }
+
+  (*len) = file.len;
+  (*data) = file.data;
 }
 
-void create_command_buffers() {
-  VkCommandBufferAllocateInfo alloc_info = {0};
-  alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  alloc_info.commandPool = command_pool;
-  alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  alloc_info.commandBufferCount = MAX_FRAMES_IN_FLIGHT;
-  if (vkAllocateCommandBuffers(device, &alloc_info, command_buffers) !=
-      VK_SUCCESS) {
-    THROW("failed to allocate command buffers!");
+// the name_len bytes at `name`, a path relative to the model file, as a
+// path from the working directory, returns 0 if that is too long
+static int model_relative_path(const char *name, int name_len, char *path) {
+  const char *slash = strrchr(model_path, '/');
+  int dir_len = slash ? (int)(slash - model_path) + 1 : 0;
+  return snprintf(path, MATERIAL_PATH_MAX, "%.*s%.*s", dir_len, model_path,
+                  name_len, name) < MATERIAL_PATH_MAX;
+}
+
+// the texture `material` is drawn with: its diffuse map, which is named
+// relative to the .obj like the .mtl itself, or TEXTURE_PATH without one.
+// Returns 0 if the path doesn't fit.
+static int material_texture_path(const tinyobj_material_t *material,
+                                 char *path) {
+  if (!material || !material->diffuse_texname ||
+      !material->diffuse_texname[0]) {
+    snprintf(path, MATERIAL_PATH_MAX, "%s", TEXTURE_PATH);
+    return 1;
+  }
+
+  if (!model_relative_path(material->diffuse_texname,
+                           strlen(material->diffuse_texname), path)) {
+    fprintf(stderr, "texture path of material %s is too long!\n",
+            material->name);
+    return 0;
+  }
+  return 1;
+}
+
+static int same_texture(const MeshMaterial *a, const MeshMaterial *b) {
+  return strcmp(a->texture_path, b->texture_path) == 0 &&
+         a->texture_offset == b->texture_offset &&
+         a->texture_size == b->texture_size;
+}
+
+// index of the mesh_materials[] entry with the same texture, which is
+// added if there is none yet
+static uint32_t add_mesh_material(const MeshMaterial *material) {
+  uint32_t m = 0;
+  while (m < mesh_materials_len &&
+         !same_texture(&mesh_materials[m], material)) {
+    m++;
   }
+  if (m == mesh_materials_len) {
+    reserve_array((void **)&mesh_materials, &mesh_materials_cap, m + 1,
+                  sizeof(MeshMaterial));
+    mesh_materials[m] = *material;
+    mesh_materials_len += 1;
+  }
+  return m;
 }
 
-void create_sync_objects() {
-  VkSemaphoreCreateInfo semaphore_info = {0};
-  semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+// slot 0 is for faces without a material, slot i + 1 for materials[i]
+static uint32_t material_slot(int32_t material_id, size_t num_materials) {
+  return material_id >= 0 && material_id < num_materials ? material_id + 1
+                                                         : 0;
+}
 
-  VkFenceCreateInfo fence_info = {0};
-  fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
-  fence_info.flags = VK_FENCE_CREATE_SIGNALED_BIT;
+// turns the .mtl materials the faces use into mesh_materials[], sorts the
+// triangles by material so each one is a contiguous range of indices[] and
+// records those ranges, in material order, as the batches of level 0.
+// Returns 0 if the model can't be drawn that way.
+static int group_triangles_by_material(const ObjLoader *loader,
+                                       const tinyobj_material_t *materials,
+                                       size_t num_materials) {
+  uint32_t triangles_len = indices_len / 3;
+  if (loader->triangle_materials_len != triangles_len) {
+    fprintf(stderr, "%s has faces that aren't triangles!\n", model_path);
+    return 0;
+  }
 
-  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-    if (vkCreateSemaphore(device, &semaphore_info, NULL,
-                          &image_available_semaphores[i]) != VK_SUCCESS ||
-        vkCreateSemaphore(device, &semaphore_info, NULL,
-                          &render_finished_semaphores[i]) != VK_SUCCESS ||
-        vkCreateFence(device, &fence_info, NULL, &in_flight_fences[i]) !=
-            VK_SUCCESS) {
-      THROW("failed to create semaphores!\n");
+  uint32_t *slot_materials = malloc(sizeof(uint32_t) * (num_materials + 1));
+  uint32_t *sorted = malloc(sizeof(uint32_t) * (indices_len + 1));
+  if (!slot_materials || !sorted) {
+    THROW("failed to allocate material sort!\n");
+  }
+  for (int i = 0; i <= num_materials; i++) {
+    slot_materials[i] = UINT32_MAX;
+  }
+  for (int t = 0; t < triangles_len; t++) {
+    slot_materials[material_slot(loader->triangle_materials[t],
+                                 num_materials)] = 0;
+  }
+
+  // unused materials get no texture, ones with the same texture are merged
+  for (int i = 0; i <= num_materials; i++) {
+    if (slot_materials[i] == UINT32_MAX) {
+      continue;
+    }
+    MeshMaterial material = {0};
+    uint32_t m = UINT32_MAX;
+    if (material_texture_path(i > 0 ? &materials[i - 1] : NULL,
+                              material.texture_path)) {
+      m = add_mesh_material(&material);
     }
+    if (m == UINT32_MAX) {
+      free(slot_materials);
+      free(sorted);
+      return 0;
+    }
+    slot_materials[i] = m;
+  }
+
+  // counting sort, stable so every batch keeps the file's triangle order
+  uint32_t *material_offsets =
+      calloc(mesh_materials_len + 1, sizeof(uint32_t));
+  if (!material_offsets) {
+    THROW("failed to allocate material sort!\n");
+  }
+  for (int t = 0; t < triangles_len; t++) {
+    uint32_t slot = material_slot(loader->triangle_materials[t], num_materials);
+    material_offsets[slot_materials[slot] + 1] += 1;
+  }
+  for (int m = 0; m < mesh_materials_len; m++) {
+    material_offsets[m + 1] += material_offsets[m];
+  }
+
+  reserve_array((void **)&batches, &batches_cap, mesh_materials_len,
+                sizeof(MeshBatch));
+  for (int m = 0; m < mesh_materials_len; m++) {
+    batches[m].index_offset = material_offsets[m] * 3;
+    batches[m].index_count =
+        (material_offsets[m + 1] - material_offsets[m]) * 3;
+    batches[m].material = m;
+    batches[m].vertex_offset = 0;
   }
+  batches_len = mesh_materials_len;
+
+  for (int t = 0; t < triangles_len; t++) {
+    uint32_t slot = material_slot(loader->triangle_materials[t], num_materials);
+    uint32_t m = slot_materials[slot];
+    memcpy(&sorted[material_offsets[m] * 3], &indices[t * 3],
+           sizeof(uint32_t) * 3);
+    material_offsets[m] += 1;
+  }
+  memcpy(indices, sorted, sizeof(uint32_t) * indices_len);
+
+  free(slot_materials);
+  free(material_offsets);
+  free(sorted);
+  printf("grouped %u triangles into %u materials\n", triangles_len,
+         mesh_materials_len);
+  return 1;
 }
 
-void cleanup_swap_chain() {
-  vkDestroyImageView(device, color_image_view, NULL);
-  vkDestroyImage(device, color_image, NULL);
-  vkFreeMemory(device, color_image_memory, NULL);
+// Vertex codec. Vertices are coded in groups of VERTEX_CODEC_GROUP, each
+// split into 32 bit words. Each 16 bit half of a word is stored as the
+// zigzag of its difference to the same half of the previous vertex, so
+// neighbouring vertices leave the high bits of both halves empty, whether
+// the word holds two PackedVertex components or a float. The differences
+// of a group are split into 4 byte planes that are bit packed as tightly
+// as their largest byte allows. For every word of a group the stream holds
+// a byte with the 2 bit width codes of its planes, lowest plane first,
+// then the planes. Vertices past the end of the last group repeat the
+// last vertex.
+static const int vertex_plane_bits[4] = {0, 2, 4, 8};
+
+static uint32_t zigzag32(uint32_t value) {
+  return (value << 1) ^ (uint32_t)((int32_t)value >> 31);
+}
 
-  vkDestroyImageView(device, depth_image_view, NULL);
-  vkDestroyImage(device, depth_image, NULL);
-  vkFreeMemory(device, depth_image_memory, NULL);
+static uint32_t unzigzag32(uint32_t value) {
+  return (value >> 1) ^ (0u - (value & 1));
+}
 
-  for (int i = 0; i < swap_chain_framebuffers_count; i++) {
-    vkDestroyFramebuffer(device, swap_chain_framebuffers[i], NULL);
+static uint32_t zigzag_halves(uint32_t value, uint32_t previous) {
+  uint32_t delta = 0;
+  for (int shift = 0; shift < 32; shift += 16) {
+    uint16_t d = (uint16_t)((value >> shift) - (previous >> shift));
+    uint16_t z = (uint16_t)((d << 1) ^ (uint16_t)((int16_t)d >> 15));
+    delta |= (uint32_t)z << shift;
   }
+  return delta;
+}
 
-  for (int i = 0; i < swap_chain_images_count; i++) {
-    vkDestroyImageView(device, swap_chain_image_views[i], NULL);
+static uint32_t unzigzag_halves(uint32_t previous, uint32_t delta) {
+  uint32_t value = 0;
+  for (int shift = 0; shift < 32; shift += 16) {
+    uint16_t z = (uint16_t)(delta >> shift);
+    uint16_t d = (uint16_t)((z >> 1) ^ (0u - (z & 1)));
+    value |= (uint32_t)(uint16_t)((previous >> shift) + d) << shift;
   }
+  return value;
+}
 
-  vkDestroySwapchainKHR(device, swap_chain, NULL);
+size_t encode_vertices_bound(uint32_t count, uint32_t vertex_size) {
+  size_t groups = (count + VERTEX_CODEC_GROUP - 1) / VERTEX_CODEC_GROUP;
+  return groups * (vertex_size / 4) * (1 + 4 * VERTEX_CODEC_GROUP);
 }
 
-void recreate_swap_chain() {
-  int width = 0, height = 0;
-  glfwGetFramebufferSize(window, &width, &height);
-  while (width == 0 || height == 0) {
-    glfwGetFramebufferSize(window, &width, &height);
-    glfwWaitEvents();
+// codes `count` vertices of vertex_size bytes, a multiple of 4, into `out`,
+// which has room for encode_vertices_bound() bytes, and returns the size
+size_t encode_vertices(const char *vertices, uint32_t count,
+                       uint32_t vertex_size, char *out) {
+  uint32_t words = vertex_size / 4;
+  uint8_t *cursor = (uint8_t *)out;
+  for (uint32_t base = 0; base < count; base += VERTEX_CODEC_GROUP) {
+    for (uint32_t w = 0; w < words; w++) {
+      uint8_t planes[4][VERTEX_CODEC_GROUP];
+      uint8_t max_bytes[4] = {0};
+      for (uint32_t i = 0; i < VERTEX_CODEC_GROUP; i++) {
+        uint32_t v = base + i < count ? base + i : count - 1;
+        uint32_t value, previous = 0;
+        memcpy(&value, vertices + (size_t)v * vertex_size + w * 4, 4);
+        if (v > 0) {
+          memcpy(&previous, vertices + (size_t)(v - 1) * vertex_size + w * 4,
+                 4);
+        }
+        uint32_t delta =
+            base + i < count ? zigzag_halves(value, previous) : 0;
+        for (int p = 0; p < 4; p++) {
+          planes[p][i] = delta >> (8 * p);
+          max_bytes[p] |= planes[p][i];
+        }
+      }
+
+      uint8_t *header = cursor++;
+      *header = 0;
+      for (int p = 0; p < 4; p++) {
+        int code = max_bytes[p] == 0 ? 0
+                   : max_bytes[p] < 4  ? 1
+                   : max_bytes[p] < 16 ? 2
+                                       : 3;
+        int bits = vertex_plane_bits[code];
+        *header |= code << (2 * p);
+        for (int i = 0; code > 0 && i < VERTEX_CODEC_GROUP * bits / 8; i++) {
+          uint8_t byte = 0;
+          for (int k = 0; k < 8 / bits; k++) {
+            byte |= planes[p][i * 8 / bits + k] << (k * bits);
+          }
+          *cursor++ = byte;
+        }
+      }
+    }
   }
+  return cursor - (uint8_t *)out;
+}
 
-  vkDeviceWaitIdle(device);
+// the bytes a word header says its planes take
+static size_t vertex_word_size(uint8_t header) {
+  size_t size = 0;
+  for (int p = 0; p < 4; p++) {
+    size += vertex_plane_bits[(header >> (2 * p)) & 3] * VERTEX_CODEC_GROUP / 8;
+  }
+  return size;
+}
 
-  cleanup_swap_chain();
+// decodes the words [first_word, first_word + word_count) of one group into
+// the vertex_size byte vertices at dst, previous[] holds the last value of
+// each word so far. Returns the new cursor, NULL if `end` comes first.
+static const uint8_t *decode_vertex_words(const uint8_t *cursor,
+                                          const uint8_t *end, char *dst,
+                                          uint32_t vertex_size,
+                                          uint32_t first_word,
+                                          uint32_t word_count,
+                                          uint32_t *previous) {
+  for (uint32_t w = first_word; w < first_word + word_count; w++) {
+    if (cursor >= end || vertex_word_size(*cursor) > end - cursor - 1) {
+      return NULL;
+    }
+    uint8_t header = *cursor++;
+    uint32_t deltas[VERTEX_CODEC_GROUP] = {0};
+    for (int p = 0; p < 4; p++) {
+      int bits = vertex_plane_bits[(header >> (2 * p)) & 3];
+      for (int i = 0; bits > 0 && i < VERTEX_CODEC_GROUP; i++) {
+        uint32_t byte = cursor[i * bits / 8] >> (i * bits % 8);
+        deltas[i] |= (byte & ((1u << bits) - 1)) << (8 * p);
+      }
+      cursor += VERTEX_CODEC_GROUP * bits / 8;
+    }
+    for (int i = 0; i < VERTEX_CODEC_GROUP; i++) {
+      previous[w] = unzigzag_halves(previous[w], deltas[i]);
+      memcpy(dst + (size_t)i * vertex_size + w * 4, &previous[w], 4);
+    }
+  }
+  return cursor;
+}
 
-  create_swap_chain();
-  create_image_views();
-  create_color_resources();
-  create_depth_resources();
-  create_framebuffers();
+#ifdef HAS_SSE2
+// the 16 values of a byte plane with the given width code
+static __m128i unpack_vertex_plane(const uint8_t *data, int code) {
+  switch (code) {
+  case 0:
+    return _mm_setzero_si128();
+  case 1: {
+    // byte j holds values 4j to 4j + 3, two bits each
+    int32_t packed;
+    memcpy(&packed, data, sizeof(packed));
+    __m128i bytes = _mm_cvtsi32_si128(packed);
+    __m128i mask = _mm_set1_epi8(3);
+    __m128i v0 = _mm_and_si128(bytes, mask);
+    __m128i v1 = _mm_and_si128(_mm_srli_epi16(bytes, 2), mask);
+    __m128i v2 = _mm_and_si128(_mm_srli_epi16(bytes, 4), mask);
+    __m128i v3 = _mm_and_si128(_mm_srli_epi16(bytes, 6), mask);
+    return _mm_unpacklo_epi16(_mm_unpacklo_epi8(v0, v1),
+                              _mm_unpacklo_epi8(v2, v3));
+  }
+  case 2: {
+    // byte j holds values 2j and 2j + 1, four bits each
+    __m128i bytes = _mm_loadl_epi64((const __m128i *)data);
+    __m128i mask = _mm_set1_epi8(15);
+    return _mm_unpacklo_epi8(_mm_and_si128(bytes, mask),
+                             _mm_and_si128(_mm_srli_epi16(bytes, 4), mask));
+  }
+  default:
+    return _mm_loadu_si128((const __m128i *)data);
+  }
 }
 
-uint32_t find_memory_type(uint32_t type_filter,
-                          VkMemoryPropertyFlags properties) {
-  VkPhysicalDeviceMemoryProperties mem_properties;
-  vkGetPhysicalDeviceMemoryProperties(physical_device, &mem_properties);
+// decodes 4 words of a full group at once: every word becomes 4 registers
+// of 4 vertices each, and the registers of the 4 words are transposed into
+// 16 bytes of each vertex. With word_count 3, for 12 byte vertices, the
+// last 4 of those bytes are zero and land on the next vertex, which has to
+// exist and be written after this one.
+static const uint8_t *decode_vertex_words_sse2(const uint8_t *cursor,
+                                               const uint8_t *end, char *dst,
+                                               uint32_t vertex_size,
+                                               uint32_t first_word,
+                                               uint32_t word_count,
+                                               __m128i *previous) {
+  __m128i words[4][4];
+  for (int w = 0; w < 4; w++) {
+    if (w >= word_count) {
+      for (int q = 0; q < 4; q++) {
+        words[w][q] = _mm_setzero_si128();
+      }
+      continue;
+    }
+    if (cursor >= end || vertex_word_size(*cursor) > end - cursor - 1) {
+      return NULL;
+    }
+    uint8_t header = *cursor++;
+    __m128i planes[4];
+    for (int p = 0; p < 4; p++) {
+      int code = (header >> (2 * p)) & 3;
+      planes[p] = unpack_vertex_plane(cursor, code);
+      cursor += vertex_plane_bits[code] * VERTEX_CODEC_GROUP / 8;
+    }
 
-  for (int i = 0; i < mem_properties.memoryTypeCount; i++) {
-    if (type_filter & (1 << i) && (mem_properties.memoryTypes[i].propertyFlags &
-                                   properties) == properties) {
-      return i;
+    __m128i low = _mm_unpacklo_epi8(planes[0], planes[1]);
+    __m128i high = _mm_unpacklo_epi8(planes[2], planes[3]);
+    words[w][0] = _mm_unpacklo_epi16(low, high);
+    words[w][1] = _mm_unpackhi_epi16(low, high);
+    low = _mm_unpackhi_epi8(planes[0], planes[1]);
+    high = _mm_unpackhi_epi8(planes[2], planes[3]);
+    words[w][2] = _mm_unpacklo_epi16(low, high);
+    words[w][3] = _mm_unpackhi_epi16(low, high);
+
+    // undo the zigzag of both halves, then a prefix sum of each half
+    // carried over from the last value
+    __m128i one = _mm_set1_epi16(1);
+    __m128i carry = previous[first_word + w];
+    for (int q = 0; q < 4; q++) {
+      __m128i z = words[w][q];
+      __m128i x = _mm_xor_si128(
+          _mm_srli_epi16(z, 1),
+          _mm_sub_epi16(_mm_setzero_si128(), _mm_and_si128(z, one)));
+      x = _mm_add_epi16(x, _mm_slli_si128(x, 4));
+      x = _mm_add_epi16(x, _mm_slli_si128(x, 8));
+      x = _mm_add_epi16(x, carry);
+      carry = _mm_shuffle_epi32(x, _MM_SHUFFLE(3, 3, 3, 3));
+      words[w][q] = x;
     }
+    previous[first_word + w] = carry;
   }
 
-  THROW("failed to find suitable memory type!\n");
+  for (int q = 0; q < 4; q++) {
+    __m128i t0 = _mm_unpacklo_epi32(words[0][q], words[1][q]);
+    __m128i t1 = _mm_unpacklo_epi32(words[2][q], words[3][q]);
+    __m128i t2 = _mm_unpackhi_epi32(words[0][q], words[1][q]);
+    __m128i t3 = _mm_unpackhi_epi32(words[2][q], words[3][q]);
+    char *row = dst + (size_t)4 * q * vertex_size + first_word * 4;
+    _mm_storeu_si128((__m128i *)row, _mm_unpacklo_epi64(t0, t1));
+    _mm_storeu_si128((__m128i *)(row + vertex_size),
+                     _mm_unpackhi_epi64(t0, t1));
+    _mm_storeu_si128((__m128i *)(row + 2 * vertex_size),
+                     _mm_unpacklo_epi64(t2, t3));
+    _mm_storeu_si128((__m128i *)(row + 3 * vertex_size),
+                     _mm_unpackhi_epi64(t2, t3));
+  }
+  return cursor;
 }
+#endif
+
+// decodes `count` vertices coded by encode_vertices() into dst, returns 0
+// if the len bytes of `data` don't hold them
+int decode_vertices(char *dst, uint32_t count, uint32_t vertex_size,
+                    const char *data, size_t len) {
+  uint32_t words = vertex_size / 4;
+  const uint8_t *cursor = (const uint8_t *)data;
+  const uint8_t *end = cursor + len;
+  uint32_t *previous = calloc(words, sizeof(uint32_t));
+  char *tail = malloc((size_t)VERTEX_CODEC_GROUP * vertex_size);
+  if (!previous || !tail) {
+    THROW("failed to allocate vertex decoder!\n");
+  }
 
-void create_buffer(VkDeviceSize size, VkBufferUsageFlags usage,
-                   VkMemoryPropertyFlags properties, VkBuffer *buffer,
-                   VkDeviceMemory *buffer_memory) {
-  VkBufferCreateInfo buffer_info = {0};
-  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-  buffer_info.size = size;
-  buffer_info.usage = usage;
-  buffer_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-  if (vkCreateBuffer(device, &buffer_info, NULL, buffer) != VK_SUCCESS) {
-    THROW("failed to create vertex buffer!\n");
+  uint32_t base = 0;
+#ifdef HAS_SSE2
+  if (vertex_size % 16 == 0 || vertex_size == 12) {
+    __m128i *carries = malloc(sizeof(__m128i) * words);
+    if (!carries) {
+      THROW("failed to allocate vertex decoder!\n");
+    }
+    for (uint32_t w = 0; w < words; w++) {
+      carries[w] = _mm_setzero_si128();
+    }
+    // a group of 12 byte vertices writes into the vertex after it
+    uint32_t after = vertex_size == 12 ? 1 : 0;
+    for (; cursor && base + VERTEX_CODEC_GROUP + after <= count;
+         base += VERTEX_CODEC_GROUP) {
+      for (uint32_t w = 0; cursor && w < words; w += 4) {
+        cursor = decode_vertex_words_sse2(
+            cursor, end, dst + (size_t)base * vertex_size, vertex_size, w,
+            words - w < 4 ? words - w : 4, carries);
+      }
+    }
+    for (uint32_t w = 0; w < words; w++) {
+      previous[w] = _mm_cvtsi128_si32(carries[w]);
+    }
+    free(carries);
+  }
+#endif
+
+  for (; cursor && base < count; base += VERTEX_CODEC_GROUP) {
+    uint32_t group_len =
+        count - base < VERTEX_CODEC_GROUP ? count - base : VERTEX_CODEC_GROUP;
+    char *out = group_len == VERTEX_CODEC_GROUP
+                    ? dst + (size_t)base * vertex_size
+                    : tail;
+    cursor = decode_vertex_words(cursor, end, out, vertex_size, 0, words,
+                                 previous);
+    if (cursor && out == tail) {
+      memcpy(dst + (size_t)base * vertex_size, tail,
+             (size_t)group_len * vertex_size);
+    }
   }
+  free(previous);
+  free(tail);
+  return cursor == end;
+}
 
-  VkMemoryRequirements mem_requirements;
-  vkGetBufferMemoryRequirements(device, *buffer, &mem_requirements);
+// Index codec. Triangles are coded one byte each where they can, relying
+// on neighbours sharing an edge and on optimize_vertex_fetch() numbering
+// vertices in the order they are first used. The high nibble of a
+// triangle's code is the position of its first edge among the 15 edges
+// last pushed to an edge FIFO, 15 if none of its three rotations starts
+// with one; then a second byte holds the nibbles of its first two
+// vertices. A vertex nibble is 0 for the next never used vertex, 1 to 14
+// for a position in a FIFO of recent vertices, 15 for a zigzag varint
+// delta to the last vertex coded that way, which follows. Every triangle
+// pushes its edges reversed, as its neighbours walk them, so a triangle
+// may come out rotated but keeps its winding.
+typedef struct {
+  uint32_t edges[INDEX_CODEC_FIFO_SIZE][2];
+  uint32_t vertices[INDEX_CODEC_FIFO_SIZE];
+  uint32_t edge_head;
+  uint32_t vertex_head;
+  uint32_t next;
+  uint32_t last;
+} IndexCodec;
+
+static void push_codec_vertex(IndexCodec *codec, uint32_t v) {
+  codec->vertices[codec->vertex_head++ % INDEX_CODEC_FIFO_SIZE] = v;
+}
 
-  VkMemoryAllocateInfo alloc_info = {0};
-  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  alloc_info.allocationSize = mem_requirements.size;
-  alloc_info.memoryTypeIndex =
-      find_memory_type(mem_requirements.memoryTypeBits, properties);
+static void push_codec_edges(IndexCodec *codec, const uint32_t *tri) {
+  for (int e = 0; e < 3; e++) {
+    uint32_t *edge = codec->edges[codec->edge_head++ % INDEX_CODEC_FIFO_SIZE];
+    edge[0] = tri[(e + 1) % 3];
+    edge[1] = tri[e];
+  }
+}
 
-  if (vkAllocateMemory(device, &alloc_info, NULL, buffer_memory) !=
-      VK_SUCCESS) {
-    THROW("failed to allocate vertex buffer memory!\n");
+static int find_codec_edge(const IndexCodec *codec, uint32_t a, uint32_t b) {
+  for (int i = 0; i < INDEX_CODEC_FIFO_SIZE - 1; i++) {
+    const uint32_t *edge =
+        codec->edges[(codec->edge_head - 1 - i) % INDEX_CODEC_FIFO_SIZE];
+    if (edge[0] == a && edge[1] == b) {
+      return i;
+    }
   }
+  return -1;
+}
 
-  vkBindBufferMemory(device, *buffer, *buffer_memory, 0);
+static uint8_t *write_varint(uint8_t *out, uint32_t value) {
+  while (value >= 0x80) {
+    *out++ = (value & 0x7f) | 0x80;
+    value >>= 7;
+  }
+  *out++ = value;
+  return out;
 }
 
-VkCommandBuffer begin_single_time_commands() {
-  VkCommandBufferAllocateInfo alloc_info = {0};
-  alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  alloc_info.commandPool = command_pool;
-  alloc_info.commandBufferCount = 1;
+// the nibble vertex v is coded with, appending its varint if it needs one
+static int encode_codec_vertex(IndexCodec *codec, uint32_t v,
+                               uint8_t **varints) {
+  if (v == codec->next) {
+    codec->next += 1;
+    push_codec_vertex(codec, v);
+    return 0;
+  }
+  for (int i = 0; i < INDEX_CODEC_FIFO_SIZE - 2; i++) {
+    if (codec->vertices[(codec->vertex_head - 1 - i) % INDEX_CODEC_FIFO_SIZE] ==
+        v) {
+      return 1 + i;
+    }
+  }
+  *varints = write_varint(*varints, zigzag32(v - codec->last));
+  codec->last = v;
+  push_codec_vertex(codec, v);
+  return 15;
+}
 
-  VkCommandBuffer command_buffer;
-  vkAllocateCommandBuffers(device, &alloc_info, &command_buffer);
+size_t encode_indices_bound(uint32_t count) {
+  return (size_t)count / 3 * (2 + 3 * 5) + INDEX_CODEC_PADDING;
+}
 
-  VkCommandBufferBeginInfo begin_info = {0};
-  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+// codes `count` indices, a whole number of triangles, into `out`, which
+// has room for encode_indices_bound() bytes, and returns the size
+size_t encode_indices(const uint32_t *indices, uint32_t count, char *out) {
+  IndexCodec codec = {0};
+  uint8_t *cursor = (uint8_t *)out;
+  for (uint32_t t = 0; t + 3 <= count; t += 3) {
+    uint32_t tri[3];
+    int edge = -1;
+    for (int r = 0; r < 3 && edge < 0; r++) {
+      for (int k = 0; k < 3; k++) {
+        tri[k] = indices[t + (r + k) % 3];
+      }
+      edge = find_codec_edge(&codec, tri[0], tri[1]);
+    }
+    if (edge < 0) {
+      memcpy(tri, &indices[t], sizeof(tri));
+    }
 
-  vkBeginCommandBuffer(command_buffer, &begin_info);
+    uint8_t varints[3 * 5];
+    uint8_t *varint_end = varints;
+    if (edge >= 0) {
+      int c = encode_codec_vertex(&codec, tri[2], &varint_end);
+      *cursor++ = edge << 4 | c;
+    } else {
+      int a = encode_codec_vertex(&codec, tri[0], &varint_end);
+      int b = encode_codec_vertex(&codec, tri[1], &varint_end);
+      int c = encode_codec_vertex(&codec, tri[2], &varint_end);
+      *cursor++ = 0xf0 | c;
+      *cursor++ = a << 4 | b;
+    }
+    memcpy(cursor, varints, varint_end - varints);
+    cursor += varint_end - varints;
+    push_codec_edges(&codec, tri);
+  }
 
-  return command_buffer;
+  // a triangle reads at most its longest coding ahead without checking
+  memset(cursor, 0, INDEX_CODEC_PADDING);
+  return cursor + INDEX_CODEC_PADDING - (uint8_t *)out;
 }
 
-void end_single_time_commands(VkCommandBuffer command_buffer) {
-  vkEndCommandBuffer(command_buffer);
+static uint32_t decode_codec_vertex(IndexCodec *codec, int nibble,
+                                    const uint8_t **cursor) {
+  if (nibble == 0) {
+    uint32_t v = codec->next++;
+    push_codec_vertex(codec, v);
+    return v;
+  }
+  if (nibble < 15) {
+    return codec->vertices[(codec->vertex_head - nibble) %
+                           INDEX_CODEC_FIFO_SIZE];
+  }
 
-  VkSubmitInfo submit_info = {0};
-  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-  submit_info.commandBufferCount = 1;
-  submit_info.pCommandBuffers = &command_buffer;
+  uint32_t delta = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    uint8_t byte = *(*cursor)++;
+    delta |= (uint32_t)(byte & 0x7f) << shift;
+    if (byte < 0x80) {
+      break;
+    }
+  }
+  codec->last += unzigzag32(delta);
+  push_codec_vertex(codec, codec->last);
+  return codec->last;
+}
 
-  vkQueueSubmit(graphics_queue, 1, &submit_info, VK_NULL_HANDLE);
-  vkQueueWaitIdle(graphics_queue);
+// decodes `count` indices coded by encode_indices() into dst, returns 0
+// if the len bytes of `data` don't hold them or an index isn't below
+// vertex_count
+int decode_indices(uint32_t *dst, uint32_t count, uint32_t vertex_count,
+                   const char *data, size_t len) {
+  IndexCodec codec = {0};
+  const uint8_t *cursor = (const uint8_t *)data;
+  const uint8_t *end = cursor + len;
+  for (uint32_t t = 0; t + 3 <= count; t += 3) {
+    if (end - cursor < INDEX_CODEC_PADDING) {
+      return 0;
+    }
+    uint8_t code = *cursor++;
+    uint32_t *tri = &dst[t];
+    if (code < 0xf0) {
+      const uint32_t *edge =
+          codec.edges[(codec.edge_head - 1 - (code >> 4)) %
+                      INDEX_CODEC_FIFO_SIZE];
+      tri[0] = edge[0];
+      tri[1] = edge[1];
+    } else {
+      uint8_t nibbles = *cursor++;
+      tri[0] = decode_codec_vertex(&codec, nibbles >> 4, &cursor);
+      tri[1] = decode_codec_vertex(&codec, nibbles & 15, &cursor);
+    }
+    tri[2] = decode_codec_vertex(&codec, code & 15, &cursor);
+    push_codec_edges(&codec, tri);
+    if (tri[0] >= vertex_count || tri[1] >= vertex_count ||
+        tri[2] >= vertex_count) {
+      return 0;
+    }
+  }
+  return end - cursor == INDEX_CODEC_PADDING;
+}
 
-  vkFreeCommandBuffers(device, command_pool, 1, &command_buffer);
+// layout of a .vmesh file: this header, then each of mesh_arrays[] in
+// order, padded to MESH_CACHE_ALIGNMENT, all in native byte order. An
+// array with a nonzero encoded size is stored coded with its codec.
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t source_hash;
+  uint64_t source_len;
+  float bounds_min[3];
+  float bounds_max[3];
+  // what packed_vertices[] were quantized with
+  float position_offset[4];
+  float position_scale[4];
+  float tex_coord_transform[4];
+  uint32_t array_lens[MESH_CACHE_MAX_ARRAYS];
+  uint32_t elem_sizes[MESH_CACHE_MAX_ARRAYS];
+  uint64_t encoded_sizes[MESH_CACHE_MAX_ARRAYS];
+} MeshCacheHeader;
+
+_Static_assert(MESH_ARRAYS_LEN <= MESH_CACHE_MAX_ARRAYS,
+               "MeshCacheHeader has no room for every mesh array");
+_Static_assert(sizeof(MeshCacheHeader) % MESH_CACHE_ALIGNMENT == 0,
+               "the first mesh array would be misaligned");
+
+// the bytes array i takes in the file, padding included
+static size_t mesh_cache_section_size(const MeshCacheHeader *header, int i) {
+  size_t size = header->encoded_sizes[i] > 0
+                    ? header->encoded_sizes[i]
+                    : (size_t)header->array_lens[i] * header->elem_sizes[i];
+  size_t mask = MESH_CACHE_ALIGNMENT - 1;
+  return (size + mask) & ~mask;
 }
 
-void copy_buffer_to_image(VkBuffer buffer, VkImage image, uint32_t width,
-                          uint32_t height) {
-  VkCommandBuffer command_buffer = begin_single_time_commands();
+// codes an array with its codec into a new buffer, returns the coded size
+// or 0 if it has no codec or coding doesn't make it smaller
+static size_t encode_mesh_array(const MeshArray *array, char **encoded) {
+  uint32_t len = *array->len;
+  *encoded = NULL;
+  if (array->codec == MESH_CODEC_NONE || len == 0) {
+    return 0;
+  }
 
-  VkBufferImageCopy region = {0};
-  region.bufferOffset = 0;
-  region.bufferRowLength = 0;
-  region.bufferImageHeight = 0;
+  size_t bound = array->codec == MESH_CODEC_VERTICES
+                     ? encode_vertices_bound(len, array->elem_size)
+                     : encode_indices_bound(len);
+  *encoded = malloc(bound);
+  if (!*encoded) {
+    THROW("failed to allocate mesh encoder!\n");
+  }
+  size_t size = array->codec == MESH_CODEC_VERTICES
+                    ? encode_vertices(*array->data, len, array->elem_size,
+                                      *encoded)
+                    : encode_indices(*array->data, len, *encoded);
+  if (size >= (size_t)len * array->elem_size) {
+    free(*encoded);
+    *encoded = NULL;
+    return 0;
+  }
+  return size;
+}
 
-  region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  region.imageSubresource.mipLevel = 0;
-  region.imageSubresource.baseArrayLayer = 0;
-  region.imageSubresource.layerCount = 1;
+// decodes a coded array into a heap copy of len elements, returns 0 if the
+// data is corrupt. Indices are checked against packed_vertices[], which
+// comes first in the file.
+static int decode_mesh_array(const MeshArray *array, uint32_t len,
+                             const char *data, size_t size) {
+  void *decoded = malloc((size_t)len * array->elem_size);
+  if (!decoded) {
+    THROW("failed to allocate decoded mesh array!\n");
+  }
+  *array->data = decoded;
+  *array->len = len;
+  *array->cap = len;
+  if (array->codec == MESH_CODEC_VERTICES) {
+    return decode_vertices(decoded, len, array->elem_size, data, size);
+  }
+  return array->codec == MESH_CODEC_INDICES && len % 3 == 0 &&
+         decode_indices(decoded, len, packed_vertices_len, data, size);
+}
 
-  region.imageExtent.height = height;
-  region.imageExtent.width = width;
-  region.imageExtent.depth = 1;
+// 64 bit multiply-xorshift hash, cheap enough to run over the source model
+// on every launch. hash_words() takes the whole words of a piece so the data
+// can also be fed in chunks that are a multiple of 8 bytes long.
+static uint64_t hash_words(uint64_t h, const char *data, size_t len) {
+  for (size_t i = 0; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(uint64_t));
+    word *= 0xff51afd7ed558ccdull;
+    word ^= word >> 32;
+    h = (h ^ word) * 0xc4ceb9fe1a85ec53ull;
+  }
+  return h;
+}
 
-  vkCmdCopyBufferToImage(command_buffer, buffer, image,
-                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-  end_single_time_commands(command_buffer);
+static uint64_t hash_tail(uint64_t h, const char *data, size_t len) {
+  uint64_t tail = 0;
+  memcpy(&tail, data + len / sizeof(uint64_t) * sizeof(uint64_t),
+         len % sizeof(uint64_t));
+  h = (h ^ tail) * 0xff51afd7ed558ccdull;
+  h ^= h >> 29;
+  return h;
 }
 
-int has_stencil_component(VkFormat format) {
-  return format == VK_FORMAT_D32_SFLOAT_S8_UINT ||
-         format == VK_FORMAT_D24_UNORM_S8_UINT;
+uint64_t hash_bytes(const char *data, size_t len) {
+  uint64_t h = hash_words(0x9e3779b97f4a7c15ull ^ len, data, len);
+  return hash_tail(h, data, len);
 }
 
-void transition_image_layout(VkImage image, VkFormat format,
-                             VkImageLayout old_layout, VkImageLayout new_layout,
-                             uint32_t mip_levels) {
+// hash_bytes() of the len bytes left in fd, read a chunk at a time
+uint64_t hash_file(int fd, size_t len) {
+  char *chunk = malloc(FILE_READ_CHUNK_SIZE);
+  if (!chunk) {
+    THROW("failed to allocate read buffer!\n");
+  }
 
-  VkCommandBuffer command_buffer = begin_single_time_commands();
+  uint64_t h = 0x9e3779b97f4a7c15ull ^ len;
+  size_t n;
+  do {
+    n = read_fully(fd, chunk, FILE_READ_CHUNK_SIZE);
+    h = hash_words(h, chunk, n);
+  } while (n == FILE_READ_CHUNK_SIZE);
+  h = hash_tail(h, chunk, n);
 
-  VkImageMemoryBarrier barrier = {0};
-  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-  barrier.oldLayout = old_layout;
-  barrier.newLayout = new_layout;
+  free(chunk);
+  return h;
+}
 
-  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+void compute_mesh_bounds() {
+  glm_vec3_fill(mesh_bounds_min, INFINITY);
+  glm_vec3_fill(mesh_bounds_max, -INFINITY);
+  for (int i = 0; i < vertices_len; i++) {
+    glm_vec3_minv(mesh_bounds_min, vertices[i].pos, mesh_bounds_min);
+    glm_vec3_maxv(mesh_bounds_max, vertices[i].pos, mesh_bounds_max);
+  }
+}
 
-  barrier.image = image;
+// points the mesh arrays straight into the mapped cache if it was built
+// from the same source, returns 0 when the cache is missing or stale
+int load_mesh_cache(const char *filename, uint64_t source_hash,
+                    uint64_t source_len) {
+  MappedFile file = map_file(filename);
+  if (!file.data) {
+    return 0;
+  }
+  if (file.len < sizeof(MeshCacheHeader)) {
+    unmap_file(file);
+    return 0;
+  }
 
-  if (new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
+  MeshCacheHeader header;
+  memcpy(&header, file.data, sizeof(header));
+  if (header.magic != MESH_CACHE_MAGIC ||
+      header.version != MESH_CACHE_VERSION ||
+      header.source_hash != source_hash || header.source_len != source_len) {
+    unmap_file(file);
+    return 0;
+  }
 
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_DEPTH_BIT;
-    if (has_stencil_component(format)) {
-      barrier.subresourceRange.aspectMask |= VK_IMAGE_ASPECT_STENCIL_BIT;
+  size_t expected_len = sizeof(header);
+  for (int i = 0; i < MESH_ARRAYS_LEN; i++) {
+    if (header.elem_sizes[i] != mesh_arrays[i].elem_size ||
+        (header.encoded_sizes[i] > 0 &&
+         (mesh_arrays[i].codec == MESH_CODEC_NONE ||
+          header.array_lens[i] == 0))) {
+      unmap_file(file);
+      return 0;
     }
-  } else {
-    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    expected_len += mesh_cache_section_size(&header, i);
+  }
+  if (file.len != expected_len) {
+    unmap_file(file);
+    return 0;
   }
 
-  barrier.subresourceRange.baseMipLevel = 0;
-  barrier.subresourceRange.levelCount = mip_levels;
-  barrier.subresourceRange.baseArrayLayer = 0;
-  barrier.subresourceRange.layerCount = 1;
-
-  VkPipelineStageFlags source_stage;
-  VkPipelineStageFlags destination_stage;
-  if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED &&
-      new_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL) {
-    barrier.srcAccessMask = 0;
-    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-    destination_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-  } else if (old_layout == VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL &&
-             new_layout == VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL) {
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
-    source_stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
-    destination_stage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
-  } else if (old_layout == VK_IMAGE_LAYOUT_UNDEFINED &&
-             new_layout == VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL) {
-    barrier.srcAccessMask = 0;
-    barrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
-                            VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
-    source_stage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
-    destination_stage = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
-  } else {
-    THROW("unsupported layout transition!\n");
+  // raw arrays are used in place, coded ones are decoded to the heap
+  free_mesh();
+  struct timespec decode_start;
+  clock_gettime(CLOCK_MONOTONIC, &decode_start);
+  size_t decoded_size = 0;
+  char *cursor = file.data + sizeof(header);
+  for (int i = 0; i < MESH_ARRAYS_LEN; i++) {
+    if (header.encoded_sizes[i] > 0) {
+      if (!decode_mesh_array(&mesh_arrays[i], header.array_lens[i], cursor,
+                             header.encoded_sizes[i])) {
+        free_mesh();
+        unmap_file(file);
+        return 0;
+      }
+      decoded_size += (size_t)header.array_lens[i] * header.elem_sizes[i];
+    } else {
+      *mesh_arrays[i].data = header.array_lens[i] > 0 ? cursor : NULL;
+      *mesh_arrays[i].len = header.array_lens[i];
+    }
+    cursor += mesh_cache_section_size(&header, i);
+  }
+  if (decoded_size > 0) {
+    double decode_ms = elapsed_ms(&decode_start);
+    printf("decoded %.2f MB of mesh in %.3f ms, %.2f GB/s\n",
+           decoded_size / 1e6, decode_ms, decoded_size / 1e6 / decode_ms);
+  }
+  memcpy(mesh_bounds_min, header.bounds_min, sizeof(header.bounds_min));
+  memcpy(mesh_bounds_max, header.bounds_max, sizeof(header.bounds_max));
+  memcpy(position_offset, header.position_offset, sizeof(vec4));
+  memcpy(position_scale, header.position_scale, sizeof(vec4));
+  memcpy(tex_coord_transform, header.tex_coord_transform, sizeof(vec4));
+  mesh_cache_file = file;
+  return 1;
+}
+
+// a cache that can't be written only costs the next launch a full parse,
+// so failures are reported and otherwise ignored
+void write_mesh_cache(const char *filename, uint64_t source_hash,
+                      uint64_t source_len) {
+  MeshCacheHeader header = {0};
+  header.magic = MESH_CACHE_MAGIC;
+  header.version = MESH_CACHE_VERSION;
+  header.source_hash = source_hash;
+  header.source_len = source_len;
+  char *encoded[MESH_CACHE_MAX_ARRAYS];
+  size_t raw_len = sizeof(header);
+  size_t file_len = sizeof(header);
+  for (int i = 0; i < MESH_ARRAYS_LEN; i++) {
+    header.array_lens[i] = *mesh_arrays[i].len;
+    header.elem_sizes[i] = mesh_arrays[i].elem_size;
+    header.encoded_sizes[i] = encode_mesh_array(&mesh_arrays[i], &encoded[i]);
+    raw_len += (size_t)header.array_lens[i] * header.elem_sizes[i];
+    file_len += mesh_cache_section_size(&header, i);
+  }
+  memcpy(header.bounds_min, mesh_bounds_min, sizeof(header.bounds_min));
+  memcpy(header.bounds_max, mesh_bounds_max, sizeof(header.bounds_max));
+  memcpy(header.position_offset, position_offset, sizeof(vec4));
+  memcpy(header.position_scale, position_scale, sizeof(vec4));
+  memcpy(header.tex_coord_transform, tex_coord_transform, sizeof(vec4));
+
+  // write beside the cache and rename so readers never see a partial file
+  char tmp_filename[256];
+  snprintf(tmp_filename, sizeof(tmp_filename), "%s.tmp", filename);
+  FILE *f = fopen(tmp_filename, "wb");
+  if (!f) {
+    fprintf(stderr, "failed to create mesh cache %s!\n", tmp_filename);
+    for (int i = 0; i < MESH_ARRAYS_LEN; i++) {
+      free(encoded[i]);
+    }
+    return;
   }
 
-  vkCmdPipelineBarrier(command_buffer, source_stage, destination_stage, 0, 0,
-                       NULL, 0, NULL, 1, &barrier);
-  end_single_time_commands(command_buffer);
+  static const char padding[MESH_CACHE_ALIGNMENT] = {0};
+  int ok = fwrite(&header, sizeof(header), 1, f) == 1;
+  for (int i = 0; i < MESH_ARRAYS_LEN && ok; i++) {
+    const char *data = encoded[i] ? encoded[i] : *mesh_arrays[i].data;
+    size_t size = encoded[i]
+                      ? header.encoded_sizes[i]
+                      : (size_t)*mesh_arrays[i].len * mesh_arrays[i].elem_size;
+    size_t padded_size = mesh_cache_section_size(&header, i);
+    ok = size == 0 || fwrite(data, size, 1, f) == 1;
+    ok = ok && (padded_size == size ||
+                fwrite(padding, padded_size - size, 1, f) == 1);
+  }
+  for (int i = 0; i < MESH_ARRAYS_LEN; i++) {
+    free(encoded[i]);
+  }
+  ok = fclose(f) == 0 && ok;
+  if (!ok || rename(tmp_filename, filename) != 0) {
+    fprintf(stderr, "failed to write mesh cache %s!\n", filename);
+    remove(tmp_filename);
+    return;
+  }
+  printf("wrote mesh cache %s: %.1f KB, %.1f KB uncoded\n", filename,
+         file_len / 1e3, raw_len / 1e3);
 }
 
-void copy_buffer(VkBuffer src_buffer, VkBuffer dst_buffer, VkDeviceSize size) {
-  VkCommandBuffer command_buffer = begin_single_time_commands();
+// loads model_path as an .obj, or its mesh cache if that was built from
+// the same file. Returns 0 if tinyobj can't parse it or the mesh can't be
+// drawn, with the mesh partly loaded.
+int load_model() {
+  struct timespec load_start;
+  clock_gettime(CLOCK_MONOTONIC, &load_start);
+
+  ObjLoader loader = {0};
+  struct stat source_stat;
+  loader.fd = open(model_path, O_RDONLY);
+  if (loader.fd < 0 || fstat(loader.fd, &source_stat) != 0) {
+    fprintf(stderr, "failed to read %s!\n", model_path);
+    if (loader.fd >= 0) {
+      close(loader.fd);
+    }
+    return 0;
+  }
+  size_t source_len = source_stat.st_size;
+
+  uint64_t source_hash = hash_file(loader.fd, source_len);
+  if (load_mesh_cache(mesh_cache_path, source_hash, source_len)) {
+    close(loader.fd);
+    printf("loaded model %s from %s: %u face corners, %u vertices, %u LODs "
+           "in %.3f ms\n",
+           model_path, mesh_cache_path, lods[0].index_count,
+           packed_vertices_len, lods_len, elapsed_ms(&load_start));
+    return 1;
+  }
 
-  VkBufferCopy copy_region = {0};
-  copy_region.size = size;
-  vkCmdCopyBuffer(command_buffer, src_buffer, dst_buffer, 1, &copy_region);
+  tinyobj_attrib_t attrib = {0};
+  tinyobj_material_t *materials = NULL;
+  size_t num_materials = 0;
+  unsigned int flags = TINYOBJ_FLAG_TRIANGULATE | TINYOBJ_FLAG_PARALLEL;
+  int ok;
+
+  // large scans are streamed through a fixed window with their faces
+  // deduplicated as they are parsed, so neither the text nor the raw face
+  // list is ever held in memory. Smaller files are parsed whole, which lets
+  // tinyobj spread the lines over threads.
+  if (source_len > MODEL_STREAM_THRESHOLD) {
+    lseek(loader.fd, 0, SEEK_SET);
+    vertex_map_init(&loader.vertex_map, 0);
+    ok = tinyobj_parse_obj_stream(&attrib, &materials, &num_materials,
+                                  model_path, read_obj_stream, add_obj_face,
+                                  get_file_data, &loader,
+                                  flags) == TINYOBJ_SUCCESS;
+  } else {
+    tinyobj_shape_t *shapes = NULL;
+    size_t num_shapes = 0;
+    loader.source = map_file(model_path);
+    ok = loader.source.data &&
+         tinyobj_parse_obj(&attrib, &shapes, &num_shapes, &materials,
+                           &num_materials, model_path, get_file_data, &loader,
+                           flags) == TINYOBJ_SUCCESS;
+
+    if (ok) {
+      reserve_array((void **)&indices, &indices_cap, attrib.num_faces,
+                    sizeof(uint32_t));
+      vertex_map_init(&loader.vertex_map, attrib.num_faces);
+
+      int face_offset = 0;
+      for (int i = 0; i < attrib.num_face_num_verts; i++) {
+        add_obj_face(&loader, &attrib, &attrib.faces[face_offset],
+                     attrib.face_num_verts[i], attrib.material_ids[i]);
+        face_offset += attrib.face_num_verts[i];
+      }
+      tinyobj_shapes_free(shapes, num_shapes);
+    }
+    if (loader.source.data) {
+      unmap_file(loader.source);
+    }
+  }
+  close(loader.fd);
+  for (int i = 0; i < loader.mtl_files_len; i++) {
+    unmap_file(loader.mtl_files[i]);
+  }
+  free(loader.mtl_files);
+  vertex_map_free(&loader.vertex_map);
+
+  if (!ok) {
+    fprintf(stderr, "failed to parse %s!\n", model_path);
+  } else if (indices_len == 0) {
+    fprintf(stderr, "%s has no triangles to draw!\n", model_path);
+    ok = 0;
+  }
+  ok = ok && group_triangles_by_material(&loader, materials, num_materials);
+  free(loader.triangle_materials);
+  tinyobj_attrib_free(&attrib);
+  tinyobj_materials_free(materials, num_materials);
+  if (!ok) {
+    free_vertices();
+    return 0;
+  }
 
-  end_single_time_commands(command_buffer);
-}
+  shrink_array((void **)&vertices, &vertices_cap, vertices_len,
+               sizeof(Vertex));
+  shrink_array((void **)&indices, &indices_cap, indices_len, sizeof(uint32_t));
+
+  if (OPTIMIZE_MESH) {
+    print_mesh_stats("mesh before optimization");
+    // triangles are only reordered within their batch
+    for (int i = 0; i < batches_len; i++) {
+      uint32_t *batch_indices = &indices[batches[i].index_offset];
+      optimize_vertex_cache(batch_indices, batches[i].index_count,
+                            vertices_len);
+      optimize_overdraw(batch_indices, batches[i].index_count, vertices,
+                        vertices_len, OVERDRAW_THRESHOLD);
+    }
+    optimize_vertex_fetch();
+    print_mesh_stats("mesh after optimization");
+  }
 
-void create_vertex_buffer() {
-  VkDeviceSize buffer_size = sizeof(Vertex) * vertices_len;
+  if (GENERATE_TANGENT_SPACE) {
+    generate_tangent_space();
+  }
 
-  VkBuffer staging_buffer;
-  VkDeviceMemory staging_buffer_memory;
+  if (BUILD_MESHLETS) {
+    build_meshlets();
+    print_mesh_stats("mesh after meshlet build");
+  }
 
-  create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                &staging_buffer, &staging_buffer_memory);
+  build_lods();
+  compute_mesh_bounds();
+  pack_vertices();
+  write_mesh_cache(mesh_cache_path, source_hash, source_len);
 
-  void *data;
-  vkMapMemory(device, staging_buffer_memory, 0, buffer_size, 0, &data);
-  memcpy(data, vertices, (size_t)buffer_size);
-  vkUnmapMemory(device, staging_buffer_memory);
+  printf("loaded model %s: %u face corners, %u vertices, %u LODs in %.2f "
+         "ms\n",
+         model_path, lods[0].index_count, packed_vertices_len, lods_len,
+         elapsed_ms(&load_start));
+  return 1;
+}
 
-  create_buffer(buffer_size,
-                VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-                    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vertex_buffer,
-                &vertex_buffer_memory);
-  copy_buffer(staging_buffer, vertex_buffer, buffer_size);
+#define JSON_MAX_DEPTH 64
 
-  vkDestroyBuffer(device, staging_buffer, NULL);
-  vkFreeMemory(device, staging_buffer_memory, NULL);
-}
+typedef enum { JSON_OBJECT, JSON_ARRAY, JSON_STRING, JSON_PRIMITIVE } JsonType;
 
-void create_index_buffer() {
-  VkDeviceSize buffer_size = sizeof(Vertex) * indices_len;
-  VkBuffer staging_buffer;
-  VkDeviceMemory staging_buffer_memory;
-  create_buffer(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                &staging_buffer, &staging_buffer_memory);
+// one value of a JSON document, text[start, end) without the quotes of a
+// string. Its children follow it in tokens[]: the `size` keys of an object
+// each followed by their value, or the `size` elements of an array.
+typedef struct {
+  JsonType type;
+  uint32_t start;
+  uint32_t end;
+  uint32_t size;
+} JsonToken;
+
+// just enough of a JSON parser for the header of a .glb, strings are not
+// unescaped
+typedef struct {
+  const char *text;
+  uint32_t tokens_len;
+  uint32_t tokens_cap;
+  JsonToken *tokens;
+} Json;
+
+// tokenizes the len bytes at text, returns 0 unless they are a single
+// object. Commas and colons are skipped rather than checked.
+static int json_parse(Json *json, const char *text, uint32_t len) {
+  // the containers still open and how many tokens each has so far
+  uint32_t open[JSON_MAX_DEPTH];
+  uint32_t children[JSON_MAX_DEPTH];
+  int depth = 0;
+  json->text = text;
+  json->tokens_len = 0;
+
+  uint32_t i = 0;
+  while (i < len) {
+    char c = text[i];
+    if (c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == ',' ||
+        c == ':') {
+      i++;
+      continue;
+    }
+    if (c == '}' || c == ']') {
+      if (depth == 0) {
+        return 0;
+      }
+      JsonToken *container = &json->tokens[open[depth - 1]];
+      if (container->type != (c == '}' ? JSON_OBJECT : JSON_ARRAY) ||
+          (container->type == JSON_OBJECT && children[depth - 1] % 2 != 0)) {
+        return 0;
+      }
+      container->end = i + 1;
+      depth--;
+      i++;
+      continue;
+    }
 
-  void *data;
-  vkMapMemory(device, staging_buffer_memory, 0, buffer_size, 0, &data);
-  memcpy(data, indices, (size_t)buffer_size);
-  vkUnmapMemory(device, staging_buffer_memory);
+    JsonToken token = {JSON_PRIMITIVE, i, i + 1, 0};
+    if (c == '{' || c == '[') {
+      token.type = c == '{' ? JSON_OBJECT : JSON_ARRAY;
+    } else if (c == '"') {
+      token.type = JSON_STRING;
+      token.start = i + 1;
+      token.end = token.start;
+      while (token.end < len && text[token.end] != '"') {
+        token.end += text[token.end] == '\\' ? 2 : 1;
+      }
+      if (token.end >= len) {
+        return 0;
+      }
+    } else if (c != '\0' && strchr("-0123456789tfn", c)) {
+      token.end = i;
+      while (token.end < len && !strchr(" \t\n\r,:]}", text[token.end])) {
+        token.end++;
+      }
+    } else {
+      return 0;
+    }
 
-  create_buffer(
-      buffer_size,
-      VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-      VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &index_buffer, &index_buffer_memory);
+    // every token is a value or, in an object, a key
+    if (depth > 0) {
+      JsonToken *parent = &json->tokens[open[depth - 1]];
+      int is_key = parent->type == JSON_OBJECT && children[depth - 1] % 2 == 0;
+      if (is_key && token.type != JSON_STRING) {
+        return 0;
+      }
+      if (is_key || parent->type == JSON_ARRAY) {
+        parent->size += 1;
+      }
+      children[depth - 1] += 1;
+    } else if (json->tokens_len > 0 || token.type != JSON_OBJECT) {
+      return 0;
+    }
 
-  copy_buffer(staging_buffer, index_buffer, buffer_size);
+    reserve_array((void **)&json->tokens, &json->tokens_cap,
+                  json->tokens_len + 1, sizeof(JsonToken));
+    json->tokens[json->tokens_len] = token;
+    if (token.type == JSON_OBJECT || token.type == JSON_ARRAY) {
+      if (depth == JSON_MAX_DEPTH) {
+        return 0;
+      }
+      open[depth] = json->tokens_len;
+      children[depth] = 0;
+      depth++;
+      i++;
+    } else {
+      i = token.type == JSON_STRING ? token.end + 1 : token.end;
+    }
+    json->tokens_len += 1;
+  }
+  return depth == 0 && json->tokens_len > 0;
+}
 
-  vkDestroyBuffer(device, staging_buffer, NULL);
-  vkFreeMemory(device, staging_buffer_memory, NULL);
+// the index of the token after tokens[i] and all of its children
+static uint32_t json_skip(const Json *json, uint32_t i) {
+  uint32_t pending = 1;
+  while (pending > 0) {
+    const JsonToken *token = &json->tokens[i];
+    pending += token->type == JSON_OBJECT  ? token->size * 2
+               : token->type == JSON_ARRAY ? token->size
+                                           : 0;
+    pending -= 1;
+    i++;
+  }
+  return i;
 }
 
-void create_uniform_buffers() {
-  VkDeviceSize buffer_size = sizeof(UniformBufferObject);
+static int json_equals(const Json *json, int i, const char *s) {
+  if (i < 0) {
+    return 0;
+  }
+  const JsonToken *token = &json->tokens[i];
+  size_t len = strlen(s);
+  return token->end - token->start == len &&
+         memcmp(json->text + token->start, s, len) == 0;
+}
 
-  uniform_buffers_len = MAX_FRAMES_IN_FLIGHT;
-  uniform_buffers_memory_len = MAX_FRAMES_IN_FLIGHT;
-  uniform_buffers_mapped_len = MAX_FRAMES_IN_FLIGHT;
+// the value of `key` in `object`, -1 if there is none or object is -1
+static int json_get(const Json *json, int object, const char *key) {
+  if (object < 0 || json->tokens[object].type != JSON_OBJECT) {
+    return -1;
+  }
+  uint32_t i = object + 1;
+  for (uint32_t k = 0; k < json->tokens[object].size; k++) {
+    if (json_equals(json, i, key)) {
+      return i + 1;
+    }
+    i = json_skip(json, i + 1);
+  }
+  return -1;
+}
 
-  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-    create_buffer(buffer_size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-                  VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                  &uniform_buffers[i], &uniform_buffers_memory[i]);
-    vkMapMemory(device, uniform_buffers_memory[i], 0, buffer_size, 0,
-                &uniform_buffers_mapped[i]);
+// element n of `array`, -1 if it has no such element or array is -1
+static int json_at(const Json *json, int array, uint32_t n) {
+  if (array < 0 || json->tokens[array].type != JSON_ARRAY ||
+      n >= json->tokens[array].size) {
+    return -1;
   }
+  uint32_t i = array + 1;
+  while (n-- > 0) {
+    i = json_skip(json, i);
+  }
+  return i;
 }
 
-void create_descriptor_pool() {
-  VkDescriptorPoolSize pool_size[2] = {0};
-  pool_size[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-  pool_size[0].descriptorCount = (uint32_t)MAX_FRAMES_IN_FLIGHT;
-  pool_size[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-  pool_size[1].descriptorCount = (uint32_t)MAX_FRAMES_IN_FLIGHT;
+static double json_number(const Json *json, int i, double fallback) {
+  if (i < 0 || json->tokens[i].type != JSON_PRIMITIVE ||
+      !strchr("-0123456789", json->text[json->tokens[i].start])) {
+    return fallback;
+  }
+  return strtod(json->text + json->tokens[i].start, NULL);
+}
 
-  VkDescriptorPoolCreateInfo pool_info = {0};
-  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-  pool_info.poolSizeCount = 2;
-  pool_info.pPoolSizes = pool_size;
-  pool_info.maxSets = (uint32_t)MAX_FRAMES_IN_FLIGHT;
+static int json_is_true(const Json *json, int i) {
+  return i >= 0 && json->tokens[i].type == JSON_PRIMITIVE &&
+         json_equals(json, i, "true");
+}
 
-  if (vkCreateDescriptorPool(device, &pool_info, NULL, &descriptor_pool) !=
-      VK_SUCCESS) {
-    THROW("failed to create descriptor pool!\n");
+// the elements of an array looked up by index, which json_at() would walk
+// the array for every time
+typedef struct {
+  uint32_t len;
+  int *items;
+} JsonArray;
+
+static JsonArray json_array(const Json *json, int object, const char *key) {
+  JsonArray array = {0};
+  int i = json_get(json, object, key);
+  if (i < 0 || json->tokens[i].type != JSON_ARRAY) {
+    return array;
   }
+  array.len = json->tokens[i].size;
+  array.items = malloc(sizeof(int) * (array.len + 1));
+  if (!array.items) {
+    THROW("failed to allocate JSON array!\n");
+  }
+  uint32_t item = i + 1;
+  for (uint32_t n = 0; n < array.len; n++) {
+    array.items[n] = item;
+    item = json_skip(json, item);
+  }
+  return array;
 }
 
-void create_descriptor_sets() {
-  VkDescriptorSetLayout layouts[MAX_FRAMES_IN_FLIGHT];
-
-  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-    layouts[i] = descriptor_set_layout;
+// the token of element `index`, -1 unless index is a valid one
+static int json_item(const JsonArray *array, double index) {
+  if (!(index >= 0 && index < array->len)) {
+    return -1;
   }
+  return array->items[(uint32_t)index];
+}
 
-  VkDescriptorSetAllocateInfo alloc_info = {0};
-  alloc_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-  alloc_info.descriptorPool = descriptor_pool;
-  alloc_info.descriptorSetCount = (uint32_t)MAX_FRAMES_IN_FLIGHT;
-  alloc_info.pSetLayouts = layouts;
+#define GLB_MAGIC 0x46546c67 // "glTF"
+#define GLB_CHUNK_JSON 0x4e4f534a
+#define GLB_CHUNK_BIN 0x004e4942
 
-  if (vkAllocateDescriptorSets(device, &alloc_info, descriptor_sets) !=
-      VK_SUCCESS) {
-    THROW("failed to allocate descriptor sets!\n");
+// state of one .glb load
+typedef struct {
+  MappedFile file;
+  Json json;
+  const char *bin;
+  uint64_t bin_len;
+  JsonArray accessors;
+  JsonArray buffer_views;
+  JsonArray meshes;
+  JsonArray nodes;
+  JsonArray materials;
+  JsonArray textures;
+  JsonArray images;
+  // the mesh_materials[] entry of .glb material i - 1, or of primitives
+  // without a material for i = 0, UINT32_MAX until it is first used
+  uint32_t *material_slots;
+} GlbLoader;
+
+// The .glb readers below report what is wrong with the file and return 0,
+// so a model that is broken or still being written fails a hot reload
+// instead of ending the program.
+
+// the byte range of a buffer view, which has to be in the BIN chunk
+static int glb_buffer_view(const GlbLoader *loader, double index,
+                           uint64_t *offset, uint64_t *len) {
+  const Json *json = &loader->json;
+  int view = json_item(&loader->buffer_views, index);
+  if (view < 0 || json_number(json, json_get(json, view, "buffer"), 0) != 0) {
+    fprintf(stderr, "%s: buffer view %g isn't in the BIN chunk!\n",
+            model_path, index);
+    return 0;
   }
-  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
-    VkDescriptorBufferInfo buffer_info = {0};
-    buffer_info.buffer = uniform_buffers[i];
-    buffer_info.offset = 0;
-    buffer_info.range = sizeof(UniformBufferObject);
-
-    VkDescriptorImageInfo image_info = {0};
-    image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    image_info.imageView = texture_image_view;
-    image_info.sampler = texture_sampler;
-
-    VkWriteDescriptorSet descriptor_writes[2] = {0};
-    descriptor_writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptor_writes[0].dstSet = descriptor_sets[i];
-    descriptor_writes[0].dstBinding = 0;
-    descriptor_writes[0].dstArrayElement = 0;
-    descriptor_writes[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptor_writes[0].descriptorCount = 1;
-    descriptor_writes[0].pBufferInfo = &buffer_info;
-
-    descriptor_writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptor_writes[1].dstSet = descriptor_sets[i];
-    descriptor_writes[1].dstBinding = 1;
-    descriptor_writes[1].dstArrayElement = 0;
-    descriptor_writes[1].descriptorType =
-        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-    descriptor_writes[1].descriptorCount = 1;
-    descriptor_writes[1].pImageInfo = &image_info;
-
-    vkUpdateDescriptorSets(device, 2, descriptor_writes, 0, NULL);
+  *offset = json_number(json, json_get(json, view, "byteOffset"), 0);
+  *len = json_number(json, json_get(json, view, "byteLength"), 0);
+  if (*offset > loader->bin_len || *len > loader->bin_len - *offset) {
+    fprintf(stderr, "%s: buffer view %g reaches past the BIN chunk!\n",
+            model_path, index);
+    return 0;
   }
+  return 1;
 }
 
-void create_image(uint32_t width, uint32_t height, uint32_t mip_levels,
-                  VkSampleCountFlagBits num_samples, VkFormat format,
-                  VkImageTiling tiling, VkImageUsageFlags usage,
-                  VkMemoryPropertyFlags properties, VkImage *image,
-                  VkDeviceMemory *image_memory) {
-  VkImageCreateInfo image_info = {0};
-  image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-  image_info.imageType = VK_IMAGE_TYPE_2D;
-  image_info.extent.width = width;
-  image_info.extent.height = height;
-  image_info.extent.depth = 1;
-  image_info.mipLevels = mip_levels;
-  image_info.arrayLayers = 1;
-  image_info.format = format;
-  image_info.tiling = tiling;
-  image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  image_info.usage = usage;
-  image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-  image_info.samples = num_samples;
-
-  if (vkCreateImage(device, &image_info, NULL, image) != VK_SUCCESS) {
-    THROW("failed to create image!\n");
+static int glb_accessor(const GlbLoader *loader, double index,
+                        GlbAccessor *dst) {
+  const Json *json = &loader->json;
+  int accessor = json_item(&loader->accessors, index);
+  if (accessor < 0) {
+    fprintf(stderr, "%s: accessor %g doesn't exist!\n", model_path, index);
+    return 0;
+  }
+  if (json_get(json, accessor, "sparse") >= 0) {
+    fprintf(stderr, "%s: sparse accessors are not supported!\n", model_path);
+    return 0;
   }
 
-  VkMemoryRequirements mem_requirements;
-  vkGetImageMemoryRequirements(device, *image, &mem_requirements);
+  GlbAccessor result = {0};
+  result.count = json_number(json, json_get(json, accessor, "count"), 0);
+  result.component_type =
+      json_number(json, json_get(json, accessor, "componentType"), 0);
+  result.normalized =
+      json_is_true(json, json_get(json, accessor, "normalized"));
+  int type = json_get(json, accessor, "type");
+  result.components = json_equals(json, type, "SCALAR") ? 1
+                      : json_equals(json, type, "VEC2") ? 2
+                      : json_equals(json, type, "VEC3") ? 3
+                      : json_equals(json, type, "VEC4") ? 4
+                                                        : 0;
+  uint32_t elem_size =
+      glb_component_size(result.component_type) * result.components;
+  if (elem_size == 0) {
+    fprintf(stderr, "%s: accessor %g has an unsupported type!\n", model_path,
+            index);
+    return 0;
+  }
 
-  VkMemoryAllocateInfo alloc_info = {0};
-  alloc_info.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-  alloc_info.allocationSize = mem_requirements.size;
-  alloc_info.memoryTypeIndex =
-      find_memory_type(mem_requirements.memoryTypeBits, properties);
-  if (vkAllocateMemory(device, &alloc_info, NULL, image_memory) != VK_SUCCESS) {
-    THROW("failed to allocate image memory!\n");
+  double view_index =
+      json_number(json, json_get(json, accessor, "bufferView"), -1);
+  uint64_t view_offset, view_len;
+  if (!glb_buffer_view(loader, view_index, &view_offset, &view_len)) {
+    return 0;
   }
-  vkBindImageMemory(device, *image, *image_memory, 0);
+  int view = json_item(&loader->buffer_views, view_index);
+  uint64_t offset =
+      json_number(json, json_get(json, accessor, "byteOffset"), 0);
+  result.stride =
+      json_number(json, json_get(json, view, "byteStride"), elem_size);
+  if (result.count > 0 &&
+      (result.stride < elem_size || offset > view_len ||
+       (uint64_t)result.stride * (result.count - 1) + elem_size >
+           view_len - offset)) {
+    fprintf(stderr, "%s: accessor %g reaches past its buffer view!\n",
+            model_path, index);
+    return 0;
+  }
+  result.data = loader->bin + view_offset + offset;
+  *dst = result;
+  return 1;
 }
 
-void generate_mipmaps(VkImage image, VkFormat image_format, int32_t tex_width,
-                      int32_t tex_height, uint32_t mip_levels) {
+// the mesh_materials[] entry of .glb material `index`, added when it is
+// first used, or UINT32_MAX. Its texture is the base color map, embedded
+// in the .glb or a file named relative to it, or TEXTURE_PATH without one.
+static uint32_t glb_material(GlbLoader *loader, double index) {
+  const Json *json = &loader->json;
+  int material = json_item(&loader->materials, index);
+  uint32_t *slot =
+      &loader->material_slots[material < 0 ? 0 : (uint32_t)index + 1];
+  if (*slot != UINT32_MAX) {
+    return *slot;
+  }
 
-  VkFormatProperties format_properties;
-  vkGetPhysicalDeviceFormatProperties(physical_device, image_format,
-                                      &format_properties);
+  MeshMaterial mesh_material = {0};
+  snprintf(mesh_material.texture_path, MATERIAL_PATH_MAX, "%s", TEXTURE_PATH);
+  int texture_info = json_get(
+      json, json_get(json, material, "pbrMetallicRoughness"),
+      "baseColorTexture");
+  int texture = json_item(
+      &loader->textures,
+      json_number(json, json_get(json, texture_info, "index"), -1));
+  int image =
+      json_item(&loader->images,
+                json_number(json, json_get(json, texture, "source"), -1));
+  int uri = json_get(json, image, "uri");
+  int view = json_get(json, image, "bufferView");
+  if (uri >= 0) {
+    const JsonToken *token = &json->tokens[uri];
+    const char *name = json->text + token->start;
+    int name_len = token->end - token->start;
+    if (name_len >= 5 && memcmp(name, "data:", 5) == 0) {
+      fprintf(stderr, "%s: images in data URIs are not supported!\n",
+              model_path);
+      return UINT32_MAX;
+    }
+    if (!model_relative_path(name, name_len, mesh_material.texture_path)) {
+      fprintf(stderr, "%s: image path %.*s is too long!\n", model_path,
+              name_len, name);
+      return UINT32_MAX;
+    }
+  } else if (view >= 0) {
+    uint64_t view_offset, view_len;
+    if (!glb_buffer_view(loader, json_number(json, view, -1), &view_offset,
+                         &view_len)) {
+      return UINT32_MAX;
+    }
+    if (view_len == 0 || view_len > INT_MAX) {
+      fprintf(stderr, "%s: embedded image has an invalid size!\n",
+              model_path);
+      return UINT32_MAX;
+    }
+    snprintf(mesh_material.texture_path, MATERIAL_PATH_MAX, "%s", model_path);
+    mesh_material.texture_offset =
+        loader->bin - loader->file.data + view_offset;
+    mesh_material.texture_size = view_len;
+  }
 
-  if (!(format_properties.optimalTilingFeatures &
-        VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT)) {
-    THROW("texture image format does not support linear blitting!\n");
+  *slot = add_mesh_material(&mesh_material);
+  return *slot;
+}
+
+// adds the triangle lists of .glb mesh `index`, drawn with `transform`
+static int add_glb_mesh(GlbLoader *loader, double index, mat4 transform) {
+  const Json *json = &loader->json;
+  int mesh = json_item(&loader->meshes, index);
+  if (mesh < 0) {
+    fprintf(stderr, "%s: mesh %g doesn't exist!\n", model_path, index);
+    return 0;
   }
 
-  VkCommandBuffer command_buffer = begin_single_time_commands();
+  int primitives = json_get(json, mesh, "primitives");
+  int primitive;
+  for (uint32_t n = 0; (primitive = json_at(json, primitives, n)) >= 0; n++) {
+    if (json_number(json, json_get(json, primitive, "mode"),
+                    GLTF_TRIANGLES) != GLTF_TRIANGLES) {
+      fprintf(stderr, "%s: skipping a primitive that isn't a triangle list\n",
+              model_path);
+      continue;
+    }
 
-  VkImageMemoryBarrier barrier = {0};
-  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
-  barrier.image = image;
-  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
-  barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-  barrier.subresourceRange.baseArrayLayer = 0;
-  barrier.subresourceRange.layerCount = 1;
-  barrier.subresourceRange.levelCount = 1;
+    GlbPrimitive prim = {0};
+    int attributes = json_get(json, primitive, "attributes");
+    double position_index =
+        json_number(json, json_get(json, attributes, "POSITION"), -1);
+    if (!glb_accessor(loader, position_index, &prim.position)) {
+      return 0;
+    }
+    if (prim.position.components != 3) {
+      fprintf(stderr, "%s: positions have to be 3D!\n", model_path);
+      return 0;
+    }
+    int tex_coord = json_get(json, attributes, "TEXCOORD_0");
+    if (tex_coord >= 0) {
+      if (!glb_accessor(loader, json_number(json, tex_coord, -1),
+                        &prim.tex_coord)) {
+        return 0;
+      }
+      if (prim.tex_coord.components != 2 ||
+          prim.tex_coord.count != prim.position.count) {
+        fprintf(stderr,
+                "%s: texture coordinates don't match the positions!\n",
+                model_path);
+        return 0;
+      }
+    }
+    int indices = json_get(json, primitive, "indices");
+    prim.index_count = prim.position.count;
+    if (indices >= 0) {
+      if (!glb_accessor(loader, json_number(json, indices, -1),
+                        &prim.indices)) {
+        return 0;
+      }
+      if (prim.indices.components != 1 ||
+          prim.indices.component_type == GLTF_BYTE ||
+          prim.indices.component_type == GLTF_SHORT ||
+          prim.indices.component_type == GLTF_FLOAT) {
+        fprintf(stderr, "%s: indices have to be unsigned integers!\n",
+                model_path);
+        return 0;
+      }
+      prim.index_count = prim.indices.count;
+    }
+    if (prim.index_count % 3 != 0) {
+      fprintf(stderr, "%s: a triangle list has %u indices!\n", model_path,
+              prim.index_count);
+      return 0;
+    }
+    if (prim.index_count == 0) {
+      continue;
+    }
 
-  int32_t mip_width = tex_width;
-  int32_t mip_height = tex_height;
+    // glTF requires position bounds, which a transform that may rotate
+    // turns into the bounds of the box's corners
+    int accessor = json_item(&loader->accessors, position_index);
+    int min = json_get(json, accessor, "min");
+    int max = json_get(json, accessor, "max");
+    glm_vec3_fill(prim.bounds_min, INFINITY);
+    glm_vec3_fill(prim.bounds_max, -INFINITY);
+    for (int corner = 0; corner < 8; corner++) {
+      vec3 pos;
+      for (int j = 0; j < 3; j++) {
+        int bound = json_at(json, corner >> j & 1 ? max : min, j);
+        if (bound < 0) {
+          fprintf(stderr, "%s: positions have no min and max!\n",
+                  model_path);
+          return 0;
+        }
+        pos[j] = glb_normalize(&prim.position, json_number(json, bound, 0));
+      }
+      glm_mat4_mulv3(transform, pos, 1.0f, pos);
+      glm_vec3_minv(prim.bounds_min, pos, prim.bounds_min);
+      glm_vec3_maxv(prim.bounds_max, pos, prim.bounds_max);
+    }
 
-  for (int i = 1; i < mip_levels; i++) {
+    memcpy(prim.transform, transform, sizeof(prim.transform));
+    prim.material = glb_material(
+        loader, json_number(json, json_get(json, primitive, "material"), -1));
+    if (prim.material == UINT32_MAX) {
+      return 0;
+    }
+    reserve_array((void **)&glb_primitives, &glb_primitives_cap,
+                  glb_primitives_len + 1, sizeof(GlbPrimitive));
+    glb_primitives[glb_primitives_len] = prim;
+    glb_primitives_len += 1;
+  }
+  return 1;
+}
 
-    barrier.subresourceRange.baseMipLevel = i - 1;
-    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-    barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+// the local transform of a node: its matrix, or its translation, rotation
+// and scale applied in reverse order
+static void glb_node_transform(const Json *json, int node, mat4 dst) {
+  int matrix = json_get(json, node, "matrix");
+  if (matrix >= 0) {
+    for (int i = 0; i < 16; i++) {
+      dst[i / 4][i % 4] = json_number(json, json_at(json, matrix, i),
+                                      i % 5 == 0 ? 1.0 : 0.0);
+    }
+    return;
+  }
 
-    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1,
-                         &barrier);
+  int translation = json_get(json, node, "translation");
+  int rotation = json_get(json, node, "rotation");
+  int scale = json_get(json, node, "scale");
+  versor quat;
+  for (int i = 0; i < 4; i++) {
+    quat[i] = json_number(json, json_at(json, rotation, i), i == 3);
+  }
+  glm_quat_mat4(quat, dst);
+  for (int i = 0; i < 3; i++) {
+    glm_vec4_scale(dst[i], json_number(json, json_at(json, scale, i), 1),
+                   dst[i]);
+    dst[3][i] = json_number(json, json_at(json, translation, i), 0);
+  }
+}
 
-    VkImageBlit blit = {0};
-    blit.srcOffsets[0].x = 0;
-    blit.srcOffsets[0].y = 0;
-    blit.srcOffsets[0].z = 0;
+static int add_glb_node(GlbLoader *loader, double index, mat4 parent,
+                        int depth) {
+  const Json *json = &loader->json;
+  int node = json_item(&loader->nodes, index);
+  if (node < 0 || depth > JSON_MAX_DEPTH) {
+    fprintf(stderr, "%s: node %g doesn't exist or is nested too deep!\n",
+            model_path, index);
+    return 0;
+  }
 
-    blit.srcOffsets[1].x = mip_width;
-    blit.srcOffsets[1].y = mip_height;
-    blit.srcOffsets[1].z = 1;
+  mat4 local, transform;
+  glb_node_transform(json, node, local);
+  glm_mat4_mul(parent, local, transform);
+  int mesh = json_get(json, node, "mesh");
+  if (mesh >= 0 &&
+      !add_glb_mesh(loader, json_number(json, mesh, -1), transform)) {
+    return 0;
+  }
 
-    blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    blit.srcSubresource.mipLevel = i - 1;
-    blit.srcSubresource.baseArrayLayer = 0;
-    blit.srcSubresource.layerCount = 1;
+  int children = json_get(json, node, "children");
+  int child;
+  for (uint32_t n = 0; (child = json_at(json, children, n)) >= 0; n++) {
+    if (!add_glb_node(loader, json_number(json, child, -1), transform,
+                      depth + 1)) {
+      return 0;
+    }
+  }
+  return 1;
+}
 
-    blit.dstOffsets[0].x = 0;
-    blit.dstOffsets[0].y = 0;
-    blit.dstOffsets[0].z = 0;
+static int same_glb_accessor(const GlbAccessor *a, const GlbAccessor *b) {
+  return a->data == b->data && a->count == b->count &&
+         a->stride == b->stride && a->component_type == b->component_type &&
+         a->components == b->components && a->normalized == b->normalized;
+}
 
-    blit.dstOffsets[1].x = mip_width > 1 ? mip_width / 2 : 1;
-    blit.dstOffsets[1].y = mip_height > 1 ? mip_height / 2 : 1;
-    blit.dstOffsets[1].z = 1;
+// the dequantization under which a primitive's vertices can be copied as
+// they are: unsigned 16 bit positions and texture coordinates interleaved
+// exactly like PackedVertex, which the node only scales and moves.
+// Returns 0 if they can't.
+static int glb_copy_transform(const GlbPrimitive *prim, vec4 offset,
+                              vec4 scale, vec4 tex_coord) {
+  const GlbAccessor *pos = &prim->position;
+  const GlbAccessor *tex = &prim->tex_coord;
+  if (pos->component_type != GLTF_UNSIGNED_SHORT ||
+      pos->stride != sizeof(PackedVertex) ||
+      tex->component_type != GLTF_UNSIGNED_SHORT ||
+      tex->stride != sizeof(PackedVertex) ||
+      tex->data != pos->data + offsetof(PackedVertex, tex_coord)) {
+    return 0;
+  }
+  const float *m = prim->transform;
+  for (int column = 0; column < 4; column++) {
+    for (int row = 0; row < 4; row++) {
+      float value = m[column * 4 + row];
+      if (column == row ? value <= 0.0f : column < 3 && value != 0.0f) {
+        return 0;
+      }
+    }
+  }
+  if (m[15] != 1.0f) {
+    return 0;
+  }
 
-    blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-    blit.dstSubresource.mipLevel = i;
-    blit.dstSubresource.baseArrayLayer = 0;
-    blit.dstSubresource.layerCount = 1;
+  float pos_unit = pos->normalized ? 1.0f : UINT16_MAX;
+  float tex_unit = tex->normalized ? 1.0f : UINT16_MAX;
+  for (int j = 0; j < 3; j++) {
+    offset[j] = m[12 + j];
+    scale[j] = m[j * 5] * pos_unit;
+  }
+  offset[3] = 0.0f;
+  scale[3] = 0.0f;
+  tex_coord[0] = 0.0f;
+  tex_coord[1] = 0.0f;
+  tex_coord[2] = tex_unit;
+  tex_coord[3] = tex_unit;
+  return 1;
+}
 
-    vkCmdBlitImage(command_buffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
-                   image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
-                   VK_FILTER_LINEAR);
+// picks the dequantization the vertex buffer is written with. Primitives
+// that can be copied keep their bytes if they all agree on it and every
+// other primitive fits in its range, otherwise everything is quantized
+// against the bounds of the whole mesh.
+static void choose_glb_quantization() {
+  glm_vec3_fill(mesh_bounds_min, INFINITY);
+  glm_vec3_fill(mesh_bounds_max, -INFINITY);
+  vec4 offset, scale, tex_coord;
+  int have_copy_transform = 0;
+  for (int p = 0; p < glb_primitives_len; p++) {
+    GlbPrimitive *prim = &glb_primitives[p];
+    glm_vec3_minv(mesh_bounds_min, prim->bounds_min, mesh_bounds_min);
+    glm_vec3_maxv(mesh_bounds_max, prim->bounds_max, mesh_bounds_max);
+    if (prim->shares_vertices) {
+      continue;
+    }
+    vec4 prim_offset, prim_scale, prim_tex_coord;
+    prim->copy_vertices =
+        glb_copy_transform(prim, prim_offset, prim_scale, prim_tex_coord);
+    if (prim->copy_vertices && !have_copy_transform) {
+      glm_vec4_copy(prim_offset, offset);
+      glm_vec4_copy(prim_scale, scale);
+      glm_vec4_copy(prim_tex_coord, tex_coord);
+      have_copy_transform = 1;
+    } else if (prim->copy_vertices) {
+      prim->copy_vertices = memcmp(prim_offset, offset, sizeof(vec4)) == 0 &&
+                            memcmp(prim_scale, scale, sizeof(vec4)) == 0 &&
+                            memcmp(prim_tex_coord, tex_coord,
+                                   sizeof(vec4)) == 0;
+    }
+  }
 
-    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
-    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-    barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
-    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  // texture coordinates have no required bounds, so the ones that will be
+  // converted are scanned
+  vec2 tex_coord_min = {INFINITY, INFINITY};
+  vec2 tex_coord_max = {-INFINITY, -INFINITY};
+  int fits = have_copy_transform;
+  for (int p = 0; p < glb_primitives_len; p++) {
+    const GlbPrimitive *prim = &glb_primitives[p];
+    if (prim->shares_vertices || prim->copy_vertices) {
+      continue;
+    }
+    for (int j = 0; j < 3 && fits; j++) {
+      float slack = scale[j] * 1e-6f;
+      fits = prim->bounds_min[j] >= offset[j] - slack &&
+             prim->bounds_max[j] <= offset[j] + scale[j] + slack;
+    }
+    for (uint32_t i = 0; i < prim->tex_coord.count; i++) {
+      vec2 value = {glb_component(&prim->tex_coord, i, 0),
+                    glb_component(&prim->tex_coord, i, 1)};
+      glm_vec2_minv(tex_coord_min, value, tex_coord_min);
+      glm_vec2_maxv(tex_coord_max, value, tex_coord_max);
+    }
+  }
+  if (fits && tex_coord_min[0] <= tex_coord_max[0]) {
+    fits = tex_coord_min[0] >= 0.0f && tex_coord_min[1] >= 0.0f &&
+           tex_coord_max[0] <= tex_coord[2] && tex_coord_max[1] <= tex_coord[3];
+  }
+  if (fits) {
+    glm_vec4_copy(offset, position_offset);
+    glm_vec4_copy(scale, position_scale);
+    glm_vec4_copy(tex_coord, tex_coord_transform);
+    return;
+  }
 
-    vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                         VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0,
-                         NULL, 1, &barrier);
-    if (mip_width > 1)
-      mip_width /= 2;
-    if (mip_height > 1)
-      mip_height /= 2;
+  // the copyable primitives' texture coordinates weren't scanned yet
+  for (int p = 0; p < glb_primitives_len; p++) {
+    GlbPrimitive *prim = &glb_primitives[p];
+    for (uint32_t i = 0; prim->copy_vertices && i < prim->tex_coord.count;
+         i++) {
+      vec2 value = {glb_component(&prim->tex_coord, i, 0),
+                    glb_component(&prim->tex_coord, i, 1)};
+      glm_vec2_minv(tex_coord_min, value, tex_coord_min);
+      glm_vec2_maxv(tex_coord_max, value, tex_coord_max);
+    }
+    prim->copy_vertices = 0;
   }
+  glm_vec4_zero(position_offset);
+  glm_vec4_zero(position_scale);
+  glm_vec4_zero(tex_coord_transform);
+  for (int j = 0; j < 3; j++) {
+    position_offset[j] = mesh_bounds_min[j];
+    position_scale[j] = mesh_bounds_max[j] - mesh_bounds_min[j];
+  }
+  if (tex_coord_min[0] <= tex_coord_max[0]) {
+    tex_coord_transform[0] = tex_coord_min[0];
+    tex_coord_transform[1] = tex_coord_min[1];
+    tex_coord_transform[2] = tex_coord_max[0] - tex_coord_min[0];
+    tex_coord_transform[3] = tex_coord_max[1] - tex_coord_min[1];
+  }
+}
 
-  barrier.subresourceRange.baseMipLevel = mip_levels - 1;
-  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
-  barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
-  barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+static int compare_batches(const void *a, const void *b) {
+  const MeshBatch *batch_a = a;
+  const MeshBatch *batch_b = b;
+  if (batch_a->material != batch_b->material) {
+    return batch_a->material < batch_b->material ? -1 : 1;
+  }
+  return batch_a->index_offset < batch_b->index_offset ? -1
+         : batch_a->index_offset > batch_b->index_offset;
+}
 
-  vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
-                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, NULL, 0,
-                       NULL, 1, &barrier);
+// places every primitive in the vertex and index buffers, primitives
+// drawing the same vertices under the same transform share them, and
+// makes each one a batch of the single level of detail
+static void layout_glb_primitives() {
+  for (int p = 0; p < glb_primitives_len; p++) {
+    GlbPrimitive *prim = &glb_primitives[p];
+    prim->index_offset = glb_indices_len;
+    glb_indices_len += prim->index_count;
+    for (int q = 0; q < p && !prim->shares_vertices; q++) {
+      const GlbPrimitive *other = &glb_primitives[q];
+      if (!other->shares_vertices &&
+          same_glb_accessor(&prim->position, &other->position) &&
+          same_glb_accessor(&prim->tex_coord, &other->tex_coord) &&
+          memcmp(prim->transform, other->transform,
+                 sizeof(prim->transform)) == 0) {
+        prim->shares_vertices = 1;
+        prim->vertex_offset = other->vertex_offset;
+      }
+    }
+    if (!prim->shares_vertices) {
+      prim->vertex_offset = glb_vertices_len;
+      glb_vertices_len += prim->position.count;
+    }
+  }
 
-  end_single_time_commands(command_buffer);
+  reserve_array((void **)&batches, &batches_cap, glb_primitives_len,
+                sizeof(MeshBatch));
+  for (int p = 0; p < glb_primitives_len; p++) {
+    MeshBatch *batch = &batches[p];
+    batch->index_offset = glb_primitives[p].index_offset;
+    batch->index_count = glb_primitives[p].index_count;
+    batch->material = glb_primitives[p].material;
+    batch->vertex_offset = glb_primitives[p].vertex_offset;
+  }
+  batches_len = glb_primitives_len;
+  qsort(batches, batches_len, sizeof(MeshBatch), compare_batches);
+
+  reserve_array((void **)&lods, &lods_cap, 1, sizeof(MeshLod));
+  lods[0].batch_offset = 0;
+  lods[0].batch_count = batches_len;
+  lods[0].index_count = glb_indices_len;
+  lods[0].error = 0.0f;
+  lods_len = 1;
 }
 
-void create_texture_image() {
-  int tex_width, tex_height, tex_channels;
-  stbi_uc *pixels = stbi_load(TEXTURE_PATH, &tex_width, &tex_height,
-                              &tex_channels, STBI_rgb_alpha);
-  VkDeviceSize image_size = tex_width * tex_height * 4;
-  if (!pixels) {
-    THROW("failed to load texture image!\n");
+// loads model_path as a glTF 2.0 binary. Its buffers already are indexed
+// vertex streams, so nothing is parsed or deduplicated: the primitives
+// only record where their data is in the mapped file, and the vertex and
+// index buffers are filled straight from there. The mesh isn't optimized
+// and has no meshlets or simplified levels. Returns 0 if the file is
+// broken, with the mesh partly loaded.
+int load_glb() {
+  struct timespec load_start;
+  clock_gettime(CLOCK_MONOTONIC, &load_start);
+
+  GlbLoader loader = {0};
+  loader.file = map_file(model_path);
+  glb_source = loader.file;
+  uint32_t header[3];
+  if (!loader.file.data || loader.file.len < sizeof(header)) {
+    fprintf(stderr, "failed to read %s!\n", model_path);
+    return 0;
+  }
+  memcpy(header, loader.file.data, sizeof(header));
+  if (header[0] != GLB_MAGIC || header[1] != 2 ||
+      header[2] > loader.file.len) {
+    fprintf(stderr, "%s isn't a glTF 2.0 binary!\n", model_path);
+    return 0;
+  }
+
+  const char *json_text = NULL;
+  uint32_t json_len = 0;
+  uint64_t offset = sizeof(header);
+  while (offset + 2 * sizeof(uint32_t) <= header[2]) {
+    uint32_t chunk[2];
+    memcpy(chunk, loader.file.data + offset, sizeof(chunk));
+    offset += sizeof(chunk);
+    if (chunk[0] > header[2] - offset) {
+      fprintf(stderr, "%s is truncated!\n", model_path);
+      return 0;
+    }
+    if (chunk[1] == GLB_CHUNK_JSON && !json_text) {
+      json_text = loader.file.data + offset;
+      json_len = chunk[0];
+    } else if (chunk[1] == GLB_CHUNK_BIN && !loader.bin) {
+      loader.bin = loader.file.data + offset;
+      loader.bin_len = chunk[0];
+    }
+    offset += chunk[0];
+  }
+  if (!json_text || !json_parse(&loader.json, json_text, json_len)) {
+    fprintf(stderr, "%s has no valid JSON chunk!\n", model_path);
+    free(loader.json.tokens);
+    return 0;
   }
 
-  mip_levels = (uint32_t)floorf(log2f(glm_max(tex_width, tex_height))) + 1;
+  const Json *json = &loader.json;
+  int ok = 1;
+  JsonArray buffers = json_array(json, 0, "buffers");
+  for (int i = 0; i < buffers.len && ok; i++) {
+    if (json_get(json, buffers.items[i], "uri") >= 0) {
+      fprintf(stderr, "%s: only the BIN chunk buffer is supported!\n",
+              model_path);
+      ok = 0;
+    }
+  }
+  free(buffers.items);
+  loader.accessors = json_array(json, 0, "accessors");
+  loader.buffer_views = json_array(json, 0, "bufferViews");
+  loader.meshes = json_array(json, 0, "meshes");
+  loader.nodes = json_array(json, 0, "nodes");
+  loader.materials = json_array(json, 0, "materials");
+  loader.textures = json_array(json, 0, "textures");
+  loader.images = json_array(json, 0, "images");
+  loader.material_slots =
+      malloc(sizeof(uint32_t) * (loader.materials.len + 1));
+  if (!loader.material_slots) {
+    THROW("failed to allocate material slots!\n");
+  }
+  for (int i = 0; i <= loader.materials.len; i++) {
+    loader.material_slots[i] = UINT32_MAX;
+  }
 
-  VkBuffer staging_buffer;
-  VkDeviceMemory staging_buffer_memory;
+  free_mesh();
+  glb_primitives_len = 0;
+  glb_vertices_len = 0;
+  glb_indices_len = 0;
+
+  // the default scene, or every mesh untransformed if there is no scene
+  mat4 identity = GLM_MAT4_IDENTITY_INIT;
+  JsonArray scenes = json_array(json, 0, "scenes");
+  int scene =
+      json_item(&scenes, json_number(json, json_get(json, 0, "scene"), 0));
+  if (scene >= 0) {
+    int roots = json_get(json, scene, "nodes");
+    int root;
+    for (uint32_t n = 0; ok && (root = json_at(json, roots, n)) >= 0; n++) {
+      ok = add_glb_node(&loader, json_number(json, root, -1), identity, 0);
+    }
+  } else {
+    for (int i = 0; ok && i < loader.meshes.len; i++) {
+      ok = add_glb_mesh(&loader, i, identity);
+    }
+  }
+  if (ok && glb_primitives_len == 0) {
+    fprintf(stderr, "%s has no triangles to draw!\n", model_path);
+    ok = 0;
+  }
 
-  create_buffer(image_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
-                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-                &staging_buffer, &staging_buffer_memory);
-  void *data;
-  vkMapMemory(device, staging_buffer_memory, 0, image_size, 0, &data);
-  memcpy(data, pixels, (size_t)image_size);
-  vkUnmapMemory(device, staging_buffer_memory);
-  stbi_image_free(pixels);
+  if (ok) {
+    layout_glb_primitives();
+    choose_glb_quantization();
 
-  create_image(tex_width, tex_height, mip_levels, VK_SAMPLE_COUNT_1_BIT,
-               VK_FORMAT_R8G8B8A8_SRGB, VK_IMAGE_TILING_OPTIMAL,
-               VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
-                   VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &texture_image,
-               &texture_image_memory);
+    uint32_t copy_vertices = 0;
+    for (int p = 0; p < glb_primitives_len; p++) {
+      if (glb_primitives[p].copy_vertices) {
+        copy_vertices += glb_primitives[p].position.count;
+      }
+    }
+    printf("loaded model %s: %u primitives, %u face corners, %u vertices, "
+           "%u of them ready to copy, in %.2f ms\n",
+           model_path, glb_primitives_len, glb_indices_len, glb_vertices_len,
+           copy_vertices, elapsed_ms(&load_start));
+  }
 
-  transition_image_layout(texture_image, VK_FORMAT_R8G8B8A8_SRGB,
-                          VK_IMAGE_LAYOUT_UNDEFINED,
-                          VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mip_levels);
-  copy_buffer_to_image(staging_buffer, texture_image, tex_width, tex_height);
-  // transition_image_layout(texture_image, VK_FORMAT_R8G8B8A8_SRGB,
-  //                         VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-  //                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-  //                         mip_levels);
-  vkDestroyBuffer(device, staging_buffer, NULL);
-  vkFreeMemory(device, staging_buffer_memory, NULL);
-  generate_mipmaps(texture_image, VK_FORMAT_R8G8B8A8_SRGB, tex_width,
-                   tex_height, mip_levels);
+  free(scenes.items);
+  free(loader.accessors.items);
+  free(loader.buffer_views.items);
+  free(loader.meshes.items);
+  free(loader.nodes.items);
+  free(loader.materials.items);
+  free(loader.textures.items);
+  free(loader.images.items);
+  free(loader.material_slots);
+  free(loader.json.tokens);
+  return ok;
 }
 
-void create_texture_image_view() {
-  texture_image_view = create_image_view(texture_image, VK_FORMAT_R8G8B8A8_SRGB,
-                                         VK_IMAGE_ASPECT_COLOR_BIT, mip_levels);
+// the CPU side of startup: parsing the model runs on a worker while the
+// main thread creates the window and the device, then its textures decode
+// on the texture loader's threads while the first of them upload
+typedef struct {
+  pthread_t thread;
+  struct timespec start;
+  double busy_ms;
+  // how much of busy_ms the main thread spent on its own work
+  double overlap_ms;
+} AssetLoader;
+
+static AssetLoader asset_loader;
+
+static void *load_assets(void *arg) {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  int loaded = has_extension(model_path, ".glb") ? load_glb() : load_model();
+  if (!loaded) {
+    THROW("failed to load model %s!\n", model_path);
+  }
+  start_texture_loading(NULL, mesh_materials_len);
+  asset_loader.busy_ms = elapsed_ms(&start);
+  return NULL;
 }
 
-void create_texture_sampler() {
-  VkSamplerCreateInfo sampler_info = {0};
-  sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-  sampler_info.magFilter = VK_FILTER_LINEAR;
-  sampler_info.minFilter = VK_FILTER_LINEAR;
-  sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-  sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-  sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
-  sampler_info.anisotropyEnable = VK_TRUE;
+void start_asset_loading() {
+  clock_gettime(CLOCK_MONOTONIC, &asset_loader.start);
+  if (pthread_create(&asset_loader.thread, NULL, load_assets, NULL) != 0) {
+    THROW("failed to start asset loading thread!\n");
+  }
+}
 
-  VkPhysicalDeviceProperties properties = {0};
-  vkGetPhysicalDeviceProperties(physical_device, &properties);
+// the mesh belongs to the main thread from here on
+void wait_for_assets() {
+  struct timespec wait_start;
+  clock_gettime(CLOCK_MONOTONIC, &wait_start);
+  if (pthread_join(asset_loader.thread, NULL) != 0) {
+    THROW("failed to join asset loading thread!\n");
+  }
+  double wait_ms = elapsed_ms(&wait_start);
+  asset_loader.overlap_ms = fmax(asset_loader.busy_ms - wait_ms, 0.0);
+  printf("assets took %.2f ms on a worker, the main thread waited %.2f ms "
+         "for them\n",
+         asset_loader.busy_ms, wait_ms);
+}
 
-  sampler_info.maxAnisotropy = properties.limits.maxSamplerAnisotropy;
-  sampler_info.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK;
-  sampler_info.unnormalizedCoordinates = VK_FALSE;
-  sampler_info.compareEnable = VK_FALSE;
-  sampler_info.compareOp = VK_COMPARE_OP_ALWAYS;
+void create_color_resources() {
+  VkFormat color_format = swap_chain_image_format;
 
-  sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-  sampler_info.mipLodBias = 0.0f;
-  sampler_info.minLod = 0.0f;
-  sampler_info.maxLod = (float)mip_levels;
+  create_image(swap_chain_extent.width, swap_chain_extent.height, 1,
+               msaa_samples, color_format, VK_IMAGE_TILING_OPTIMAL, 0,
+               VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT |
+                   VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &color_image,
+               &color_image_memory);
+  color_image_view = create_image_view(color_image, color_format,
+                                       VK_IMAGE_ASPECT_COLOR_BIT, 1);
+}
 
-  if (vkCreateSampler(device, &sampler_info, NULL, &texture_sampler) !=
-      VK_SUCCESS) {
-    THROW("failed to create texture sampler!\n");
+// what changed on disk since the last frame
+typedef struct {
+  int model;
+  int shaders;
+  // the materials whose texture changed, each listed once
+  uint32_t *textures;
+  uint32_t textures_len;
+  uint32_t textures_cap;
+} AssetChanges;
+
+static void add_changed_texture(AssetChanges *changes, uint32_t material) {
+  reserve_array((void **)&changes->textures, &changes->textures_cap,
+                changes->textures_len + 1, sizeof(uint32_t));
+  changes->textures[changes->textures_len++] = material;
+}
+
+// enough of a file's metadata to tell it was written or replaced, editors
+// that save by renaming a new file over the old one change the inode
+typedef struct {
+  ino_t inode;
+  off_t size;
+  struct timespec modified;
+} FileStamp;
+
+static FileStamp stamp_file(const char *path) {
+  FileStamp stamp = {0};
+  struct stat st;
+  if (stat(path, &st) == 0) {
+    stamp.inode = st.st_ino;
+    stamp.size = st.st_size;
+#ifdef __APPLE__
+    stamp.modified = st.st_mtimespec;
+#else
+    stamp.modified = st.st_mtim;
+#endif
   }
+  return stamp;
 }
 
-void create_depth_resources() {
-  VkFormat depth_format = find_depth_format();
-  create_image(swap_chain_extent.width, swap_chain_extent.height, 1,
-               msaa_samples, depth_format, VK_IMAGE_TILING_OPTIMAL,
-               VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &depth_image,
-               &depth_image_memory);
-  depth_image_view = create_image_view(depth_image, depth_format,
-                                       VK_IMAGE_ASPECT_DEPTH_BIT, 1);
-  transition_image_layout(depth_image, depth_format, VK_IMAGE_LAYOUT_UNDEFINED,
-                          VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL, 1);
+static int same_stamp(const FileStamp *a, const FileStamp *b) {
+  return a->inode == b->inode && a->size == b->size &&
+         a->modified.tv_sec == b->modified.tv_sec &&
+         a->modified.tv_nsec == b->modified.tv_nsec;
 }
 
-static void get_file_data(void *ctx, const char *filename, const int is_mtl,
-                          const char *obj_filename, char **data, size_t *len) {
-  (void)ctx;
+// The stamps of the files the assets were last loaded from. On Linux they
+// are compared when inotify reports a file closed after writing or renamed
+// into one of their directories, elsewhere every ASSET_POLL_INTERVAL_MS.
+typedef struct {
+  int fd;
+  struct timespec last_poll;
+  FileStamp model;
+  FileStamp shaders[2];
+  // one per material, zeroed for materials not stamped yet
+  FileStamp *textures;
+  uint32_t textures_cap;
+} AssetWatcher;
+
+static AssetWatcher asset_watcher = {.fd = -1};
+
+static const char *shader_paths[2] = {VERT_SHADER_PATH, FRAG_SHADER_PATH};
+
+// compares every asset with its stamp and restamps it, images embedded in
+// a .glb change with the model
+static AssetChanges stamp_assets() {
+  AssetChanges changes = {0};
+  FileStamp stamp = stamp_file(model_path);
+  changes.model = !same_stamp(&stamp, &asset_watcher.model);
+  asset_watcher.model = stamp;
+  for (int i = 0; i < 2; i++) {
+    stamp = stamp_file(shader_paths[i]);
+    changes.shaders |= !same_stamp(&stamp, &asset_watcher.shaders[i]);
+    asset_watcher.shaders[i] = stamp;
+  }
+  reserve_zeroed_array((void **)&asset_watcher.textures,
+                       &asset_watcher.textures_cap, mesh_materials_len,
+                       sizeof(FileStamp));
+  for (int m = 0; m < mesh_materials_len; m++) {
+    if (mesh_materials[m].texture_size > 0) {
+      continue;
+    }
+    stamp = stamp_file(mesh_materials[m].texture_path);
+    if (!same_stamp(&stamp, &asset_watcher.textures[m])) {
+      add_changed_texture(&changes, m);
+    }
+    asset_watcher.textures[m] = stamp;
+  }
+  return changes;
+}
 
-  if (!filename) {
-    fprintf(stderr, "null filename\n");
-    (*data) = NULL;
-    (*len) = 0;
+#ifdef __linux__
+// watching a directory twice is harmless, inotify returns the same watch
+static int watch_dir_of(const char *path) {
+  char dir[MATERIAL_PATH_MAX];
+  const char *slash = strrchr(path, '/');
+  snprintf(dir, sizeof(dir), "%.*s", slash ? (int)(slash - path) : 1,
+           slash ? path : ".");
+  return inotify_add_watch(asset_watcher.fd, dir,
+                           IN_CLOSE_WRITE | IN_MOVED_TO) >= 0;
+}
+#endif
+
+// watches the directories of the files stamp_assets() stamps, polling them
+// if inotify can't
+static void watch_asset_dirs() {
+#ifdef __linux__
+  if (asset_watcher.fd < 0) {
     return;
   }
-
-  char *buffer;
-  if (strcmp(filename, "models/viking_room.obj") == 0) {
-    buffer = model_object_buffer;
-  } else if (strcmp(filename, "models/viking_room.mtl") == 0) {
-    buffer = model_material_buffer;
-  } else {
-    THROW("failed to get file\n");
+  int ok = watch_dir_of(model_path) && watch_dir_of(shader_paths[0]) &&
+           watch_dir_of(shader_paths[1]);
+  for (int m = 0; m < mesh_materials_len && ok; m++) {
+    ok = mesh_materials[m].texture_size > 0 ||
+         watch_dir_of(mesh_materials[m].texture_path);
   }
+  if (!ok) {
+    fprintf(stderr, "failed to watch the asset directories, polling them "
+                    "instead\n");
+    close(asset_watcher.fd);
+    asset_watcher.fd = -1;
+  }
+#endif
+}
 
-  uint32_t data_len = read_file((char *)filename, buffer);
-  (*len) = data_len;
-  (*data) = buffer;
+void watch_assets() {
+  stamp_assets();
+  clock_gettime(CLOCK_MONOTONIC, &asset_watcher.last_poll);
+#ifdef __linux__
+  asset_watcher.fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (asset_watcher.fd < 0) {
+    fprintf(stderr, "failed to start inotify, polling the assets instead\n");
+  }
+#endif
+  watch_asset_dirs();
+}
 
-  assert(data_len < MAX_MODEL_LEN);
+// the assets that changed since the last call, or since watch_assets()
+AssetChanges poll_asset_changes() {
+  AssetChanges changes = {0};
+  if (asset_watcher.fd >= 0) {
+#ifdef __linux__
+    // only whether anything happened matters, the stamps tell what
+    char events[4096]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    int any = 0;
+    while (read(asset_watcher.fd, events, sizeof(events)) > 0) {
+      any = 1;
+    }
+    if (any) {
+      changes = stamp_assets();
+    }
+#endif
+  } else if (elapsed_ms(&asset_watcher.last_poll) >= ASSET_POLL_INTERVAL_MS) {
+    clock_gettime(CLOCK_MONOTONIC, &asset_watcher.last_poll);
+    changes = stamp_assets();
+  }
+  return changes;
 }
 
-void load_model() {
-  tinyobj_attrib_t attrib = {0};
-  tinyobj_shape_t *shapes = NULL;
-  size_t num_shapes;
-  tinyobj_material_t *materials = NULL;
-  size_t num_materials;
-  unsigned int flags = TINYOBJ_FLAG_TRIANGULATE;
+// everything load_model() and load_glb() fill in, with the one file the
+// mesh points into: its mesh cache or its .glb
+typedef struct {
+  void *data[MESH_ARRAYS_LEN];
+  uint32_t len[MESH_ARRAYS_LEN];
+  uint32_t cap[MESH_ARRAYS_LEN];
+  GlbPrimitive *glb_primitives;
+  uint32_t glb_primitives_len;
+  uint32_t glb_primitives_cap;
+  uint32_t glb_vertices_len;
+  uint32_t glb_indices_len;
+  vec3 bounds_min;
+  vec3 bounds_max;
+  vec4 position_offset;
+  vec4 position_scale;
+  vec4 tex_coord_transform;
+  MappedFile glb_source;
+  MappedFile cache_file;
+} MeshState;
+
+// moves the loaded mesh into `state`, leaving none loaded
+static void take_mesh(MeshState *state) {
+  for (int i = 0; i < MESH_ARRAYS_LEN; i++) {
+    state->data[i] = *mesh_arrays[i].data;
+    state->len[i] = *mesh_arrays[i].len;
+    state->cap[i] = *mesh_arrays[i].cap;
+    *mesh_arrays[i].data = NULL;
+    *mesh_arrays[i].len = 0;
+    *mesh_arrays[i].cap = 0;
+  }
+  state->glb_primitives = glb_primitives;
+  state->glb_primitives_len = glb_primitives_len;
+  state->glb_primitives_cap = glb_primitives_cap;
+  state->glb_vertices_len = glb_vertices_len;
+  state->glb_indices_len = glb_indices_len;
+  glb_primitives = NULL;
+  glb_primitives_len = 0;
+  glb_primitives_cap = 0;
+  glb_vertices_len = 0;
+  glb_indices_len = 0;
+  glm_vec3_copy(mesh_bounds_min, state->bounds_min);
+  glm_vec3_copy(mesh_bounds_max, state->bounds_max);
+  glm_vec4_copy(position_offset, state->position_offset);
+  glm_vec4_copy(position_scale, state->position_scale);
+  glm_vec4_copy(tex_coord_transform, state->tex_coord_transform);
+  state->glb_source = glb_source;
+  state->cache_file = mesh_cache_file;
+  glb_source = (MappedFile){0};
+  mesh_cache_file = (MappedFile){0};
+}
 
-  if (tinyobj_parse_obj(&attrib, &shapes, &num_shapes, &materials,
-                        &num_materials, MODEL_PATH, get_file_data, NULL,
-                        flags) != TINYOBJ_SUCCESS) {
-    THROW("failed to load model!\n");
+// makes the mesh in `state` the loaded one again, there must be none
+static void put_mesh(MeshState *state) {
+  for (int i = 0; i < MESH_ARRAYS_LEN; i++) {
+    *mesh_arrays[i].data = state->data[i];
+    *mesh_arrays[i].len = state->len[i];
+    *mesh_arrays[i].cap = state->cap[i];
   }
+  glb_primitives = state->glb_primitives;
+  glb_primitives_len = state->glb_primitives_len;
+  glb_primitives_cap = state->glb_primitives_cap;
+  glb_vertices_len = state->glb_vertices_len;
+  glb_indices_len = state->glb_indices_len;
+  glm_vec3_copy(state->bounds_min, mesh_bounds_min);
+  glm_vec3_copy(state->bounds_max, mesh_bounds_max);
+  glm_vec4_copy(state->position_offset, position_offset);
+  glm_vec4_copy(state->position_scale, position_scale);
+  glm_vec4_copy(state->tex_coord_transform, tex_coord_transform);
+  glb_source = state->glb_source;
+  mesh_cache_file = state->cache_file;
+}
 
-  int face_offset = 0;
-  for (int i = 0; i < attrib.num_face_num_verts; i++) {
-    for (int j = 0; j < (size_t)attrib.face_num_verts[i]; j++) {
-      Vertex *vertex = &vertices[vertices_len];
+// frees a mesh taken by take_mesh() and unmaps its file
+static void release_mesh(MeshState *state) {
+  for (int i = 0; i < MESH_ARRAYS_LEN; i++) {
+    if (state->cap[i] > 0) {
+      free(state->data[i]);
+    }
+  }
+  free(state->glb_primitives);
+  if (state->glb_source.data) {
+    unmap_file(state->glb_source);
+  }
+  if (state->cache_file.data) {
+    unmap_file(state->cache_file);
+  }
+  memset(state, 0, sizeof(MeshState));
+}
 
-      tinyobj_vertex_index_t idx = attrib.faces[j + face_offset];
+// rebuilds the mesh and its buffers, and adds the textures that have to be
+// uploaded again for the new materials to `changes`. A model that fails to
+// load, say one that is still being written, leaves the old mesh and its
+// buffers in place for the next change to replace.
+static void reload_model(AssetChanges *changes) {
+  // set aside, not freed, so these stay valid until release_mesh()
+  const MeshMaterial *old_materials = mesh_materials;
+  uint32_t old_materials_len = mesh_materials_len;
+  MeshState old_mesh;
+  take_mesh(&old_mesh);
+  int loaded = has_extension(model_path, ".glb") ? load_glb() : load_model();
+  if (!loaded) {
+    fprintf(stderr, "failed to reload %s, keeping the old model\n",
+            model_path);
+    MeshState failed_mesh;
+    take_mesh(&failed_mesh);
+    release_mesh(&failed_mesh);
+    put_mesh(&old_mesh);
+    return;
+  }
 
-      vertex->pos[0] = attrib.vertices[3 * idx.v_idx + 0];
-      vertex->pos[1] = attrib.vertices[3 * idx.v_idx + 1];
-      vertex->pos[2] = attrib.vertices[3 * idx.v_idx + 2];
+  retire_resource((RetiredResource){.buffer = vertex_buffer,
+                                    .memory = vertex_buffer_memory});
+  retire_resource((RetiredResource){.buffer = index_buffer,
+                                    .memory = index_buffer_memory});
+  retire_resource((RetiredResource){.buffer = meshlet_buffer,
+                                    .memory = meshlet_buffer_memory});
+  meshlet_buffer = VK_NULL_HANDLE;
+  meshlet_buffer_memory = VK_NULL_HANDLE;
+  create_vertex_buffer();
+  create_index_buffer();
+  create_meshlet_buffer();
 
-      vertex->tex_coord[0] = attrib.texcoords[2 * idx.vt_idx + 0];
-      vertex->tex_coord[1] = 1.0f - attrib.texcoords[2 * idx.vt_idx + 1];
+  // the descriptor sets of materials past the new count go unused, as do
+  // the changes stamped for them
+  uint8_t *listed = calloc(mesh_materials_len, 1);
+  if (!listed) {
+    THROW("failed to allocate changed textures!\n");
+  }
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < changes->textures_len; i++) {
+    uint32_t m = changes->textures[i];
+    if (m < mesh_materials_len) {
+      changes->textures[kept++] = m;
+      listed[m] = 1;
+    }
+  }
+  changes->textures_len = kept;
+  for (int m = 0; m < mesh_materials_len; m++) {
+    if (!listed[m] &&
+        (m >= old_materials_len || mesh_materials[m].texture_size > 0 ||
+         !same_texture(&mesh_materials[m], &old_materials[m]))) {
+      add_changed_texture(changes, m);
+    }
+  }
+  free(listed);
+  for (int m = mesh_materials_len; m < old_materials_len; m++) {
+    retire_resource((RetiredResource){.image = textures[m].image,
+                                      .view = textures[m].view,
+                                      .memory = textures[m].memory});
+    textures[m] = (Texture){0};
+  }
+  // the old mesh may point into its mesh cache or .glb, which stay mapped
+  // until the new mesh is uploaded
+  release_mesh(&old_mesh);
+}
 
-      vertex->color[0] = 1.0f;
-      vertex->color[1] = 1.0f;
-      vertex->color[2] = 1.0f;
+// a 1x1 white texture for a new material whose image doesn't load, so its
+// descriptor set still has something to sample
+static void create_placeholder_texture(Texture *texture) {
+  DecodedImage image = {.width = 1, .height = 1};
+  image.pixels = malloc(4);
+  if (!image.pixels) {
+    THROW("failed to allocate placeholder texture!\n");
+  }
+  memset(image.pixels, 0xff, 4);
+  create_texture_image(&image, texture);
+}
 
-      int index = find_vertex(vertex);
-      if (index == -1) {
-        index = vertices_len;
-        vertices_len += 1;
-        assert(vertices_len < MAX_VERTEX_LEN);
+// uploads the textures of the `count` materials in `materials` again and
+// points new descriptor sets at them, the sets of the frames in flight
+// can't be updated. An image that fails to load, say one that is still
+// being written, keeps the material's old texture.
+static void reload_textures(const uint32_t *materials, uint32_t count) {
+  reserve_zeroed_array((void **)&textures, &textures_cap, mesh_materials_len,
+                       sizeof(Texture));
+  start_texture_loading(materials, count);
+  uint32_t m;
+  DecodedImage *image;
+  while ((image = next_loaded_texture(&m))) {
+    Texture texture = {0};
+    if (!create_texture_image(image, &texture)) {
+      if (textures[m].view) {
+        fprintf(stderr, "failed to reload %s, keeping the old texture\n",
+                image->material.texture_path);
+        continue;
       }
-
-      indices[indices_len] = index;
-      indices_len += 1;
-      assert(indices_len < MAX_VERTEX_INDICES_LEN);
+      fprintf(stderr, "failed to load %s, using a placeholder\n",
+              image->material.texture_path);
+      create_placeholder_texture(&texture);
     }
-    face_offset += (size_t)attrib.face_num_verts[i];
+    retire_resource((RetiredResource){.image = textures[m].image,
+                                      .view = textures[m].view,
+                                      .memory = textures[m].memory});
+    textures[m] = texture;
+    create_texture_image_view(&textures[m]);
   }
+  retire_resource((RetiredResource){.descriptor_pool = descriptor_pool});
+  create_descriptor_pool();
+  create_descriptor_sets();
 }
 
-void create_color_resources() {
-  VkFormat color_format = swap_chain_image_format;
+// a shader compiler that is still writing leaves a file that isn't SPIR-V
+// yet, the next change reloads it
+static int is_spirv(const char *filename) {
+  MappedFile file = map_file(filename);
+  uint32_t magic = 0;
+  if (file.data && file.len >= sizeof(magic)) {
+    memcpy(&magic, file.data, sizeof(magic));
+  }
+  int ok = magic == SPIRV_MAGIC && file.len % sizeof(uint32_t) == 0;
+  if (file.data) {
+    unmap_file(file);
+  }
+  return ok;
+}
 
-  create_image(swap_chain_extent.width, swap_chain_extent.height, 1,
-               msaa_samples, color_format, VK_IMAGE_TILING_OPTIMAL,
-               VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT |
-                   VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
-               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &color_image,
-               &color_image_memory);
-  color_image_view = create_image_view(color_image, color_format,
-                                       VK_IMAGE_ASPECT_COLOR_BIT, 1);
+static void reload_pipeline() {
+  if (!is_spirv(VERT_SHADER_PATH) || !is_spirv(FRAG_SHADER_PATH)) {
+    fprintf(stderr, "shaders aren't valid SPIR-V, keeping the old ones\n");
+    return;
+  }
+  retire_resource((RetiredResource){.pipeline = graphics_pipeline,
+                                    .pipeline_layout = pipeline_layout});
+  create_graphics_pipeline();
+}
+
+// reloads the assets that changed on disk, returns the command buffer
+// with their uploads for draw_frame() to submit, or VK_NULL_HANDLE. The
+// CPU work runs on the main thread between two frames. Whatever a reload
+// replaces is retired rather than destroyed, so the frames still in
+// flight keep drawing with the old resources and nothing waits for them.
+VkCommandBuffer reload_assets() {
+  AssetChanges changes = poll_asset_changes();
+  if (!changes.model && !changes.shaders && changes.textures_len == 0) {
+    free(changes.textures);
+    return VK_NULL_HANDLE;
+  }
+  struct timespec reload_start;
+  clock_gettime(CLOCK_MONOTONIC, &reload_start);
+
+  VkCommandBufferAllocateInfo alloc_info = {0};
+  alloc_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  alloc_info.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  alloc_info.commandPool = command_pool;
+  alloc_info.commandBufferCount = 1;
+  if (vkAllocateCommandBuffers(device, &alloc_info, &reload_commands) !=
+      VK_SUCCESS) {
+    THROW("failed to allocate reload command buffer!\n");
+  }
+  VkCommandBufferBeginInfo begin_info = {0};
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  vkBeginCommandBuffer(reload_commands, &begin_info);
+
+  if (changes.model) {
+    reload_model(&changes);
+    // the new materials may have other textures to watch, the ones they
+    // changed are already listed
+    AssetChanges restamped = stamp_assets();
+    free(restamped.textures);
+    watch_asset_dirs();
+  }
+  if (changes.textures_len > 0) {
+    reload_textures(changes.textures, changes.textures_len);
+  }
+  if (changes.shaders) {
+    reload_pipeline();
+  }
+
+  // the textures are made readable by generate_mipmaps(), the buffer
+  // copies have to finish before the frame's vertex input reads them
+  VkMemoryBarrier barrier = {0};
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask =
+      VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT | VK_ACCESS_INDEX_READ_BIT;
+  vkCmdPipelineBarrier(reload_commands, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0, 1, &barrier, 0,
+                       NULL, 0, NULL);
+  if (vkEndCommandBuffer(reload_commands) != VK_SUCCESS) {
+    THROW("failed to record reload command buffer!\n");
+  }
+
+  VkCommandBuffer command_buffer = reload_commands;
+  reload_commands = VK_NULL_HANDLE;
+  printf("reloaded %s%s%u of %u textures in %.2f ms\n",
+         changes.model ? "the model, " : "",
+         changes.shaders ? "the shaders, " : "", changes.textures_len,
+         mesh_materials_len, elapsed_ms(&reload_start));
+  free(changes.textures);
+  return command_buffer;
 }
 
 void init_vulkan() {
@@ -1880,20 +9657,25 @@ void init_vulkan() {
   create_descriptor_set_layout();
   create_graphics_pipeline();
   create_command_pool();
+  create_mip_pipeline();
   create_color_resources();
   create_depth_resources();
   create_framebuffers();
-  create_texture_image();
-  create_texture_image_view();
   create_texture_sampler();
-  load_model();
+  create_uniform_buffers();
+  create_command_buffers();
+  create_sync_objects();
+  wait_for_assets();
+  create_textures();
   create_vertex_buffer();
   create_index_buffer();
-  create_uniform_buffers();
+  create_meshlet_buffer();
   create_descriptor_pool();
   create_descriptor_sets();
-  create_command_buffers();
-  create_sync_objects();
+
+  printf("started in %.2f ms, %.2f ms sooner than with the assets loaded "
+         "in line\n",
+         elapsed_ms(&asset_loader.start), asset_loader.overlap_ms);
 }
 
 void update_uniform_buffer(uint32_t current_image) {
@@ -1911,23 +9693,28 @@ void update_uniform_buffer(uint32_t current_image) {
 
   vec3 axis = {0.0f, 0.0f, 1.0f};
   glm_rotate(ubo.model, elapsed_secs * glm_rad(90.0f), axis);
+  glm_mat4_copy(ubo.model, model_matrix);
 
-  vec3 eye = {2.0f, 2.0f, 2.0f};
   vec3 up = {0.0f, 0.0f, 1.0f};
-  glm_lookat(eye, GLM_VEC3_ZERO, up, ubo.view);
+  glm_lookat(camera_eye, GLM_VEC3_ZERO, up, ubo.view);
 
-  glm_perspective(glm_rad(45.0f),
+  glm_perspective(glm_rad(CAMERA_FOV_DEGREES),
                   swap_chain_extent.width / (float)swap_chain_extent.height,
-                  0.1f, 10.0f, ubo.proj);
+                  CAMERA_NEAR, CAMERA_FAR, ubo.proj);
   // invert Y
   ubo.proj[1][1] *= -1;
 
+  glm_vec4_copy(position_offset, ubo.position_offset);
+  glm_vec4_copy(position_scale, ubo.position_scale);
+  glm_vec4_copy(tex_coord_transform, ubo.tex_coord_transform);
+
   memcpy(uniform_buffers_mapped[current_image], &ubo, sizeof(ubo));
 }
 
 void draw_frame() {
   vkWaitForFences(device, 1, &in_flight_fences[current_frame], VK_TRUE,
                   UINT64_MAX);
+  destroy_retired_resources(0);
 
   uint32_t image_index;
   VkResult result = vkAcquireNextImageKHR(
@@ -1941,11 +9728,26 @@ void draw_frame() {
     THROW("failed to acquire swap chain image!\n");
   }
 
+  // assets changed on disk are swapped in here, between two frames, and
+  // their uploads go out in the same submission ahead of this frame
+  VkCommandBuffer submit_commands[2];
+  uint32_t submit_commands_len = 0;
+  VkCommandBuffer upload_commands = reload_assets();
+  if (upload_commands != VK_NULL_HANDLE) {
+    submit_commands[submit_commands_len] = upload_commands;
+    submit_commands_len += 1;
+    retire_resource((RetiredResource){.command_buffer = upload_commands});
+  }
+  submit_commands[submit_commands_len] = command_buffers[current_frame];
+  submit_commands_len += 1;
+
   vkResetFences(device, 1, &in_flight_fences[current_frame]);
 
   vkResetCommandBuffer(command_buffers[current_frame], 0);
-  record_command_buffer(command_buffers[current_frame], image_index);
+  // the uniforms go first so the command buffer can pick the LOD for this
+  // frame's camera
   update_uniform_buffer(current_frame);
+  record_command_buffer(command_buffers[current_frame], image_index);
 
   VkSubmitInfo submit_info = {0};
   submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
@@ -1956,8 +9758,8 @@ void draw_frame() {
   submit_info.waitSemaphoreCount = 1;
   submit_info.pWaitSemaphores = wait_semaphores;
   submit_info.pWaitDstStageMask = wait_stages;
-  submit_info.commandBufferCount = 1;
-  submit_info.pCommandBuffers = &command_buffers[current_frame];
+  submit_info.commandBufferCount = submit_commands_len;
+  submit_info.pCommandBuffers = submit_commands;
 
   VkSemaphore signal_semaphores[] = {render_finished_semaphores[current_frame]};
   submit_info.signalSemaphoreCount = 1;
@@ -1988,6 +9790,7 @@ void draw_frame() {
     THROW("failed to present swap chain image!\n");
   }
   current_frame = (current_frame + 1) % MAX_FRAMES_IN_FLIGHT;
+  frame_number += 1;
 }
 
 void main_loop() {
@@ -2001,12 +9804,24 @@ void main_loop() {
 
 void cleanup() {
   cleanup_swap_chain();
+  destroy_retired_resources(1);
+  free(retired_resources);
+  if (asset_watcher.fd >= 0) {
+    close(asset_watcher.fd);
+  }
 
   vkDestroySampler(device, texture_sampler, NULL);
-  vkDestroyImageView(device, texture_image_view, NULL);
-
-  vkDestroyImage(device, texture_image, NULL);
-  vkFreeMemory(device, texture_image_memory, NULL);
+  for (int i = 0; i < mesh_materials_len; i++) {
+    vkDestroyImageView(device, textures[i].view, NULL);
+    vkDestroyImage(device, textures[i].image, NULL);
+    vkFreeMemory(device, textures[i].memory, NULL);
+  }
+  free(textures);
+  free(texture_loader.materials);
+  free(asset_watcher.textures);
+  for (int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+    free(descriptor_sets[i]);
+  }
 
   vkDestroyDescriptorPool(device, descriptor_pool, NULL);
   vkDestroyDescriptorSetLayout(device, descriptor_set_layout, NULL);
@@ -2019,11 +9834,17 @@ void cleanup() {
   vkDestroyBuffer(device, index_buffer, NULL);
   vkFreeMemory(device, index_buffer_memory, NULL);
 
+  vkDestroyBuffer(device, meshlet_buffer, NULL);
+  vkFreeMemory(device, meshlet_buffer_memory, NULL);
+
   vkDestroyBuffer(device, vertex_buffer, NULL);
   vkFreeMemory(device, vertex_buffer_memory, NULL);
+  free_mesh();
+  free(glb_primitives);
 
   vkDestroyPipeline(device, graphics_pipeline, NULL);
   vkDestroyPipelineLayout(device, pipeline_layout, NULL);
+  destroy_mip_pipeline();
 
   vkDestroyRenderPass(device, render_pass, NULL);
 
@@ -2041,18 +9862,37 @@ void cleanup() {
   }
   vkDestroySurfaceKHR(instance, surface, NULL);
   vkDestroyInstance(instance, NULL);
+  unmap_files();
   glfwDestroyWindow(window);
   glfwTerminate();
 }
 
+// the mesh cache of a model is its path with the extension replaced
+void set_model_path(const char *path) {
+  const char *dot = strrchr(path, '.');
+  const char *slash = strrchr(path, '/');
+  int stem_len = dot && (!slash || dot > slash) ? (int)(dot - path)
+                                                : (int)strlen(path);
+  if (snprintf(mesh_cache_path, MATERIAL_PATH_MAX, "%.*s.vmesh", stem_len,
+               path) >= MATERIAL_PATH_MAX) {
+    THROW("model path %s is too long!\n", path);
+  }
+  model_path = path;
+}
+
 void run() {
+  start_asset_loading();
   init_window();
   init_vulkan();
+  watch_assets();
   main_loop();
   cleanup();
 }
 
-int main() {
+int main(int argc, char **argv) {
+  if (argc > 1) {
+    set_model_path(argv[1]);
+  }
   run();
   return 0;
 }
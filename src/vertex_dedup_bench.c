@@ -0,0 +1,86 @@
+// Measures how load time of the vertex deduplication scales with the number
+// of face corners, the hash map should keep the cost per corner flat from
+// 10k to 10M where the linear scan it replaced grew with the mesh.
+//
+//   ./build.sh vertex_dedup_bench --run
+
+#define main tutorial_main
+#include "tutorial.c"
+#undef main
+
+#define RUNS 3
+
+// face corners of a grid of quads split into triangles, every interior
+// vertex is shared by six corners like in a scanned mesh
+static Vertex *build_corners(uint32_t corners_len) {
+  Vertex *corners = malloc(corners_len * sizeof(Vertex));
+  if (!corners) {
+    THROW("failed to allocate face corners!\n");
+  }
+
+  uint32_t side = 1;
+  while ((uint64_t)side * side * 6 < corners_len) {
+    side++;
+  }
+
+  uint32_t corner = 0;
+  for (uint32_t y = 0; y < side && corner < corners_len; y++) {
+    for (uint32_t x = 0; x < side && corner < corners_len; x++) {
+      static const uint32_t quad[6][2] = {{0, 0}, {1, 0}, {1, 1},
+                                          {0, 0}, {1, 1}, {0, 1}};
+      for (int i = 0; i < 6 && corner < corners_len; i++) {
+        float u = (float)(x + quad[i][0]) / side;
+        float v = (float)(y + quad[i][1]) / side;
+        corners[corner] = (Vertex){
+            .pos = {u, v, sinf(u * 7.0f) * cosf(v * 5.0f)},
+            .color = {1.0f, 1.0f, 1.0f},
+            .tex_coord = {u, 1.0f - v},
+        };
+        corner++;
+      }
+    }
+  }
+  return corners;
+}
+
+static double dedup_ms(const Vertex *corners, uint32_t corners_len) {
+  double best = 0.0;
+  for (int run = 0; run < RUNS; run++) {
+    vertices_len = 0;
+    reserve_array((void **)&indices, &indices_cap, corners_len,
+                  sizeof(uint32_t));
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    VertexMap map;
+    vertex_map_init(&map, corners_len);
+    for (uint32_t i = 0; i < corners_len; i++) {
+      Vertex vertex = corners[i];
+      indices[i] = vertex_map_insert(&map, &vertex);
+    }
+    vertex_map_free(&map);
+    double ms = elapsed_ms(&start);
+
+    if (run == 0 || ms < best) {
+      best = ms;
+    }
+  }
+  return best;
+}
+
+int main() {
+  static const uint32_t sizes[] = {10000, 100000, 1000000, 10000000};
+
+  printf("%12s %12s %12s %14s\n", "corners", "vertices", "ms", "ns/corner");
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+    Vertex *corners = build_corners(sizes[i]);
+    double ms = dedup_ms(corners, sizes[i]);
+    printf("%12u %12u %12.2f %14.1f\n", sizes[i], vertices_len, ms,
+           ms * 1e6 / sizes[i]);
+    free(corners);
+  }
+
+  free(vertices);
+  free(indices);
+  return 0;
+}